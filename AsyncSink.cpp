@@ -0,0 +1,179 @@
+#include "AsyncSink.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace protolib
+{
+	const size_t AsyncSink::HeaderSize;
+	const size_t AsyncSink::MaxBatchBytes;
+
+	AsyncSink::AsyncSink(std::unique_ptr<LogSink> sink, Logger::LogType minLogType, Logger::OverflowPolicy policy,
+		size_t queueCapacity)
+		:mSink(std::move(sink)), mMinLogType(static_cast<int>(minLogType)), mOverflowPolicy(policy),
+		mQueue(std::max(queueCapacity, HeaderSize + 1)), mDroppedLogs(0), mHead(0), mTail(0), mFlushTarget(0),
+		mFlushedPosition(0), mSleeping(false), mStop(false)
+	{
+		mWorker = std::thread(&AsyncSink::worker, this);
+	}
+
+	AsyncSink::~AsyncSink()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mWakeUp.notify_one();
+		mNotFull.notify_all();
+		mWorker.join();
+	}
+
+	void AsyncSink::copyIn(size_t position, const char* data, size_t length)
+	{
+		const size_t capacity = mQueue.size();
+		size_t offset = position % capacity;
+		size_t firstPart = std::min(length, capacity - offset);
+		memcpy(mQueue.data() + offset, data, firstPart);
+		memcpy(mQueue.data(), data + firstPart, length - firstPart);
+	}
+
+	void AsyncSink::copyOut(size_t position, char* destination, size_t length) const
+	{
+		const size_t capacity = mQueue.size();
+		size_t offset = position % capacity;
+		size_t firstPart = std::min(length, capacity - offset);
+		memcpy(destination, mQueue.data() + offset, firstPart);
+		memcpy(destination + firstPart, mQueue.data(), length - firstPart);
+	}
+
+	void AsyncSink::push(const char* data, size_t length, Logger::LogType logType)
+	{
+		if (!accepts(logType)) { return; }
+
+		const size_t recordSize = HeaderSize + length;
+		if (recordSize > mQueue.size())
+		{
+			mDroppedLogs.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (mQueue.size() - (mTail - mHead) < recordSize)
+		{
+			if (mOverflowPolicy == Logger::OverflowPolicy::DROP_NEWEST || mStop)
+			{
+				mDroppedLogs.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else if (mOverflowPolicy == Logger::OverflowPolicy::DROP_OLDEST)
+			{
+				uint32_t oldestLength;
+				copyOut(mHead, reinterpret_cast<char*>(&oldestLength), sizeof(oldestLength));
+				mHead += HeaderSize + oldestLength;
+				mDroppedLogs.fetch_add(1, std::memory_order_relaxed);
+			}
+			else
+			{
+				mNotFull.wait(lock);
+			}
+		}
+
+		char header[HeaderSize];
+		uint32_t storedLength = static_cast<uint32_t>(length);
+		memcpy(header, &storedLength, sizeof(storedLength));
+		header[4] = static_cast<char>(logType);
+		copyIn(mTail, header, HeaderSize);
+		copyIn(mTail + HeaderSize, data, length);
+		mTail += recordSize;
+
+		if (mSleeping)
+		{
+			mWakeUp.notify_one();
+		}
+	}
+
+	void AsyncSink::flush()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		size_t target = mTail;
+		if (mFlushedPosition >= target) { return; }
+
+		mFlushTarget = std::max(mFlushTarget, target);
+		mWakeUp.notify_one();
+		mFlushed.wait(lock, [this, target]() { return mFlushedPosition >= target; });
+	}
+
+	void AsyncSink::worker()
+	{
+		// Time limit of the flush policy is enforced while idle
+		auto maxDelay = mSink->getFlushPolicy().maxDelay;
+		auto idleTimeout = std::chrono::milliseconds(100);
+		if (maxDelay.count() > 0)
+		{
+			idleTimeout = std::max(std::chrono::milliseconds(1), std::min(idleTimeout, maxDelay));
+		}
+
+		std::string batch;
+		while (true)
+		{
+			size_t position;
+			bool flushNeeded;
+			bool stop;
+			batch.clear();
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				if (mHead == mTail && !mStop && mFlushTarget <= mFlushedPosition)
+				{
+					mSleeping = true;
+					mWakeUp.wait_for(lock, idleTimeout);
+					mSleeping = false;
+				}
+
+				// Records are copied out so that the lock isn't held while the sink is written
+				while (mHead != mTail && batch.size() < MaxBatchBytes)
+				{
+					uint32_t length;
+					copyOut(mHead, reinterpret_cast<char*>(&length), sizeof(length));
+					size_t batchSize = batch.size();
+					batch.resize(batchSize + HeaderSize + length);
+					copyOut(mHead, &batch[batchSize], HeaderSize + length);
+					mHead += HeaderSize + length;
+				}
+
+				position = mHead;
+				stop = mStop && mHead == mTail;
+				flushNeeded = mFlushTarget > mFlushedPosition && position >= mFlushTarget;
+			}
+
+			if (!batch.empty())
+			{
+				mNotFull.notify_all();
+			}
+
+			for (size_t offset = 0; offset < batch.size();)
+			{
+				uint32_t length;
+				memcpy(&length, batch.data() + offset, sizeof(length));
+				Logger::LogType logType = static_cast<Logger::LogType>(batch[offset + 4]);
+				mSink->write(batch.data() + offset + HeaderSize, length, logType == Logger::LogType::ERR, 1);
+				offset += HeaderSize + length;
+			}
+
+			if (flushNeeded || stop)
+			{
+				mSink->flush();
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mFlushedPosition = std::max(mFlushedPosition, position);
+				}
+				mFlushed.notify_all();
+			}
+			else if (batch.empty())
+			{
+				mSink->flushIfDue();
+			}
+
+			if (stop) { return; }
+		}
+	}
+}
@@ -0,0 +1,125 @@
+/*
+   AsyncSink decouples a LogSink from producers of logs. Formatted records
+   are copied into a bounded byte queue of the sink and written to the sink
+   by its own thread, so a slow destination (e.g. console or socket) doesn't
+   delay other sinks. What happens when the queue is full is determined
+   by the overflow policy of the sink, i.e. a dropping policy ensures that
+   producers are never stalled by the sink. Each sink also filters records
+   by its own minimal log type. Instances are created by Logger::addSink.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Logger.h"
+#include "LogSink.h"
+
+namespace protolib
+{
+	class AsyncSink
+	{
+	private:
+		// Each queued record is prefixed by uint32 length and uint8 log type
+		static const size_t HeaderSize = 5;
+		// Maximal amount of data taken from the queue at once
+		static const size_t MaxBatchBytes = 64 * 1024;
+
+		std::unique_ptr<LogSink> mSink;
+		std::atomic<int> mMinLogType;
+		Logger::OverflowPolicy mOverflowPolicy;
+		std::vector<char> mQueue;
+		std::atomic<size_t> mDroppedLogs;
+
+		// Following members are guarded by mMutex, positions only grow
+		size_t mHead;				// Position of the oldest queued record
+		size_t mTail;				// Position after the newest queued record
+		size_t mFlushTarget;		// Position up to which a flush was requested
+		size_t mFlushedPosition;	// Position up to which records were flushed
+		bool mSleeping;
+		bool mStop;
+		std::mutex mMutex;
+		std::condition_variable mWakeUp;
+		std::condition_variable mNotFull;
+		std::condition_variable mFlushed;
+
+		std::thread mWorker;
+
+		void copyIn(size_t position, const char* data, size_t length);
+
+		void copyOut(size_t position, char* destination, size_t length) const;
+
+		void worker();
+	public:
+		/**
+		Main constructor to initialize the whole class, starts the writer thread
+
+		@param sink sink which is written by the writer thread
+		@param minLogType records of lower type are ignored
+		@param policy what to do with new records when the queue is full
+		@param queueCapacity capacity of the queue in bytes (records longer than that are dropped)
+		*/
+		AsyncSink(std::unique_ptr<LogSink> sink, Logger::LogType minLogType, Logger::OverflowPolicy policy,
+			size_t queueCapacity);
+
+		AsyncSink(const AsyncSink&) = delete;
+		AsyncSink& operator=(const AsyncSink&) = delete;
+
+		/**
+		Writes all queued records, flushes the sink and stops the writer thread
+		*/
+		~AsyncSink();
+
+		/**
+		Checks whether records of given type pass the filter of the sink
+
+		@param logType type of log
+		@return true if records of logType are written, false otherwise
+		*/
+		bool accepts(Logger::LogType logType) const
+		{
+			return static_cast<int>(logType) >= mMinLogType.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Sets minimal type of written records
+
+		@param minLogType records of lower type are ignored
+		*/
+		void setMinLogType(Logger::LogType minLogType)
+		{
+			mMinLogType.store(static_cast<int>(minLogType), std::memory_order_relaxed);
+		}
+
+		/**
+		Queues a formatted record if it passes the filter of the sink
+
+		@param data formatted record (including line ending)
+		@param length length of data
+		@param logType type of log
+		*/
+		void push(const char* data, size_t length, Logger::LogType logType);
+
+		/**
+		Waits until all records queued so far are written and the sink is flushed
+		*/
+		void flush();
+
+		/**
+		Returns number of records discarded because of the full queue
+
+		@return number of dropped records
+		*/
+		size_t getDroppedLogsCount() const
+		{
+			return mDroppedLogs.load(std::memory_order_relaxed);
+		}
+	};
+}
@@ -0,0 +1,206 @@
+/*
+BenchmarkFramework.h contains simple helpers for measuring execution time
+and heap allocations of code snippets.
+Since it replaces global operator new/delete to count allocations,
+it must be included in exactly one translation unit of a benchmark executable.
+
+(c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+
+// Special namespace for counters to avoid polluting of global namespace with global variables
+namespace benchCounters
+{
+	std::atomic<size_t> allocCount(0);
+	std::atomic<size_t> allocBytes(0);
+}
+
+void* operator new(size_t size)
+{
+	benchCounters::allocCount.fetch_add(1, std::memory_order_relaxed);
+	benchCounters::allocBytes.fetch_add(size, std::memory_order_relaxed);
+
+	void* ptr = std::malloc(size == 0 ? 1 : size);
+	if (ptr == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+// GCC reports false positives when free() from replaced operator delete
+// gets inlined into the code using replaced operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace benchmarks
+{
+	/**
+	Prevents compiler from optimizing away computation of given value
+
+	@param value value which should be considered "used"
+	*/
+	template<typename T>
+	void doNotOptimize(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r"(&value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	struct BenchmarkResult
+	{
+		std::string name;
+		std::string variant;
+		std::string container;
+		std::string element;
+		size_t elements;
+		size_t iterations;
+		double nsPerElement;
+		double bytesPerIteration;
+		double allocsPerIteration;
+	};
+
+	/**
+	Runs func(input) repeatedly (at least once and at least minSeconds in total)
+	where input is a fresh value returned by setup() in each iteration.
+	Only the call to func is timed and only its allocations are counted.
+
+	@param elements number of elements processed by one call of func
+	@param minSeconds minimal total measured time
+	@param setup function creating input for each iteration
+	@param func measured function
+	@return filled result (without name/variant/container/element)
+	*/
+	template<typename Setup, typename Func>
+	BenchmarkResult measure(size_t elements, double minSeconds, Setup setup, Func func)
+	{
+		using Clock = std::chrono::steady_clock;
+
+		BenchmarkResult result = BenchmarkResult();
+		result.elements = elements;
+
+		double totalNs = 0.0;
+		size_t totalBytes = 0;
+		size_t totalAllocs = 0;
+
+		while (result.iterations == 0 || totalNs < minSeconds * 1e9)
+		{
+			auto input = setup();
+
+			size_t allocsBefore = benchCounters::allocCount.load(std::memory_order_relaxed);
+			size_t bytesBefore = benchCounters::allocBytes.load(std::memory_order_relaxed);
+			auto start = Clock::now();
+
+			func(input);
+
+			auto stop = Clock::now();
+			totalAllocs += benchCounters::allocCount.load(std::memory_order_relaxed) - allocsBefore;
+			totalBytes += benchCounters::allocBytes.load(std::memory_order_relaxed) - bytesBefore;
+			totalNs += static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+			++result.iterations;
+		}
+
+		result.nsPerElement = totalNs / result.iterations / (elements > 0 ? elements : 1);
+		result.bytesPerIteration = static_cast<double>(totalBytes) / result.iterations;
+		result.allocsPerIteration = static_cast<double>(totalAllocs) / result.iterations;
+
+		return result;
+	}
+
+	/**
+	Outputs benchmark results as a human-readable table to std::cout
+	and optionally as CSV to a file (for tracking of regressions)
+	*/
+	class BenchmarkReporter
+	{
+	private:
+		std::ofstream mCsvFile;
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param csvFileName name of the CSV output file (if empty, no CSV is written)
+		*/
+		BenchmarkReporter(const std::string& csvFileName = std::string())
+		{
+			if (!csvFileName.empty())
+			{
+				mCsvFile.open(csvFileName);
+				mCsvFile << "name,variant,container,element,elements,iterations,"
+					"ns_per_element,bytes_per_iteration,allocs_per_iteration\n";
+			}
+
+			std::cout << std::left << std::setw(14) << "name" << std::setw(9) << "variant"
+				<< std::setw(8) << "cont" << std::setw(10) << "elem" << std::right
+				<< std::setw(11) << "elements" << std::setw(12) << "ns/elem"
+				<< std::setw(14) << "bytes/iter" << std::setw(12) << "allocs/iter" << std::endl;
+		}
+
+		/**
+		Reports single result
+
+		@param result result to report
+		*/
+		void report(const BenchmarkResult& result)
+		{
+			std::cout << std::left << std::setw(14) << result.name << std::setw(9) << result.variant
+				<< std::setw(8) << result.container << std::setw(10) << result.element << std::right
+				<< std::setw(11) << result.elements << std::setw(12) << std::fixed << std::setprecision(3)
+				<< result.nsPerElement << std::setw(14) << std::setprecision(0) << result.bytesPerIteration
+				<< std::setw(12) << std::setprecision(1) << result.allocsPerIteration << std::endl;
+
+			if (mCsvFile.is_open())
+			{
+				mCsvFile << result.name << ',' << result.variant << ',' << result.container << ','
+					<< result.element << ',' << result.elements << ',' << result.iterations << ','
+					<< result.nsPerElement << ',' << result.bytesPerIteration << ','
+					<< result.allocsPerIteration << '\n';
+			}
+		}
+	};
+}
@@ -0,0 +1,435 @@
+#include "BinaryLogger.h"
+#include <chrono>
+#include "Formatter.h"
+
+namespace protolib
+{
+	std::vector<BinaryLogger::Descriptor> BinaryLogger::mDescriptors;
+	std::mutex BinaryLogger::mDescriptorsMutex;
+
+	std::unique_ptr<MpscRingBuffer<BinaryLogger::Record>> BinaryLogger::mQueue;
+	Logger::OverflowPolicy BinaryLogger::mOverflowPolicy = Logger::OverflowPolicy::BLOCK;
+	std::ofstream BinaryLogger::mBinaryFile;
+	size_t BinaryLogger::mDescriptorsInFile = 0;
+	std::atomic<bool> BinaryLogger::mRunning(false);
+	std::thread BinaryLogger::mWorkerThread;
+	std::mutex BinaryLogger::mControlMutex;
+	std::mutex BinaryLogger::mWorkerMutex;
+	std::condition_variable BinaryLogger::mWakeUp;
+	std::condition_variable BinaryLogger::mProcessedCv;
+	std::atomic<bool> BinaryLogger::mStop(false);
+	std::atomic<bool> BinaryLogger::mSleeping(false);
+	std::atomic<size_t> BinaryLogger::mProcessed(0);
+	std::atomic<size_t> BinaryLogger::mDroppedRecords(0);
+
+	namespace
+	{
+		// Stops the background thread (and processes pending records)
+		// before the static members above are destroyed
+		struct BinaryLoggerGuard
+		{
+			~BinaryLoggerGuard()
+			{
+				BinaryLogger::stop();
+			}
+		} binaryLoggerGuard;
+
+		const char FileMagic[] = { 'P', 'L', 'B', 'L' };
+		const uint16_t FileVersion = 2;
+		const char DescriptorEntry = 1;
+		const char RecordEntry = 2;
+
+		void appendLittleEndian(std::string& output, uint64_t value, size_t bytes)
+		{
+			for (size_t i = 0; i < bytes; ++i)
+			{
+				output += static_cast<char>((value >> (8 * i)) & 0xFF);
+			}
+		}
+
+		bool readLittleEndian(std::istream& input, uint64_t& value, size_t bytes)
+		{
+			unsigned char data[8];
+			if (!input.read(reinterpret_cast<char*>(data), bytes))
+			{
+				return false;
+			}
+
+			value = 0;
+			for (size_t i = 0; i < bytes; ++i)
+			{
+				value |= static_cast<uint64_t>(data[i]) << (8 * i);
+			}
+			return true;
+		}
+
+		bool readString(std::istream& input, std::string& value)
+		{
+			uint64_t length;
+			if (!readLittleEndian(input, length, 2))
+			{
+				return false;
+			}
+
+			value.resize(length);
+			return length == 0 || static_cast<bool>(input.read(&value[0], length));
+		}
+
+		// Decodes one argument from the payload and appends its text form to output
+		bool appendDecodedArg(const char*& pos, const char* end, std::string& output)
+		{
+			if (pos >= end) { return false; }
+
+			BinaryLogger::ArgTag tag = static_cast<BinaryLogger::ArgTag>(*pos++);
+			size_t valueSize = 0;
+
+			switch (tag)
+			{
+			case BinaryLogger::ArgTag::BOOL:
+				valueSize = 1;
+				if (pos + valueSize > end) { return false; }
+				output += *pos ? "1" : "0";
+				break;
+			case BinaryLogger::ArgTag::CHAR:
+				valueSize = 1;
+				if (pos + valueSize > end) { return false; }
+				output += *pos;
+				break;
+			case BinaryLogger::ArgTag::INT64:
+			{
+				int64_t val;
+				valueSize = sizeof(val);
+				if (pos + valueSize > end) { return false; }
+				memcpy(&val, pos, valueSize);
+				Formatter::appendSigned(output, val);
+				break;
+			}
+			case BinaryLogger::ArgTag::UINT64:
+			{
+				uint64_t val;
+				valueSize = sizeof(val);
+				if (pos + valueSize > end) { return false; }
+				memcpy(&val, pos, valueSize);
+				Formatter::appendUnsigned(output, val);
+				break;
+			}
+			case BinaryLogger::ArgTag::DOUBLE:
+			{
+				double val;
+				valueSize = sizeof(val);
+				if (pos + valueSize > end) { return false; }
+				memcpy(&val, pos, valueSize);
+				// Same output as Logger::writeSimpleLog would produce
+				Formatter::appendDouble(output, val);
+				break;
+			}
+			case BinaryLogger::ArgTag::FLOAT:
+			{
+				float val;
+				valueSize = sizeof(val);
+				if (pos + valueSize > end) { return false; }
+				memcpy(&val, pos, valueSize);
+				Formatter::appendFloat(output, val);
+				break;
+			}
+			case BinaryLogger::ArgTag::STRING:
+			{
+				uint16_t length;
+				if (pos + sizeof(length) > end) { return false; }
+				memcpy(&length, pos, sizeof(length));
+				pos += sizeof(length);
+				valueSize = length;
+				if (pos + valueSize > end) { return false; }
+				output.append(pos, length);
+				break;
+			}
+			default:
+				return false;
+			}
+
+			pos += valueSize;
+			return true;
+		}
+	}
+
+	uint32_t BinaryLogger::registerFormat(const char* file, size_t line, Logger::LogType logType, const char* format)
+	{
+		std::lock_guard<std::mutex> lock(mDescriptorsMutex);
+
+		Descriptor descriptor;
+		descriptor.file = file;
+		descriptor.line = static_cast<uint32_t>(line);
+		descriptor.logType = logType;
+		descriptor.format = format;
+		mDescriptors.push_back(descriptor);
+
+		return static_cast<uint32_t>(mDescriptors.size() - 1);
+	}
+
+	void BinaryLogger::appendDescriptorEntry(std::string& output, uint32_t id, const Descriptor& descriptor)
+	{
+		output += DescriptorEntry;
+		appendLittleEndian(output, id, 4);
+		appendLittleEndian(output, static_cast<uint64_t>(descriptor.logType), 1);
+		appendLittleEndian(output, descriptor.line, 4);
+		appendLittleEndian(output, descriptor.file.size(), 2);
+		output += descriptor.file;
+		appendLittleEndian(output, descriptor.format.size(), 2);
+		output += descriptor.format;
+	}
+
+	std::string BinaryLogger::formatRecord(const std::string& format, const char* payload, size_t payloadLength)
+	{
+		const char* pos = payload;
+		const char* end = payload + payloadLength;
+		std::string result;
+
+		size_t lastPos = 0;
+		size_t placeholderPos;
+		while ((placeholderPos = format.find("{}", lastPos)) != std::string::npos)
+		{
+			result.append(format, lastPos, placeholderPos - lastPos);
+			if (!appendDecodedArg(pos, end, result))
+			{
+				// Argument is missing (e.g. it didn't fit into the record)
+				result += "{}";
+			}
+			lastPos = placeholderPos + 2;
+		}
+		result.append(format, lastPos, std::string::npos);
+
+		return result;
+	}
+
+	void BinaryLogger::worker()
+	{
+		const size_t maxBatchSize = 256;
+		std::vector<Descriptor> knownDescriptors;
+		Record record;
+		std::string buffer;
+
+		while (true)
+		{
+			size_t batchSize = 0;
+			buffer.clear();
+
+			while (batchSize < maxBatchSize && mQueue->tryPop(record))
+			{
+				if (record.descriptorId >= knownDescriptors.size())
+				{
+					std::lock_guard<std::mutex> lock(mDescriptorsMutex);
+					knownDescriptors = mDescriptors;
+				}
+
+				if (mBinaryFile.is_open())
+				{
+					while (mDescriptorsInFile <= record.descriptorId)
+					{
+						appendDescriptorEntry(buffer, static_cast<uint32_t>(mDescriptorsInFile),
+							knownDescriptors[mDescriptorsInFile]);
+						++mDescriptorsInFile;
+					}
+
+					buffer += RecordEntry;
+					appendLittleEndian(buffer, record.descriptorId, 4);
+					appendLittleEndian(buffer, static_cast<uint64_t>(LogClock::toWallClockNs(record.ticks)), 8);
+					appendLittleEndian(buffer, record.threadIndex, 4);
+					appendLittleEndian(buffer, record.payloadLength, 2);
+					buffer.append(record.payload, record.payloadLength);
+				}
+				else
+				{
+					const Descriptor& descriptor = knownDescriptors[record.descriptorId];
+					if (Logger::isLogEnabled(descriptor.logType))
+					{
+						// Line carries time and thread of the producer like NamedLogger records do
+						const std::string message = formatRecord(descriptor.format, record.payload, record.payloadLength);
+						std::string line;
+						Logger::appendRecordInfo(line, record.ticks, record.threadIndex);
+						Logger::appendFormattedLog(line, descriptor.logType, descriptor.file.data(),
+							descriptor.file.size(), descriptor.line, nullptr, 0, message.data(), message.size());
+						line += '\n';
+						Logger::dispatchRawLog(line, descriptor.logType, record.ticks, record.threadIndex);
+					}
+				}
+				++batchSize;
+			}
+
+			if (batchSize > 0)
+			{
+				if (mBinaryFile.is_open())
+				{
+					mBinaryFile.write(buffer.data(), buffer.size());
+					if (mQueue->size() == 0)
+					{
+						mBinaryFile.flush();
+					}
+				}
+
+				mProcessed.fetch_add(batchSize, std::memory_order_release);
+				{
+					std::lock_guard<std::mutex> lock(mWorkerMutex);
+				}
+				mProcessedCv.notify_all();
+				continue;
+			}
+
+			if (mStop.load(std::memory_order_acquire))
+			{
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(mWorkerMutex);
+			mSleeping.store(true, std::memory_order_relaxed);
+			// Either this thread sees a record pushed concurrently or its producer sees the flag
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (mQueue->size() == 0 && !mStop.load(std::memory_order_acquire))
+			{
+				mWakeUp.wait(lock);
+			}
+			mSleeping.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	void BinaryLogger::start(const std::string& binaryFileName, size_t capacity, Logger::OverflowPolicy policy)
+	{
+		stop();
+
+		std::lock_guard<std::mutex> lock(mControlMutex);
+		mQueue.reset(new MpscRingBuffer<Record>(capacity));
+		mOverflowPolicy = policy;
+		mProcessed.store(0, std::memory_order_relaxed);
+		mStop.store(false, std::memory_order_relaxed);
+
+		if (!binaryFileName.empty())
+		{
+			mBinaryFile.open(binaryFileName, std::ios::binary | std::ios::trunc);
+
+			std::string header(FileMagic, sizeof(FileMagic));
+			appendLittleEndian(header, FileVersion, 2);
+			{
+				std::lock_guard<std::mutex> descriptorsLock(mDescriptorsMutex);
+				appendLittleEndian(header, mDescriptors.size(), 4);
+				for (size_t i = 0; i < mDescriptors.size(); ++i)
+				{
+					appendDescriptorEntry(header, static_cast<uint32_t>(i), mDescriptors[i]);
+				}
+				mDescriptorsInFile = mDescriptors.size();
+			}
+			mBinaryFile.write(header.data(), header.size());
+		}
+
+		mWorkerThread = std::thread(worker);
+		mRunning.store(true, std::memory_order_release);
+	}
+
+	void BinaryLogger::stop()
+	{
+		std::lock_guard<std::mutex> lock(mControlMutex);
+		if (!mWorkerThread.joinable()) { return; }
+
+		mRunning.store(false, std::memory_order_release);
+		mStop.store(true, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> workerLock(mWorkerMutex);
+		}
+		mWakeUp.notify_one();
+		mWorkerThread.join();
+
+		if (mBinaryFile.is_open())
+		{
+			mBinaryFile.close();
+		}
+	}
+
+	void BinaryLogger::flush()
+	{
+		std::lock_guard<std::mutex> lock(mControlMutex);
+		if (!mWorkerThread.joinable()) { return; }
+
+		size_t target = mQueue->pushedCount();
+		mWakeUp.notify_one();
+
+		std::unique_lock<std::mutex> workerLock(mWorkerMutex);
+		while (mProcessed.load(std::memory_order_acquire) < target)
+		{
+			mProcessedCv.wait_for(workerLock, std::chrono::milliseconds(1));
+		}
+	}
+
+	bool BinaryLogger::decodeFile(const std::string& binaryFileName, std::ostream& output)
+	{
+		std::ifstream input(binaryFileName, std::ios::binary);
+		std::vector<Descriptor> descriptors;
+		std::string line;
+
+		auto readDescriptor = [&]() {
+			uint64_t id, logType, descLine;
+			Descriptor descriptor;
+			if (!readLittleEndian(input, id, 4) || !readLittleEndian(input, logType, 1) ||
+				!readLittleEndian(input, descLine, 4) || !readString(input, descriptor.file) ||
+				!readString(input, descriptor.format))
+			{
+				return false;
+			}
+
+			descriptor.logType = static_cast<Logger::LogType>(logType);
+			descriptor.line = static_cast<uint32_t>(descLine);
+			if (id >= descriptors.size())
+			{
+				descriptors.resize(id + 1);
+			}
+			descriptors[id] = descriptor;
+			return true;
+		};
+
+		char magic[sizeof(FileMagic)];
+		uint64_t version, descriptorCount;
+		if (!input.read(magic, sizeof(magic)) || memcmp(magic, FileMagic, sizeof(magic)) != 0 ||
+			!readLittleEndian(input, version, 2) || version != FileVersion ||
+			!readLittleEndian(input, descriptorCount, 4))
+		{
+			return false;
+		}
+
+		char entryType;
+		while (input.get(entryType))
+		{
+			if (entryType == DescriptorEntry)
+			{
+				if (!readDescriptor()) { return false; }
+			}
+			else if (entryType == RecordEntry)
+			{
+				uint64_t id, wallClockNs, threadIndex, payloadLength;
+				char payload[Record::MaxPayloadLength];
+				if (!readLittleEndian(input, id, 4) || !readLittleEndian(input, wallClockNs, 8) ||
+					!readLittleEndian(input, threadIndex, 4) || !readLittleEndian(input, payloadLength, 2) ||
+					payloadLength > sizeof(payload) || !input.read(payload, payloadLength) ||
+					id >= descriptors.size())
+				{
+					return false;
+				}
+
+				const Descriptor& descriptor = descriptors[id];
+				std::string message = formatRecord(descriptor.format, payload, payloadLength);
+
+				line = "[Time ";
+				LogClock::appendWallClock(line, static_cast<int64_t>(wallClockNs));
+				line += "] [Thread ";
+				Formatter::appendUnsigned(line, threadIndex);
+				line += "] ";
+				Logger::appendFormattedLog(line, descriptor.logType, descriptor.file.data(), descriptor.file.size(),
+					descriptor.line, nullptr, 0, message.data(), message.size());
+				line += '\n';
+				output << line;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,362 @@
+/*
+   BinaryLogger is a static class implementing deferred (NanoLog-like) logging.
+   Each call site registers its static format descriptor (file, line, log type and
+   format string with "{}" placeholders) just once and then every log only stores
+   the descriptor ID, LogClock ticks, thread index and raw binary values of arguments
+   into a compact record. Records are passed through a lock-free ring buffer to a background thread
+   which either formats them to text and hands them over to Logger (with the time
+   and thread of the original call, not of the background thread) or
+   writes them unchanged to a binary log file. Binary log files are turned
+   into text offline by decodeFile (see decodeBinaryLog.cpp).
+
+   Binary file layout (integers outside of payload are little-endian,
+   payload values are stored in the native byte order of the producer):
+   header:     "PLBL" | uint16 version | uint32 descriptor count | descriptor entries
+   stream:     sequence of entries, each starting with uint8 entry type
+   descriptor: type 1 | uint32 id | uint8 log type | uint32 line | uint16 length + file | uint16 length + format
+   record:     type 2 | uint32 id | int64 wall clock ns | uint32 thread index | uint16 payload length | payload
+   payload:    sequence of arguments, each is uint8 tag followed by its value
+
+   Descriptors registered after the file was opened are written
+   to the stream just before their first record. Ticks are converted
+   to wall clock time by the background thread since they are meaningful
+   only within the process which took them.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "LogClock.h"
+#include "Logger.h"
+#include "MpscRingBuffer.h"
+
+namespace protolib
+{
+	class BinaryLogger
+	{
+	public:
+		// Tags of argument types stored in record payload
+		enum class ArgTag : uint8_t
+		{
+			BOOL = 1,
+			CHAR,
+			INT64,
+			UINT64,
+			DOUBLE,
+			STRING,
+			FLOAT,
+		};
+	private:
+		struct Descriptor
+		{
+			std::string file;
+			uint32_t line;
+			Logger::LogType logType;
+			std::string format;
+		};
+
+		struct Record
+		{
+			static const size_t MaxPayloadLength = 250;
+
+			uint64_t ticks;
+			uint32_t threadIndex;
+			uint32_t descriptorId;
+			uint16_t payloadLength;
+			char payload[MaxPayloadLength];
+		};
+
+		// Sequentially appends binary values to the fixed-size payload,
+		// values which don't fit are silently omitted (strings are truncated)
+		class PayloadWriter
+		{
+		private:
+			char* mData;
+			size_t mCapacity;
+			size_t mSize;
+
+			bool appendTagged(ArgTag tag, const void* value, size_t valueSize)
+			{
+				if (mSize + 1 + valueSize > mCapacity)
+				{
+					mSize = mCapacity;
+					return false;
+				}
+
+				mData[mSize++] = static_cast<char>(tag);
+				memcpy(mData + mSize, value, valueSize);
+				mSize += valueSize;
+				return true;
+			}
+
+			template<typename T>
+			void append(const T& value, std::true_type /*isIntegral*/, std::false_type)
+			{
+				if (std::is_same<T, bool>::value)
+				{
+					uint8_t val = value ? 1 : 0;
+					appendTagged(ArgTag::BOOL, &val, 1);
+				}
+				else if (std::is_same<T, char>::value)
+				{
+					appendTagged(ArgTag::CHAR, &value, 1);
+				}
+				else if (std::is_signed<T>::value)
+				{
+					int64_t val = static_cast<int64_t>(value);
+					appendTagged(ArgTag::INT64, &val, sizeof(val));
+				}
+				else
+				{
+					uint64_t val = static_cast<uint64_t>(value);
+					appendTagged(ArgTag::UINT64, &val, sizeof(val));
+				}
+			}
+
+			template<typename T>
+			void append(const T& value, std::false_type, std::true_type /*isFloatingPoint*/)
+			{
+				double val = static_cast<double>(value);
+				appendTagged(ArgTag::DOUBLE, &val, sizeof(val));
+			}
+
+			// Floats keep their type so that they are printed with float precision
+			void append(float value, std::false_type, std::true_type /*isFloatingPoint*/)
+			{
+				appendTagged(ArgTag::FLOAT, &value, sizeof(value));
+			}
+
+			void appendString(const char* str, size_t length)
+			{
+				if (mSize + 3 > mCapacity)
+				{
+					mSize = mCapacity;
+					return;
+				}
+
+				uint16_t storedLength = static_cast<uint16_t>(std::min(length, mCapacity - mSize - 3));
+				mData[mSize++] = static_cast<char>(ArgTag::STRING);
+				memcpy(mData + mSize, &storedLength, sizeof(storedLength));
+				mSize += sizeof(storedLength);
+				memcpy(mData + mSize, str, storedLength);
+				mSize += storedLength;
+			}
+		public:
+			PayloadWriter(char* data, size_t capacity)
+				:mData(data), mCapacity(capacity), mSize(0)
+			{ }
+
+			size_t size() const
+			{
+				return mSize;
+			}
+
+			template<typename T>
+			void append(const T& value)
+			{
+				static_assert(std::is_arithmetic<T>::value,
+					"BinaryLogger supports only arithmetic types and strings as arguments.");
+				append(value, std::is_integral<T>(), std::is_floating_point<T>());
+			}
+
+			void append(const std::string& value)
+			{
+				appendString(value.data(), value.size());
+			}
+
+			void append(const char* value)
+			{
+				appendString(value, strlen(value));
+			}
+
+			void append(char* value)
+			{
+				appendString(value, strlen(value));
+			}
+		};
+
+		static std::vector<Descriptor> mDescriptors;
+		static std::mutex mDescriptorsMutex;
+
+		static std::unique_ptr<MpscRingBuffer<Record>> mQueue;
+		static Logger::OverflowPolicy mOverflowPolicy;
+		static std::ofstream mBinaryFile;
+		static size_t mDescriptorsInFile;
+		static std::atomic<bool> mRunning;
+		static std::thread mWorkerThread;
+		static std::mutex mControlMutex;
+		static std::mutex mWorkerMutex;
+		static std::condition_variable mWakeUp;
+		static std::condition_variable mProcessedCv;
+		static std::atomic<bool> mStop;
+		static std::atomic<bool> mSleeping;
+		static std::atomic<size_t> mProcessed;
+		static std::atomic<size_t> mDroppedRecords;
+
+		static void appendArgs(PayloadWriter&) { }
+
+		template<typename T, typename... Args>
+		static void appendArgs(PayloadWriter& writer, const T& value, const Args&... args)
+		{
+			writer.append(value);
+			appendArgs(writer, args...);
+		}
+
+		template<typename Writer>
+		static void pushRecord(Writer writer);
+
+		static void appendDescriptorEntry(std::string& output, uint32_t id, const Descriptor& descriptor);
+
+		static std::string formatRecord(const std::string& format, const char* payload, size_t payloadLength);
+
+		static void worker();
+	public:
+		/**
+		Registers a format descriptor of a call site
+		(typically called once per call site by PROTOLIB_LOG_DEFERRED macro)
+
+		@param file file containing the call site
+		@param line line of the call site
+		@param logType type of log
+		@param format format string where "{}" is replaced by the next argument
+		@return descriptor ID
+		*/
+		static uint32_t registerFormat(const char* file, size_t line, Logger::LogType logType, const char* format);
+
+		/**
+		Starts the background thread processing binary records (the running logger is stopped first).
+		Like switching of Logger modes, this should be done while other threads are not logging,
+		since the ring buffer is replaced.
+
+		@param binaryFileName if empty, records are formatted to text in the background
+		       and passed to Logger, otherwise they are saved in binary form to this file
+		@param capacity capacity of the ring buffer (rounded up to the power of two)
+		@param policy what to do with new records when the ring buffer is full
+		*/
+		static void start(const std::string& binaryFileName = std::string(), size_t capacity = 16384,
+			Logger::OverflowPolicy policy = Logger::OverflowPolicy::BLOCK);
+
+		/**
+		Processes all pending records, stops the background thread
+		and closes the binary file (if any).
+		Should be called while other threads are not logging, records written
+		concurrently with stop might be lost (they are never waited for).
+		*/
+		static void stop();
+
+		/**
+		Waits until all records written so far are processed
+		and flushes the binary file (if any)
+		*/
+		static void flush();
+
+		/**
+		Returns number of records discarded because of the full ring buffer
+
+		@return number of dropped records
+		*/
+		static size_t getDroppedRecordsCount()
+		{
+			return mDroppedRecords.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Writes a binary record, arguments are stored in their binary form
+		(strings are copied). If BinaryLogger is not running, the call has no effect.
+
+		@param descriptorId ID returned by registerFormat
+		@param args arguments (arithmetic types, std::string or C strings)
+		*/
+		template<typename... Args>
+		static void write(uint32_t descriptorId, const Args&... args)
+		{
+			if (!mRunning.load(std::memory_order_acquire)) { return; }
+
+			// Time is taken before a possible wait for free space in the ring buffer
+			const uint64_t ticks = LogClock::now();
+			pushRecord([&](Record& record) {
+				PayloadWriter writer(record.payload, Record::MaxPayloadLength);
+				appendArgs(writer, args...);
+				record.ticks = ticks;
+				record.threadIndex = LogClock::threadIndex();
+				record.descriptorId = descriptorId;
+				record.payloadLength = static_cast<uint16_t>(writer.size());
+			});
+		}
+
+		/**
+		Converts binary log file to text
+
+		@param binaryFileName binary log file
+		@param output stream where the text is written
+		@return true if the whole file was decoded, false if it is not a valid binary log
+		*/
+		static bool decodeFile(const std::string& binaryFileName, std::ostream& output);
+	};
+
+	template<typename Writer>
+	void BinaryLogger::pushRecord(Writer writer)
+	{
+		while (!mQueue->tryPushWith(writer))
+		{
+			if (mOverflowPolicy == Logger::OverflowPolicy::DROP_NEWEST)
+			{
+				mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else if (mOverflowPolicy == Logger::OverflowPolicy::DROP_OLDEST)
+			{
+				Record oldest;
+				if (mQueue->tryPop(oldest))
+				{
+					mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+					mProcessed.fetch_add(1, std::memory_order_release);
+				}
+			}
+			else
+			{
+				// Writer racing with stop() must not wait for a worker which is gone
+				if (!mRunning.load(std::memory_order_acquire))
+				{
+					mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				mWakeUp.notify_one();
+				std::this_thread::yield();
+			}
+		}
+
+		// Pairs with the fence of the worker, see Logger::wakeAsyncWorker
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (mSleeping.load(std::memory_order_relaxed))
+		{
+			{
+				std::lock_guard<std::mutex> lock(mWorkerMutex);
+			}
+			mWakeUp.notify_one();
+		}
+	}
+}
+
+// Writes a deferred log, only the descriptor ID and binary values of arguments
+// are stored on the calling thread, formatting happens in background or offline
+// ------
+// Example usage:
+// PROTOLIB_LOG_DEFERRED(INF, "request {} took {} ms", requestId, elapsed);
+// ------
+#define PROTOLIB_LOG_DEFERRED(type, format, ...) PROTOLIB_LOG_IF_ENABLED(type, \
+	static const uint32_t protolibDescriptorId = ::protolib::BinaryLogger::registerFormat( \
+		__FILE__, __LINE__, ::protolib::Logger::LogType::type, format); \
+	::protolib::BinaryLogger::write(protolibDescriptorId, ##__VA_ARGS__))
@@ -0,0 +1,581 @@
+#include "CompressedLogFile.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if PROTOLIB_USE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace protolib
+{
+	namespace
+	{
+		// File starts with magic and version, each frame with FrameHeaderSize bytes of header:
+		// marker, method, offset of the text in the decompressed stream, text size, payload size
+		// and FNV-1a checksum of the text (all little endian)
+		const char FileMagic[] = { 'P', 'L', 'Z', 'L' };
+		const uint16_t FileVersion = 1;
+		const size_t FileHeaderSize = 8;
+		const char FrameMarker[] = { 'P', 'L', 'Z', 'F' };
+		const size_t FrameHeaderSize = 28;
+
+		const uint32_t StoredMethod = 0;
+		const uint32_t FastMethod = 1;
+		const uint32_t ZlibMethod = 2;
+
+		const size_t MinMatch = 4;
+		const size_t MaxOffset = 65535;
+
+		uint32_t read32(const unsigned char* data)
+		{
+			uint32_t value;
+			memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		void storeLittleEndian(char* output, uint64_t value, size_t bytes)
+		{
+			for (size_t i = 0; i < bytes; ++i)
+			{
+				output[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+			}
+		}
+
+		uint64_t loadLittleEndian(const char* data, size_t bytes)
+		{
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; ++i)
+			{
+				value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+			}
+			return value;
+		}
+
+		uint32_t computeChecksum(const char* data, size_t length)
+		{
+			uint32_t hash = 2166136261u;
+			for (size_t i = 0; i < length; ++i)
+			{
+				hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+			}
+			return hash;
+		}
+
+		// Length which doesn't fit into the 4-bit field of the token continues by bytes, 255 means "more follows"
+		void appendLengthBytes(std::string& output, size_t length)
+		{
+			while (length >= 255)
+			{
+				output += static_cast<char>(255);
+				length -= 255;
+			}
+			output += static_cast<char>(length);
+		}
+
+		bool readLengthBytes(const unsigned char*& input, const unsigned char* end, size_t& length)
+		{
+			unsigned char byte;
+			do
+			{
+				if (input == end) { return false; }
+				byte = *input++;
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+		// Sequence is a token (4 bits of literal length, 4 bits of match length - MinMatch), literals
+		// and, unless this is the last sequence of the block, 2 bytes of match offset
+		void appendSequence(std::string& output, const unsigned char* literals, size_t literalLength,
+			size_t offset, size_t matchLength)
+		{
+			const size_t matchCode = matchLength >= MinMatch ? matchLength - MinMatch : 0;
+			output += static_cast<char>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+			if (literalLength >= 15)
+			{
+				appendLengthBytes(output, literalLength - 15);
+			}
+			output.append(reinterpret_cast<const char*>(literals), literalLength);
+
+			if (matchLength == 0) { return; }
+
+			output += static_cast<char>(offset & 0xFF);
+			output += static_cast<char>(offset >> 8);
+			if (matchCode >= 15)
+			{
+				appendLengthBytes(output, matchCode - 15);
+			}
+		}
+	}
+
+	const size_t LogCompressor::HashBits;
+	const size_t LogCompressor::MaxBlockSize;
+	const size_t CompressedFileSink::FrameSize;
+
+	LogCompressor::LogCompressor()
+		:mHashTable(static_cast<size_t>(1) << HashBits)
+	{ }
+
+	void LogCompressor::compress(const char* data, size_t length, std::string& output)
+	{
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(data);
+		auto hash = [](uint32_t sequence) { return (sequence * 2654435761u) >> (32 - HashBits); };
+
+		// Table keeps position + 1 of the last occurrence of each hashed sequence, 0 = none
+		std::fill(mHashTable.begin(), mHashTable.end(), 0);
+
+		size_t anchor = 0;
+		size_t pos = 0;
+		while (pos + MinMatch <= length)
+		{
+			const uint32_t sequence = read32(src + pos);
+			uint32_t& entry = mHashTable[hash(sequence)];
+			size_t candidate = entry;
+			entry = static_cast<uint32_t>(pos + 1);
+
+			if (candidate == 0 || pos - (candidate - 1) > MaxOffset || read32(src + candidate - 1) != sequence)
+			{
+				// Incompressible data are skipped faster the longer no match is found
+				pos += 1 + ((pos - anchor) >> 6);
+				continue;
+			}
+
+			size_t matchStart = candidate - 1;
+			while (pos > anchor && matchStart > 0 && src[pos - 1] == src[matchStart - 1])
+			{
+				--pos;
+				--matchStart;
+			}
+			size_t matchLength = MinMatch;
+			while (pos + matchLength < length && src[pos + matchLength] == src[matchStart + matchLength])
+			{
+				++matchLength;
+			}
+
+			appendSequence(output, src + anchor, pos - anchor, pos - matchStart, matchLength);
+			pos += matchLength;
+			anchor = pos;
+
+			// Position inside the match helps to find the next one
+			if (pos >= 2 && pos + MinMatch <= length + 2)
+			{
+				mHashTable[hash(read32(src + pos - 2))] = static_cast<uint32_t>(pos - 1);
+			}
+		}
+
+		appendSequence(output, src + anchor, length - anchor, 0, 0);
+	}
+
+	bool LogCompressor::decompress(const char* data, size_t length, char* output, size_t outputLength)
+	{
+		const unsigned char* input = reinterpret_cast<const unsigned char*>(data);
+		const unsigned char* const end = input + length;
+		char* out = output;
+		char* const outEnd = output + outputLength;
+
+		while (input < end)
+		{
+			const unsigned char token = *input++;
+			size_t literalLength = token >> 4;
+			if (literalLength == 15 && !readLengthBytes(input, end, literalLength)) { return false; }
+			if (literalLength > static_cast<size_t>(end - input) || literalLength > static_cast<size_t>(outEnd - out))
+			{
+				return false;
+			}
+			memcpy(out, input, literalLength);
+			input += literalLength;
+			out += literalLength;
+
+			// Last sequence has no match
+			if (input == end) { break; }
+
+			if (end - input < 2) { return false; }
+			const size_t offset = input[0] | (static_cast<size_t>(input[1]) << 8);
+			input += 2;
+			size_t matchLength = token & 15;
+			if (matchLength == 15 && !readLengthBytes(input, end, matchLength)) { return false; }
+			matchLength += MinMatch;
+			if (offset == 0 || offset > static_cast<size_t>(out - output) ||
+				matchLength > static_cast<size_t>(outEnd - out))
+			{
+				return false;
+			}
+
+			// Overlapping match repeats the last offset bytes, so it is copied byte by byte
+			const char* match = out - offset;
+			if (offset >= matchLength)
+			{
+				memcpy(out, match, matchLength);
+				out += matchLength;
+			}
+			else
+			{
+				for (size_t i = 0; i < matchLength; ++i)
+				{
+					*out++ = *match++;
+				}
+			}
+		}
+
+		return out == outEnd;
+	}
+
+	CompressedFileSink::CompressedFileSink(const std::string& fileName, LogCompression compression,
+		const FlushPolicy& policy)
+		:LogSink(policy), mCompression(compression), mRawOffset(0), mWrittenBytes(0)
+	{
+#if !PROTOLIB_USE_ZLIB
+		if (compression == LogCompression::ZLIB)
+		{
+			throw std::runtime_error("zlib compression is not available (compile with PROTOLIB_USE_ZLIB=1)");
+		}
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+		mFd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (mFd < 0)
+		{
+			throw std::runtime_error("Unable to open log file " + fileName);
+		}
+#else
+		mFile.open(fileName, std::ios::binary | std::ios::trunc);
+		if (!mFile.is_open())
+		{
+			throw std::runtime_error("Unable to open log file " + fileName);
+		}
+#endif
+
+		char header[FileHeaderSize] = {};
+		memcpy(header, FileMagic, sizeof(FileMagic));
+		storeLittleEndian(header + sizeof(FileMagic), FileVersion, 2);
+		writeToFile(header, sizeof(header));
+	}
+
+	CompressedFileSink::~CompressedFileSink()
+	{
+		flush();
+#if defined(__unix__) || defined(__APPLE__)
+		::close(mFd);
+#endif
+	}
+
+	bool CompressedFileSink::writeToFile(const char* data, size_t length)
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		while (length > 0)
+		{
+			ssize_t written = ::write(mFd, data, length);
+			if (written < 0)
+			{
+				if (errno == EINTR) { continue; }
+				return false;
+			}
+			mWrittenBytes.fetch_add(static_cast<uint64_t>(written), std::memory_order_relaxed);
+			data += written;
+			length -= static_cast<size_t>(written);
+		}
+		return true;
+#else
+		mFile.write(data, length);
+		mFile.flush();
+		if (!mFile)
+		{
+			mFile.clear();
+			return false;
+		}
+		mWrittenBytes.fetch_add(length, std::memory_order_relaxed);
+		return true;
+#endif
+	}
+
+	void CompressedFileSink::writeFrame(const char* data, size_t length)
+	{
+		// Header is filled in once the size of the payload is known
+		mFrame.assign(FrameHeaderSize, '\0');
+		uint32_t method = FastMethod;
+#if PROTOLIB_USE_ZLIB
+		if (mCompression == LogCompression::ZLIB)
+		{
+			method = ZlibMethod;
+			uLongf compressedLength = compressBound(static_cast<uLong>(length));
+			mFrame.resize(FrameHeaderSize + compressedLength);
+			if (compress2(reinterpret_cast<Bytef*>(&mFrame[FrameHeaderSize]), &compressedLength,
+				reinterpret_cast<const Bytef*>(data), static_cast<uLong>(length), Z_DEFAULT_COMPRESSION) != Z_OK)
+			{
+				compressedLength = length;
+			}
+			mFrame.resize(FrameHeaderSize + compressedLength);
+		}
+		else
+#endif
+		{
+			mCompressor.compress(data, length, mFrame);
+		}
+
+		// Incompressible text is stored as it is
+		if (mFrame.size() - FrameHeaderSize >= length)
+		{
+			method = StoredMethod;
+			mFrame.resize(FrameHeaderSize);
+			mFrame.append(data, length);
+		}
+
+		char* header = &mFrame[0];
+		memcpy(header, FrameMarker, sizeof(FrameMarker));
+		storeLittleEndian(header + 4, method, 4);
+		const uint64_t rawOffset = mRawOffset.load(std::memory_order_relaxed);
+		storeLittleEndian(header + 8, rawOffset, 8);
+		storeLittleEndian(header + 16, length, 4);
+		storeLittleEndian(header + 20, mFrame.size() - FrameHeaderSize, 4);
+		storeLittleEndian(header + 24, computeChecksum(data, length), 4);
+		if (!writeToFile(mFrame.data(), mFrame.size()))
+		{
+			// Text of the frame is lost, the next frame starts at the same offset so that readers can
+			// skip a partially written frame (frames start at record boundaries, a split record counts once)
+			addDroppedRecords(std::max<size_t>(static_cast<size_t>(std::count(data, data + length, '\n')), 1));
+			return;
+		}
+
+		mRawOffset.store(rawOffset + length, std::memory_order_relaxed);
+	}
+
+	void CompressedFileSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		// Chunks consist of complete records, so frames start at record boundaries
+		// unless a chunk is longer than a frame
+		for (const auto& chunk : chunks)
+		{
+			const char* data = chunk.first;
+			size_t length = chunk.second;
+			if (!mPending.empty() && mPending.size() + length > FrameSize)
+			{
+				writeFrame(mPending.data(), mPending.size());
+				mPending.clear();
+			}
+			while (length > FrameSize)
+			{
+				writeFrame(data, FrameSize);
+				data += FrameSize;
+				length -= FrameSize;
+			}
+			mPending.append(data, length);
+		}
+
+		// Flushed records are complete in the file so that readers can see them
+		if (!mPending.empty())
+		{
+			writeFrame(mPending.data(), mPending.size());
+			mPending.clear();
+		}
+	}
+
+	CompressedLogReader::CompressedLogReader(const std::string& fileName)
+		:mInput(fileName, std::ios::binary), mPosition(0), mCorrupted(false)
+	{
+		char header[FileHeaderSize];
+		if (!mInput.read(header, sizeof(header)))
+		{
+			throw std::runtime_error("Unable to read compressed log " + fileName);
+		}
+		if (memcmp(header, FileMagic, sizeof(FileMagic)) != 0 ||
+			loadLittleEndian(header + sizeof(FileMagic), 2) != FileVersion)
+		{
+			throw std::runtime_error(fileName + " is not a compressed log");
+		}
+	}
+
+	CompressedLogReader::FrameStatus CompressedLogReader::readFrameHeader(uint32_t& method, uint64_t& rawOffset,
+		uint32_t& rawSize, uint32_t& storedSize, uint32_t& checksum, std::streamoff& frameStart)
+	{
+		mInput.clear();
+		frameStart = mInput.tellg();
+
+		char header[FrameHeaderSize];
+		if (!mInput.read(header, sizeof(header)))
+		{
+			// Frame is not written yet (or not completely)
+			mInput.clear();
+			mInput.seekg(frameStart);
+			return FrameStatus::INCOMPLETE;
+		}
+
+		method = static_cast<uint32_t>(loadLittleEndian(header + 4, 4));
+		rawOffset = loadLittleEndian(header + 8, 8);
+		rawSize = static_cast<uint32_t>(loadLittleEndian(header + 16, 4));
+		storedSize = static_cast<uint32_t>(loadLittleEndian(header + 20, 4));
+		checksum = static_cast<uint32_t>(loadLittleEndian(header + 24, 4));
+		// Compressed payload is never larger than the text (such frames are stored)
+		if (memcmp(header, FrameMarker, sizeof(FrameMarker)) != 0 || method > ZlibMethod ||
+			rawSize > CompressedFileSink::FrameSize || storedSize > rawSize)
+		{
+			mInput.seekg(frameStart);
+			return FrameStatus::INVALID;
+		}
+		return FrameStatus::VALID;
+	}
+
+	CompressedLogReader::FrameStatus CompressedLogReader::decodeFrame(std::string& output)
+	{
+		uint32_t method, rawSize, storedSize, checksum;
+		uint64_t rawOffset;
+		std::streamoff frameStart;
+		const FrameStatus headerStatus = readFrameHeader(method, rawOffset, rawSize, storedSize, checksum, frameStart);
+		if (headerStatus != FrameStatus::VALID) { return headerStatus; }
+		if (rawOffset != mPosition)
+		{
+			mInput.seekg(frameStart);
+			return FrameStatus::INVALID;
+		}
+
+		mCompressed.resize(storedSize);
+		if (storedSize > 0 && !mInput.read(&mCompressed[0], storedSize))
+		{
+			mInput.clear();
+			mInput.seekg(frameStart);
+			return FrameStatus::INCOMPLETE;
+		}
+
+		const size_t outputStart = output.size();
+		output.resize(outputStart + rawSize);
+		char* text = &output[0] + outputStart;
+		bool valid = false;
+		if (method == StoredMethod)
+		{
+			valid = storedSize == rawSize;
+			if (valid)
+			{
+				memcpy(text, mCompressed.data(), rawSize);
+			}
+		}
+		else if (method == FastMethod)
+		{
+			valid = LogCompressor::decompress(mCompressed.data(), storedSize, text, rawSize);
+		}
+#if PROTOLIB_USE_ZLIB
+		else if (method == ZlibMethod)
+		{
+			uLongf textLength = rawSize;
+			valid = uncompress(reinterpret_cast<Bytef*>(text), &textLength,
+				reinterpret_cast<const Bytef*>(mCompressed.data()), storedSize) == Z_OK && textLength == rawSize;
+		}
+#endif
+
+		if (!valid || computeChecksum(text, rawSize) != checksum)
+		{
+			output.resize(outputStart);
+			mInput.seekg(frameStart);
+			return FrameStatus::INVALID;
+		}
+
+		mPosition = rawOffset + rawSize;
+		return FrameStatus::VALID;
+	}
+
+	bool CompressedLogReader::resynchronize(std::streamoff from, std::string& output)
+	{
+		// File is scanned in blocks, the next block overlaps by the marker size - 1 bytes
+		const size_t scanBlockSize = 64 * 1024;
+		std::streamoff blockStart = from;
+		while (true)
+		{
+			mInput.clear();
+			mInput.seekg(blockStart);
+			mScanBlock.resize(scanBlockSize);
+			mInput.read(&mScanBlock[0], scanBlockSize);
+			const size_t blockLength = static_cast<size_t>(mInput.gcount());
+			if (blockLength < sizeof(FrameMarker)) { return false; }
+			mScanBlock.resize(blockLength);
+
+			const std::string marker(FrameMarker, sizeof(FrameMarker));
+			for (size_t pos = mScanBlock.find(marker); pos != std::string::npos; pos = mScanBlock.find(marker, pos + 1))
+			{
+				mInput.clear();
+				mInput.seekg(blockStart + static_cast<std::streamoff>(pos));
+				if (decodeFrame(output) == FrameStatus::VALID) { return true; }
+			}
+			blockStart += static_cast<std::streamoff>(blockLength - (sizeof(FrameMarker) - 1));
+		}
+	}
+
+	bool CompressedLogReader::readFrame(std::string& output)
+	{
+		mInput.clear();
+		const std::streamoff frameStart = mInput.tellg();
+		const FrameStatus status = decodeFrame(output);
+		if (status == FrameStatus::VALID) { return true; }
+
+		// Damaged frame (or a frame cut short by a failed write) is skipped if a valid frame
+		// continuing the text follows, an incomplete frame at the end is waited for
+		if (resynchronize(frameStart + 1, output))
+		{
+			mCorrupted = true;
+			return true;
+		}
+		mCorrupted = mCorrupted || status == FrameStatus::INVALID;
+		mInput.clear();
+		mInput.seekg(frameStart);
+		return false;
+	}
+
+	bool CompressedLogReader::seek(uint64_t rawOffset)
+	{
+		mInput.clear();
+		const std::streamoff originalPosition = mInput.tellg();
+		const uint64_t originalRawPosition = mPosition;
+		if (rawOffset < mPosition)
+		{
+			mInput.seekg(FileHeaderSize);
+		}
+
+		uint32_t method, rawSize, storedSize, checksum;
+		uint64_t frameOffset;
+		std::streamoff frameStart;
+		while (readFrameHeader(method, frameOffset, rawSize, storedSize, checksum, frameStart) == FrameStatus::VALID)
+		{
+			if (rawOffset < frameOffset + rawSize)
+			{
+				mInput.seekg(frameStart);
+				mPosition = frameOffset;
+				return true;
+			}
+			mInput.seekg(storedSize, std::ios::cur);
+		}
+
+		// Position past the written text, or the file is corrupted
+		mInput.clear();
+		mInput.seekg(originalPosition);
+		mPosition = originalRawPosition;
+		return false;
+	}
+
+	bool CompressedLogReader::decompressFile(const std::string& fileName, std::ostream& output)
+	{
+		try
+		{
+			CompressedLogReader reader(fileName);
+			std::string text;
+			while (reader.readFrame(text))
+			{
+				output.write(text.data(), text.size());
+				text.clear();
+			}
+
+			// Whole file has to be consumed, otherwise it is corrupted or truncated
+			reader.mInput.clear();
+			const std::streamoff position = reader.mInput.tellg();
+			reader.mInput.seekg(0, std::ios::end);
+			return !reader.isCorrupted() && reader.mInput.tellg() == position;
+		}
+		catch (std::exception&)
+		{
+			return false;
+		}
+	}
+}
@@ -0,0 +1,222 @@
+/*
+   CompressedFileSink is a file sink which compresses flushed records
+   in independent frames of up to 64 KiB of text, so it is meant to be
+   added by Logger::addSink (or NamedLogger::addSink) where compression
+   runs on the sink's own thread. Frames are compressed by LogCompressor,
+   a small LZ77 codec in the spirit of LZ4 (greedy matching via a hash
+   table of 4-byte sequences, literal runs and back-references of at least
+   4 bytes within the frame), or by zlib when the library is compiled
+   with PROTOLIB_USE_ZLIB=1 (and linked with -lz).
+   Every frame header carries a sync marker, the offset of the frame's
+   text in the decompressed stream, sizes and a checksum, so a reader
+   can skip frames without decompressing them and seek to any position.
+   A frame whose write fails is counted as dropped records and its text
+   is not included in the offsets, the next frame continues at the same offset.
+   CompressedLogReader decompresses such a file frame by frame, a frame
+   which is not completely written yet is simply not returned, so the
+   reader might be used to tail a file being written (see decompressLog.cpp).
+   After a damaged frame (e.g. a half-written one) the reader continues
+   at the next sync marker of a valid frame which starts at the expected offset.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "LogSink.h"
+
+#ifndef PROTOLIB_USE_ZLIB
+#define PROTOLIB_USE_ZLIB 0
+#endif
+
+namespace protolib
+{
+	enum class LogCompression
+	{
+		FAST,		// LogCompressor, fast compression of repetitive text
+		ZLIB		// Better ratio for more CPU time, requires PROTOLIB_USE_ZLIB=1
+	};
+
+	// LZ77 block codec, instance keeps its hash table so repeated compression doesn't allocate
+	class LogCompressor
+	{
+	private:
+		static const size_t HashBits = 14;
+
+		std::vector<uint32_t> mHashTable;
+	public:
+		// Largest block which can be compressed (back-references have 16 bits)
+		static const size_t MaxBlockSize = 64 * 1024;
+
+		LogCompressor();
+
+		/**
+		Compresses a block of data
+
+		@param data data to compress
+		@param length length of data, at most MaxBlockSize
+		@param output where the compressed block is appended
+		*/
+		void compress(const char* data, size_t length, std::string& output);
+
+		/**
+		Decompresses a block produced by compress
+
+		@param data compressed block
+		@param length length of the compressed block
+		@param output destination of decompressed data
+		@param outputLength exact length of decompressed data
+		@return true if the block is valid and decompresses to outputLength bytes, false otherwise
+		*/
+		static bool decompress(const char* data, size_t length, char* output, size_t outputLength);
+	};
+
+	class CompressedFileSink : public LogSink
+	{
+	private:
+		LogCompression mCompression;
+		LogCompressor mCompressor;
+		std::string mPending;		// Text of the frame being collected
+		std::string mFrame;			// Reused buffer of the compressed frame
+		std::atomic<uint64_t> mRawOffset;		// Written only by the thread writing to the sink
+		std::atomic<uint64_t> mWrittenBytes;
+#if defined(__unix__) || defined(__APPLE__)
+		int mFd;
+#else
+		std::ofstream mFile;
+#endif
+
+		void writeFrame(const char* data, size_t length);
+
+		bool writeToFile(const char* data, size_t length);
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		// Maximal amount of text in one frame
+		static const size_t FrameSize = LogCompressor::MaxBlockSize;
+
+		/**
+		Main constructor to initialize the whole class (file is truncated, throws std::runtime_error
+		if it can't be opened or zlib is requested but not compiled in)
+
+		@param fileName name of the file
+		@param compression compression algorithm of frames
+		@param policy flush policy (every flush ends a frame, so frequent flushes make compression worse)
+		*/
+		CompressedFileSink(const std::string& fileName, LogCompression compression = LogCompression::FAST,
+			const FlushPolicy& policy = FlushPolicy(256 * 1024));
+
+		~CompressedFileSink() override;
+
+		/**
+		Returns number of bytes of uncompressed text written so far
+
+		@return number of bytes
+		*/
+		uint64_t getRawBytes() const
+		{
+			return mRawOffset.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Returns number of bytes written to the file so far (including headers)
+
+		@return number of bytes
+		*/
+		uint64_t getWrittenBytes() const
+		{
+			return mWrittenBytes.load(std::memory_order_relaxed);
+		}
+	};
+
+	class CompressedLogReader
+	{
+	private:
+		enum class FrameStatus
+		{
+			VALID,
+			INCOMPLETE,		// Frame is not completely written yet
+			INVALID
+		};
+
+		std::ifstream mInput;
+		std::string mCompressed;
+		std::string mScanBlock;
+		uint64_t mPosition;
+		bool mCorrupted;
+
+		// Reads header of the next frame and leaves the file positioned at its payload
+		FrameStatus readFrameHeader(uint32_t& method, uint64_t& rawOffset, uint32_t& rawSize, uint32_t& storedSize,
+			uint32_t& checksum, std::streamoff& frameStart);
+
+		// Decodes the frame at the current position if it starts at mPosition, text is appended only if it is valid
+		FrameStatus decodeFrame(std::string& output);
+
+		// Looks for the next valid frame starting at mPosition behind the given file offset and decodes it
+		bool resynchronize(std::streamoff from, std::string& output);
+	public:
+		/**
+		Main constructor to initialize the whole class
+		(throws std::runtime_error if the file can't be opened or it is not a compressed log)
+
+		@param fileName name of the compressed log file
+		*/
+		explicit CompressedLogReader(const std::string& fileName);
+
+		/**
+		Appends text of the next frame
+
+		@param output where the text is appended
+		@return true if a frame was read, false at the end of the file, when the next frame
+		is not completely written yet (reading might be retried later) or when it is corrupted
+		and no valid frame follows (frames behind a corrupted one are returned)
+		*/
+		bool readFrame(std::string& output);
+
+		/**
+		Moves to the frame which contains given position of the decompressed text
+		(frames are skipped without being decompressed), readFrame then returns text
+		starting at the beginning of that frame
+
+		@param rawOffset position in the decompressed text
+		@return true if such a frame exists, false otherwise (position is not changed)
+		*/
+		bool seek(uint64_t rawOffset);
+
+		/**
+		Returns position in the decompressed text where the next frame starts
+
+		@return position in bytes
+		*/
+		uint64_t getPosition() const
+		{
+			return mPosition;
+		}
+
+		/**
+		Checks whether a corrupted frame was encountered (and skipped)
+
+		@return true if the file is corrupted, false otherwise
+		*/
+		bool isCorrupted() const
+		{
+			return mCorrupted;
+		}
+
+		/**
+		Writes whole decompressed text of a file to the stream
+
+		@param fileName name of the compressed log file
+		@param output destination stream
+		@return true if the file was decompressed completely, false otherwise
+		*/
+		static bool decompressFile(const std::string& fileName, std::ostream& output);
+	};
+}
@@ -13,6 +13,7 @@ It provides some additional & more complex functionality to the underlying conta
 #include <set>
 #include <map>
 #include <vector>
+#include "Tracer.h"
 
 namespace protolib
 {
@@ -407,6 +408,7 @@ namespace protolib
 		*/
 		ContainerWrapper getSorted() const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "getSorted");
 			ContainerWrapper res = *this;
 			std::sort(res.begin(), res.end());
 			return res;
@@ -422,6 +424,7 @@ namespace protolib
 		template<typename UnPred>
 		ContainerWrapper where(UnPred pred) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "where");
 			ContainerWrapper res;
 
 			for (const_reference el : mContainer)
@@ -445,6 +448,7 @@ namespace protolib
 		template<typename TRes, typename TContRes>
 		auto map(const std::function<TRes(value_type)>& func) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "map");
 			ContainerWrapper<TContRes> res;
 
 			for (const_reference el : mContainer)
@@ -466,6 +470,7 @@ namespace protolib
 		template<typename TRes, typename BinFunc>
 		TRes accumulateLeft(TRes init, BinFunc func) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "accumulateLeft");
 			return std::accumulate(begin(), end(), init, func);
 		}
 
@@ -480,6 +485,7 @@ namespace protolib
 		template<typename TRes, typename BinFunc>
 		TRes accumulateRight(TRes fin, BinFunc func) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "accumulateRight");
 			auto funcRev = [func](auto lhs, auto rhs) { return func(rhs, lhs); };
 
 			return std::accumulate(rbegin(), rend(), fin, funcRev);
@@ -546,6 +552,7 @@ namespace protolib
 		*/
 		ContainerWrapper reverse() const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "reverse");
 			return ContainerWrapper(rbegin(), rend());
 		}
 
@@ -558,6 +565,7 @@ namespace protolib
 		*/
 		ContainerWrapper skip(size_t numOfElements) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "skip");
 			const_iterator iter = cbegin();
 			if (numOfElements <= size())
 			{
@@ -578,6 +586,7 @@ namespace protolib
 		template<typename UnPred>
 		ContainerWrapper skipWhile(UnPred pred) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "skipWhile");
 			ContainerWrapper result;
 
 			bool shouldSkip = true;
@@ -602,6 +611,7 @@ namespace protolib
 		*/
 		ContainerWrapper take(size_t numOfElements) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "take");
 			const_iterator iter = cbegin();
 			for (size_t i = 0; i < numOfElements && iter != cend(); ++i, ++iter);
 			return ContainerWrapper(cbegin(), iter);
@@ -620,6 +630,7 @@ namespace protolib
 		template<typename UnPred>
 		ContainerWrapper takeWhile(UnPred pred) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "takeWhile");
 			ContainerWrapper result;
 
 			for (const_reference el : mContainer)
@@ -641,6 +652,7 @@ namespace protolib
 		*/
 		ContainerWrapper unique() const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "unique");
 			std::set<value_type> foundElements;
 			ContainerWrapper result;
 
@@ -667,6 +679,7 @@ namespace protolib
 		template<typename UnFunc>
 		auto groupBy(UnFunc func) const
 		{
+			PROTOLIB_TRACE_SCOPE("ContainerWrapper", "groupBy");
 			static_assert(std::is_default_constructible<value_type>::value,
 				"Data type of values stored in container must be default constructible to use groupBy member function.");
 			std::map<decltype(func(value_type())), std::vector<value_type>> result;
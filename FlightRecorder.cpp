@@ -0,0 +1,277 @@
+#include "FlightRecorder.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace protolib
+{
+	namespace
+	{
+		const int fatalSignals[] = {
+			SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+			SIGBUS,
+#endif
+		};
+		const size_t fatalSignalsCount = sizeof(fatalSignals) / sizeof(fatalSignals[0]);
+		const size_t maxFileNameLength = 4096;
+
+		// Everything used by the handlers is preallocated so that they don't allocate
+		std::atomic<FlightRecorder*> crashRecorder(nullptr);
+		char crashFileName[maxFileNameLength];
+		std::atomic<bool> crashDumped(false);
+		bool handlersInstalled = false;
+		std::terminate_handler previousTerminate = nullptr;
+#if defined(__unix__) || defined(__APPLE__)
+		const size_t alternateStackSize = 64 * 1024;
+		struct sigaction previousActions[fatalSignalsCount];
+#else
+		void (*previousHandlers[fatalSignalsCount])(int);
+#endif
+
+		const char* getSignalName(int signal)
+		{
+			switch (signal)
+			{
+			case SIGSEGV: return "SIGSEGV";
+			case SIGABRT: return "SIGABRT";
+			case SIGFPE: return "SIGFPE";
+			case SIGILL: return "SIGILL";
+#ifdef SIGBUS
+			case SIGBUS: return "SIGBUS";
+#endif
+			default: return "fatal signal";
+			}
+		}
+
+		void dumpOnCrash(const char* reason)
+		{
+			// Only the first crash is dumped, e.g. std::terminate is usually followed by SIGABRT
+			FlightRecorder* recorder = crashRecorder.load(std::memory_order_acquire);
+			if (recorder != nullptr && !crashDumped.exchange(true))
+			{
+				recorder->dump(crashFileName, reason);
+			}
+		}
+
+		void restorePreviousHandler(size_t index)
+		{
+#if defined(__unix__) || defined(__APPLE__)
+			sigaction(fatalSignals[index], &previousActions[index], nullptr);
+#else
+			std::signal(fatalSignals[index], previousHandlers[index]);
+#endif
+		}
+
+		void signalHandler(int signal)
+		{
+			dumpOnCrash(getSignalName(signal));
+
+			// Signal is raised again with the original handler, it is delivered once this
+			// handler returns (or the faulting instruction is executed again)
+			for (size_t i = 0; i < fatalSignalsCount; ++i)
+			{
+				if (fatalSignals[i] == signal)
+				{
+					restorePreviousHandler(i);
+				}
+			}
+			std::raise(signal);
+		}
+
+		void terminateHandler()
+		{
+			dumpOnCrash("std::terminate");
+			if (previousTerminate != nullptr)
+			{
+				previousTerminate();
+			}
+			std::abort();
+		}
+	}
+
+	FlightRecorder::FlightRecorder(size_t capacity)
+		:mBuffer(new char[std::max<size_t>(capacity, 1)]), mCapacity(std::max<size_t>(capacity, 1)), mWritePosition(0)
+	{ }
+
+	void FlightRecorder::record(const char* data, size_t length)
+	{
+		if (length > mCapacity)
+		{
+			data += length - mCapacity;
+			length = mCapacity;
+		}
+
+		uint64_t position = mWritePosition.fetch_add(length, std::memory_order_acq_rel);
+		size_t offset = static_cast<size_t>(position % mCapacity);
+		size_t firstPart = std::min(length, mCapacity - offset);
+		memcpy(mBuffer.get() + offset, data, firstPart);
+		memcpy(mBuffer.get(), data + firstPart, length - firstPart);
+	}
+
+	void FlightRecorder::getRange(uint64_t& start, uint64_t& end) const
+	{
+		end = mWritePosition.load(std::memory_order_acquire);
+		start = end > mCapacity ? end - mCapacity : 0;
+		if (start == 0) { return; }
+
+		// Oldest record was partially overwritten, so the output starts with the next one
+		while (start < end && mBuffer[static_cast<size_t>(start % mCapacity)] != '\n')
+		{
+			++start;
+		}
+		start = std::min(start + 1, end);
+	}
+
+	std::string FlightRecorder::getContent() const
+	{
+		uint64_t start, end;
+		getRange(start, end);
+
+		std::string content;
+		content.reserve(static_cast<size_t>(end - start));
+		size_t offset = static_cast<size_t>(start % mCapacity);
+		size_t length = static_cast<size_t>(end - start);
+		size_t firstPart = std::min(length, mCapacity - offset);
+		content.append(mBuffer.get() + offset, firstPart);
+		content.append(mBuffer.get(), length - firstPart);
+		return content;
+	}
+
+#if defined(__unix__) || defined(__APPLE__)
+	namespace
+	{
+		bool writeAll(int fd, const char* data, size_t length)
+		{
+			while (length > 0)
+			{
+				ssize_t written = ::write(fd, data, length);
+				if (written < 0)
+				{
+					if (errno == EINTR) { continue; }
+					return false;
+				}
+				data += written;
+				length -= static_cast<size_t>(written);
+			}
+			return true;
+		}
+	}
+
+	bool FlightRecorder::dump(int fd) const
+	{
+		uint64_t start, end;
+		getRange(start, end);
+
+		size_t offset = static_cast<size_t>(start % mCapacity);
+		size_t length = static_cast<size_t>(end - start);
+		size_t firstPart = std::min(length, mCapacity - offset);
+		return writeAll(fd, mBuffer.get() + offset, firstPart) &&
+			writeAll(fd, mBuffer.get(), length - firstPart);
+	}
+
+	bool FlightRecorder::dump(const char* fileName, const char* reason) const
+	{
+		int fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) { return false; }
+
+		const char headerStart[] = "=== Flight recorder dump (";
+		const char headerEnd[] = ") ===\n";
+		bool success = writeAll(fd, headerStart, sizeof(headerStart) - 1) &&
+			writeAll(fd, reason, strlen(reason)) &&
+			writeAll(fd, headerEnd, sizeof(headerEnd) - 1) &&
+			dump(fd);
+		::close(fd);
+		return success;
+	}
+
+	void FlightRecorder::installCrashHandlers(FlightRecorder* recorder, const std::string& fileName)
+	{
+		uninstallCrashHandlers();
+
+		size_t length = std::min(fileName.size(), maxFileNameLength - 1);
+		memcpy(crashFileName, fileName.data(), length);
+		crashFileName[length] = '\0';
+		crashDumped.store(false);
+		crashRecorder.store(recorder, std::memory_order_release);
+
+		// Alternate stack is never released since a handler might be running on it
+		static char* alternateStack = new char[alternateStackSize];
+		stack_t stack;
+		stack.ss_sp = alternateStack;
+		stack.ss_size = alternateStackSize;
+		stack.ss_flags = 0;
+		sigaltstack(&stack, nullptr);
+
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = signalHandler;
+		action.sa_flags = SA_ONSTACK;
+		sigemptyset(&action.sa_mask);
+		for (size_t i = 0; i < fatalSignalsCount; ++i)
+		{
+			sigaction(fatalSignals[i], &action, &previousActions[i]);
+		}
+
+		previousTerminate = std::set_terminate(terminateHandler);
+		handlersInstalled = true;
+	}
+#else
+	bool FlightRecorder::dump(int) const
+	{
+		return false;
+	}
+
+	bool FlightRecorder::dump(const char* fileName, const char* reason) const
+	{
+		// Without POSIX there is no async-signal-safe way to write a file, best effort is used
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) { return false; }
+
+		file << "=== Flight recorder dump (" << reason << ") ===\n" << getContent();
+		return static_cast<bool>(file);
+	}
+
+	void FlightRecorder::installCrashHandlers(FlightRecorder* recorder, const std::string& fileName)
+	{
+		uninstallCrashHandlers();
+
+		size_t length = std::min(fileName.size(), maxFileNameLength - 1);
+		memcpy(crashFileName, fileName.data(), length);
+		crashFileName[length] = '\0';
+		crashDumped.store(false);
+		crashRecorder.store(recorder, std::memory_order_release);
+
+		for (size_t i = 0; i < fatalSignalsCount; ++i)
+		{
+			previousHandlers[i] = std::signal(fatalSignals[i], signalHandler);
+		}
+
+		previousTerminate = std::set_terminate(terminateHandler);
+		handlersInstalled = true;
+	}
+#endif
+
+	void FlightRecorder::uninstallCrashHandlers()
+	{
+		if (!handlersInstalled) { return; }
+
+		for (size_t i = 0; i < fatalSignalsCount; ++i)
+		{
+			restorePreviousHandler(i);
+		}
+		std::set_terminate(previousTerminate);
+		crashRecorder.store(nullptr, std::memory_order_release);
+		handlersInstalled = false;
+	}
+}
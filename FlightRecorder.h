@@ -0,0 +1,95 @@
+/*
+   FlightRecorder keeps the most recent formatted log records in a fixed-size
+   in-memory ring. Writers only reserve space by a single atomic addition
+   and copy the record, so recording even the most verbose logs is cheap.
+   The ring is written to a file on demand or, once crash handlers are
+   installed, on fatal signals (SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL)
+   and std::terminate. Dumping uses only async-signal-safe operations
+   (open, write, close) and doesn't allocate.
+   Records being written while the ring is dumped or overwritten by
+   a much faster writer might appear garbled, which is the price for
+   the lock-free recording.
+   Logger owns its recorder (see Logger::enableFlightRecorder).
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace protolib
+{
+	class FlightRecorder
+	{
+	private:
+		std::unique_ptr<char[]> mBuffer;
+		size_t mCapacity;
+		std::atomic<uint64_t> mWritePosition;
+
+		// Returns position of the oldest complete record and end of the recorded data
+		void getRange(uint64_t& start, uint64_t& end) const;
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param capacity size of the ring in bytes
+		*/
+		explicit FlightRecorder(size_t capacity);
+
+		FlightRecorder(const FlightRecorder&) = delete;
+		FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+		/**
+		Appends a formatted record to the ring (lock-free),
+		only the end of a record longer than the ring is kept
+
+		@param data formatted record (including line ending)
+		@param length length of data
+		*/
+		void record(const char* data, size_t length);
+
+		/**
+		Returns recorded records from the oldest one
+
+		@return recorded records (including line endings)
+		*/
+		std::string getContent() const;
+
+		/**
+		Writes recorded records to a file descriptor (async-signal-safe)
+
+		@param fd file descriptor
+		@return true if everything was written, false otherwise
+		*/
+		bool dump(int fd) const;
+
+		/**
+		Writes header with the reason of the dump and recorded records
+		to a file which is truncated first (async-signal-safe)
+
+		@param fileName name of the file
+		@param reason reason of the dump written to the header (e.g. "SIGSEGV")
+		@return true if the file was written, false otherwise
+		*/
+		bool dump(const char* fileName, const char* reason) const;
+
+		/**
+		Installs handlers of fatal signals and std::terminate which dump
+		given recorder to given file before the original handler is invoked.
+		Fatal signals are handled on an alternate stack of the calling thread
+		so that stack overflow of this thread can be reported as well.
+
+		@param recorder recorder which is dumped (nullptr = nothing is dumped)
+		@param fileName name of the dump file
+		*/
+		static void installCrashHandlers(FlightRecorder* recorder, const std::string& fileName);
+
+		/**
+		Restores handlers replaced by installCrashHandlers
+		*/
+		static void uninstallCrashHandlers();
+	};
+}
@@ -0,0 +1,555 @@
+/*
+   Formatter converts numbers to text without iostreams, locales or
+   temporary strings. Integers are converted two digits at a time using
+   a lookup table, floating-point values are printed as the shortest
+   decimal which reads back as the same value of their own type (values
+   with at most nine decimal places are converted by integer arithmetic,
+   the rest falls back to snprintf with increasing precision). FormatBuffer is a growable buffer
+   which starts in a fixed-size array on the stack and moves to the heap
+   only when the array is exhausted.
+   Formatter is shared by Logger, StructuredLogger, SvgExporter and PnmExporter,
+   benchFormatter.cpp compares it with the previously used formatting.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace protolib
+{
+	class Formatter
+	{
+	private:
+		static const char* getDigitPairs()
+		{
+			static const char digitPairs[] =
+				"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+				"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+				"8081828384858687888990919293949596979899";
+			return digitPairs;
+		}
+
+		// Decimal text of each byte value in 4 characters, the last one is the length of the text
+		static const char* getByteDecimals()
+		{
+			static const struct ByteDecimals
+			{
+				char data[256 * 4];
+
+				ByteDecimals()
+				{
+					for (size_t value = 0; value < 256; ++value)
+					{
+						char* entry = data + value * 4;
+						entry[3] = static_cast<char>(snprintf(entry, 4, "%u", static_cast<unsigned>(value)));
+					}
+				}
+			} byteDecimals;
+			return byteDecimals.data;
+		}
+
+		// Writes n / 10^k in fixed notation
+		static size_t formatScaled(char* output, uint64_t n, size_t k)
+		{
+			char digits[MaxIntegerLength];
+			const size_t digitsLength = formatUnsigned(digits, n);
+			if (k == 0)
+			{
+				memcpy(output, digits, digitsLength);
+				return digitsLength;
+			}
+
+			size_t length = 0;
+			if (digitsLength > k)
+			{
+				memcpy(output, digits, digitsLength - k);
+				length = digitsLength - k;
+				output[length++] = '.';
+				memcpy(output + length, digits + digitsLength - k, k);
+				return length + k;
+			}
+			output[length++] = '0';
+			output[length++] = '.';
+			memset(output + length, '0', k - digitsLength);
+			length += k - digitsLength;
+			memcpy(output + length, digits, digitsLength);
+			return length + digitsLength;
+		}
+
+		// Writes sign, "nan" or "inf" and "0" for zero, returns false if the value needs digits
+		static bool formatSpecial(char* output, double& value, size_t& length)
+		{
+			length = 0;
+			if (std::isnan(value))
+			{
+				memcpy(output, "nan", 3);
+				length = 3;
+				return true;
+			}
+			if (std::signbit(value))
+			{
+				output[length++] = '-';
+				value = -value;
+			}
+			if (std::isinf(value))
+			{
+				memcpy(output + length, "inf", 3);
+				length += 3;
+				return true;
+			}
+			if (value == 0.0)
+			{
+				output[length++] = '0';
+				return true;
+			}
+			return false;
+		}
+
+		static const double* getPowersOf10()
+		{
+			static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+			return powersOf10;
+		}
+
+		template<typename T>
+		static void appendValue(std::string& output, const T& value, std::true_type /*isArithmetic*/)
+		{
+			appendArithmetic(output, value);
+		}
+
+		template<typename T>
+		static void appendValue(std::string& output, const T& value, std::false_type /*isArithmetic*/)
+		{
+			std::ostringstream ss;
+			ss << value;
+			output += ss.str();
+		}
+
+		// Same text as operator<< produces for bool and characters
+		static void appendArithmetic(std::string& output, bool value) { output += value ? '1' : '0'; }
+		static void appendArithmetic(std::string& output, char value) { output += value; }
+		static void appendArithmetic(std::string& output, signed char value) { output += static_cast<char>(value); }
+		static void appendArithmetic(std::string& output, unsigned char value) { output += static_cast<char>(value); }
+
+		static void appendArithmetic(std::string& output, float value) { appendFloat(output, value); }
+
+		template<typename T>
+		static void appendArithmetic(std::string& output, T value)
+		{
+			if (std::is_floating_point<T>::value)
+			{
+				appendDouble(output, static_cast<double>(value));
+			}
+			else if (std::is_signed<T>::value)
+			{
+				appendSigned(output, static_cast<int64_t>(value));
+			}
+			else
+			{
+				appendUnsigned(output, static_cast<uint64_t>(value));
+			}
+		}
+	public:
+		// Maximal length of a formatted integer and floating-point value
+		static const size_t MaxIntegerLength = 20;
+		static const size_t MaxDoubleLength = 32;
+
+		/**
+		Writes decimal representation of an unsigned integer
+
+		@param output destination with space for at least MaxIntegerLength characters
+		@param value value to format
+		@return number of written characters
+		*/
+		static size_t formatUnsigned(char* output, uint64_t value)
+		{
+			char digits[MaxIntegerLength];
+			char* const end = digits + MaxIntegerLength;
+			char* start = end;
+			const char* digitPairs = getDigitPairs();
+			while (value >= 100)
+			{
+				const size_t pair = static_cast<size_t>(value % 100) * 2;
+				value /= 100;
+				start -= 2;
+				memcpy(start, digitPairs + pair, 2);
+			}
+			if (value >= 10)
+			{
+				start -= 2;
+				memcpy(start, digitPairs + value * 2, 2);
+			}
+			else
+			{
+				*--start = static_cast<char>('0' + value);
+			}
+
+			const size_t length = static_cast<size_t>(end - start);
+			memcpy(output, start, length);
+			return length;
+		}
+
+		/**
+		Writes decimal representation of a byte by a single table lookup
+
+		@param output destination with space for at least 4 characters (all of them might be overwritten)
+		@param value value to format
+		@return number of written characters
+		*/
+		static size_t formatByte(char* output, uint8_t value)
+		{
+			const char* entry = getByteDecimals() + value * 4;
+			memcpy(output, entry, 4);
+			return static_cast<size_t>(entry[3]);
+		}
+
+		/**
+		Writes decimal representation of a signed integer
+
+		@param output destination with space for at least MaxIntegerLength characters
+		@param value value to format
+		@return number of written characters
+		*/
+		static size_t formatSigned(char* output, int64_t value)
+		{
+			if (value < 0)
+			{
+				*output = '-';
+				// Negation is done in unsigned arithmetic so that the minimal value doesn't overflow
+				return 1 + formatUnsigned(output + 1, 0ull - static_cast<uint64_t>(value));
+			}
+			return formatUnsigned(output, static_cast<uint64_t>(value));
+		}
+
+		/**
+		Writes the shortest decimal representation which reads back as the same value
+		(fixed notation, or exponent notation of %g for very small and large values),
+		NaN and infinities are written as "nan", "inf" and "-inf"
+
+		@param output destination with space for at least MaxDoubleLength characters
+		@param value value to format
+		@return number of written characters
+		*/
+		static size_t formatDouble(char* output, double value)
+		{
+			size_t length = 0;
+			if (formatSpecial(output, value, length)) { return length; }
+
+			// Value is n / 10^k for the smallest k for which the division gives back the same value,
+			// division of exact integers is correctly rounded just like parsing of the decimal text
+			const double* powersOf10 = getPowersOf10();
+			if (value >= 1e-4 && value < 1e15)
+			{
+				for (size_t k = 0; k < 10; ++k)
+				{
+					const double scaled = std::nearbyint(value * powersOf10[k]);
+					if (scaled >= 9007199254740992.0) { break; }
+					if (scaled / powersOf10[k] != value) { continue; }
+					return length + formatScaled(output + length, static_cast<uint64_t>(scaled), k);
+				}
+			}
+
+			// Any decimal of at most 15 digits survives the round trip through double,
+			// so the first precision which reads back as the same value is the shortest one
+			char text[MaxDoubleLength];
+			int textLength = 0;
+			for (int precision = 15; precision <= 17; ++precision)
+			{
+				textLength = snprintf(text, sizeof(text), "%.*g", precision, value);
+				if (precision == 17 || strtod(text, nullptr) == value) { break; }
+			}
+			memcpy(output + length, text, static_cast<size_t>(textLength));
+			return length + static_cast<size_t>(textLength);
+		}
+
+		/**
+		Writes the shortest decimal representation which reads back as the same float
+		(so 0.1f is written as "0.1", not as the digits of its exact double value),
+		notation is the same as in formatDouble
+
+		@param output destination with space for at least MaxDoubleLength characters
+		@param value value to format
+		@return number of written characters
+		*/
+		static size_t formatFloat(char* output, float value)
+		{
+			double wide = value;
+			size_t length = 0;
+			if (formatSpecial(output, wide, length)) { return length; }
+			value = static_cast<float>(wide);
+
+			// Same search as in formatDouble, n / 10^k reads back as the float if the (exact) decimal
+			// lies strictly between the midpoints to the neighbouring floats, the midpoints and
+			// the quotient are doubles, so the quotient might be rounded only towards a midpoint
+			const double* powersOf10 = getPowersOf10();
+			if (value >= 1e-4f && value < 1e15f)
+			{
+				const double lower = (wide + std::nextafter(value, 0.0f)) / 2;
+				const double upper = (wide + std::nextafter(value, HUGE_VALF)) / 2;
+				for (size_t k = 0; k < 10; ++k)
+				{
+					const double scaled = std::nearbyint(wide * powersOf10[k]);
+					if (scaled >= 9007199254740992.0) { break; }
+					const double quotient = scaled / powersOf10[k];
+					if (quotient <= lower || quotient >= upper) { continue; }
+					return length + formatScaled(output + length, static_cast<uint64_t>(scaled), k);
+				}
+			}
+
+			// Nine significant digits identify any float
+			char text[MaxDoubleLength];
+			int textLength = 0;
+			for (int precision = 6; precision <= 9; ++precision)
+			{
+				textLength = snprintf(text, sizeof(text), "%.*g", precision, wide);
+				if (precision == 9 || strtof(text, nullptr) == value) { break; }
+			}
+			memcpy(output + length, text, static_cast<size_t>(textLength));
+			return length + static_cast<size_t>(textLength);
+		}
+
+		/**
+		Appends decimal representation of an unsigned integer
+
+		@param output where the text is appended
+		@param value value to format
+		*/
+		static void appendUnsigned(std::string& output, uint64_t value)
+		{
+			char text[MaxIntegerLength];
+			output.append(text, formatUnsigned(text, value));
+		}
+
+		/**
+		Appends decimal representation of a signed integer
+
+		@param output where the text is appended
+		@param value value to format
+		*/
+		static void appendSigned(std::string& output, int64_t value)
+		{
+			char text[MaxIntegerLength + 1];
+			output.append(text, formatSigned(text, value));
+		}
+
+		/**
+		Appends the shortest decimal representation of a floating-point value (see formatDouble)
+
+		@param output where the text is appended
+		@param value value to format
+		*/
+		static void appendDouble(std::string& output, double value)
+		{
+			char text[MaxDoubleLength];
+			output.append(text, formatDouble(text, value));
+		}
+
+		/**
+		Appends the shortest decimal representation of a float (see formatFloat)
+
+		@param output where the text is appended
+		@param value value to format
+		*/
+		static void appendFloat(std::string& output, float value)
+		{
+			char text[MaxDoubleLength];
+			output.append(text, formatFloat(text, value));
+		}
+
+		/**
+		Appends text form of a value: numbers are converted by Formatter,
+		bool and characters as operator<< does, other types by operator<<
+
+		@param output where the text is appended
+		@param value value to format
+		*/
+		template<typename T>
+		static void appendValue(std::string& output, const T& value)
+		{
+			appendValue(output, value, std::is_arithmetic<T>());
+		}
+
+		static void appendValue(std::string& output, const std::string& value) { output += value; }
+		static void appendValue(std::string& output, const char* value) { output += value; }
+		static void appendValue(std::string& output, char* value) { output += value; }
+	};
+
+	// Growable character buffer which uses StackCapacity bytes on the stack before it moves to the heap
+	template<size_t StackCapacity = 512>
+	class FormatBuffer
+	{
+	private:
+		char mStackData[StackCapacity];
+		std::unique_ptr<char[]> mHeapData;
+		char* mData;
+		size_t mSize;
+		size_t mCapacity;
+
+		void grow(size_t required)
+		{
+			size_t capacity = mCapacity * 2;
+			while (capacity < required)
+			{
+				capacity *= 2;
+			}
+
+			std::unique_ptr<char[]> heapData(new char[capacity]);
+			memcpy(heapData.get(), mData, mSize);
+			mHeapData = std::move(heapData);
+			mData = mHeapData.get();
+			mCapacity = capacity;
+		}
+
+		// Returns pointer where up to length characters might be written
+		char* reserveTail(size_t length)
+		{
+			if (mSize + length > mCapacity)
+			{
+				grow(mSize + length);
+			}
+			return mData + mSize;
+		}
+	public:
+		FormatBuffer()
+			:mData(mStackData), mSize(0), mCapacity(StackCapacity)
+		{ }
+
+		FormatBuffer(const FormatBuffer&) = delete;
+		FormatBuffer& operator=(const FormatBuffer&) = delete;
+
+		/**
+		Appends characters
+
+		@param data characters to append
+		@param length number of characters
+		@return reference to this buffer
+		*/
+		FormatBuffer& append(const char* data, size_t length)
+		{
+			memcpy(reserveTail(length), data, length);
+			mSize += length;
+			return *this;
+		}
+
+		/**
+		Appends a string
+
+		@param str string to append
+		@return reference to this buffer
+		*/
+		FormatBuffer& append(const std::string& str)
+		{
+			return append(str.data(), str.size());
+		}
+
+		/**
+		Appends a string literal (without the terminating zero)
+
+		@param str string literal to append
+		@return reference to this buffer
+		*/
+		template<size_t N>
+		FormatBuffer& append(const char(&str)[N])
+		{
+			return append(str, N - 1);
+		}
+
+		/**
+		Appends a character
+
+		@param c character to append
+		@return reference to this buffer
+		*/
+		FormatBuffer& append(char c)
+		{
+			*reserveTail(1) = c;
+			++mSize;
+			return *this;
+		}
+
+		/**
+		Appends decimal representation of a signed integer
+
+		@param value value to format
+		@return reference to this buffer
+		*/
+		FormatBuffer& appendSigned(int64_t value)
+		{
+			mSize += Formatter::formatSigned(reserveTail(Formatter::MaxIntegerLength + 1), value);
+			return *this;
+		}
+
+		/**
+		Appends decimal representation of an unsigned integer
+
+		@param value value to format
+		@return reference to this buffer
+		*/
+		FormatBuffer& appendUnsigned(uint64_t value)
+		{
+			mSize += Formatter::formatUnsigned(reserveTail(Formatter::MaxIntegerLength), value);
+			return *this;
+		}
+
+		/**
+		Appends the shortest decimal representation of a floating-point value
+
+		@param value value to format
+		@return reference to this buffer
+		*/
+		FormatBuffer& appendDouble(double value)
+		{
+			mSize += Formatter::formatDouble(reserveTail(Formatter::MaxDoubleLength), value);
+			return *this;
+		}
+
+		/**
+		Appends the shortest decimal representation of a float
+
+		@param value value to format
+		@return reference to this buffer
+		*/
+		FormatBuffer& appendFloat(float value)
+		{
+			mSize += Formatter::formatFloat(reserveTail(Formatter::MaxDoubleLength), value);
+			return *this;
+		}
+
+		const char* data() const
+		{
+			return mData;
+		}
+
+		size_t size() const
+		{
+			return mSize;
+		}
+
+		/**
+		Removes content of the buffer (capacity is kept)
+		*/
+		void clear()
+		{
+			mSize = 0;
+		}
+
+		/**
+		Returns content of the buffer as a string
+
+		@return content of the buffer
+		*/
+		std::string toString() const
+		{
+			return std::string(mData, mSize);
+		}
+	};
+}
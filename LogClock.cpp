@@ -0,0 +1,181 @@
+#include "LogClock.h"
+#include <atomic>
+#include <ctime>
+#include <mutex>
+
+#if defined(PROTOLIB_LOG_CLOCK_TSC) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace protolib
+{
+	namespace
+	{
+		struct Sample
+		{
+			uint64_t ticks;
+			int64_t steadyNs;
+			int64_t wallNs;
+		};
+
+		Sample takeSample()
+		{
+			// Ticks are read around both clocks and averaged to reduce the error
+			Sample sample;
+			uint64_t before = LogClock::now();
+			sample.steadyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+			sample.wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+			uint64_t after = LogClock::now();
+			sample.ticks = before + (after - before) / 2;
+			return sample;
+		}
+
+		struct Calibration
+		{
+			std::mutex mutex;
+			Sample base;			// Taken at startup, used to compute tick rate over the longest span
+			Sample last;			// Latest sample, used as the reference point of conversions
+			double ticksPerNs;		// 0 until the rate is known
+
+			Calibration()
+				:base(takeSample()), last(base), ticksPerNs(LogClock::usesTsc() ? 0.0 : 1.0)
+			{ }
+		};
+
+		Calibration& getCalibration()
+		{
+			static Calibration calibration;
+			return calibration;
+		}
+
+		// Takes the base sample during static initialization so that
+		// the first conversion usually doesn't have to wait for the rate
+		struct CalibrationInitializer
+		{
+			CalibrationInitializer()
+			{
+				getCalibration();
+			}
+		} calibrationInitializer;
+
+		// Must be called with calibration mutex locked
+		void refreshCalibration(Calibration& calibration)
+		{
+			const int64_t minRateSpanNs = 1000000;
+			const double refreshPeriodNs = 1e9;
+			bool rateKnown = calibration.ticksPerNs > 0.0;
+			if (rateKnown && static_cast<double>(LogClock::now() - calibration.last.ticks) <=
+				refreshPeriodNs * calibration.ticksPerNs)
+			{
+				return;
+			}
+
+			Sample current = takeSample();
+			while (LogClock::usesTsc() && current.steadyNs - calibration.base.steadyNs < minRateSpanNs)
+			{
+				// Happens at most once, right after the start of the program
+				current = takeSample();
+			}
+
+			if (LogClock::usesTsc())
+			{
+				calibration.ticksPerNs = static_cast<double>(current.ticks - calibration.base.ticks) /
+					static_cast<double>(current.steadyNs - calibration.base.steadyNs);
+			}
+			calibration.last = current;
+		}
+
+		std::atomic<uint32_t> nextThreadIndex(0);
+
+		std::tm toLocalTime(std::time_t time)
+		{
+			std::tm result;
+#if defined(__unix__) || defined(__APPLE__)
+			localtime_r(&time, &result);
+#elif defined(_MSC_VER)
+			localtime_s(&result, &time);
+#else
+			result = *std::localtime(&time);
+#endif
+			return result;
+		}
+	}
+
+	bool LogClock::detectInvariantTsc()
+	{
+#if defined(PROTOLIB_LOG_CLOCK_TSC) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0x80000000);
+		if (static_cast<unsigned>(info[0]) < 0x80000007u) { return false; }
+		__cpuid(info, 0x80000007);
+		return (info[3] & (1 << 8)) != 0;
+#elif defined(PROTOLIB_LOG_CLOCK_TSC)
+		// CPUID.80000007H:EDX[8] reports TSC running at constant rate in all power states
+		unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+		if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007u) { return false; }
+		__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+		return (edx & (1u << 8)) != 0;
+#else
+		return false;
+#endif
+	}
+
+	uint32_t LogClock::threadIndex()
+	{
+		thread_local uint32_t index = nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	double LogClock::ticksPerSecond()
+	{
+		Calibration& calibration = getCalibration();
+		std::lock_guard<std::mutex> lock(calibration.mutex);
+		refreshCalibration(calibration);
+		return calibration.ticksPerNs * 1e9;
+	}
+
+	int64_t LogClock::toWallClockNs(uint64_t ticks)
+	{
+		Calibration& calibration = getCalibration();
+		std::lock_guard<std::mutex> lock(calibration.mutex);
+		refreshCalibration(calibration);
+
+		// Records might be older than the last sample, hence the signed difference
+		int64_t deltaTicks = static_cast<int64_t>(ticks - calibration.last.ticks);
+		return calibration.last.wallNs + static_cast<int64_t>(static_cast<double>(deltaTicks) / calibration.ticksPerNs);
+	}
+
+	void LogClock::appendWallClock(std::string& output, int64_t wallClockNs)
+	{
+		int64_t seconds = wallClockNs / 1000000000;
+		int64_t fraction = wallClockNs % 1000000000;
+		if (fraction < 0)
+		{
+			--seconds;
+			fraction += 1000000000;
+		}
+
+		// Calendar conversion is done only once per second and thread
+		thread_local int64_t cachedSecond = -1;
+		thread_local char cachedText[32] = {};
+		if (seconds != cachedSecond)
+		{
+			std::tm localTime = toLocalTime(static_cast<std::time_t>(seconds));
+			std::strftime(cachedText, sizeof(cachedText), "%Y-%m-%d %H:%M:%S", &localTime);
+			cachedSecond = seconds;
+		}
+
+		char micros[8] = { '.', '0', '0', '0', '0', '0', '0', '\0' };
+		int64_t value = fraction / 1000;
+		for (int i = 6; i > 0 && value > 0; --i)
+		{
+			micros[i] = static_cast<char>('0' + value % 10);
+			value /= 10;
+		}
+
+		output += cachedText;
+		output += micros;
+	}
+}
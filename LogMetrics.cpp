@@ -0,0 +1,275 @@
+#include "LogMetrics.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "LogClock.h"
+#include "AsyncSink.h"
+
+namespace protolib
+{
+	const size_t LogMetrics::Histogram::BucketCount;
+
+	std::atomic<uint64_t> LogMetrics::mBytesWritten(0);
+	std::atomic<size_t> LogMetrics::mAsyncQueueHighWater(0);
+	LogMetrics::Histogram LogMetrics::mLockHold;
+	LogMetrics::Histogram LogMetrics::mFlush;
+
+	namespace
+	{
+		// Counters of running threads and sums of counters of finished threads,
+		// never destroyed since threads might finish during static destruction
+		struct CountersRegistry
+		{
+			std::mutex mutex;
+			std::vector<const void*> threads;
+			uint64_t finishedRecords[4];
+			uint64_t finishedSuppressed;
+
+			CountersRegistry()
+				:finishedRecords(), finishedSuppressed(0)
+			{ }
+		};
+
+		CountersRegistry& getRegistry()
+		{
+			static CountersRegistry* registry = new CountersRegistry();
+			return *registry;
+		}
+
+		// State of the periodic metrics log, never destroyed for the same reason as the registry
+		struct PeriodicLog
+		{
+			std::mutex mutex;
+			std::condition_variable wakeUp;
+			std::thread thread;
+			bool stop = false;
+		};
+
+		PeriodicLog& getPeriodicLog()
+		{
+			static PeriodicLog* periodicLog = new PeriodicLog();
+			return *periodicLog;
+		}
+
+		size_t getBucket(uint64_t ticks)
+		{
+			size_t bucket = 0;
+			while (ticks > 0)
+			{
+				ticks >>= 1;
+				++bucket;
+			}
+			return bucket;
+		}
+
+		void appendStats(std::string& output, const char* name, const LatencyStats& stats)
+		{
+			output += ' ';
+			output += name;
+			output += "_count=" + std::to_string(stats.count);
+			output += ' ';
+			output += name;
+			output += "_mean_ns=" + std::to_string(static_cast<uint64_t>(stats.meanNs));
+			output += ' ';
+			output += name;
+			output += "_p50_ns=" + std::to_string(static_cast<uint64_t>(stats.p50Ns));
+			output += ' ';
+			output += name;
+			output += "_p99_ns=" + std::to_string(static_cast<uint64_t>(stats.p99Ns));
+			output += ' ';
+			output += name;
+			output += "_max_ns=" + std::to_string(static_cast<uint64_t>(stats.maxNs));
+		}
+	}
+
+	std::string LogMetricsSnapshot::toString() const
+	{
+		std::string output;
+		output += "records_dbg=" + std::to_string(records[0]);
+		output += " records_inf=" + std::to_string(records[1]);
+		output += " records_war=" + std::to_string(records[2]);
+		output += " records_err=" + std::to_string(records[3]);
+		output += " bytes_written=" + std::to_string(bytesWritten);
+		output += " dropped=" + std::to_string(droppedLogs);
+		output += " suppressed=" + std::to_string(suppressedLogs);
+		output += " async_queue_max=" + std::to_string(asyncQueueHighWater);
+		output += " synced_queue_max=" + std::to_string(syncedQueueHighWater);
+		appendStats(output, "lock_hold", lockHold);
+		appendStats(output, "flush", flush);
+		return output;
+	}
+
+	LogMetrics::Histogram::Histogram()
+		:mCount(0), mTotalTicks(0), mMaxTicks(0)
+	{
+		for (auto& bucket : mBuckets)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void LogMetrics::Histogram::record(uint64_t ticks)
+	{
+		mBuckets[getBucket(ticks)].fetch_add(1, std::memory_order_relaxed);
+		mCount.fetch_add(1, std::memory_order_relaxed);
+		mTotalTicks.fetch_add(ticks, std::memory_order_relaxed);
+
+		uint64_t maxTicks = mMaxTicks.load(std::memory_order_relaxed);
+		while (ticks > maxTicks && !mMaxTicks.compare_exchange_weak(maxTicks, ticks, std::memory_order_relaxed))
+		{ }
+	}
+
+	LatencyStats LogMetrics::Histogram::getStats(double nsPerTick) const
+	{
+		LatencyStats stats;
+		stats.count = mCount.load(std::memory_order_relaxed);
+		stats.meanNs = stats.count > 0 ?
+			static_cast<double>(mTotalTicks.load(std::memory_order_relaxed)) * nsPerTick / stats.count : 0.0;
+		stats.maxNs = static_cast<double>(mMaxTicks.load(std::memory_order_relaxed)) * nsPerTick;
+		stats.p50Ns = 0.0;
+		stats.p99Ns = 0.0;
+
+		// Bucket i contains durations in [2^(i-1), 2^i) ticks
+		uint64_t seen = 0;
+		bool medianFound = false;
+		for (size_t i = 0; i < BucketCount && stats.count > 0; ++i)
+		{
+			seen += mBuckets[i].load(std::memory_order_relaxed);
+			double upperBound = std::min(static_cast<double>(i < 64 ? (1ull << i) : ~0ull) * nsPerTick, stats.maxNs);
+			if (!medianFound && seen * 2 >= stats.count)
+			{
+				stats.p50Ns = upperBound;
+				medianFound = true;
+			}
+			if (seen * 100 >= stats.count * 99)
+			{
+				stats.p99Ns = upperBound;
+				break;
+			}
+		}
+		return stats;
+	}
+
+	LogMetrics::ThreadCounters::ThreadCounters()
+		:suppressed(0)
+	{
+		for (auto& counter : records)
+		{
+			counter.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	LogMetrics::ThreadCounters& LogMetrics::getThreadCounters()
+	{
+		// Counters of a finished thread are added to the sums of the registry
+		struct Holder
+		{
+			ThreadCounters counters;
+
+			Holder()
+			{
+				CountersRegistry& registry = getRegistry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				registry.threads.push_back(&counters);
+			}
+
+			~Holder()
+			{
+				CountersRegistry& registry = getRegistry();
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				for (size_t i = 0; i < 4; ++i)
+				{
+					registry.finishedRecords[i] += counters.records[i].load(std::memory_order_relaxed);
+				}
+				registry.finishedSuppressed += counters.suppressed.load(std::memory_order_relaxed);
+				registry.threads.erase(std::remove(registry.threads.begin(), registry.threads.end(), &counters),
+					registry.threads.end());
+			}
+		};
+		thread_local Holder holder;
+		return holder.counters;
+	}
+
+	LogMetricsSnapshot LogMetrics::getSnapshot()
+	{
+		LogMetricsSnapshot snapshot;
+		{
+			CountersRegistry& registry = getRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			for (size_t i = 0; i < 4; ++i)
+			{
+				snapshot.records[i] = registry.finishedRecords[i];
+			}
+			snapshot.suppressedLogs = registry.finishedSuppressed;
+
+			for (const void* thread : registry.threads)
+			{
+				const ThreadCounters* counters = static_cast<const ThreadCounters*>(thread);
+				for (size_t i = 0; i < 4; ++i)
+				{
+					snapshot.records[i] += counters->records[i].load(std::memory_order_relaxed);
+				}
+				snapshot.suppressedLogs += counters->suppressed.load(std::memory_order_relaxed);
+			}
+		}
+
+		snapshot.bytesWritten = mBytesWritten.load(std::memory_order_relaxed);
+		snapshot.asyncQueueHighWater = mAsyncQueueHighWater.load(std::memory_order_relaxed);
+
+		snapshot.droppedLogs = Logger::getDroppedLogsCount();
+		{
+			std::lock_guard<std::mutex> lock(Logger::mLogMutex);
+			for (const auto& sink : Logger::mSinks)
+			{
+				snapshot.droppedLogs += sink.second->getDroppedLogsCount();
+			}
+			if (Logger::mMappedLogFile)
+			{
+				snapshot.droppedLogs += Logger::mMappedLogFile->getDroppedRecordsCount();
+			}
+		}
+
+		snapshot.syncedQueueHighWater = 0;
+		for (const auto& threadStats : Logger::getThreadStats())
+		{
+			snapshot.syncedQueueHighWater = std::max(snapshot.syncedQueueHighWater, threadStats.maxPendingLogs);
+		}
+
+		double nsPerTick = 1e9 / LogClock::ticksPerSecond();
+		snapshot.lockHold = mLockHold.getStats(nsPerTick);
+		snapshot.flush = mFlush.getStats(nsPerTick);
+		return snapshot;
+	}
+
+	void LogMetrics::startPeriodicLog(std::chrono::milliseconds period, Logger::LogType logType)
+	{
+		stopPeriodicLog();
+
+		PeriodicLog& periodicLog = getPeriodicLog();
+		std::lock_guard<std::mutex> lock(periodicLog.mutex);
+		periodicLog.stop = false;
+		periodicLog.thread = std::thread([period, logType, &periodicLog]() {
+			std::unique_lock<std::mutex> threadLock(periodicLog.mutex);
+			while (!periodicLog.wakeUp.wait_for(threadLock, period, [&periodicLog]() { return periodicLog.stop; }))
+			{
+				threadLock.unlock();
+				Logger::writeSimpleLog(getSnapshot().toString(), "metrics", "LogMetrics", logType);
+				threadLock.lock();
+			}
+		});
+	}
+
+	void LogMetrics::stopPeriodicLog()
+	{
+		PeriodicLog& periodicLog = getPeriodicLog();
+		{
+			std::lock_guard<std::mutex> lock(periodicLog.mutex);
+			if (!periodicLog.thread.joinable()) { return; }
+			periodicLog.stop = true;
+		}
+		periodicLog.wakeUp.notify_one();
+		periodicLog.thread.join();
+	}
+}
@@ -0,0 +1,178 @@
+/*
+   LogMetrics measures what logging costs: records per log type, bytes of
+   outputted records, dropped and suppressed records, high-water marks
+   of asynchronous and synced queues, time spent holding Logger's output
+   lock and latency of sink flushes. Counters incremented by producers are
+   per-thread (single writer, summed by getSnapshot), the rest are updated
+   by relaxed atomics, mostly while the output lock is held anyway.
+   Durations are measured in LogClock ticks and collected in histograms with
+   power-of-two buckets, they are converted to nanoseconds only in snapshots
+   (with a coarse fallback clock short durations are reported as 0).
+   Snapshot might be written periodically as a metrics log (startPeriodicLog).
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "Logger.h"
+
+namespace protolib
+{
+	// Summary of measured durations in nanoseconds
+	struct LatencyStats
+	{
+		uint64_t count;
+		double meanNs;
+		double p50Ns;		// Upper bound of the histogram bucket containing the median
+		double p99Ns;		// Upper bound of the histogram bucket containing the 99th percentile
+		double maxNs;
+	};
+
+	struct LogMetricsSnapshot
+	{
+		uint64_t records[4];			// Outputted records indexed by Logger::LogType
+		uint64_t bytesWritten;			// Bytes of outputted records (counted once regardless of number of sinks)
+		uint64_t droppedLogs;			// Dropped by full asynchronous queue, added sinks or mapped log file
+		uint64_t suppressedLogs;		// Suppressed by LogSiteLimiter
+		size_t asyncQueueHighWater;		// Maximal number of records in the asynchronous queue
+		size_t syncedQueueHighWater;	// Maximal number of pending records of a thread in synced mode
+		LatencyStats lockHold;			// Time spent holding the output lock
+		LatencyStats flush;				// Duration of sending buffered records to the destination of a sink
+
+		/**
+		Formats the snapshot as a single line of key=value pairs
+
+		@return formatted snapshot
+		*/
+		std::string toString() const;
+	};
+
+	class LogMetrics
+	{
+	private:
+		// Histogram of durations with power-of-two buckets of ticks
+		class Histogram
+		{
+		private:
+			static const size_t BucketCount = 65;
+
+			std::atomic<uint64_t> mBuckets[BucketCount];
+			std::atomic<uint64_t> mCount;
+			std::atomic<uint64_t> mTotalTicks;
+			std::atomic<uint64_t> mMaxTicks;
+		public:
+			Histogram();
+
+			void record(uint64_t ticks);
+
+			LatencyStats getStats(double nsPerTick) const;
+		};
+
+		// Counters written only by their owner thread
+		struct ThreadCounters
+		{
+			std::atomic<uint64_t> records[4];
+			std::atomic<uint64_t> suppressed;
+
+			ThreadCounters();
+		};
+
+		static std::atomic<uint64_t> mBytesWritten;
+		static std::atomic<size_t> mAsyncQueueHighWater;
+		static Histogram mLockHold;
+		static Histogram mFlush;
+
+		static ThreadCounters& getThreadCounters();
+
+		static void increment(std::atomic<uint64_t>& counter)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	public:
+		/**
+		Counts an outputted record
+
+		@param logType type of the record
+		*/
+		static void countRecord(Logger::LogType logType)
+		{
+			increment(getThreadCounters().records[static_cast<int>(logType)]);
+		}
+
+		/**
+		Counts a record suppressed by LogSiteLimiter
+		*/
+		static void countSuppressed()
+		{
+			increment(getThreadCounters().suppressed);
+		}
+
+		/**
+		Adds bytes of outputted records
+
+		@param bytes number of bytes
+		*/
+		static void addBytesWritten(size_t bytes)
+		{
+			mBytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+		}
+
+		/**
+		Updates high-water mark of the asynchronous queue
+
+		@param depth current number of records in the queue
+		*/
+		static void updateAsyncQueueHighWater(size_t depth)
+		{
+			size_t highWater = mAsyncQueueHighWater.load(std::memory_order_relaxed);
+			while (depth > highWater &&
+				!mAsyncQueueHighWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed))
+			{ }
+		}
+
+		/**
+		Records time for which the output lock was held
+
+		@param ticks duration in LogClock ticks
+		*/
+		static void recordLockHold(uint64_t ticks)
+		{
+			mLockHold.record(ticks);
+		}
+
+		/**
+		Records duration of a sink flush
+
+		@param ticks duration in LogClock ticks
+		*/
+		static void recordFlush(uint64_t ticks)
+		{
+			mFlush.record(ticks);
+		}
+
+		/**
+		Returns current values of all metrics (counters are cumulative since the start of the program)
+
+		@return snapshot of metrics
+		*/
+		static LogMetricsSnapshot getSnapshot();
+
+		/**
+		Starts a background thread which periodically writes the snapshot
+		as a log with message "metrics" and the formatted snapshot
+
+		@param period time between two metrics logs
+		@param logType type of metrics logs
+		*/
+		static void startPeriodicLog(std::chrono::milliseconds period, Logger::LogType logType = Logger::LogType::INF);
+
+		/**
+		Stops periodic metrics logs
+		*/
+		static void stopPeriodicLog();
+	};
+}
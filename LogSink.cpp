@@ -0,0 +1,698 @@
+#include "LogSink.h"
+#include "LogClock.h"
+#include "LogMetrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace protolib
+{
+	const size_t LogSink::HardLimitBytes;
+	const size_t LogSink::BlockSize;
+
+	LogSink::LogSink(const FlushPolicy& policy)
+		:mPolicy(policy), mUsedBlocks(0), mBufferedBytes(0), mBufferedRecords(0), mDroppedRecords(0)
+	{ }
+
+	void LogSink::setFlushPolicy(const FlushPolicy& policy)
+	{
+		mPolicy = policy;
+		if (shouldFlush(false))
+		{
+			flush();
+		}
+	}
+
+	bool LogSink::shouldFlush(bool isError) const
+	{
+		if (mBufferedRecords == 0) { return false; }
+
+		if ((isError && mPolicy.flushOnError) ||
+			mBufferedBytes >= std::min(mPolicy.maxBufferedBytes, HardLimitBytes) ||
+			(mPolicy.maxBufferedRecords > 0 && mBufferedRecords >= mPolicy.maxBufferedRecords))
+		{
+			return true;
+		}
+
+		return mPolicy.maxDelay.count() > 0 &&
+			std::chrono::steady_clock::now() - mOldestRecordTime >= mPolicy.maxDelay;
+	}
+
+	void LogSink::write(const char* data, size_t length, bool isError, size_t records)
+	{
+		if (mBufferedRecords == 0 && mPolicy.maxDelay.count() > 0)
+		{
+			mOldestRecordTime = std::chrono::steady_clock::now();
+		}
+
+		// Records never straddle blocks, oversized ones get a block of their own
+		if (mUsedBlocks == 0 || mBlocks[mUsedBlocks - 1].size() + length > mBlocks[mUsedBlocks - 1].capacity())
+		{
+			if (mUsedBlocks == mBlocks.size())
+			{
+				mBlocks.emplace_back();
+				mBlocks.back().reserve(std::max(BlockSize, length));
+			}
+			++mUsedBlocks;
+		}
+
+		mBlocks[mUsedBlocks - 1].append(data, length);
+		mBufferedBytes += length;
+		mBufferedRecords += records;
+
+		if (shouldFlush(isError))
+		{
+			flush();
+		}
+	}
+
+	void LogSink::flush()
+	{
+		if (mBufferedRecords == 0) { return; }
+
+		mChunks.clear();
+		for (size_t i = 0; i < mUsedBlocks; ++i)
+		{
+			mChunks.emplace_back(mBlocks[i].data(), mBlocks[i].size());
+		}
+
+		uint64_t start = LogClock::now();
+		writeChunks(mChunks);
+		LogMetrics::recordFlush(LogClock::now() - start);
+
+		// Blocks keep their capacity so the steady state is allocation-free
+		for (size_t i = 0; i < mUsedBlocks; ++i)
+		{
+			mBlocks[i].clear();
+		}
+		mUsedBlocks = 0;
+		mBufferedBytes = 0;
+		mBufferedRecords = 0;
+	}
+
+	void LogSink::flushIfDue()
+	{
+		if (mBufferedRecords > 0 && mPolicy.maxDelay.count() > 0 &&
+			std::chrono::steady_clock::now() - mOldestRecordTime >= mPolicy.maxDelay)
+		{
+			flush();
+		}
+	}
+
+	bool LogSink::getFlushDeadline(std::chrono::steady_clock::time_point& deadline) const
+	{
+		if (mBufferedRecords == 0 || mPolicy.maxDelay.count() <= 0) { return false; }
+
+		deadline = mOldestRecordTime + mPolicy.maxDelay;
+		return true;
+	}
+
+	StreamSink::StreamSink(std::ostream& stream, const FlushPolicy& policy)
+		:LogSink(policy), mStream(stream)
+	{ }
+
+	StreamSink::~StreamSink()
+	{
+		flush();
+	}
+
+	void StreamSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		for (const auto& chunk : chunks)
+		{
+			mStream.write(chunk.first, chunk.second);
+		}
+		mStream.flush();
+	}
+
+#if defined(__unix__) || defined(__APPLE__)
+	namespace
+	{
+#ifdef MSG_NOSIGNAL
+		const int socketSendFlags = MSG_NOSIGNAL;
+#else
+		const int socketSendFlags = 0;
+#endif
+
+		// Writes all chunks by as few writev (sendmsg for sockets) calls as possible
+		bool writeChunksToFd(int fd, const std::vector<std::pair<const char*, size_t>>& chunks, bool isSocket = false)
+		{
+			const size_t maxIov = 64;
+			struct iovec iov[maxIov];
+
+			for (size_t base = 0; base < chunks.size(); base += maxIov)
+			{
+				size_t count = std::min(maxIov, chunks.size() - base);
+				for (size_t i = 0; i < count; ++i)
+				{
+					iov[i].iov_base = const_cast<char*>(chunks[base + i].first);
+					iov[i].iov_len = chunks[base + i].second;
+				}
+
+				size_t first = 0;
+				while (first < count)
+				{
+					ssize_t written;
+					if (isSocket)
+					{
+						// sendmsg is used instead of writev so that closed connection doesn't raise SIGPIPE
+						struct msghdr message;
+						memset(&message, 0, sizeof(message));
+						message.msg_iov = iov + first;
+						message.msg_iovlen = count - first;
+						written = ::sendmsg(fd, &message, socketSendFlags);
+					}
+					else
+					{
+						written = ::writev(fd, iov + first, static_cast<int>(count - first));
+					}
+
+					if (written < 0)
+					{
+						if (errno == EINTR) { continue; }
+						// Nothing sensible to do with the logs if the destination is not writable
+						return false;
+					}
+
+					// Skips fully written chunks and adjusts partially written one
+					size_t remaining = static_cast<size_t>(written);
+					while (first < count && remaining >= iov[first].iov_len)
+					{
+						remaining -= iov[first].iov_len;
+						++first;
+					}
+					if (remaining > 0)
+					{
+						iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+						iov[first].iov_len -= remaining;
+					}
+				}
+			}
+			return true;
+		}
+	}
+
+	FileSink::FileSink(const std::string& fileName, const FlushPolicy& policy)
+		:LogSink(policy)
+	{
+		mFd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (mFd < 0)
+		{
+			throw std::runtime_error("Unable to open log file " + fileName);
+		}
+	}
+
+	FileSink::~FileSink()
+	{
+		flush();
+		::close(mFd);
+	}
+
+	void FileSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		writeChunksToFd(mFd, chunks);
+	}
+#else
+	FileSink::FileSink(const std::string& fileName, const FlushPolicy& policy)
+		:LogSink(policy), mFile(fileName)
+	{
+		if (!mFile.is_open())
+		{
+			throw std::runtime_error("Unable to open log file " + fileName);
+		}
+	}
+
+	FileSink::~FileSink()
+	{
+		flush();
+	}
+
+	void FileSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		for (const auto& chunk : chunks)
+		{
+			mFile.write(chunk.first, chunk.second);
+		}
+		mFile.flush();
+	}
+#endif
+
+	namespace
+	{
+		std::tm toLocalTime(std::time_t time)
+		{
+			std::tm result;
+#if defined(__unix__) || defined(__APPLE__)
+			localtime_r(&time, &result);
+#elif defined(_MSC_VER)
+			localtime_s(&result, &time);
+#else
+			result = *std::localtime(&time);
+#endif
+			return result;
+		}
+	}
+
+	void RotatingFileSink::updateNextRotationTime()
+	{
+		auto sinceEpoch = std::chrono::duration_cast<std::chrono::seconds>(
+			std::chrono::system_clock::now().time_since_epoch());
+		mNextRotationTime = std::chrono::system_clock::time_point(
+			(sinceEpoch / mRotation.interval + 1) * mRotation.interval);
+	}
+
+	std::string RotatingFileSink::getRotatedName(size_t index, std::time_t time) const
+	{
+		const std::string& pattern = mRotation.namePattern;
+		std::string result;
+		for (size_t i = 0; i < pattern.size(); ++i)
+		{
+			if (pattern[i] != '%' || i + 1 == pattern.size())
+			{
+				result += pattern[i];
+				continue;
+			}
+
+			char specifier = pattern[++i];
+			if (specifier == 'n')
+			{
+				result += mFileName;
+			}
+			else if (specifier == 'i')
+			{
+				result += std::to_string(index);
+			}
+			else if (specifier == 't')
+			{
+				char buffer[32];
+				std::tm localTime = toLocalTime(time);
+				std::strftime(buffer, sizeof(buffer), "%Y%m%d-%H%M%S", &localTime);
+				result += buffer;
+			}
+			else
+			{
+				result += '%';
+				result += specifier;
+			}
+		}
+		return result;
+	}
+
+	void RotatingFileSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		if (mRotation.interval.count() > 0 && std::chrono::system_clock::now() >= mNextRotationTime)
+		{
+			if (mFileBytes > 0)
+			{
+				rotate();
+			}
+			updateNextRotationTime();
+		}
+
+		mPieces.clear();
+		for (const auto& chunk : chunks)
+		{
+			const char* data = chunk.first;
+			size_t length = chunk.second;
+			while (length > 0)
+			{
+				size_t part = length;
+				if (mRotation.maxBytes > 0 && mFileBytes + length > mRotation.maxBytes)
+				{
+					// Only complete records are written before the rotation
+					size_t fits = mFileBytes < mRotation.maxBytes ? mRotation.maxBytes - mFileBytes : 0;
+					while (fits > 0 && data[fits - 1] != '\n') { --fits; }
+
+					if (fits > 0)
+					{
+						part = fits;
+					}
+					else if (mFileBytes > 0)
+					{
+						writePieces();
+						rotate();
+						continue;
+					}
+					else
+					{
+						// Record longer than maxBytes is written whole to the empty file
+						const char* newLine = static_cast<const char*>(memchr(data, '\n', length));
+						part = newLine != nullptr ? static_cast<size_t>(newLine - data) + 1 : length;
+					}
+				}
+
+				mPieces.emplace_back(data, part);
+				mFileBytes += part;
+				data += part;
+				length -= part;
+			}
+		}
+		writePieces();
+	}
+
+#if defined(__unix__) || defined(__APPLE__)
+	RotatingFileSink::RotatingFileSink(const std::string& fileName, const RotationPolicy& rotation,
+		const FlushPolicy& policy)
+		:LogSink(policy), mFileName(fileName), mRotation(rotation), mFileBytes(0), mNextIndex(1),
+		mSpareFd(-1), mTempCounter(0), mStop(false)
+	{
+		mFd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (mFd < 0)
+		{
+			throw std::runtime_error("Unable to open log file " + fileName);
+		}
+
+		if (mRotation.interval.count() > 0)
+		{
+			updateNextRotationTime();
+		}
+		mWorker = std::thread(&RotatingFileSink::worker, this);
+	}
+
+	RotatingFileSink::~RotatingFileSink()
+	{
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(mTasksMutex);
+			mStop = true;
+		}
+		mTasksCv.notify_one();
+		mWorker.join();
+
+		::close(mFd);
+		if (mSpareFd >= 0)
+		{
+			::close(mSpareFd);
+			std::remove(mSpareName.c_str());
+		}
+	}
+
+	void RotatingFileSink::writePieces()
+	{
+		if (!mPieces.empty())
+		{
+			writeChunksToFd(mFd, mPieces);
+			mPieces.clear();
+		}
+	}
+
+	void RotatingFileSink::rotate()
+	{
+		std::unique_lock<std::mutex> lock(mTasksMutex);
+		int newFd = mSpareFd;
+		std::string newFileName = mSpareName;
+		mSpareFd = -1;
+
+		if (newFd < 0)
+		{
+			// Background thread didn't manage to prepare the file in time
+			newFileName = mFileName + ".next" + std::to_string(mTempCounter++);
+			lock.unlock();
+			newFd = ::open(newFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			lock.lock();
+			if (newFd < 0)
+			{
+				// Logs keep going to the current file, rotation is attempted again after maxBytes
+				mFileBytes = 0;
+				return;
+			}
+		}
+
+		mTasks.push_back(RotationTask{ mFd, newFileName, mNextIndex++, std::time(nullptr) });
+		mFd = newFd;
+		mFileBytes = 0;
+		lock.unlock();
+		mTasksCv.notify_one();
+	}
+
+	void RotatingFileSink::finishRotation(const RotationTask& task)
+	{
+		::close(task.fd);
+
+		// Writer already uses the new file so both renames are invisible to it
+		std::string rotatedName = getRotatedName(task.index, task.time);
+		std::rename(mFileName.c_str(), rotatedName.c_str());
+		std::rename(task.newFileName.c_str(), mFileName.c_str());
+
+		if (mRotation.onRotated)
+		{
+			mRotation.onRotated(rotatedName);
+		}
+
+		mRotatedFiles.push_back(rotatedName);
+		while (mRotation.maxFiles > 0 && mRotatedFiles.size() > mRotation.maxFiles)
+		{
+			std::remove(mRotatedFiles.front().c_str());
+			mRotatedFiles.pop_front();
+		}
+	}
+
+	void RotatingFileSink::worker()
+	{
+		std::unique_lock<std::mutex> lock(mTasksMutex);
+		while (true)
+		{
+			while (!mTasks.empty())
+			{
+				RotationTask task = mTasks.front();
+				mTasks.pop_front();
+				lock.unlock();
+				finishRotation(task);
+				lock.lock();
+			}
+
+			if (mStop) { return; }
+
+			if (mSpareFd < 0)
+			{
+				// Writer only takes the spare file, so no other one can appear while unlocked
+				std::string spareName = mFileName + ".next" + std::to_string(mTempCounter++);
+				lock.unlock();
+				int spareFd = ::open(spareName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				lock.lock();
+				if (spareFd >= 0)
+				{
+					mSpareFd = spareFd;
+					mSpareName = spareName;
+				}
+			}
+
+			mTasksCv.wait(lock, [this]() { return mStop || !mTasks.empty(); });
+		}
+	}
+#else
+	RotatingFileSink::RotatingFileSink(const std::string& fileName, const RotationPolicy& rotation,
+		const FlushPolicy& policy)
+		:LogSink(policy), mFileName(fileName), mRotation(rotation), mFileBytes(0), mNextIndex(1), mFile(fileName)
+	{
+		if (!mFile.is_open())
+		{
+			throw std::runtime_error("Unable to open log file " + fileName);
+		}
+
+		if (mRotation.interval.count() > 0)
+		{
+			updateNextRotationTime();
+		}
+	}
+
+	RotatingFileSink::~RotatingFileSink()
+	{
+		flush();
+	}
+
+	void RotatingFileSink::writePieces()
+	{
+		for (const auto& piece : mPieces)
+		{
+			mFile.write(piece.first, piece.second);
+		}
+		mFile.flush();
+		mPieces.clear();
+	}
+
+	void RotatingFileSink::rotate()
+	{
+		// Without POSIX semantics an open file can't be renamed, so the rotation is synchronous
+		mFile.close();
+		std::string rotatedName = getRotatedName(mNextIndex++, std::time(nullptr));
+		std::rename(mFileName.c_str(), rotatedName.c_str());
+		mFile.open(mFileName);
+		mFileBytes = 0;
+
+		if (mRotation.onRotated)
+		{
+			mRotation.onRotated(rotatedName);
+		}
+
+		mRotatedFiles.push_back(rotatedName);
+		while (mRotation.maxFiles > 0 && mRotatedFiles.size() > mRotation.maxFiles)
+		{
+			std::remove(mRotatedFiles.front().c_str());
+			mRotatedFiles.pop_front();
+		}
+	}
+#endif
+
+	RingSink::RingSink(size_t capacity, const FlushPolicy& policy)
+		:LogSink(policy), mRing(std::max<size_t>(capacity, 1)), mWrittenBytes(0)
+	{ }
+
+	RingSink::~RingSink()
+	{
+		flush();
+	}
+
+	void RingSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		const size_t capacity = mRing.size();
+		for (const auto& chunk : chunks)
+		{
+			// Only the tail of a chunk longer than the ring can be kept
+			const char* data = chunk.first;
+			size_t length = chunk.second;
+			if (length > capacity)
+			{
+				mWrittenBytes += length - capacity;
+				data += length - capacity;
+				length = capacity;
+			}
+
+			size_t position = mWrittenBytes % capacity;
+			size_t firstPart = std::min(length, capacity - position);
+			memcpy(mRing.data() + position, data, firstPart);
+			memcpy(mRing.data(), data + firstPart, length - firstPart);
+			mWrittenBytes += length;
+		}
+	}
+
+	std::string RingSink::getContent() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		const size_t capacity = mRing.size();
+		if (mWrittenBytes <= capacity)
+		{
+			return std::string(mRing.data(), mWrittenBytes);
+		}
+
+		size_t position = mWrittenBytes % capacity;
+		std::string content(mRing.data() + position, capacity - position);
+		content.append(mRing.data(), position);
+
+		size_t firstLineEnd = content.find('\n');
+		return firstLineEnd == std::string::npos ? std::string() : content.substr(firstLineEnd + 1);
+	}
+
+	size_t RingSink::getWrittenBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mWrittenBytes;
+	}
+
+#if defined(__unix__) || defined(__APPLE__)
+	UnixSocketSink::UnixSocketSink(const std::string& path, const FlushPolicy& policy)
+		:LogSink(policy), mPath(path), mSocket(-1)
+	{
+		if (!connectSocket())
+		{
+			throw std::runtime_error("Unable to connect to socket " + path);
+		}
+	}
+
+	UnixSocketSink::~UnixSocketSink()
+	{
+		flush();
+		if (mSocket >= 0)
+		{
+			::close(mSocket);
+		}
+	}
+
+	bool UnixSocketSink::connectSocket()
+	{
+		mLastConnectAttempt = std::chrono::steady_clock::now();
+
+		struct sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		if (mPath.size() >= sizeof(address.sun_path)) { return false; }
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, mPath.c_str(), mPath.size());
+
+		mSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (mSocket < 0) { return false; }
+
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+		int noSigPipe = 1;
+		::setsockopt(mSocket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+		if (::connect(mSocket, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			::close(mSocket);
+			mSocket = -1;
+			return false;
+		}
+		return true;
+	}
+
+	void UnixSocketSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		if (mSocket < 0 && (std::chrono::steady_clock::now() - mLastConnectAttempt < std::chrono::seconds(1) ||
+			!connectSocket()))
+		{
+			return;
+		}
+
+		if (!writeChunksToFd(mSocket, chunks, true))
+		{
+			::close(mSocket);
+			mSocket = -1;
+		}
+	}
+#else
+	UnixSocketSink::UnixSocketSink(const std::string& path, const FlushPolicy& policy)
+		:LogSink(policy), mPath(path), mSocket(-1)
+	{
+		throw std::runtime_error("UNIX-domain sockets are not supported on this platform");
+	}
+
+	UnixSocketSink::~UnixSocketSink()
+	{ }
+
+	bool UnixSocketSink::connectSocket()
+	{
+		return false;
+	}
+
+	void UnixSocketSink::writeChunks(const std::vector<std::pair<const char*, size_t>>&)
+	{ }
+#endif
+
+	CallbackSink::CallbackSink(const std::function<void(const char*, size_t)>& callback, const FlushPolicy& policy)
+		:LogSink(policy), mCallback(callback)
+	{ }
+
+	CallbackSink::~CallbackSink()
+	{
+		flush();
+	}
+
+	void CallbackSink::writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks)
+	{
+		for (const auto& chunk : chunks)
+		{
+			mCallback(chunk.first, chunk.second);
+		}
+	}
+}
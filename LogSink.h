@@ -0,0 +1,403 @@
+/*
+   LogSink is a destination of formatted log records (console, file, ...).
+   Records are collected in large user-space blocks and sent to the
+   underlying destination in batches according to the FlushPolicy,
+   file sinks pass all blocks to a single writev call.
+   RotatingFileSink additionally switches to a new file according to
+   the RotationPolicy, file operations are done by its background thread.
+   RingSink keeps last records in memory, UnixSocketSink sends records
+   to a local UNIX-domain stream socket and CallbackSink passes them
+   to a user function.
+   Sinks are not thread-safe, synchronization is up to their owner
+   (see AsyncSink.h for sinks with their own queue and thread).
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace protolib
+{
+	/**
+	Determines when buffered records are sent to the destination,
+	buffer is flushed as soon as any of the enabled conditions is met
+	*/
+	struct FlushPolicy
+	{
+		size_t maxBufferedBytes;				// Flush when this many bytes are buffered
+		size_t maxBufferedRecords;				// Flush after this many records (0 = no limit)
+		std::chrono::milliseconds maxDelay;		// Flush when the oldest buffered record is older (0 = no limit)
+		bool flushOnError;						// Flush immediately after error records
+
+		FlushPolicy(size_t maxBufferedBytes = 64 * 1024, size_t maxBufferedRecords = 0,
+			std::chrono::milliseconds maxDelay = std::chrono::milliseconds(1000), bool flushOnError = true)
+			:maxBufferedBytes(maxBufferedBytes), maxBufferedRecords(maxBufferedRecords),
+			maxDelay(maxDelay), flushOnError(flushOnError)
+		{ }
+
+		/**
+		Policy flushing every single record (behavior of std::endl)
+
+		@return corresponding policy
+		*/
+		static FlushPolicy everyRecord()
+		{
+			return FlushPolicy(0, 1, std::chrono::milliseconds(0), true);
+		}
+
+		/**
+		Policy flushing only on explicit flush() call
+		(or when the hard limit of buffered bytes is reached)
+
+		@return corresponding policy
+		*/
+		static FlushPolicy explicitOnly()
+		{
+			return FlushPolicy(std::numeric_limits<size_t>::max(), 0, std::chrono::milliseconds(0), false);
+		}
+	};
+
+	/**
+	Determines when a log file is rotated and how many rotated files are kept
+	*/
+	struct RotationPolicy
+	{
+		size_t maxBytes;						// Maximal size of a file (0 = no limit)
+		std::chrono::seconds interval;			// Rotate at multiples of interval since epoch (0 = never)
+		size_t maxFiles;						// Number of kept rotated files, older are deleted (0 = keep all)
+		std::string namePattern;				// Name of rotated file, %n = file name, %i = index, %t = time
+		std::function<void(const std::string&)> onRotated;	// Called from background thread with name of
+															// each rotated file (e.g. to compress it)
+
+		RotationPolicy(size_t maxBytes = 0, std::chrono::seconds interval = std::chrono::seconds(0),
+			size_t maxFiles = 0, const std::string& namePattern = "%n.%i")
+			:maxBytes(maxBytes), interval(interval), maxFiles(maxFiles), namePattern(namePattern)
+		{ }
+	};
+
+	class LogSink
+	{
+	private:
+		// Upper bound of buffered data regardless of the policy
+		static const size_t HardLimitBytes = 16 * 1024 * 1024;
+		static const size_t BlockSize = 64 * 1024;
+
+		FlushPolicy mPolicy;
+		std::vector<std::string> mBlocks;
+		std::vector<std::pair<const char*, size_t>> mChunks;
+		size_t mUsedBlocks;
+		size_t mBufferedBytes;
+		size_t mBufferedRecords;
+		std::chrono::steady_clock::time_point mOldestRecordTime;
+		std::atomic<size_t> mDroppedRecords;
+
+		bool shouldFlush(bool isError) const;
+	protected:
+		/**
+		Counts records which couldn't be written to the destination
+
+		@param records number of records
+		*/
+		void addDroppedRecords(size_t records)
+		{
+			mDroppedRecords.fetch_add(records, std::memory_order_relaxed);
+		}
+
+		/**
+		Sends data to the destination
+
+		@param chunks pointers & lengths of data chunks to be written in the given order
+		*/
+		virtual void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) = 0;
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param policy flush policy
+		*/
+		explicit LogSink(const FlushPolicy& policy);
+
+		LogSink(const LogSink&) = delete;
+		LogSink& operator=(const LogSink&) = delete;
+
+		/**
+		Destructor of derived class must call flush() since
+		writeChunks is not available here anymore
+		*/
+		virtual ~LogSink() { }
+
+		/**
+		Returns current flush policy
+
+		@return flush policy
+		*/
+		const FlushPolicy& getFlushPolicy() const
+		{
+			return mPolicy;
+		}
+
+		/**
+		Sets new flush policy
+
+		@param policy new flush policy
+		*/
+		void setFlushPolicy(const FlushPolicy& policy);
+
+		/**
+		Appends one or more complete records (including line endings)
+
+		@param data formatted records
+		@param length length of data
+		@param isError true if data contain an error record
+		@param records number of records in data
+		*/
+		void write(const char* data, size_t length, bool isError = false, size_t records = 1);
+
+		/**
+		Sends buffered records to the destination
+		*/
+		void flush();
+
+		/**
+		Flushes the buffer if the oldest record is older than the time limit
+		of the policy (to be called periodically, e.g. by a background thread)
+		*/
+		void flushIfDue();
+
+		/**
+		Returns time when flushIfDue sends the buffered records because of the time limit of the policy
+
+		@param deadline set to the time of the flush, if there is any
+		@return true if buffered records wait for the time limit, false otherwise
+		*/
+		bool getFlushDeadline(std::chrono::steady_clock::time_point& deadline) const;
+
+		/**
+		Returns number of records which the sink failed to write to its destination
+		(might be called from any thread)
+
+		@return number of dropped records
+		*/
+		size_t getDroppedRecordsCount() const
+		{
+			return mDroppedRecords.load(std::memory_order_relaxed);
+		}
+	};
+
+	// Sink writing to std::ostream (typically std::cout)
+	class StreamSink : public LogSink
+	{
+	private:
+		std::ostream& mStream;
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param stream output stream (must outlive the sink)
+		@param policy flush policy
+		*/
+		StreamSink(std::ostream& stream, const FlushPolicy& policy = FlushPolicy::everyRecord());
+
+		~StreamSink() override;
+	};
+
+	// Sink writing to a file (via writev on POSIX systems)
+	class FileSink : public LogSink
+	{
+	private:
+#if defined(__unix__) || defined(__APPLE__)
+		int mFd;
+#else
+		std::ofstream mFile;
+#endif
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		/**
+		Main constructor to initialize the whole class
+		(file is truncated, throws std::runtime_error if it can't be opened)
+
+		@param fileName name of the file
+		@param policy flush policy
+		*/
+		FileSink(const std::string& fileName, const FlushPolicy& policy = FlushPolicy());
+
+		~FileSink() override;
+	};
+
+	// File sink which rotates the file, i.e. producers switch to an already opened
+	// new file and renaming, retention and onRotated callback are done in background.
+	// The new file is created as <file name>.next<N> and renamed once the finished
+	// file is moved away. Only files rotated by this instance are subject to retention.
+	class RotatingFileSink : public LogSink
+	{
+	private:
+		std::string mFileName;
+		RotationPolicy mRotation;
+		size_t mFileBytes;
+		size_t mNextIndex;
+		std::chrono::system_clock::time_point mNextRotationTime;
+		std::vector<std::pair<const char*, size_t>> mPieces;
+#if defined(__unix__) || defined(__APPLE__)
+		struct RotationTask
+		{
+			int fd;
+			std::string newFileName;
+			size_t index;
+			std::time_t time;
+		};
+
+		int mFd;
+		std::deque<std::string> mRotatedFiles;	// Used only by the background thread
+		// Following members are guarded by mTasksMutex
+		std::deque<RotationTask> mTasks;
+		int mSpareFd;
+		std::string mSpareName;
+		size_t mTempCounter;
+		bool mStop;
+		std::mutex mTasksMutex;
+		std::condition_variable mTasksCv;
+		std::thread mWorker;
+
+		void worker();
+
+		void finishRotation(const RotationTask& task);
+#else
+		std::ofstream mFile;
+		std::deque<std::string> mRotatedFiles;
+#endif
+
+		void updateNextRotationTime();
+
+		std::string getRotatedName(size_t index, std::time_t time) const;
+
+		void writePieces();
+
+		void rotate();
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		/**
+		Main constructor to initialize the whole class
+		(file is truncated, throws std::runtime_error if it can't be opened)
+
+		@param fileName name of the active log file
+		@param rotation rotation policy
+		@param policy flush policy
+		*/
+		RotatingFileSink(const std::string& fileName, const RotationPolicy& rotation,
+			const FlushPolicy& policy = FlushPolicy());
+
+		~RotatingFileSink() override;
+	};
+
+	// Sink keeping only the last records in memory (e.g. for diagnostics),
+	// content might be read by other threads while the sink is written
+	class RingSink : public LogSink
+	{
+	private:
+		std::vector<char> mRing;
+		size_t mWrittenBytes;
+		mutable std::mutex mMutex;
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param capacity number of kept bytes
+		@param policy flush policy (records become visible only once they are flushed)
+		*/
+		explicit RingSink(size_t capacity = 1024 * 1024, const FlushPolicy& policy = FlushPolicy::everyRecord());
+
+		~RingSink() override;
+
+		/**
+		Returns kept records, record which was partially overwritten is omitted
+
+		@return kept records (including line endings)
+		*/
+		std::string getContent() const;
+
+		/**
+		Returns total number of bytes written to the sink
+
+		@return number of bytes
+		*/
+		size_t getWrittenBytes() const;
+	};
+
+	// Sink sending records to a local UNIX-domain stream socket (e.g. of a log collector).
+	// If the connection is lost, the sink reconnects on the next flush (at most once per second)
+	// and records flushed while disconnected are lost.
+	class UnixSocketSink : public LogSink
+	{
+	private:
+		std::string mPath;
+		int mSocket;
+		std::chrono::steady_clock::time_point mLastConnectAttempt;
+
+		bool connectSocket();
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		/**
+		Main constructor to initialize the whole class (throws std::runtime_error
+		if the socket can't be connected or UNIX-domain sockets are not supported)
+
+		@param path path of the listening socket
+		@param policy flush policy
+		*/
+		UnixSocketSink(const std::string& path, const FlushPolicy& policy = FlushPolicy());
+
+		~UnixSocketSink() override;
+
+		/**
+		Checks whether the socket is currently connected
+
+		@return true if connected, false otherwise
+		*/
+		bool isConnected() const
+		{
+			return mSocket >= 0;
+		}
+	};
+
+	// Sink passing records to a user function, data contain one or more complete records.
+	// The function must not write logs through Logger when the sink is added by Logger::addSink.
+	class CallbackSink : public LogSink
+	{
+	private:
+		std::function<void(const char*, size_t)> mCallback;
+	protected:
+		void writeChunks(const std::vector<std::pair<const char*, size_t>>& chunks) override;
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param callback function called with data & length of flushed records
+		@param policy flush policy
+		*/
+		CallbackSink(const std::function<void(const char*, size_t)>& callback,
+			const FlushPolicy& policy = FlushPolicy::everyRecord());
+
+		~CallbackSink() override;
+	};
+}
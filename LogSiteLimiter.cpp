@@ -0,0 +1,118 @@
+#include "LogSiteLimiter.h"
+#include <algorithm>
+#include <string>
+
+namespace protolib
+{
+	std::mutex LogSiteLimiter::mRegistryMutex;
+	std::vector<LogSiteLimiter*> LogSiteLimiter::mRegistry;
+
+	LogSiteLimiter::LogSiteLimiter(const char* file, size_t line, Logger::LogType logType, Mode mode, size_t count,
+		std::chrono::milliseconds window)
+		:mFile(file), mLine(line), mLogType(logType), mMode(mode), mCount(std::max<size_t>(count, 1)),
+		mIntervalTicks(0), mBurstTolerance(0), mCounter(0), mWindowStart(0), mTheoreticalArrival(0), mSuppressed(0)
+	{
+		if (mode == Mode::FIRST_N && window.count() > 0)
+		{
+			mIntervalTicks = static_cast<uint64_t>(LogClock::ticksPerSecond() * window.count() / 1000.0);
+			mWindowStart.store(LogClock::now(), std::memory_order_relaxed);
+		}
+		registerLimiter();
+	}
+
+	LogSiteLimiter::LogSiteLimiter(const char* file, size_t line, Logger::LogType logType, double logsPerSecond,
+		size_t burst)
+		:mFile(file), mLine(line), mLogType(logType), mMode(Mode::TOKEN_BUCKET), mCount(std::max<size_t>(burst, 1)),
+		mIntervalTicks(0), mBurstTolerance(0), mCounter(0), mWindowStart(0), mTheoreticalArrival(0), mSuppressed(0)
+	{
+		mIntervalTicks = static_cast<uint64_t>(LogClock::ticksPerSecond() / std::max(logsPerSecond, 1e-9));
+		mBurstTolerance = mIntervalTicks * (mCount - 1);
+		mTheoreticalArrival.store(LogClock::now(), std::memory_order_relaxed);
+		registerLimiter();
+	}
+
+	LogSiteLimiter::~LogSiteLimiter()
+	{
+		std::lock_guard<std::mutex> lock(mRegistryMutex);
+		mRegistry.erase(std::remove(mRegistry.begin(), mRegistry.end(), this), mRegistry.end());
+	}
+
+	void LogSiteLimiter::registerLimiter()
+	{
+		std::lock_guard<std::mutex> lock(mRegistryMutex);
+		mRegistry.push_back(this);
+	}
+
+	bool LogSiteLimiter::isAllowed()
+	{
+		if (mMode == Mode::EVERY_NTH)
+		{
+			return mCounter.fetch_add(1, std::memory_order_relaxed) % mCount == 0;
+		}
+		else if (mMode == Mode::FIRST_N)
+		{
+			if (mIntervalTicks > 0)
+			{
+				// Only the thread which wins the CAS starts the new window (count is approximate under races),
+				// window start is loaded first and compared so that a window just moved by another thread
+				// (to a time later than this thread's clock reading) is never moved backwards
+				uint64_t windowStart = mWindowStart.load(std::memory_order_relaxed);
+				uint64_t now = LogClock::now();
+				if (now > windowStart && now - windowStart >= mIntervalTicks &&
+					mWindowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed))
+				{
+					mCounter.store(0, std::memory_order_relaxed);
+				}
+			}
+
+			// Counter is not incremented once the limit is reached so it can't overflow
+			size_t counter = mCounter.load(std::memory_order_relaxed);
+			while (counter < mCount)
+			{
+				if (mCounter.compare_exchange_weak(counter, counter + 1, std::memory_order_relaxed))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Token bucket implemented as generic cell rate algorithm, i.e. single timestamp
+		// of the theoretical arrival of the next log is advanced by the interval for each passing log
+		uint64_t now = LogClock::now();
+		uint64_t arrival = mTheoreticalArrival.load(std::memory_order_relaxed);
+		while (true)
+		{
+			uint64_t base = std::max(arrival, now);
+			if (base - now > mBurstTolerance)
+			{
+				return false;
+			}
+
+			if (mTheoreticalArrival.compare_exchange_weak(arrival, base + mIntervalTicks, std::memory_order_relaxed))
+			{
+				return true;
+			}
+		}
+	}
+
+	void LogSiteLimiter::reportSuppressed(size_t suppressed) const
+	{
+		if (suppressed == 0) { return; }
+
+		Logger::writeSimpleInfoLog("suppressed " + std::to_string(suppressed) + " similar messages",
+			mFile, mLogType, mLine);
+	}
+
+	void LogSiteLimiter::reportAllSuppressed()
+	{
+		std::lock_guard<std::mutex> lock(mRegistryMutex);
+		for (LogSiteLimiter* limiter : mRegistry)
+		{
+			if (limiter->mMode != Mode::EVERY_NTH)
+			{
+				limiter->reportSuppressed(limiter->mSuppressed.exchange(0, std::memory_order_relaxed));
+			}
+		}
+	}
+}
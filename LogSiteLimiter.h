@@ -0,0 +1,148 @@
+/*
+   LogSiteLimiter throttles logs of a single call site so that a misbehaving
+   loop can't flood the output. Supported modes are logging of every Nth
+   occurrence, token bucket (rate with allowed burst) and first N occurrences
+   per time window. The decision is made by lock-free counters before
+   the log statement (and thus formatting) is evaluated. Suppressed
+   occurrences are reported by a summary log ("suppressed N similar messages")
+   just before the next log which passes, or by reportAllSuppressed().
+   Limiters are typically created by PROTOLIB_LOG_EVERY_N,
+   PROTOLIB_LOG_RATE_LIMITED and PROTOLIB_LOG_FIRST_N macros
+   defined at the end of this file.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "Logger.h"
+#include "LogMetrics.h"
+
+namespace protolib
+{
+	class LogSiteLimiter
+	{
+	public:
+		enum class Mode
+		{
+			EVERY_NTH = 1,		// Every Nth occurrence passes (1st, N+1st, ...)
+			TOKEN_BUCKET,		// Occurrences pass at given rate, with given burst
+			FIRST_N,			// First N occurrences pass in each time window
+		};
+	private:
+		const char* mFile;
+		size_t mLine;
+		Logger::LogType mLogType;
+		Mode mMode;
+		size_t mCount;
+		uint64_t mIntervalTicks;		// Window (FIRST_N) or time between tokens (TOKEN_BUCKET)
+		uint64_t mBurstTolerance;		// How far in future mTheoreticalArrival might be
+		std::atomic<size_t> mCounter;
+		std::atomic<uint64_t> mWindowStart;
+		std::atomic<uint64_t> mTheoreticalArrival;
+		std::atomic<size_t> mSuppressed;
+
+		static std::mutex mRegistryMutex;
+		static std::vector<LogSiteLimiter*> mRegistry;
+
+		bool isAllowed();
+
+		void reportSuppressed(size_t suppressed) const;
+
+		void registerLimiter();
+	public:
+		/**
+		Creates limiter in EVERY_NTH or FIRST_N mode
+
+		@param file file of the call site
+		@param line line of the call site
+		@param logType type of logs of the call site (used by summary logs)
+		@param mode EVERY_NTH or FIRST_N
+		@param count N
+		@param window length of the window in FIRST_N mode (0 = whole program run)
+		*/
+		LogSiteLimiter(const char* file, size_t line, Logger::LogType logType, Mode mode, size_t count,
+			std::chrono::milliseconds window = std::chrono::milliseconds(0));
+
+		/**
+		Creates limiter in TOKEN_BUCKET mode
+
+		@param file file of the call site
+		@param line line of the call site
+		@param logType type of logs of the call site (used by summary logs)
+		@param logsPerSecond sustained rate of passing logs
+		@param burst maximal number of logs which pass at once
+		*/
+		LogSiteLimiter(const char* file, size_t line, Logger::LogType logType, double logsPerSecond, size_t burst);
+
+		LogSiteLimiter(const LogSiteLimiter&) = delete;
+		LogSiteLimiter& operator=(const LogSiteLimiter&) = delete;
+
+		~LogSiteLimiter();
+
+		/**
+		Decides whether the current occurrence should be logged,
+		writes summary of suppressed occurrences first if there are any
+
+		@return true if the log should be written, false if it is suppressed
+		*/
+		bool allow()
+		{
+			if (!isAllowed())
+			{
+				mSuppressed.fetch_add(1, std::memory_order_relaxed);
+				LogMetrics::countSuppressed();
+				return false;
+			}
+
+			if (mMode != Mode::EVERY_NTH && mSuppressed.load(std::memory_order_relaxed) > 0)
+			{
+				reportSuppressed(mSuppressed.exchange(0, std::memory_order_relaxed));
+			}
+			return true;
+		}
+
+		/**
+		Returns number of suppressed occurrences which haven't been reported yet
+
+		@return number of suppressed occurrences
+		*/
+		size_t getSuppressedCount() const
+		{
+			return mSuppressed.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Writes summary logs of all limiters with unreported suppressed occurrences
+		(e.g. periodically or before the end of the program)
+		*/
+		static void reportAllSuppressed();
+	};
+}
+
+// Executes log statement only for every Nth occurrence at this call site
+// ------
+// Example usage:
+// PROTOLIB_LOG_EVERY_N(WAR, 1000, PROTOLIB_LOG_VAR(WAR, queueSize));
+// ------
+#define PROTOLIB_LOG_EVERY_N(type, n, statement) PROTOLIB_LOG_IF_ENABLED(type, \
+	static ::protolib::LogSiteLimiter protolibLimiter(__FILE__, __LINE__, ::protolib::Logger::LogType::type, \
+		::protolib::LogSiteLimiter::Mode::EVERY_NTH, (n)); \
+	if (protolibLimiter.allow()) { statement; })
+
+// Executes log statement at most logsPerSecond times per second (with given burst) at this call site
+#define PROTOLIB_LOG_RATE_LIMITED(type, logsPerSecond, burst, statement) PROTOLIB_LOG_IF_ENABLED(type, \
+	static ::protolib::LogSiteLimiter protolibLimiter(__FILE__, __LINE__, ::protolib::Logger::LogType::type, \
+		(logsPerSecond), (burst)); \
+	if (protolibLimiter.allow()) { statement; })
+
+// Executes log statement only for first n occurrences in each window of windowMs milliseconds
+// (0 = whole program run) at this call site, suppressed occurrences are summarized
+#define PROTOLIB_LOG_FIRST_N(type, n, windowMs, statement) PROTOLIB_LOG_IF_ENABLED(type, \
+	static ::protolib::LogSiteLimiter protolibLimiter(__FILE__, __LINE__, ::protolib::Logger::LogType::type, \
+		::protolib::LogSiteLimiter::Mode::FIRST_N, (n), std::chrono::milliseconds(windowMs)); \
+	if (protolibLimiter.allow()) { statement; })
@@ -1,68 +1,708 @@
 #include "Logger.h"
+#include "AsyncSink.h"
+#include "LogMetrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <utility>
 
 namespace protolib
 {
-	std::queue<Logger::Log> Logger::mLogs;
 	std::mutex Logger::mLogMutex;
 	bool Logger::mLogToFileOnly = false;
-	bool Logger::mLoggingEnabled = true;
-	bool Logger::mSyncedLogging = false;
-	std::ofstream Logger::mLogFile;
+	std::atomic<bool> Logger::mLoggingEnabled(true);
+	std::atomic<int> Logger::mLogLevel(static_cast<int>(Logger::LogType::DBG));
+	std::atomic<int> Logger::mCaptureLevel(static_cast<int>(Logger::LogType::DBG));
+	std::unique_ptr<FlightRecorder> Logger::mFlightRecorder;
+	std::atomic<FlightRecorder*> Logger::mActiveRecorder(nullptr);
+	std::atomic<int> Logger::mRecorderLevel(static_cast<int>(Logger::LogType::DBG));
+	std::string Logger::mFlightRecorderFile;
+	std::atomic<bool> Logger::mSyncedLogging(false);
+	std::vector<std::shared_ptr<Logger::ThreadLogBuffer>> Logger::mThreadBuffers;
+	std::mutex Logger::mThreadBuffersMutex;
+	std::atomic<bool> Logger::mTimestampOutput(false);
+	std::atomic<bool> Logger::mThreadIndexOutput(false);
+	bool Logger::mConsoleOutput = true;
+	std::unique_ptr<LogSink> Logger::mConsoleSink(new StreamSink(std::cout, FlushPolicy::everyRecord()));
+	std::unique_ptr<LogSink> Logger::mFileSink;
+	FlushPolicy Logger::mFileFlushPolicy;
+	std::unique_ptr<MappedLogFile> Logger::mMappedLogFile;
+	std::atomic<bool> Logger::mMappedLogging(false);
+	bool Logger::mMappedFileOnly = false;
+	std::vector<std::pair<size_t, std::unique_ptr<AsyncSink>>> Logger::mSinks;
+	std::atomic<bool> Logger::mSinksAdded(false);
+	size_t Logger::mNextSinkId = 0;
 
-	void Logger::resolveLog(const Log& newLog)
+	std::atomic<bool> Logger::mAsyncLogging(false);
+	std::unique_ptr<MpscRingBuffer<Logger::AsyncLog>> Logger::mAsyncQueue;
+	Logger::OverflowPolicy Logger::mOverflowPolicy = Logger::OverflowPolicy::BLOCK;
+	std::thread Logger::mAsyncThread;
+	std::mutex Logger::mAsyncControlMutex;
+	std::mutex Logger::mAsyncMutex;
+	std::condition_variable Logger::mAsyncWakeUp;
+	std::condition_variable Logger::mAsyncProcessedCv;
+	std::atomic<bool> Logger::mAsyncStop(false);
+	std::atomic<bool> Logger::mAsyncSleeping(false);
+	std::atomic<size_t> Logger::mAsyncProcessed(0);
+	std::atomic<size_t> Logger::mDroppedLogs(0);
+
+	namespace
+	{
+		// Stops the background thread (and outputs pending logs)
+		// before the static members above are destroyed
+		struct AsyncLoggingGuard
+		{
+			~AsyncLoggingGuard()
+			{
+				LogMetrics::stopPeriodicLog();
+				Logger::disableAsyncLogging();
+				Logger::flush();
+				Logger::removeSinks();
+				Logger::closeMappedLogFile();
+				Logger::disableFlightRecorder();
+			}
+		} asyncLoggingGuard;
+
+		// Lock guard of the output lock which records how long the lock was held
+		class TimedLockGuard
+		{
+		private:
+			std::lock_guard<std::mutex> mLock;
+			uint64_t mStart;
+		public:
+			explicit TimedLockGuard(std::mutex& mutex)
+				:mLock(mutex), mStart(LogClock::now())
+			{ }
+
+			~TimedLockGuard()
+			{
+				LogMetrics::recordLockHold(LogClock::now() - mStart);
+			}
+		};
+
+		uint16_t copyTruncated(char* destination, size_t capacity, const std::string& source)
+		{
+			size_t length = std::min(capacity, source.size());
+			memcpy(destination, source.data(), length);
+			return static_cast<uint16_t>(length);
+		}
+	}
+
+	Logger::ThreadLogBuffer& Logger::getThreadBuffer()
+	{
+		// Buffer outlives its thread so that logs written just before the exit are not lost
+		struct Holder
+		{
+			std::shared_ptr<ThreadLogBuffer> buffer;
+
+			~Holder()
+			{
+				if (buffer)
+				{
+					buffer->finished.store(true, std::memory_order_release);
+				}
+			}
+		};
+		thread_local Holder holder;
+
+		if (!holder.buffer)
+		{
+			std::lock_guard<std::mutex> lock(mThreadBuffersMutex);
+			holder.buffer = std::make_shared<ThreadLogBuffer>();
+			mThreadBuffers.push_back(holder.buffer);
+		}
+
+		return *holder.buffer;
+	}
+
+	void Logger::updateCaptureLevel()
+	{
+		int level = mLogLevel.load(std::memory_order_relaxed);
+		if (mActiveRecorder.load(std::memory_order_acquire) != nullptr)
+		{
+			level = std::min(level, mRecorderLevel.load(std::memory_order_relaxed));
+		}
+		mCaptureLevel.store(level, std::memory_order_relaxed);
+	}
+
+	bool Logger::recordLog(const std::string& message, const std::string& variableName,
+		const std::string& file, size_t line, LogType logType)
+	{
+		FlightRecorder* recorder = mActiveRecorder.load(std::memory_order_acquire);
+		if (recorder != nullptr && static_cast<int>(logType) >= mRecorderLevel.load(std::memory_order_relaxed))
+		{
+			// Record is formatted by the calling thread into a reused buffer
+			thread_local std::string recorded;
+			recorded.clear();
+			appendRecordInfo(recorded, LogClock::now(), LogClock::threadIndex());
+			appendFormattedLog(recorded, logType, file.data(), file.size(), line, variableName.data(),
+				variableName.size(), message.data(), message.size());
+			recorded += '\n';
+			recorder->record(recorded.data(), recorded.size());
+		}
+
+		// Only logs which pass the log level are outputted
+		if (static_cast<int>(logType) < mLogLevel.load(std::memory_order_relaxed)) { return false; }
+
+		LogMetrics::countRecord(logType);
+		return true;
+	}
+
+	void Logger::pushThreadLog(Log&& newLog)
+	{
+		ThreadLogBuffer& buffer = getThreadBuffer();
+		buffer.logs.push(std::move(newLog));
+
+		size_t pending = buffer.logs.size();
+		if (pending > buffer.maxPendingLogs.load(std::memory_order_relaxed))
+		{
+			buffer.maxPendingLogs.store(pending, std::memory_order_relaxed);
+		}
+	}
+
+	void Logger::appendRecordInfo(std::string& output, uint64_t timestamp, uint32_t threadIndex)
+	{
+		if (mTimestampOutput.load(std::memory_order_relaxed))
+		{
+			output += "[Time ";
+			LogClock::appendWallClock(output, LogClock::toWallClockNs(timestamp));
+			output += "] ";
+		}
+
+		if (mThreadIndexOutput.load(std::memory_order_relaxed))
+		{
+			output += "[Thread ";
+			Formatter::appendUnsigned(output, threadIndex);
+			output += "] ";
+		}
+	}
+
+	void Logger::appendFormattedLog(std::string& output, LogType logType, const char* file,
+		size_t fileLength, size_t line, const char* variableName, size_t variableNameLength,
+		const char* message, size_t messageLength)
 	{
-		if (mSyncedLogging)
+		output += "[File ";
+		if (fileLength > 0)
 		{
-			mLogs.push(newLog);
+			output.append(file, fileLength);
+			if (line > 0)
+			{
+				output += ':';
+				Formatter::appendUnsigned(output, line);
+			}
 		}
 		else
 		{
-			if (logToCout())
+			output += "NONE";
+		}
+		output += "] ";
+
+		output += "[Type ";
+		output += getTypeString(logType);
+		output += "] ";
+
+		if (variableNameLength > 0)
+		{
+			output.append(variableName, variableNameLength);
+			output += " = ";
+		}
+		output.append(message, messageLength);
+	}
+
+	void Logger::outputToSinks(const Log& log)
+	{
+		if (log.preformatted)
+		{
+			outputToSinks(log.message, log.logType == LogType::ERR, 1);
+			outputToAddedSinks(log.message.data(), log.message.size(), log.logType);
+			return;
+		}
+
+		std::string line;
+		appendRecordInfo(line, log.timestamp, log.threadIndex);
+		appendFormattedLog(line, log.logType, log.file.data(), log.file.size(), log.line,
+			log.variableName.data(), log.variableName.size(), log.message.data(), log.message.size());
+		line += '\n';
+
+		outputToSinks(line, log.logType == LogType::ERR, 1);
+		outputToAddedSinks(line.data(), line.size(), log.logType);
+	}
+
+	void Logger::outputToSinks(const std::string& data, bool containsError, size_t records)
+	{
+		LogMetrics::addBytesWritten(data.size());
+		if (mMappedLogging.load(std::memory_order_acquire))
+		{
+			mMappedLogFile->write(data.data(), data.size());
+			if (mMappedFileOnly) { return; }
+		}
+
+		if (logToCout())
+		{
+			mConsoleSink->write(data.data(), data.size(), containsError, records);
+		}
+
+		if (logToFile())
+		{
+			mFileSink->write(data.data(), data.size(), containsError, records);
+		}
+	}
+
+	void Logger::outputToAddedSinks(const char* data, size_t length, LogType logType)
+	{
+		for (auto& sink : mSinks)
+		{
+			sink.second->push(data, length, logType);
+		}
+	}
+
+	AsyncSink* Logger::findSink(size_t sinkId)
+	{
+		for (auto& sink : mSinks)
+		{
+			if (sink.first == sinkId)
 			{
-				outputToStream(std::cout, newLog);
+				return sink.second.get();
 			}
+		}
+		return nullptr;
+	}
 
-			if (logToFile())
+	template<typename Writer>
+	void Logger::pushAsyncRecord(Writer& writer)
+	{
+		while (!mAsyncQueue->tryPushWith(writer))
+		{
+			if (mOverflowPolicy == OverflowPolicy::DROP_NEWEST)
+			{
+				mDroppedLogs.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else if (mOverflowPolicy == OverflowPolicy::DROP_OLDEST)
 			{
-				outputToStream(mLogFile, newLog);
+				AsyncLog oldest;
+				if (mAsyncQueue->tryPop(oldest))
+				{
+					mDroppedLogs.fetch_add(1, std::memory_order_relaxed);
+					mAsyncProcessed.fetch_add(1, std::memory_order_release);
+				}
+			}
+			else
+			{
+				mAsyncWakeUp.notify_one();
+				std::this_thread::yield();
 			}
 		}
+
+		LogMetrics::updateAsyncQueueHighWater(mAsyncQueue->size());
+		wakeAsyncWorker();
 	}
 
-	void Logger::outputToStream(std::ostream& os, const Log& log)
+	void Logger::wakeAsyncWorker()
 	{
-		os << "[File ";
-		if (!log.file.empty())
+		// Pairs with the fence of the worker: either the worker sees the pushed record
+		// (or changed sink) before it sleeps, or this thread sees the flag
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (mAsyncSleeping.load(std::memory_order_relaxed))
 		{
-			os << log.file;
+			// Worker holds the mutex from setting the flag until it waits, so the notification can't be missed
+			{
+				std::lock_guard<std::mutex> lock(mAsyncMutex);
+			}
+			mAsyncWakeUp.notify_one();
 		}
-		else
+	}
+
+	void Logger::pushAsyncLog(const std::string& message, const std::string& variableName,
+		const std::string& file, size_t line, LogType logType)
+	{
+		auto writer = [&](AsyncLog& record) {
+			record.logType = logType;
+			record.line = static_cast<uint32_t>(line);
+			record.threadIndex = LogClock::threadIndex();
+			record.timestamp = LogClock::now();
+			record.preformatted = false;
+			record.fileLength = copyTruncated(record.text, AsyncLog::MaxFileLength, file);
+			char* variableNameText = record.text + record.fileLength;
+			record.variableNameLength = copyTruncated(variableNameText, AsyncLog::MaxVariableNameLength, variableName);
+			char* messageText = variableNameText + record.variableNameLength;
+			record.messageLength = copyTruncated(messageText,
+				AsyncLog::MaxTextLength - record.fileLength - record.variableNameLength, message);
+		};
+
+		pushAsyncRecord(writer);
+	}
+
+	void Logger::dispatchLog(const std::string& message, const std::string& variableName,
+		const std::string& file, size_t line, LogType logType)
+	{
+		if (!recordLog(message, variableName, file, line, logType)) { return; }
+
+		if (mAsyncLogging.load(std::memory_order_acquire))
 		{
-			os << "NONE";
+			pushAsyncLog(message, variableName, file, line, logType);
+			return;
 		}
-		os << "] ";
 
-		os << "[Type " << log.getTypeString() << "] ";
+		Log newLog;
+		newLog.message = message;
+		newLog.variableName = variableName;
+		newLog.file = file;
+		newLog.line = line;
+		newLog.logType = logType;
+		newLog.timestamp = LogClock::now();
+		newLog.threadIndex = LogClock::threadIndex();
+		newLog.preformatted = false;
 
-		if (log.variableName.empty())
+		if (mSyncedLogging.load(std::memory_order_acquire))
 		{
-			os << log.message << std::endl;
+			pushThreadLog(std::move(newLog));
+			return;
 		}
-		else
+
+		if (mMappedLogging.load(std::memory_order_acquire) && mMappedFileOnly &&
+			!mSinksAdded.load(std::memory_order_acquire))
+		{
+			// Mapped file is thread-safe on its own so no lock is needed
+			std::string formattedLog;
+			appendRecordInfo(formattedLog, newLog.timestamp, newLog.threadIndex);
+			appendFormattedLog(formattedLog, newLog.logType, newLog.file.data(), newLog.file.size(), newLog.line,
+				newLog.variableName.data(), newLog.variableName.size(), newLog.message.data(), newLog.message.size());
+			formattedLog += '\n';
+			mMappedLogFile->write(formattedLog.data(), formattedLog.size());
+			LogMetrics::addBytesWritten(formattedLog.size());
+			return;
+		}
+
+		TimedLockGuard lock(mLogMutex);
+		outputToSinks(newLog);
+	}
+
+	void Logger::dispatchRawLog(const std::string& line, LogType logType, uint64_t timestamp, uint32_t threadIndex)
+	{
+		FlightRecorder* recorder = mActiveRecorder.load(std::memory_order_acquire);
+		if (recorder != nullptr && static_cast<int>(logType) >= mRecorderLevel.load(std::memory_order_relaxed))
+		{
+			recorder->record(line.data(), line.size());
+		}
+		if (static_cast<int>(logType) < mLogLevel.load(std::memory_order_relaxed)) { return; }
+		LogMetrics::countRecord(logType);
+
+		if (mAsyncLogging.load(std::memory_order_acquire))
+		{
+			if (line.size() <= AsyncLog::MaxTextLength)
+			{
+				auto writer = [&](AsyncLog& record) {
+					record.logType = logType;
+					record.line = 0;
+					record.threadIndex = threadIndex;
+					record.timestamp = timestamp;
+					record.preformatted = true;
+					record.fileLength = 0;
+					record.variableNameLength = 0;
+					record.messageLength = copyTruncated(record.text, AsyncLog::MaxTextLength, line);
+				};
+
+				pushAsyncRecord(writer);
+				return;
+			}
+			// Lines which don't fit into the record are outputted directly rather than truncated,
+			// i.e. possibly before older records which are still in the ring buffer
+		}
+		else if (mSyncedLogging.load(std::memory_order_acquire))
+		{
+			Log newLog;
+			newLog.message = line;
+			newLog.line = 0;
+			newLog.logType = logType;
+			newLog.timestamp = timestamp;
+			newLog.threadIndex = threadIndex;
+			newLog.preformatted = true;
+			pushThreadLog(std::move(newLog));
+			return;
+		}
+
+		if (mMappedLogging.load(std::memory_order_acquire) && mMappedFileOnly &&
+			!mSinksAdded.load(std::memory_order_acquire))
+		{
+			mMappedLogFile->write(line.data(), line.size());
+			LogMetrics::addBytesWritten(line.size());
+			return;
+		}
+
+		{
+			TimedLockGuard lock(mLogMutex);
+			outputToSinks(line, logType == LogType::ERR, 1);
+			outputToAddedSinks(line.data(), line.size(), logType);
+		}
+
+		// Worker has to know the flush deadline of the directly outputted line
+		if (mAsyncLogging.load(std::memory_order_acquire))
+		{
+			wakeAsyncWorker();
+		}
+	}
+
+	void Logger::asyncWorker()
+	{
+		const size_t maxBatchSize = 256;
+		AsyncLog record;
+		std::string buffer;
+		std::vector<std::pair<size_t, LogType>> recordEnds;
+
+		while (true)
+		{
+			size_t batchSize = 0;
+			bool containsError = false;
+			buffer.clear();
+			recordEnds.clear();
+
+			while (batchSize < maxBatchSize && mAsyncQueue->tryPop(record))
+			{
+				if (record.preformatted)
+				{
+					buffer.append(record.text, record.messageLength);
+				}
+				else
+				{
+					const char* variableName = record.text + record.fileLength;
+					const char* message = variableName + record.variableNameLength;
+					appendRecordInfo(buffer, record.timestamp, record.threadIndex);
+					appendFormattedLog(buffer, record.logType, record.text, record.fileLength, record.line,
+						variableName, record.variableNameLength, message, record.messageLength);
+					buffer += '\n';
+				}
+				recordEnds.push_back(std::make_pair(buffer.size(), record.logType));
+				containsError = containsError || record.logType == LogType::ERR;
+				++batchSize;
+			}
+
+			if (batchSize > 0)
+			{
+				{
+					TimedLockGuard lock(mLogMutex);
+					outputToSinks(buffer, containsError, batchSize);
+
+					size_t recordStart = 0;
+					for (const auto& recordEnd : recordEnds)
+					{
+						outputToAddedSinks(buffer.data() + recordStart, recordEnd.first - recordStart, recordEnd.second);
+						recordStart = recordEnd.first;
+					}
+				}
+
+				mAsyncProcessed.fetch_add(batchSize, std::memory_order_release);
+				{
+					std::lock_guard<std::mutex> lock(mAsyncMutex);
+				}
+				mAsyncProcessedCv.notify_all();
+				continue;
+			}
+
+			if (mAsyncStop.load(std::memory_order_acquire))
+			{
+				// Producers are not allowed to push after the stop flag is set
+				// and the queue was found empty so there is nothing left to do
+				return;
+			}
+
+			{
+				// Time limits of flush policies are enforced while idle
+				std::lock_guard<std::mutex> lock(mLogMutex);
+				mConsoleSink->flushIfDue();
+				if (logToFile())
+				{
+					mFileSink->flushIfDue();
+				}
+			}
+
+			std::unique_lock<std::mutex> lock(mAsyncMutex);
+			mAsyncSleeping.store(true, std::memory_order_relaxed);
+			// Pairs with the fence in wakeAsyncWorker
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (mAsyncQueue->size() == 0 && !mAsyncStop.load(std::memory_order_acquire))
+			{
+				// Worker sleeps until the earliest time limit of buffered records, or until it is woken up
+				std::chrono::steady_clock::time_point deadline;
+				bool hasDeadline = false;
+				{
+					std::lock_guard<std::mutex> logLock(mLogMutex);
+					hasDeadline = mConsoleSink->getFlushDeadline(deadline);
+					std::chrono::steady_clock::time_point fileDeadline;
+					if (logToFile() && mFileSink->getFlushDeadline(fileDeadline) &&
+						(!hasDeadline || fileDeadline < deadline))
+					{
+						deadline = fileDeadline;
+						hasDeadline = true;
+					}
+				}
+
+				if (hasDeadline)
+				{
+					mAsyncWakeUp.wait_until(lock, deadline);
+				}
+				else
+				{
+					mAsyncWakeUp.wait(lock);
+				}
+			}
+			mAsyncSleeping.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	void Logger::enableAsyncLogging(size_t capacity, OverflowPolicy policy)
+	{
+		disableAsyncLogging();
+
+		std::lock_guard<std::mutex> lock(mAsyncControlMutex);
+		mAsyncQueue.reset(new MpscRingBuffer<AsyncLog>(capacity));
+		mOverflowPolicy = policy;
+		mAsyncProcessed.store(0, std::memory_order_relaxed);
+		mAsyncStop.store(false, std::memory_order_relaxed);
+		mAsyncThread = std::thread(asyncWorker);
+		mAsyncLogging.store(true, std::memory_order_release);
+	}
+
+	void Logger::disableAsyncLogging()
+	{
+		std::lock_guard<std::mutex> lock(mAsyncControlMutex);
+		if (!mAsyncThread.joinable()) { return; }
+
+		mAsyncLogging.store(false, std::memory_order_release);
+		mAsyncStop.store(true, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> asyncLock(mAsyncMutex);
+		}
+		mAsyncWakeUp.notify_one();
+		mAsyncThread.join();
+
+		{
+			std::lock_guard<std::mutex> asyncLock(mAsyncMutex);
+		}
+		mAsyncProcessedCv.notify_all();
+	}
+
+	void Logger::flush()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mAsyncControlMutex);
+			if (mAsyncThread.joinable())
+			{
+				size_t target = mAsyncQueue->pushedCount();
+				mAsyncWakeUp.notify_one();
+
+				std::unique_lock<std::mutex> asyncLock(mAsyncMutex);
+				while (mAsyncProcessed.load(std::memory_order_acquire) < target)
+				{
+					mAsyncProcessedCv.wait_for(asyncLock, std::chrono::milliseconds(1));
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		mConsoleSink->flush();
+		if (logToFile())
+		{
+			mFileSink->flush();
+		}
+
+		for (auto& sink : mSinks)
+		{
+			sink.second->flush();
+		}
+	}
+
+	size_t Logger::addSink(std::unique_ptr<LogSink> sink, LogType minLogType, OverflowPolicy policy,
+		size_t queueCapacity)
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		size_t sinkId = mNextSinkId++;
+		mSinks.push_back(std::make_pair(sinkId,
+			std::unique_ptr<AsyncSink>(new AsyncSink(std::move(sink), minLogType, policy, queueCapacity))));
+		mSinksAdded.store(true, std::memory_order_release);
+		return sinkId;
+	}
+
+	bool Logger::removeSink(size_t sinkId)
+	{
+		std::unique_ptr<AsyncSink> removed;
+		{
+			std::lock_guard<std::mutex> lock(mLogMutex);
+			auto it = std::find_if(mSinks.begin(), mSinks.end(),
+				[sinkId](const std::pair<size_t, std::unique_ptr<AsyncSink>>& sink) { return sink.first == sinkId; });
+			if (it == mSinks.end()) { return false; }
+
+			removed = std::move(it->second);
+			mSinks.erase(it);
+			mSinksAdded.store(!mSinks.empty(), std::memory_order_release);
+		}
+
+		// Remaining records are written by the sink's thread outside of the lock
+		removed.reset();
+		return true;
+	}
+
+	void Logger::removeSinks()
+	{
+		std::vector<std::pair<size_t, std::unique_ptr<AsyncSink>>> removed;
 		{
-			os << log.variableName << " = " << log.message << std::endl;
+			std::lock_guard<std::mutex> lock(mLogMutex);
+			removed.swap(mSinks);
+			mSinksAdded.store(false, std::memory_order_release);
 		}
 	}
 
+	bool Logger::setSinkLogLevel(size_t sinkId, LogType minLogType)
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		AsyncSink* sink = findSink(sinkId);
+		if (sink == nullptr) { return false; }
+
+		sink->setMinLogType(minLogType);
+		return true;
+	}
+
+	size_t Logger::getSinkDroppedLogsCount(size_t sinkId)
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		AsyncSink* sink = findSink(sinkId);
+		return sink != nullptr ? sink->getDroppedLogsCount() : 0;
+	}
+
+	void Logger::setFileFlushPolicy(const FlushPolicy& policy)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mLogMutex);
+			mFileFlushPolicy = policy;
+			if (logToFile())
+			{
+				mFileSink->setFlushPolicy(policy);
+			}
+		}
+		// Sleeping worker has to notice the new time limit
+		wakeAsyncWorker();
+	}
+
+	void Logger::setConsoleFlushPolicy(const FlushPolicy& policy)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mLogMutex);
+			mConsoleSink->setFlushPolicy(policy);
+		}
+		wakeAsyncWorker();
+	}
+
 	void Logger::setLogFile(const std::string& logFileName, bool logToFileOnly)
 	{
 		std::lock_guard<std::mutex> lock(mLogMutex);
 		if (!mLoggingEnabled) { return; }
-		
+
 		try
 		{
-			closeLogFile();
-			mLogFile = std::ofstream(logFileName);
+			closeLogFileLocked();
+			mFileSink.reset(new FileSink(logFileName, mFileFlushPolicy));
 			mLogToFileOnly = logToFileOnly;
 		}
 		catch (std::exception& e)
@@ -71,43 +711,207 @@ namespace protolib
 		}
 	}
 
-	void Logger::syncedOutput()
+	void Logger::setRotatingLogFile(const std::string& logFileName, const RotationPolicy& rotation, bool logToFileOnly)
 	{
 		std::lock_guard<std::mutex> lock(mLogMutex);
 		if (!mLoggingEnabled) { return; }
-		
-		while (!mLogs.empty())
+
+		try
+		{
+			closeLogFileLocked();
+			mFileSink.reset(new RotatingFileSink(logFileName, rotation, mFileFlushPolicy));
+			mLogToFileOnly = logToFileOnly;
+		}
+		catch (std::exception& e)
 		{
-			if (logToCout())
+			std::cout << "[ERROR] During \"Logger::setRotatingLogFile\": " << e.what();
+		}
+	}
+
+	void Logger::closeLogFile()
+	{
+		// Asynchronous worker flushes the file sink under the same lock
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		closeLogFileLocked();
+	}
+
+	void Logger::closeLogFileLocked()
+	{
+		if (mFileSink)
+		{
+			mFileSink.reset();
+			mLogToFileOnly = false;
+		}
+	}
+
+	void Logger::setMappedLogFile(const std::string& baseName, bool logToFileOnly, size_t segmentSize)
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		if (!mLoggingEnabled) { return; }
+
+		try
+		{
+			mMappedLogging.store(false, std::memory_order_release);
+			mMappedLogFile.reset();
+			mMappedLogFile.reset(new MappedLogFile(baseName, segmentSize));
+			mMappedFileOnly = logToFileOnly;
+			mMappedLogging.store(true, std::memory_order_release);
+		}
+		catch (std::exception& e)
+		{
+			std::cout << "[ERROR] During \"Logger::setMappedLogFile\": " << e.what();
+		}
+	}
+
+	void Logger::closeMappedLogFile()
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		mMappedLogging.store(false, std::memory_order_release);
+		mMappedFileOnly = false;
+		mMappedLogFile.reset();
+	}
+
+	void Logger::enableFlightRecorder(const std::string& dumpFileName, size_t capacity, LogType recordedLogType,
+		bool installCrashHandlers)
+	{
+		disableFlightRecorder();
+
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		mFlightRecorder.reset(new FlightRecorder(capacity));
+		mFlightRecorderFile = dumpFileName;
+		mRecorderLevel.store(static_cast<int>(recordedLogType), std::memory_order_relaxed);
+		if (installCrashHandlers)
+		{
+			FlightRecorder::installCrashHandlers(mFlightRecorder.get(), dumpFileName);
+		}
+		mActiveRecorder.store(mFlightRecorder.get(), std::memory_order_release);
+		updateCaptureLevel();
+	}
+
+	void Logger::disableFlightRecorder()
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		if (!mFlightRecorder) { return; }
+
+		mActiveRecorder.store(nullptr, std::memory_order_release);
+		updateCaptureLevel();
+		FlightRecorder::uninstallCrashHandlers();
+		mFlightRecorder.reset();
+	}
+
+	bool Logger::dumpFlightRecorder(const std::string& reason)
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		return mFlightRecorder && mFlightRecorder->dump(mFlightRecorderFile.c_str(), reason.c_str());
+	}
+
+	std::string Logger::getFlightRecorderContent()
+	{
+		std::lock_guard<std::mutex> lock(mLogMutex);
+		return mFlightRecorder ? mFlightRecorder->getContent() : std::string();
+	}
+
+	void Logger::syncedOutput(bool orderByTimestamp)
+	{
+		// Holding mLogMutex makes this function the only consumer of thread buffers
+		TimedLockGuard lock(mLogMutex);
+		if (!mLoggingEnabled) { return; }
+
+		std::vector<std::shared_ptr<ThreadLogBuffer>> buffers;
+		{
+			std::lock_guard<std::mutex> buffersLock(mThreadBuffersMutex);
+			buffers = mThreadBuffers;
+		}
+
+		// Only logs present at the beginning are taken so that busy producers can't stall the output
+		std::vector<std::vector<Log>> drained(buffers.size());
+		for (size_t i = 0; i < buffers.size(); ++i)
+		{
+			size_t pending = buffers[i]->logs.size();
+			drained[i].resize(pending);
+			for (size_t j = 0; j < pending; ++j)
 			{
-				outputToStream(std::cout, mLogs.front());
+				buffers[i]->logs.tryPop(drained[i][j]);
 			}
+		}
 
-			if (logToFile())
+		if (orderByTimestamp)
+		{
+			// Logs of each thread are already ordered so k-way merge is sufficient,
+			// ties are resolved by the thread index
+			typedef std::pair<std::pair<uint64_t, size_t>, size_t> HeapItem;
+			std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem>> heads;
+			std::vector<size_t> positions(drained.size(), 0);
+			for (size_t i = 0; i < drained.size(); ++i)
 			{
-				outputToStream(mLogFile, mLogs.front());
+				if (!drained[i].empty())
+				{
+					heads.push(HeapItem(std::make_pair(drained[i][0].timestamp, buffers[i]->threadIndex), i));
+				}
 			}
 
-			mLogs.pop();
+			while (!heads.empty())
+			{
+				size_t i = heads.top().second;
+				heads.pop();
+				outputToSinks(drained[i][positions[i]]);
+				if (++positions[i] < drained[i].size())
+				{
+					heads.push(HeapItem(std::make_pair(drained[i][positions[i]].timestamp, buffers[i]->threadIndex), i));
+				}
+			}
+		}
+		else
+		{
+			for (const auto& threadLogs : drained)
+			{
+				for (const auto& log : threadLogs)
+				{
+					outputToSinks(log);
+				}
+			}
 		}
+
+		// Buffers of exited threads are released once they are empty
+		std::lock_guard<std::mutex> buffersLock(mThreadBuffersMutex);
+		mThreadBuffers.erase(std::remove_if(mThreadBuffers.begin(), mThreadBuffers.end(),
+			[](const std::shared_ptr<ThreadLogBuffer>& buffer) {
+				return buffer->finished.load(std::memory_order_acquire) && buffer->logs.size() == 0;
+			}), mThreadBuffers.end());
 	}
 
-	void Logger::writeSimpleInfoLog(const std::string& message, const std::string& file, LogType logType)
+	std::vector<Logger::ThreadStats> Logger::getThreadStats()
 	{
-		std::lock_guard<std::mutex> lock(mLogMutex);
-		if (!mLoggingEnabled) { return; }
+		std::lock_guard<std::mutex> lock(mThreadBuffersMutex);
+		std::vector<ThreadStats> stats;
+		stats.reserve(mThreadBuffers.size());
+		for (const auto& buffer : mThreadBuffers)
+		{
+			ThreadStats threadStats;
+			threadStats.threadIndex = buffer->threadIndex;
+			threadStats.threadId = buffer->threadId;
+			threadStats.writtenLogs = buffer->logs.pushedCount();
+			threadStats.pendingLogs = buffer->logs.size();
+			threadStats.maxPendingLogs = buffer->maxPendingLogs.load(std::memory_order_relaxed);
+			threadStats.finished = buffer->finished.load(std::memory_order_acquire);
+			stats.push_back(threadStats);
+		}
+		return stats;
+	}
 
-		Log newLog;
-		newLog.message = message;
-		newLog.file = file;
-		newLog.logType = logType;
+	void Logger::writeSimpleInfoLog(const std::string& message, const std::string& file, LogType logType, size_t line)
+	{
+		if (!isLogEnabled(logType)) { return; }
 
-		resolveLog(newLog);
+		dispatchLog(message, std::string(), file, line, logType);
 	}
 
-	void Logger::writeSimpleBoolLog(bool message, const std::string& condition, const std::string& file, LogType logType)
+	void Logger::writeSimpleBoolLog(bool message, const std::string& condition, const std::string& file,
+		LogType logType, size_t line)
 	{
+		if (!isLogEnabled(logType)) { return; }
+
 		std::string newMessage = condition + " is " + (message ? "true" : "false");
-		writeSimpleInfoLog(newMessage, file, logType);
+		dispatchLog(newMessage, std::string(), file, line, logType);
 	}
 }
@@ -2,6 +2,28 @@
    Logger is a fully static class designed with the aim to 
    simplify logging of events/messages during program execution.
    Logger utilizes mutexes to ensure thread-safety.
+   In synced mode every thread appends logs to its own lock-free buffer
+   so producers don't contend with each other.
+   Optionally, logs might be processed asynchronously, i.e. producers
+   only push fixed-size records into a lock-free ring buffer which is
+   emptied by a dedicated background thread.
+   Output goes through buffered sinks (see LogSink.h) whose flush
+   policies decide how often the console and the log file are flushed.
+   Additional sinks (see addSink) have their own queue, writer thread,
+   log level and overflow policy so that they don't slow down each other.
+   Alternatively, logs might be written to memory-mapped file segments
+   (see MappedLogFile.h) without any lock or system call on the hot path.
+   Optionally, the most recent records down to a more verbose level than
+   the log level are kept in an in-memory flight recorder (see FlightRecorder.h)
+   which is written to a file on demand or when the program crashes.
+   Every record captures cheap monotonic ticks and index of the calling
+   thread (see LogClock.h), ticks are converted to wall-clock time only
+   when the record is outputted with timestamps enabled.
+
+   PROTOLIB_LOG_* macros defined at the end of this file should be preferred
+   in performance-sensitive code. Logs below PROTOLIB_LOG_MIN_LEVEL
+   (which might be defined before including this file) are removed
+   during compilation and arguments of disabled logs are never evaluated.
 
 (c) 2017 David Kutak
 */
@@ -12,62 +34,216 @@
 #include <thread>
 #include <mutex>
 #include <string>
-#include <queue>
 #include <sstream>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include "FlightRecorder.h"
+#include "Formatter.h"
+#include "LogClock.h"
+#include "LogSink.h"
+#include "MappedLogFile.h"
+#include "MpscRingBuffer.h"
+#include "SpscQueue.h"
 
 namespace protolib
 {
+	class AsyncSink;
+
 	class Logger
 	{
+		// BinaryLogger formats decoded records the same way as Logger does
+		friend class BinaryLogger;
+		// StructuredLogger hands over complete preformatted lines
+		friend class StructuredLogger;
+		// LogMetrics reads counters of queues and sinks
+		friend class LogMetrics;
+		// NamedLogger formats its records the same way and propagates them to Logger
+		friend class NamedLogger;
 	public:
 		enum class LogType
 		{
-			INF = 1,
+			DBG = 0,
+			INF,
 			WAR,
 			ERR,
 		};
+
+		/**
+		Determines what happens when a log is written
+		in asynchronous mode and the ring buffer is full
+		*/
+		enum class OverflowPolicy
+		{
+			BLOCK = 1,		// Producer waits until there is a free slot
+			DROP_NEWEST,	// New log is discarded
+			DROP_OLDEST,	// Oldest log in the buffer is discarded to make space for the new one
+		};
+
+		// Statistics of a thread which has written logs in synced mode
+		struct ThreadStats
+		{
+			size_t threadIndex;			// Sequential index assigned on the first log of the thread
+			std::thread::id threadId;
+			size_t writtenLogs;			// Logs written since the thread's first log
+			size_t pendingLogs;			// Logs waiting for syncedOutput
+			size_t maxPendingLogs;		// High-water mark of pending logs
+			bool finished;				// Thread has already exited
+		};
 	private:
 		struct Log
 		{
 			std::string message;
 			std::string variableName;
 			std::string file;
+			size_t line;
 			LogType logType;
+			uint64_t timestamp;		// LogClock ticks
+			uint32_t threadIndex;
+			bool preformatted;		// Message is a complete output line
+		};
 
-			std::string getTypeString() const
-			{
-				if (logType == LogType::INF)
-				{
-					return "INF";
-				}
-				else if (logType == LogType::WAR)
-				{
-					return "WAR";
-				}
-				return "ERR";
-			}
+		// Logs of one thread in synced mode, the owner thread is
+		// the only producer and syncedOutput the only consumer
+		struct ThreadLogBuffer
+		{
+			size_t threadIndex;
+			std::thread::id threadId;
+			SpscQueue<Log> logs;
+			std::atomic<size_t> maxPendingLogs;
+			std::atomic<bool> finished;
+
+			ThreadLogBuffer()
+				:threadIndex(LogClock::threadIndex()), threadId(std::this_thread::get_id()), maxPendingLogs(0), finished(false)
+			{ }
+		};
+
+		// Fixed-size log record used in asynchronous mode, file, variable name
+		// and message are stored one after another in text, strings which don't fit are truncated
+		struct AsyncLog
+		{
+			static const size_t MaxFileLength = 64;
+			static const size_t MaxVariableNameLength = 64;
+			static const size_t MaxTextLength = 504;
+
+			LogType logType;
+			uint32_t line;
+			uint32_t threadIndex;
+			uint64_t timestamp;
+			uint16_t fileLength;
+			uint16_t variableNameLength;
+			uint16_t messageLength;
+			bool preformatted;		// Message is a complete output line
+			char text[MaxTextLength];
 		};
 
-		static std::queue<Log> mLogs;
 		static std::mutex mLogMutex;
 		static bool mLogToFileOnly;
-		static bool mLoggingEnabled;
-		static bool mSyncedLogging;
-		static std::ofstream mLogFile;
+		static std::atomic<bool> mLoggingEnabled;
+		static std::atomic<int> mLogLevel;
+		static std::atomic<int> mCaptureLevel;		// Lower of log level and flight recorder level
+		static std::unique_ptr<FlightRecorder> mFlightRecorder;
+		static std::atomic<FlightRecorder*> mActiveRecorder;
+		static std::atomic<int> mRecorderLevel;
+		static std::string mFlightRecorderFile;
+		static std::atomic<bool> mSyncedLogging;
+		static std::vector<std::shared_ptr<ThreadLogBuffer>> mThreadBuffers;
+		static std::mutex mThreadBuffersMutex;
+		static std::atomic<bool> mTimestampOutput;
+		static std::atomic<bool> mThreadIndexOutput;
+		static bool mConsoleOutput;
+		static std::unique_ptr<LogSink> mConsoleSink;
+		static std::unique_ptr<LogSink> mFileSink;
+		static FlushPolicy mFileFlushPolicy;
+		static std::unique_ptr<MappedLogFile> mMappedLogFile;
+		static std::atomic<bool> mMappedLogging;
+		static bool mMappedFileOnly;
+		static std::vector<std::pair<size_t, std::unique_ptr<AsyncSink>>> mSinks;
+		static std::atomic<bool> mSinksAdded;
+		static size_t mNextSinkId;
+
+		static std::atomic<bool> mAsyncLogging;
+		static std::unique_ptr<MpscRingBuffer<AsyncLog>> mAsyncQueue;
+		static OverflowPolicy mOverflowPolicy;
+		static std::thread mAsyncThread;
+		static std::mutex mAsyncControlMutex;
+		static std::mutex mAsyncMutex;
+		static std::condition_variable mAsyncWakeUp;
+		static std::condition_variable mAsyncProcessedCv;
+		static std::atomic<bool> mAsyncStop;
+		static std::atomic<bool> mAsyncSleeping;
+		static std::atomic<size_t> mAsyncProcessed;
+		static std::atomic<size_t> mDroppedLogs;
+
+		static const char* getTypeString(LogType logType)
+		{
+			if (logType == LogType::DBG)
+			{
+				return "DBG";
+			}
+			else if (logType == LogType::INF)
+			{
+				return "INF";
+			}
+			else if (logType == LogType::WAR)
+			{
+				return "WAR";
+			}
+			return "ERR";
+		}
 
 		static bool logToCout()
 		{
-			return !mLogToFileOnly;
+			return mConsoleOutput && !mLogToFileOnly;
 		}
 
 		static bool logToFile()
 		{
-			return mLogFile.is_open();
+			return mFileSink != nullptr;
 		}
 
-		static void resolveLog(const Log& newLog);
+		static ThreadLogBuffer& getThreadBuffer();
+
+		static void updateCaptureLevel();
+
+		static bool recordLog(const std::string& message, const std::string& variableName,
+			const std::string& file, size_t line, LogType logType);
+
+		static void pushThreadLog(Log&& newLog);
+
+		static void outputToSinks(const Log& log);
+
+		static void outputToSinks(const std::string& data, bool containsError, size_t records);
+
+		static void outputToAddedSinks(const char* data, size_t length, LogType logType);
 
-		static void outputToStream(std::ostream& os, const Log& log);
+		static AsyncSink* findSink(size_t sinkId);
+
+		static void appendRecordInfo(std::string& output, uint64_t timestamp, uint32_t threadIndex);
+
+		static void appendFormattedLog(std::string& output, LogType logType, const char* file,
+			size_t fileLength, size_t line, const char* variableName, size_t variableNameLength,
+			const char* message, size_t messageLength);
+
+		template<typename Writer>
+		static void pushAsyncRecord(Writer& writer);
+
+		static void pushAsyncLog(const std::string& message, const std::string& variableName,
+			const std::string& file, size_t line, LogType logType);
+
+		static void dispatchLog(const std::string& message, const std::string& variableName,
+			const std::string& file, size_t line, LogType logType);
+
+		static void dispatchRawLog(const std::string& line, LogType logType, uint64_t timestamp, uint32_t threadIndex);
+
+		static void asyncWorker();
+
+		// Wakes the sleeping asynchronous worker up after a record was pushed or sinks were changed
+		static void wakeAsyncWorker();
+
+		// Closes log file, caller must hold mLogMutex
+		static void closeLogFileLocked();
 	public:
 		/**
 		This function provides Logger with necessary information
@@ -75,19 +251,124 @@ namespace protolib
 
 		@param logFileName desired file name
 		@param logToFileOnly if set to true, logs will be outputted only to file and not to std::cout as well
+		Logs are buffered according to the file flush policy, time limit of the policy
+		is checked on each write (and periodically in asynchronous mode).
 		*/
 		static void setLogFile(const std::string& logFileName, bool logToFileOnly = false);
 
+		/**
+		Same as setLogFile but the log file is rotated according to the given policy.
+		Producers only switch to an already opened file, renaming of the finished
+		file and deletion of old files are done by a background thread.
+
+		@param logFileName desired file name (of the active log file)
+		@param rotation when to rotate and how many rotated files to keep
+		@param logToFileOnly if set to true, logs will be outputted only to file and not to std::cout as well
+		*/
+		static void setRotatingLogFile(const std::string& logFileName, const RotationPolicy& rotation,
+			bool logToFileOnly = false);
+
 		/**
 		Closes log file and enables outputting of logs to std::cout
 		*/
-		static void closeLogFile()
+		static void closeLogFile();
+
+		/**
+		Sets memory-mapped log file, logs are written to preallocated segments
+		<baseName>.0, <baseName>.1, ... (in addition to the log file set by setLogFile).
+		If logToFileOnly is set to true and logs are processed instantly (i.e. neither
+		synced nor asynchronous logging is enabled), write calls don't take any lock.
+		Should be called while other threads are not logging.
+
+		@param baseName base name of segment files
+		@param logToFileOnly if set to true, logs will be outputted only to the mapped file
+		@param segmentSize size of each segment in bytes
+		*/
+		static void setMappedLogFile(const std::string& baseName, bool logToFileOnly = false,
+			size_t segmentSize = 64 * 1024 * 1024);
+
+		/**
+		Closes memory-mapped log file (last segment is truncated to its written size).
+		Should be called while other threads are not logging.
+		*/
+		static void closeMappedLogFile();
+
+		/**
+		Sets flush policy of the log file (64 KiB, 1 s or error record by default),
+		applies also to log files set later
+
+		@param policy new flush policy
+		*/
+		static void setFileFlushPolicy(const FlushPolicy& policy);
+
+		/**
+		Sets flush policy of std::cout output (every record by default)
+
+		@param policy new flush policy
+		*/
+		static void setConsoleFlushPolicy(const FlushPolicy& policy);
+
+		/**
+		Adds a sink with its own bounded queue and writer thread, the sink receives
+		all processed records of at least given type regardless of the log file
+		and std::cout settings. Sinks are independent of each other, i.e. a slow
+		sink with a dropping overflow policy doesn't stall producers nor other sinks.
+
+		@param sink sink to be added (e.g. RingSink, UnixSocketSink or CallbackSink)
+		@param minLogType records of lower type are not sent to the sink
+		@param policy what to do with new records when the queue of the sink is full
+		@param queueCapacity capacity of the queue in bytes
+		@return ID of the sink
+		*/
+		static size_t addSink(std::unique_ptr<LogSink> sink, LogType minLogType = LogType::DBG,
+			OverflowPolicy policy = OverflowPolicy::DROP_NEWEST, size_t queueCapacity = 1024 * 1024);
+
+		/**
+		Removes a sink added by addSink, queued records are written first
+
+		@param sinkId ID returned by addSink
+		@return true if the sink was removed, false if there is no such sink
+		*/
+		static bool removeSink(size_t sinkId);
+
+		/**
+		Removes all sinks added by addSink
+		*/
+		static void removeSinks();
+
+		/**
+		Sets minimal type of records sent to a sink added by addSink
+
+		@param sinkId ID returned by addSink
+		@param minLogType records of lower type are not sent to the sink
+		@return true if the level was set, false if there is no such sink
+		*/
+		static bool setSinkLogLevel(size_t sinkId, LogType minLogType);
+
+		/**
+		Returns number of records discarded because of the full queue of a sink
+
+		@param sinkId ID returned by addSink
+		@return number of dropped records (0 if there is no such sink)
+		*/
+		static size_t getSinkDroppedLogsCount(size_t sinkId);
+
+		/**
+		Disables outputting of logs to std::cout (e.g. when console is added by addSink)
+		*/
+		static void disableConsoleOutput()
 		{
-			if (mLogFile.is_open())
-			{
-				mLogFile.close();
-				mLogToFileOnly = false;
-			}
+			std::lock_guard<std::mutex> lock(mLogMutex);
+			mConsoleOutput = false;
+		}
+
+		/**
+		Enables outputting of logs to std::cout (enabled by default)
+		*/
+		static void enableConsoleOutput()
+		{
+			std::lock_guard<std::mutex> lock(mLogMutex);
+			mConsoleOutput = true;
 		}
 
 		/**
@@ -96,8 +377,7 @@ namespace protolib
 		*/
 		static void disableLogging()
 		{
-			std::lock_guard<std::mutex> lock(mLogMutex);
-			mLoggingEnabled = false;
+			mLoggingEnabled.store(false, std::memory_order_relaxed);
 		}
 
 		/**
@@ -105,8 +385,113 @@ namespace protolib
 		*/
 		static void enableLogging()
 		{
-			std::lock_guard<std::mutex> lock(mLogMutex);
-			mLoggingEnabled = true;
+			mLoggingEnabled.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		Sets minimal type (severity) of logs which are processed,
+		logs of lower type are ignored (DBG by default, i.e. everything is processed)
+
+		@param minLogType minimal type of processed logs
+		*/
+		static void setLogLevel(LogType minLogType)
+		{
+			mLogLevel.store(static_cast<int>(minLogType), std::memory_order_relaxed);
+			updateCaptureLevel();
+		}
+
+		/**
+		Returns minimal type (severity) of logs which are processed
+
+		@return minimal type of processed logs
+		*/
+		static LogType getLogLevel()
+		{
+			return static_cast<LogType>(mLogLevel.load(std::memory_order_relaxed));
+		}
+
+		/**
+		Checks whether logs of given type would be processed (outputted
+		or kept by the flight recorder), the check is lock-free and cheap
+
+		@param logType type of log
+		@return true if logging is enabled and logType is not below log level
+		        or flight recorder level, false otherwise
+		*/
+		static bool isLogEnabled(LogType logType)
+		{
+			return mLoggingEnabled.load(std::memory_order_relaxed) &&
+				static_cast<int>(logType) >= mCaptureLevel.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Enables flight recorder, i.e. fixed-size in-memory ring of the most recent
+		formatted records of at least recordedLogType (even if they are below
+		the log level and thus not outputted). The ring is dumped to dumpFileName
+		by dumpFlightRecorder and, if installCrashHandlers is true, on fatal
+		signals and std::terminate. Should be called while other threads are not logging.
+
+		@param dumpFileName name of the file where the ring is dumped
+		@param capacity size of the ring in bytes
+		@param recordedLogType minimal type of recorded logs
+		@param installCrashHandlers if set to true, the ring is dumped when the program crashes
+		*/
+		static void enableFlightRecorder(const std::string& dumpFileName, size_t capacity = 1024 * 1024,
+			LogType recordedLogType = LogType::DBG, bool installCrashHandlers = true);
+
+		/**
+		Disables flight recorder (and uninstalls its crash handlers).
+		Should be called while other threads are not logging.
+		*/
+		static void disableFlightRecorder();
+
+		/**
+		Writes content of the flight recorder to its dump file
+
+		@param reason reason written to the header of the dump
+		@return true if the dump was written, false otherwise (e.g. recorder is disabled)
+		*/
+		static bool dumpFlightRecorder(const std::string& reason = "on demand");
+
+		/**
+		Returns content of the flight recorder
+
+		@return recorded records from the oldest one (empty if recorder is disabled)
+		*/
+		static std::string getFlightRecorderContent();
+
+		/**
+		Enables outputting of wall-clock time of records, i.e. each log
+		starts with "[Time YYYY-MM-DD HH:MM:SS.uuuuuu] " (disabled by default)
+		*/
+		static void enableTimestamps()
+		{
+			mTimestampOutput.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		Disables outputting of wall-clock time of records
+		*/
+		static void disableTimestamps()
+		{
+			mTimestampOutput.store(false, std::memory_order_relaxed);
+		}
+
+		/**
+		Enables outputting of index of the thread which has written
+		the record, i.e. "[Thread N] " (disabled by default)
+		*/
+		static void enableThreadIndices()
+		{
+			mThreadIndexOutput.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		Disables outputting of thread indices
+		*/
+		static void disableThreadIndices()
+		{
+			mThreadIndexOutput.store(false, std::memory_order_relaxed);
 		}
 
 		/**
@@ -114,15 +499,15 @@ namespace protolib
 		*/
 		static void disableSyncedLogging()
 		{
-			std::lock_guard<std::mutex> lock(mLogMutex);
-			mSyncedLogging = false;
+			mSyncedLogging.store(false, std::memory_order_release);
 		}
 
 		/**
 		Enables synced logging
 
 		When synced logging is enabled, new logs
-		are saved to a queue which is emptied during the
+		are saved to a lock-free buffer of the calling thread,
+		buffers of all threads are emptied during the
 		"syncedOutput" call. 
 		If synced logging is disabled (by default), logs are
 		processed (i.e. sent to output) instantly during write call.
@@ -132,14 +517,65 @@ namespace protolib
 		*/
 		static void enableSyncedLogging()
 		{
-			std::lock_guard<std::mutex> lock(mLogMutex);
-			mSyncedLogging = true;
+			mSyncedLogging.store(true, std::memory_order_release);
 		}
 
 		/**
-		Sends logs in queue to output if synced logging is enabled
+		Sends logs buffered in synced mode to output, might be called
+		periodically by a dedicated flushing thread
+
+		@param orderByTimestamp if set to true, logs of all threads are merged in the order
+		       they were written, otherwise they are outputted thread by thread
+		*/
+		static void syncedOutput(bool orderByTimestamp = true);
+
+		/**
+		Returns statistics of threads which have written logs in synced mode
+		(threads which have exited are reported until their logs are outputted)
+
+		@return statistics ordered by thread index
+		*/
+		static std::vector<ThreadStats> getThreadStats();
+
+		/**
+		Enables asynchronous logging
+
+		When asynchronous logging is enabled, write calls only copy
+		the log into a fixed-size record in a bounded lock-free ring buffer
+		and a dedicated background thread sends the records to output.
+		Records longer than the fixed size are truncated.
+		Asynchronous mode takes precedence over synced logging.
+		Switching the mode should be done while other threads are not logging.
+
+		@param capacity capacity of the ring buffer (rounded up to the power of two)
+		@param policy what to do with new logs when the ring buffer is full
 		*/
-		static void syncedOutput();
+		static void enableAsyncLogging(size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::BLOCK);
+
+		/**
+		Disables asynchronous logging, i.e. outputs all pending records
+		and stops the background thread
+		*/
+		static void disableAsyncLogging();
+
+		/**
+		Waits until all logs written so far in asynchronous mode are sent
+		to output and flushes buffered output of std::cout, log file and added sinks.
+		Should be called before changing the log file, otherwise pending
+		records might end up in the new one.
+		*/
+		static void flush();
+
+		/**
+		Returns number of logs discarded because of the full ring buffer
+		in asynchronous mode
+
+		@return number of dropped logs
+		*/
+		static size_t getDroppedLogsCount()
+		{
+			return mDroppedLogs.load(std::memory_order_relaxed);
+		}
 
 		/**
 		Writes a simple log
@@ -148,24 +584,18 @@ namespace protolib
 		@param variableName variable name
 		@param file file which contains the given variable (e.g. main.cpp)
 		@param logType type of log
+		@param line line in the file (0 if unknown)
 		*/
 		template<typename T>
-		static void writeSimpleLog(T message, const std::string& variableName,
-			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF)
+		static void writeSimpleLog(const T& message, const std::string& variableName,
+			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF, size_t line = 0)
 		{
-			std::lock_guard<std::mutex> lock(mLogMutex);
-			if (!mLoggingEnabled) { return; }
+			if (!isLogEnabled(logType)) { return; }
 
-			std::stringstream ss;
-			ss << message;
+			std::string formattedMessage;
+			Formatter::appendValue(formattedMessage, message);
 
-			Log newLog;
-			newLog.message = ss.str();
-			newLog.variableName = variableName;
-			newLog.file = file;
-			newLog.logType = logType;
-
-			resolveLog(newLog);
+			dispatchLog(formattedMessage, variableName, file, line, logType);
 		}
 
 		/**
@@ -174,9 +604,10 @@ namespace protolib
 		@param message message to show
 		@param file file which contains this write call
 		@param logType type of log
+		@param line line in the file (0 if unknown)
 		*/
 		static void writeSimpleInfoLog(const std::string& message,
-			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF);
+			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF, size_t line = 0);
 
 		/**
 		Writes a simple log with boolean variable
@@ -185,40 +616,77 @@ namespace protolib
 		@param condition how the condition looks (e.g. "george && bool")
 		@param file file which contains the given variable (e.g. main.cpp)
 		@param logType type of log
+		@param line line in the file (0 if unknown)
 		*/
 		static void writeSimpleBoolLog(bool message, const std::string& condition,
-			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF);
+			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF, size_t line = 0);
 
 		/**
 		Writes a structured log (e.g. std::vector or array)
 		Template type T must support range-based for loop
+		(see StructuredLogger.h for machine-readable key/value logs)
 
 		@param message variable content (e.g. simply an instance of std::vector class)
 		@param variableName variable name
 		@param file file which contains the given variable (e.g. main.cpp)
 		@param logType type of log
 		@param delim how to delimit values of the container during output
+		@param line line in the file (0 if unknown)
 		*/
 		template<typename T>
-		static void writeStructuredLog(T message, const std::string& variableName,
-			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF, char delim = ',')
+		static void writeStructuredLog(const T& message, const std::string& variableName,
+			const std::string& file = std::string() /*__FILE__*/, LogType logType = LogType::INF,
+			char delim = ',', size_t line = 0)
 		{
-			std::lock_guard<std::mutex> lock(mLogMutex);
-			if (!mLoggingEnabled) { return; }
+			if (!isLogEnabled(logType)) { return; }
 
-			std::stringstream ss;
+			std::string formattedMessage;
 			for (const auto& val : message)
 			{
-				ss << val << delim << " ";
+				Formatter::appendValue(formattedMessage, val);
+				formattedMessage += delim;
+				formattedMessage += ' ';
 			}
 
-			Log newLog;
-			newLog.message = ss.str();
-			newLog.variableName = variableName;
-			newLog.file = file;
-			newLog.logType = logType;
-
-			resolveLog(newLog);
+			dispatchLog(formattedMessage, variableName, file, line, logType);
 		}
 	};
 }
+
+// Numeric values of log types usable in preprocessor conditions
+#define PROTOLIB_LOG_LEVEL_DBG 0
+#define PROTOLIB_LOG_LEVEL_INF 1
+#define PROTOLIB_LOG_LEVEL_WAR 2
+#define PROTOLIB_LOG_LEVEL_ERR 3
+
+// Logs of lower type than this are compiled out completely
+#ifndef PROTOLIB_LOG_MIN_LEVEL
+#define PROTOLIB_LOG_MIN_LEVEL PROTOLIB_LOG_LEVEL_DBG
+#endif
+
+// Checks whether logs of given type (DBG, INF, WAR or ERR) are compiled in
+#define PROTOLIB_LOG_IS_COMPILED(type) (PROTOLIB_LOG_LEVEL_##type >= PROTOLIB_LOG_MIN_LEVEL)
+
+// Checks both compile-time and runtime log level before anything else is evaluated
+#define PROTOLIB_LOG_IF_ENABLED(type, statement) do { if (PROTOLIB_LOG_IS_COMPILED(type) && \
+	::protolib::Logger::isLogEnabled(::protolib::Logger::LogType::type)) { statement; } } while (0)
+
+// Logs value of a variable/expression together with its name, file and line
+// ------
+// Example usage:
+// PROTOLIB_LOG_VAR(DBG, velocity);
+// ------
+#define PROTOLIB_LOG_VAR(type, var) PROTOLIB_LOG_IF_ENABLED(type, \
+	::protolib::Logger::writeSimpleLog((var), #var, __FILE__, ::protolib::Logger::LogType::type, __LINE__))
+
+// Logs a message
+#define PROTOLIB_LOG_MSG(type, message) PROTOLIB_LOG_IF_ENABLED(type, \
+	::protolib::Logger::writeSimpleInfoLog((message), __FILE__, ::protolib::Logger::LogType::type, __LINE__))
+
+// Logs result of a condition together with the condition itself
+#define PROTOLIB_LOG_BOOL(type, cond) PROTOLIB_LOG_IF_ENABLED(type, \
+	::protolib::Logger::writeSimpleBoolLog((cond), #cond, __FILE__, ::protolib::Logger::LogType::type, __LINE__))
+
+// Logs content of a container (must support range-based for loop)
+#define PROTOLIB_LOG_CONTAINER(type, cont) PROTOLIB_LOG_IF_ENABLED(type, \
+	::protolib::Logger::writeStructuredLog((cont), #cont, __FILE__, ::protolib::Logger::LogType::type, ',', __LINE__))
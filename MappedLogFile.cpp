@@ -0,0 +1,276 @@
+#include "MappedLogFile.h"
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace protolib
+{
+	namespace
+	{
+		const size_t SegmentNotFull = std::numeric_limits<size_t>::max();
+	}
+
+	MappedLogFile::Segment::Segment(size_t index, size_t capacity)
+		:index(index), capacity(capacity), reserved(0), committed(0), used(SegmentNotFull), synced(0)
+#if defined(__unix__) || defined(__APPLE__)
+		, fd(-1), data(nullptr)
+#endif
+	{ }
+
+	MappedLogFile::MappedLogFile(const std::string& baseName, size_t segmentSize,
+		std::chrono::milliseconds syncInterval)
+		:mBaseName(baseName), mSegmentSize(segmentSize), mSyncInterval(syncInterval),
+		mCurrent(nullptr), mFailed(false), mDroppedRecords(0), mNextIndex(0), mStop(false)
+	{
+		std::unique_ptr<Segment> first = createSegment(mNextIndex++);
+		if (!first)
+		{
+			throw std::runtime_error("Unable to create log segment " + getSegmentName(0));
+		}
+
+		mCurrent.store(first.get(), std::memory_order_release);
+		mSegments.push_back(std::move(first));
+		mSyncThread = std::thread(&MappedLogFile::syncWorker, this);
+	}
+
+	MappedLogFile::~MappedLogFile()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mWakeUp.notify_one();
+		mSyncThread.join();
+
+		syncSegments(true);
+
+		if (mSpare)
+		{
+#if defined(__unix__) || defined(__APPLE__)
+			munmap(mSpare->data, mSpare->capacity);
+			close(mSpare->fd);
+#else
+			mSpare->file.close();
+#endif
+			std::remove(getSegmentName(mSpare->index).c_str());
+		}
+	}
+
+#if defined(__unix__) || defined(__APPLE__)
+	std::unique_ptr<MappedLogFile::Segment> MappedLogFile::createSegment(size_t index)
+	{
+		std::unique_ptr<Segment> segment(new Segment(index, mSegmentSize));
+		segment->fd = open(getSegmentName(index).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (segment->fd < 0) { return nullptr; }
+
+		// Blocks are allocated up front so that page faults never have to extend the file
+		bool allocated = false;
+#if defined(__linux__)
+		allocated = posix_fallocate(segment->fd, 0, static_cast<off_t>(mSegmentSize)) == 0;
+#endif
+		if (!allocated && ftruncate(segment->fd, static_cast<off_t>(mSegmentSize)) != 0)
+		{
+			close(segment->fd);
+			return nullptr;
+		}
+
+		void* data = mmap(nullptr, mSegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(segment->fd);
+			return nullptr;
+		}
+
+		segment->data = static_cast<char*>(data);
+		return segment;
+	}
+
+	bool MappedLogFile::write(const char* data, size_t length)
+	{
+		if (length > mSegmentSize)
+		{
+			mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		while (true)
+		{
+			Segment* segment = mCurrent.load(std::memory_order_acquire);
+			size_t offset = segment->reserved.fetch_add(length, std::memory_order_relaxed);
+
+			if (offset + length <= segment->capacity)
+			{
+				memcpy(segment->data + offset, data, length);
+				segment->committed.fetch_add(length, std::memory_order_release);
+				return true;
+			}
+
+			if (offset <= segment->capacity)
+			{
+				// Exactly one writer crosses the end of the segment and switches to the next one
+				switchSegment(segment, offset);
+			}
+			else
+			{
+				while (mCurrent.load(std::memory_order_acquire) == segment && !mFailed.load(std::memory_order_acquire))
+				{
+					std::this_thread::yield();
+				}
+			}
+
+			if (mFailed.load(std::memory_order_acquire))
+			{
+				mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+	}
+
+	void MappedLogFile::syncSegments(bool finalizeAll)
+	{
+		static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		Segment* current = mCurrent.load(std::memory_order_acquire);
+		for (auto& segment : mSegments)
+		{
+			if (segment->data == nullptr) { continue; }
+
+			size_t committed = segment->committed.load(std::memory_order_acquire);
+			size_t used = segment->used.load(std::memory_order_acquire);
+			bool isFull = used != SegmentNotFull && committed == used;
+
+			if (isFull || finalizeAll)
+			{
+				msync(segment->data, segment->capacity, MS_SYNC);
+				munmap(segment->data, segment->capacity);
+				segment->data = nullptr;
+				if (ftruncate(segment->fd, static_cast<off_t>(committed)) != 0)
+				{
+					// Segment keeps its zero-filled tail, the data are complete anyway
+				}
+				close(segment->fd);
+			}
+			else if (segment.get() == current && committed > segment->synced)
+			{
+				size_t start = segment->synced / pageSize * pageSize;
+				msync(segment->data + start, committed - start, MS_ASYNC);
+				segment->synced = committed;
+			}
+		}
+	}
+#else
+	std::unique_ptr<MappedLogFile::Segment> MappedLogFile::createSegment(size_t index)
+	{
+		std::unique_ptr<Segment> segment(new Segment(index, mSegmentSize));
+		segment->file.open(getSegmentName(index), std::ios::binary);
+		if (!segment->file.is_open()) { return nullptr; }
+		return segment;
+	}
+
+	bool MappedLogFile::write(const char* data, size_t length)
+	{
+		if (length > mSegmentSize)
+		{
+			mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		// Without mmap the segment is an ordinary file, so writers are serialized
+		std::lock_guard<std::mutex> lock(mMutex);
+		Segment* segment = mCurrent.load(std::memory_order_relaxed);
+		size_t offset = segment->reserved.load(std::memory_order_relaxed);
+		if (offset + length > segment->capacity)
+		{
+			segment->used.store(offset, std::memory_order_relaxed);
+			segment->file.close();
+
+			std::unique_ptr<Segment> next = mSpare ? std::move(mSpare) : createSegment(mNextIndex++);
+			if (!next)
+			{
+				mFailed.store(true, std::memory_order_release);
+				mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			segment = next.get();
+			mCurrent.store(segment, std::memory_order_release);
+			mSegments.push_back(std::move(next));
+			offset = 0;
+		}
+
+		segment->file.write(data, length);
+		segment->reserved.store(offset + length, std::memory_order_relaxed);
+		segment->committed.store(offset + length, std::memory_order_relaxed);
+		return true;
+	}
+
+	void MappedLogFile::syncSegments(bool finalizeAll)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		Segment* current = mCurrent.load(std::memory_order_relaxed);
+		if (current->file.is_open())
+		{
+			current->file.flush();
+			if (finalizeAll)
+			{
+				current->file.close();
+			}
+		}
+	}
+#endif
+
+	void MappedLogFile::switchSegment(Segment* full, size_t usedBytes)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		full->used.store(usedBytes, std::memory_order_release);
+
+		std::unique_ptr<Segment> next = std::move(mSpare);
+		if (!next)
+		{
+			// Background thread didn't manage to prepare the segment in time
+			next = createSegment(mNextIndex++);
+			if (!next)
+			{
+				mFailed.store(true, std::memory_order_release);
+				return;
+			}
+		}
+
+		mCurrent.store(next.get(), std::memory_order_release);
+		mSegments.push_back(std::move(next));
+		lock.unlock();
+		mWakeUp.notify_one();
+	}
+
+	void MappedLogFile::syncWorker()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (!mStop)
+		{
+			if (!mSpare && !mFailed.load(std::memory_order_relaxed))
+			{
+				// Spare is created under the lock so that segments are always used in order of their indices,
+				// if it fails, the writer which fills the current segment tries again
+				mSpare = createSegment(mNextIndex);
+				if (mSpare)
+				{
+					++mNextIndex;
+				}
+			}
+
+			mWakeUp.wait_for(lock, mSyncInterval);
+			if (mStop) { break; }
+
+			lock.unlock();
+			syncSegments(false);
+			lock.lock();
+		}
+	}
+}
@@ -0,0 +1,137 @@
+/*
+   MappedLogFile writes formatted log records into preallocated fixed-size
+   file segments (<base name>.0, <base name>.1, ...) mapped into memory.
+   Writers reserve byte ranges of the current segment by an atomic fetch-add
+   and copy records straight into the mapping, so the write path never enters
+   the kernel. The writer which overflows the segment switches to the next one
+   which is usually already prepared by the background thread. The background
+   thread also periodically msyncs written data, and finalizes full
+   segments (they are truncated to the written size).
+   Unused tail of the current segment contains zero bytes until the file is closed.
+   On systems without mmap, segments are written by std::ofstream under a mutex.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace protolib
+{
+	class MappedLogFile
+	{
+	private:
+		struct Segment
+		{
+			size_t index;
+			size_t capacity;
+			std::atomic<size_t> reserved;	// Bytes claimed by writers (might exceed capacity)
+			std::atomic<size_t> committed;	// Bytes already copied into the segment
+			std::atomic<size_t> used;		// Valid bytes, known once the segment is full
+			size_t synced;					// Bytes already passed to msync (background thread only)
+#if defined(__unix__) || defined(__APPLE__)
+			int fd;
+			char* data;
+#else
+			std::ofstream file;
+#endif
+
+			Segment(size_t index, size_t capacity);
+		};
+
+		std::string mBaseName;
+		size_t mSegmentSize;
+		std::chrono::milliseconds mSyncInterval;
+		std::atomic<Segment*> mCurrent;
+		std::atomic<bool> mFailed;
+		std::atomic<size_t> mDroppedRecords;
+
+		// Following members are guarded by mMutex
+		std::vector<std::unique_ptr<Segment>> mSegments;
+		std::unique_ptr<Segment> mSpare;
+		size_t mNextIndex;
+		bool mStop;
+		std::mutex mMutex;
+		std::condition_variable mWakeUp;
+		std::thread mSyncThread;
+
+		std::unique_ptr<Segment> createSegment(size_t index);
+
+		void switchSegment(Segment* full, size_t usedBytes);
+
+		void syncSegments(bool finalizeAll);
+
+		void syncWorker();
+	public:
+		/**
+		Main constructor to initialize the whole class,
+		throws std::runtime_error if the first segment can't be created
+
+		@param baseName base name of segment files
+		@param segmentSize size of each segment in bytes
+		@param syncInterval how often the background thread msyncs written data
+		*/
+		explicit MappedLogFile(const std::string& baseName, size_t segmentSize = 64 * 1024 * 1024,
+			std::chrono::milliseconds syncInterval = std::chrono::milliseconds(1000));
+
+		MappedLogFile(const MappedLogFile&) = delete;
+		MappedLogFile& operator=(const MappedLogFile&) = delete;
+
+		/**
+		Flushes all data, truncates the last segment to its written size
+		and removes the prepared spare segment.
+		Must not be called while other threads are writing.
+		*/
+		~MappedLogFile();
+
+		/**
+		Writes one or more complete records, thread-safe and lock-free
+		unless a segment is full
+
+		@param data formatted records
+		@param length length of data
+		@return false if the data were dropped (longer than a segment or a segment couldn't be created)
+		*/
+		bool write(const char* data, size_t length);
+
+		/**
+		Returns name of the segment file with given index
+
+		@param index index of the segment
+		@return file name
+		*/
+		std::string getSegmentName(size_t index) const
+		{
+			return mBaseName + "." + std::to_string(index);
+		}
+
+		/**
+		Returns index of the segment currently being written
+
+		@return segment index
+		*/
+		size_t getCurrentSegmentIndex() const
+		{
+			return mCurrent.load(std::memory_order_acquire)->index;
+		}
+
+		/**
+		Returns number of records which couldn't be written
+
+		@return number of dropped records
+		*/
+		size_t getDroppedRecordsCount() const
+		{
+			return mDroppedRecords.load(std::memory_order_relaxed);
+		}
+	};
+}
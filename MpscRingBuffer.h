@@ -0,0 +1,193 @@
+/*
+MpscRingBuffer is a bounded lock-free queue intended for
+many producer threads and a single consumer thread.
+It is based on the well-known array-based algorithm by Dmitry Vyukov
+where each slot carries a sequence number telling whether
+it is ready to be written or read.
+Since both ends are claimed by CAS, the queue stays correct
+even if producers occasionally pop (e.g. to drop the oldest element).
+
+(c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace protolib
+{
+	template<typename T>
+	class MpscRingBuffer
+	{
+	private:
+		static const size_t CacheLineSize = 64;
+
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		// Padding keeps producers' and consumer's positions in separate cache lines
+		// (alignas is avoided since over-aligned new is not available before C++17)
+		std::unique_ptr<Slot[]> mSlots;
+		size_t mMask;
+		char mPadding1[CacheLineSize];
+		std::atomic<size_t> mEnqueuePos;
+		char mPadding2[CacheLineSize - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> mDequeuePos;
+		char mPadding3[CacheLineSize - sizeof(std::atomic<size_t>)];
+
+		static size_t roundUpToPowerOfTwo(size_t value)
+		{
+			size_t result = 2;
+			while (result < value) { result <<= 1; }
+			return result;
+		}
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param capacity maximal number of elements (rounded up to the power of two)
+		*/
+		explicit MpscRingBuffer(size_t capacity)
+			:mSlots(new Slot[roundUpToPowerOfTwo(capacity)]), mMask(roundUpToPowerOfTwo(capacity) - 1),
+			mEnqueuePos(0), mDequeuePos(0)
+		{
+			for (size_t i = 0; i <= mMask; ++i)
+			{
+				mSlots[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		MpscRingBuffer(const MpscRingBuffer&) = delete;
+		MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+		/**
+		Returns maximal number of elements stored in the buffer
+
+		@return capacity of the buffer
+		*/
+		size_t capacity() const
+		{
+			return mMask + 1;
+		}
+
+		/**
+		Returns approximate number of elements in the buffer
+		(exact only if no other thread accesses the buffer)
+
+		@return number of elements in the buffer
+		*/
+		size_t size() const
+		{
+			size_t enqueuePos = mEnqueuePos.load(std::memory_order_relaxed);
+			size_t dequeuePos = mDequeuePos.load(std::memory_order_relaxed);
+			return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+		}
+
+		/**
+		Returns number of elements successfully pushed since construction
+
+		@return number of pushed elements
+		*/
+		size_t pushedCount() const
+		{
+			return mEnqueuePos.load(std::memory_order_acquire);
+		}
+
+		/**
+		Tries to insert an element into the buffer
+		Element is constructed in place by calling writer(T&)
+		so that large elements don't have to be copied twice
+
+		@param writer function filling the reserved slot
+		@return true if element was inserted, false if the buffer is full
+		*/
+		template<typename Writer>
+		bool tryPushWith(Writer writer)
+		{
+			size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+			Slot* slot;
+
+			while (true)
+			{
+				slot = &mSlots[pos & mMask];
+				size_t sequence = slot->sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+				if (diff == 0)
+				{
+					if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (diff < 0)
+				{
+					return false;
+				}
+				else
+				{
+					pos = mEnqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+
+			writer(slot->value);
+			slot->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/**
+		Tries to insert an element into the buffer
+
+		@param value element to insert
+		@return true if element was inserted, false if the buffer is full
+		*/
+		bool tryPush(const T& value)
+		{
+			return tryPushWith([&value](T& slotValue) { slotValue = value; });
+		}
+
+		/**
+		Tries to remove the oldest element from the buffer
+
+		@param[out] value removed element
+		@return true if element was removed, false if the buffer is empty
+		*/
+		bool tryPop(T& value)
+		{
+			size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+			Slot* slot;
+
+			while (true)
+			{
+				slot = &mSlots[pos & mMask];
+				size_t sequence = slot->sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+				if (diff == 0)
+				{
+					if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (diff < 0)
+				{
+					return false;
+				}
+				else
+				{
+					pos = mDequeuePos.load(std::memory_order_relaxed);
+				}
+			}
+
+			value = slot->value;
+			slot->sequence.store(pos + mMask + 1, std::memory_order_release);
+			return true;
+		}
+	};
+}
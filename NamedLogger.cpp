@@ -0,0 +1,272 @@
+#include "NamedLogger.h"
+#include <algorithm>
+#include <map>
+#include "AsyncSink.h"
+#include "LogMetrics.h"
+
+namespace protolib
+{
+	namespace
+	{
+		// Loggers are never destroyed since other static objects might log during static destruction
+		struct NamedLoggers
+		{
+			std::mutex mutex;
+			std::map<std::string, std::unique_ptr<NamedLogger>> loggers;
+		};
+
+		NamedLoggers& getNamedLoggers()
+		{
+			static NamedLoggers* namedLoggers = new NamedLoggers();
+			return *namedLoggers;
+		}
+
+		// Writes buffered records of all named loggers at the end of the program
+		struct NamedLoggersGuard
+		{
+			~NamedLoggersGuard()
+			{
+				NamedLoggers& namedLoggers = getNamedLoggers();
+				std::lock_guard<std::mutex> lock(namedLoggers.mutex);
+				for (auto& logger : namedLoggers.loggers)
+				{
+					logger.second->removeSinks();
+					logger.second->closeLogFile();
+				}
+			}
+		} namedLoggersGuard;
+	}
+
+	NamedLogger::NamedLogger(const std::string& name)
+		:mName(name), mLoggingEnabled(true), mLogLevel(static_cast<int>(Logger::LogType::DBG)), mPropagation(true),
+		mOwnOutputs(false), mNextSinkId(0)
+	{ }
+
+	NamedLogger::~NamedLogger()
+	{
+		removeSinks();
+	}
+
+	void NamedLogger::updateOwnOutputs()
+	{
+		mOwnOutputs.store(mFileSink != nullptr || !mSinks.empty(), std::memory_order_release);
+	}
+
+	AsyncSink* NamedLogger::findSink(size_t sinkId)
+	{
+		for (auto& sink : mSinks)
+		{
+			if (sink.first == sinkId)
+			{
+				return sink.second.get();
+			}
+		}
+		return nullptr;
+	}
+
+	void NamedLogger::dispatchLog(const std::string& message, const std::string& variableName,
+		const std::string& file, size_t line, Logger::LogType logType)
+	{
+		const uint64_t timestamp = LogClock::now();
+		const uint32_t threadIndex = LogClock::threadIndex();
+
+		// Record is formatted by the calling thread into a reused buffer
+		thread_local std::string formatted;
+		formatted.clear();
+		Logger::appendRecordInfo(formatted, timestamp, threadIndex);
+		formatted += "[Logger ";
+		formatted += mName;
+		formatted += "] ";
+		Logger::appendFormattedLog(formatted, logType, file.data(), file.size(), line, variableName.data(),
+			variableName.size(), message.data(), message.size());
+		formatted += '\n';
+
+		bool propagated = mPropagation.load(std::memory_order_relaxed) && Logger::isLogEnabled(logType);
+		if (mOwnOutputs.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mFileSink)
+			{
+				mFileSink->write(formatted.data(), formatted.size(), logType == Logger::LogType::ERR, 1);
+			}
+			for (auto& sink : mSinks)
+			{
+				sink.second->push(formatted.data(), formatted.size(), logType);
+			}
+
+			// Propagated records are counted by the default Logger
+			if (!propagated)
+			{
+				LogMetrics::countRecord(logType);
+				LogMetrics::addBytesWritten(formatted.size());
+			}
+		}
+
+		if (propagated)
+		{
+			Logger::dispatchRawLog(formatted, logType, timestamp, threadIndex);
+		}
+	}
+
+	void NamedLogger::setLogFile(const std::string& logFileName, bool logToFileOnly)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		try
+		{
+			mFileSink.reset();
+			mFileSink.reset(new FileSink(logFileName, mFileFlushPolicy));
+			mPropagation.store(!logToFileOnly, std::memory_order_relaxed);
+		}
+		catch (std::exception& e)
+		{
+			std::cout << "[ERROR] During \"NamedLogger::setLogFile\": " << e.what();
+		}
+		updateOwnOutputs();
+	}
+
+	void NamedLogger::setRotatingLogFile(const std::string& logFileName, const RotationPolicy& rotation,
+		bool logToFileOnly)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		try
+		{
+			mFileSink.reset();
+			mFileSink.reset(new RotatingFileSink(logFileName, rotation, mFileFlushPolicy));
+			mPropagation.store(!logToFileOnly, std::memory_order_relaxed);
+		}
+		catch (std::exception& e)
+		{
+			std::cout << "[ERROR] During \"NamedLogger::setRotatingLogFile\": " << e.what();
+		}
+		updateOwnOutputs();
+	}
+
+	void NamedLogger::closeLogFile()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mFileSink) { return; }
+
+		mFileSink.reset();
+		mPropagation.store(true, std::memory_order_relaxed);
+		updateOwnOutputs();
+	}
+
+	void NamedLogger::setFileFlushPolicy(const FlushPolicy& policy)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFileFlushPolicy = policy;
+		if (mFileSink)
+		{
+			mFileSink->setFlushPolicy(policy);
+		}
+	}
+
+	size_t NamedLogger::addSink(std::unique_ptr<LogSink> sink, Logger::LogType minLogType,
+		Logger::OverflowPolicy policy, size_t queueCapacity)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		size_t sinkId = mNextSinkId++;
+		mSinks.push_back(std::make_pair(sinkId,
+			std::unique_ptr<AsyncSink>(new AsyncSink(std::move(sink), minLogType, policy, queueCapacity))));
+		updateOwnOutputs();
+		return sinkId;
+	}
+
+	bool NamedLogger::removeSink(size_t sinkId)
+	{
+		std::unique_ptr<AsyncSink> removed;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			auto it = std::find_if(mSinks.begin(), mSinks.end(),
+				[sinkId](const std::pair<size_t, std::unique_ptr<AsyncSink>>& sink) { return sink.first == sinkId; });
+			if (it == mSinks.end()) { return false; }
+
+			removed = std::move(it->second);
+			mSinks.erase(it);
+			updateOwnOutputs();
+		}
+
+		// Remaining records are written by the sink's thread outside of the lock
+		removed.reset();
+		return true;
+	}
+
+	void NamedLogger::removeSinks()
+	{
+		std::vector<std::pair<size_t, std::unique_ptr<AsyncSink>>> removed;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			removed.swap(mSinks);
+			updateOwnOutputs();
+		}
+	}
+
+	bool NamedLogger::setSinkLogLevel(size_t sinkId, Logger::LogType minLogType)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		AsyncSink* sink = findSink(sinkId);
+		if (sink == nullptr) { return false; }
+
+		sink->setMinLogType(minLogType);
+		return true;
+	}
+
+	void NamedLogger::flush()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (mFileSink)
+		{
+			mFileSink->flush();
+		}
+		for (auto& sink : mSinks)
+		{
+			sink.second->flush();
+		}
+	}
+
+	void NamedLogger::writeSimpleInfoLog(const std::string& message, const std::string& file,
+		Logger::LogType logType, size_t line)
+	{
+		if (!isLogEnabled(logType)) { return; }
+
+		dispatchLog(message, std::string(), file, line, logType);
+	}
+
+	NamedLogger& LoggerRegistry::get(const std::string& name)
+	{
+		NamedLoggers& namedLoggers = getNamedLoggers();
+		std::lock_guard<std::mutex> lock(namedLoggers.mutex);
+		std::unique_ptr<NamedLogger>& logger = namedLoggers.loggers[name];
+		if (!logger)
+		{
+			logger.reset(new NamedLogger(name));
+		}
+		return *logger;
+	}
+
+	std::vector<std::string> LoggerRegistry::getNames()
+	{
+		NamedLoggers& namedLoggers = getNamedLoggers();
+		std::lock_guard<std::mutex> lock(namedLoggers.mutex);
+		std::vector<std::string> names;
+		names.reserve(namedLoggers.loggers.size());
+		for (const auto& logger : namedLoggers.loggers)
+		{
+			names.push_back(logger.first);
+		}
+		return names;
+	}
+
+	void LoggerRegistry::flushAll()
+	{
+		{
+			NamedLoggers& namedLoggers = getNamedLoggers();
+			std::lock_guard<std::mutex> lock(namedLoggers.mutex);
+			for (auto& logger : namedLoggers.loggers)
+			{
+				logger.second->flush();
+			}
+		}
+		Logger::flush();
+	}
+}
@@ -0,0 +1,307 @@
+/*
+   NamedLogger is an instantiable logger with its own enabled flag,
+   log level, log file, added sinks and lock, so that a chatty module
+   doesn't contend with quiet ones for a single lock and modules
+   might log to separate files. Records are formatted by the calling
+   thread (the same way as Logger does, with "[Logger <name>]" in front
+   of the file) and written to the logger's own outputs; unless disabled,
+   they are also propagated to the static Logger, which acts as the default
+   (root) logger with its console, file, synced/asynchronous modes and
+   flight recorder. A propagated record has to pass log levels of both loggers.
+   Named loggers are handed out by LoggerRegistry, the returned references
+   remain valid until the end of the program, so they should be looked up
+   once and cached.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Logger.h"
+
+namespace protolib
+{
+	class AsyncSink;
+
+	class NamedLogger
+	{
+	private:
+		std::string mName;
+		std::mutex mMutex;
+		std::atomic<bool> mLoggingEnabled;
+		std::atomic<int> mLogLevel;
+		std::atomic<bool> mPropagation;
+		std::atomic<bool> mOwnOutputs;		// Log file is set or sinks are added
+		std::unique_ptr<LogSink> mFileSink;
+		FlushPolicy mFileFlushPolicy;
+		std::vector<std::pair<size_t, std::unique_ptr<AsyncSink>>> mSinks;
+		size_t mNextSinkId;
+
+		void updateOwnOutputs();
+
+		AsyncSink* findSink(size_t sinkId);
+
+		void dispatchLog(const std::string& message, const std::string& variableName,
+			const std::string& file, size_t line, Logger::LogType logType);
+	public:
+		/**
+		Main constructor to initialize the whole class (loggers are usually obtained from LoggerRegistry)
+
+		@param name name of the logger which is outputted with every record
+		*/
+		explicit NamedLogger(const std::string& name);
+
+		~NamedLogger();
+
+		NamedLogger(const NamedLogger&) = delete;
+		NamedLogger& operator=(const NamedLogger&) = delete;
+
+		/**
+		Returns name of the logger
+
+		@return name of the logger
+		*/
+		const std::string& getName() const
+		{
+			return mName;
+		}
+
+		/**
+		Sets log file of this logger
+
+		@param logFileName desired file name
+		@param logToFileOnly if set to true, records are not propagated to the default Logger
+		*/
+		void setLogFile(const std::string& logFileName, bool logToFileOnly = false);
+
+		/**
+		Same as setLogFile but the log file is rotated according to the given policy
+
+		@param logFileName desired file name (of the active log file)
+		@param rotation when to rotate and how many rotated files to keep
+		@param logToFileOnly if set to true, records are not propagated to the default Logger
+		*/
+		void setRotatingLogFile(const std::string& logFileName, const RotationPolicy& rotation,
+			bool logToFileOnly = false);
+
+		/**
+		Closes log file of this logger and enables propagation to the default Logger
+		*/
+		void closeLogFile();
+
+		/**
+		Sets flush policy of the log file, applies also to log files set later
+
+		@param policy new flush policy
+		*/
+		void setFileFlushPolicy(const FlushPolicy& policy);
+
+		/**
+		Adds an output sink of this logger (see Logger::addSink)
+
+		@param sink sink which is owned by the logger from now on
+		@param minLogType minimal type of logs written to this sink
+		@param policy what happens when the queue of the sink is full
+		@param queueCapacity size of the queue of the sink in bytes
+		@return id of the sink usable by removeSink and setSinkLogLevel
+		*/
+		size_t addSink(std::unique_ptr<LogSink> sink, Logger::LogType minLogType = Logger::LogType::DBG,
+			Logger::OverflowPolicy policy = Logger::OverflowPolicy::DROP_NEWEST, size_t queueCapacity = 1024 * 1024);
+
+		/**
+		Removes a sink added by addSink, records already queued for the sink are written first
+
+		@param sinkId id returned by addSink
+		@return true if the sink was removed, false if there is no such sink
+		*/
+		bool removeSink(size_t sinkId);
+
+		/**
+		Removes all sinks added by addSink
+		*/
+		void removeSinks();
+
+		/**
+		Sets minimal type of logs written to a sink added by addSink
+
+		@param sinkId id returned by addSink
+		@param minLogType minimal type of logs written to the sink
+		@return true if the level was set, false if there is no such sink
+		*/
+		bool setSinkLogLevel(size_t sinkId, Logger::LogType minLogType);
+
+		/**
+		Enables propagation of records to the default Logger (enabled by default)
+		*/
+		void enablePropagation()
+		{
+			mPropagation.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		Disables propagation of records to the default Logger,
+		records are written only to the logger's own outputs
+		*/
+		void disablePropagation()
+		{
+			mPropagation.store(false, std::memory_order_relaxed);
+		}
+
+		/**
+		Disables logging of this logger
+		*/
+		void disableLogging()
+		{
+			mLoggingEnabled.store(false, std::memory_order_relaxed);
+		}
+
+		/**
+		Enables logging of this logger
+		*/
+		void enableLogging()
+		{
+			mLoggingEnabled.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		Sets minimal type (severity) of logs which are processed by this logger
+
+		@param minLogType minimal type of processed logs
+		*/
+		void setLogLevel(Logger::LogType minLogType)
+		{
+			mLogLevel.store(static_cast<int>(minLogType), std::memory_order_relaxed);
+		}
+
+		/**
+		Returns minimal type (severity) of logs which are processed by this logger
+
+		@return minimal type of processed logs
+		*/
+		Logger::LogType getLogLevel() const
+		{
+			return static_cast<Logger::LogType>(mLogLevel.load(std::memory_order_relaxed));
+		}
+
+		/**
+		Checks whether logs of given type would be outputted by this logger
+		or propagated to the default Logger, the check is lock-free and cheap
+
+		@param logType type of log
+		@return true if a log of logType would be written somewhere, false otherwise
+		*/
+		bool isLogEnabled(Logger::LogType logType) const
+		{
+			return mLoggingEnabled.load(std::memory_order_relaxed) &&
+				static_cast<int>(logType) >= mLogLevel.load(std::memory_order_relaxed) &&
+				(mOwnOutputs.load(std::memory_order_relaxed) ||
+				(mPropagation.load(std::memory_order_relaxed) && Logger::isLogEnabled(logType)));
+		}
+
+		/**
+		Flushes log file and sinks of this logger
+		*/
+		void flush();
+
+		/**
+		Writes a simple log
+
+		@param message variable content
+		@param variableName variable name
+		@param file file which contains the given variable (e.g. main.cpp)
+		@param logType type of log
+		@param line line in the file (0 if unknown)
+		*/
+		template<typename T>
+		void writeSimpleLog(const T& message, const std::string& variableName,
+			const std::string& file = std::string(), Logger::LogType logType = Logger::LogType::INF, size_t line = 0)
+		{
+			if (!isLogEnabled(logType)) { return; }
+
+			std::string formattedMessage;
+			Formatter::appendValue(formattedMessage, message);
+
+			dispatchLog(formattedMessage, variableName, file, line, logType);
+		}
+
+		/**
+		Writes a simple information log
+
+		@param message message to show
+		@param file file which contains this write call
+		@param logType type of log
+		@param line line in the file (0 if unknown)
+		*/
+		void writeSimpleInfoLog(const std::string& message, const std::string& file = std::string(),
+			Logger::LogType logType = Logger::LogType::INF, size_t line = 0);
+
+		/**
+		Writes a structured log (e.g. std::vector or array)
+		Template type T must support range-based for loop
+
+		@param message variable content (e.g. simply an instance of std::vector class)
+		@param variableName variable name
+		@param file file which contains the given variable (e.g. main.cpp)
+		@param logType type of log
+		@param delim how to delimit values of the container during output
+		@param line line in the file (0 if unknown)
+		*/
+		template<typename T>
+		void writeStructuredLog(const T& message, const std::string& variableName,
+			const std::string& file = std::string(), Logger::LogType logType = Logger::LogType::INF,
+			char delim = ',', size_t line = 0)
+		{
+			if (!isLogEnabled(logType)) { return; }
+
+			std::string formattedMessage;
+			for (const auto& val : message)
+			{
+				Formatter::appendValue(formattedMessage, val);
+				formattedMessage += delim;
+				formattedMessage += ' ';
+			}
+
+			dispatchLog(formattedMessage, variableName, file, line, logType);
+		}
+	};
+
+	// Hands out named loggers, there is a single logger of each name
+	class LoggerRegistry
+	{
+	public:
+		/**
+		Returns logger of given name, the logger is created on the first call
+		(lookup takes a lock, so the returned reference should be cached)
+
+		@param name name of the logger
+		@return logger which remains valid until the end of the program
+		*/
+		static NamedLogger& get(const std::string& name);
+
+		/**
+		Returns names of all created loggers
+
+		@return names in alphabetical order
+		*/
+		static std::vector<std::string> getNames();
+
+		/**
+		Flushes all named loggers and the default Logger
+		*/
+		static void flushAll();
+	};
+}
+
+// Same as PROTOLIB_LOG_VAR and PROTOLIB_LOG_MSG but written by given named logger
+#define PROTOLIB_LOGGER_VAR(logger, type, var) do { if (PROTOLIB_LOG_IS_COMPILED(type) && \
+	(logger).isLogEnabled(::protolib::Logger::LogType::type)) { \
+	(logger).writeSimpleLog((var), #var, __FILE__, ::protolib::Logger::LogType::type, __LINE__); } } while (0)
+
+#define PROTOLIB_LOGGER_MSG(logger, type, message) do { if (PROTOLIB_LOG_IS_COMPILED(type) && \
+	(logger).isLogEnabled(::protolib::Logger::LogType::type)) { \
+	(logger).writeSimpleInfoLog((message), __FILE__, ::protolib::Logger::LogType::type, __LINE__); } } while (0)
@@ -0,0 +1,196 @@
+/*
+   PbmBits converts rows of PBM pixels (one value per pixel, 0 = white,
+   anything else = black) to the bit-packed layout of binary PBM files and
+   back. Pixels are stored from the most significant bit, each row starts
+   on a new byte and the unused bits of its last byte are zero.
+   8-bit rows are converted 16 pixels per step with SSE2 (if the compiler
+   targets it) or 8 pixels per step using 64-bit arithmetic otherwise,
+   other channel types are converted pixel by pixel.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PROTOLIB_PBM_SSE2 1
+#include <emmintrin.h>
+#else
+#define PROTOLIB_PBM_SSE2 0
+#endif
+
+namespace protolib
+{
+	class PbmBits
+	{
+	private:
+		// Packs 8 pixels starting at pixels[0] (used by the portable kernel)
+		static uint8_t packByte(const uint8_t* pixels)
+		{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			uint8_t result = 0;
+			for (size_t i = 0; i < 8; ++i)
+			{
+				result = static_cast<uint8_t>((result << 1) | (pixels[i] != 0));
+			}
+			return result;
+#else
+			uint64_t word;
+			std::memcpy(&word, pixels, sizeof(word));
+			// Lowest bit of every byte is set iff the byte is nonzero
+			word |= word >> 4;
+			word |= word >> 2;
+			word |= word >> 1;
+			word &= 0x0101010101010101ULL;
+			// Multiplication moves lowest bit of byte i to bit 63 - i without carries
+			return static_cast<uint8_t>((word * 0x8040201008040201ULL) >> 56);
+#endif
+		}
+
+		static const uint8_t* getUnpackTable()
+		{
+			struct Table
+			{
+				uint8_t pixels[256][8];
+
+				Table()
+				{
+					for (unsigned value = 0; value < 256; ++value)
+					{
+						for (unsigned bit = 0; bit < 8; ++bit)
+						{
+							pixels[value][bit] = static_cast<uint8_t>((value >> (7 - bit)) & 1);
+						}
+					}
+				}
+			};
+			static const Table table;
+			return table.pixels[0];
+		}
+	public:
+		/**
+		Returns number of bytes taken by a packed row
+
+		@param width number of pixels in the row
+		@return number of bytes of the packed row
+		*/
+		static size_t getRowBytes(size_t width)
+		{
+			return (width + 7) / 8;
+		}
+
+		/**
+		Packs one row of pixels into bits
+
+		@param pixels row of width pixels, nonzero values are stored as 1
+		@param width number of pixels in the row
+		@param output buffer of getRowBytes(width) bytes
+		*/
+		static void packRow(const uint8_t* pixels, size_t width, uint8_t* output)
+		{
+			size_t x = 0;
+#if PROTOLIB_PBM_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			// Weight of each pixel within its byte, sum of weights of an 8-pixel group is the packed byte
+			const __m128i weights = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(128),
+				1, 2, 4, 8, 16, 32, 64, static_cast<char>(128));
+			for (; x + 16 <= width; x += 16, output += 2)
+			{
+				const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + x));
+				const __m128i black = _mm_andnot_si128(_mm_cmpeq_epi8(values, zero), weights);
+				const __m128i sums = _mm_sad_epu8(black, zero);
+				output[0] = static_cast<uint8_t>(_mm_cvtsi128_si32(sums));
+				output[1] = static_cast<uint8_t>(_mm_extract_epi16(sums, 4));
+			}
+#endif
+			for (; x + 8 <= width; x += 8)
+			{
+				*output++ = packByte(pixels + x);
+			}
+			if (x < width)
+			{
+				uint8_t last = 0;
+				for (size_t bit = 0; x < width; ++x, ++bit)
+				{
+					last |= static_cast<uint8_t>((pixels[x] != 0) << (7 - bit));
+				}
+				*output = last;
+			}
+		}
+
+		/**
+		Packs one row of pixels of a wider channel type into bits
+
+		@param pixels row of width pixels, nonzero values are stored as 1
+		@param width number of pixels in the row
+		@param output buffer of getRowBytes(width) bytes
+		*/
+		template<typename TChannelType>
+		static void packRow(const TChannelType* pixels, size_t width, uint8_t* output)
+		{
+			std::memset(output, 0, getRowBytes(width));
+			for (size_t x = 0; x < width; ++x)
+			{
+				if (pixels[x] != TChannelType())
+				{
+					output[x / 8] |= static_cast<uint8_t>(0x80 >> (x % 8));
+				}
+			}
+		}
+
+		/**
+		Unpacks one row of bits into pixels with values 0 and 1, padding bits are ignored
+
+		@param bits packed row of getRowBytes(width) bytes
+		@param width number of pixels in the row
+		@param pixels output row of width pixels
+		*/
+		static void unpackRow(const uint8_t* bits, size_t width, uint8_t* pixels)
+		{
+			size_t x = 0;
+#if PROTOLIB_PBM_SSE2
+			const __m128i masks = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, static_cast<char>(128),
+				1, 2, 4, 8, 16, 32, 64, static_cast<char>(128));
+			const __m128i ones = _mm_set1_epi8(1);
+			for (; x + 16 <= width; x += 16, bits += 2)
+			{
+				// Spreads first byte to lanes 0-7 and second byte to lanes 8-15
+				__m128i values = _mm_cvtsi32_si128(bits[0] | (bits[1] << 8));
+				values = _mm_unpacklo_epi8(values, values);
+				values = _mm_unpacklo_epi16(values, values);
+				values = _mm_unpacklo_epi32(values, values);
+				const __m128i set = _mm_cmpeq_epi8(_mm_and_si128(values, masks), masks);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + x), _mm_and_si128(set, ones));
+			}
+#endif
+			const uint8_t* table = getUnpackTable();
+			for (; x + 8 <= width; x += 8)
+			{
+				std::memcpy(pixels + x, table + 8 * *bits++, 8);
+			}
+			if (x < width)
+			{
+				std::memcpy(pixels + x, table + 8 * *bits, width - x);
+			}
+		}
+
+		/**
+		Unpacks one row of bits into pixels of a wider channel type with values 0 and 1
+
+		@param bits packed row of getRowBytes(width) bytes
+		@param width number of pixels in the row
+		@param pixels output row of width pixels
+		*/
+		template<typename TChannelType>
+		static void unpackRow(const uint8_t* bits, size_t width, TChannelType* pixels)
+		{
+			for (size_t x = 0; x < width; ++x)
+			{
+				pixels[x] = static_cast<TChannelType>((bits[x / 8] >> (7 - x % 8)) & 1);
+			}
+		}
+	};
+}
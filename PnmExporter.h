@@ -1,6 +1,8 @@
 /*
 PnmExporter provides simple interface to create and export PNM images.
 Each of the PPM, PGM and PBM file formats is supported. 
+Saved images can be loaded back by PnmReader (PnmReader.h), images larger
+than memory are written band by band by PnmStreamWriter (PnmStreamWriter.h).
 
 (c) 2018 David Kutak
 */
@@ -12,6 +14,16 @@ Each of the PPM, PGM and PBM file formats is supported.
 #include <fstream>
 #include <limits>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include "Formatter.h"
+#include "PbmBits.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
 
 namespace protolib
 {
@@ -25,9 +37,15 @@ namespace protolib
 		PPM_BIN			// RGB image saved as a binary data
 	};
 
+	template<typename TChannelType>
+	class PnmStreamWriter;
+
 	template<typename TChannelType = uint8_t>
 	class PnmExporter
 	{
+		// Writer shares the row encoding of save()
+		friend class PnmStreamWriter<TChannelType>;
+
 	public:
 		struct PixelColor
 		{
@@ -48,11 +66,7 @@ namespace protolib
 		size_t mWidth;
 		size_t mHeight;
 		std::vector<TChannelType> mPixelData;
-
-		std::string getMagicNumber() const
-		{
-			return "P" + std::to_string(static_cast<int>(mImageType));
-		}
+		unsigned mMaxValue;
 
 		bool isBinFormat() const
 		{
@@ -64,50 +78,331 @@ namespace protolib
 			mPixelData.resize(mWidth * mHeight * getNumberOfChannels());
 		}
 
-		void saveAscii(std::ofstream& output)
+		// Returns maximal number of characters of a channel value in ASCII formats
+		static size_t getMaxValueLength()
 		{
-			size_t valuesPerRow = mWidth * getNumberOfChannels();
+			if (!std::is_integral<TChannelType>::value) { return Formatter::MaxIntegerLength; }
+
+			char digits[Formatter::MaxIntegerLength];
+			return Formatter::formatUnsigned(digits, static_cast<unsigned>(std::numeric_limits<TChannelType>::max()));
+		}
 
-			for (size_t i = 0; i < mPixelData.size(); ++i)
+		// Writes decimal representation of a channel value, 8-bit values are looked up in a table
+		// (output must have space for getMaxValueLength() + 1 characters)
+		static size_t formatChannelValue(char* output, TChannelType value)
+		{
+			if (sizeof(TChannelType) == 1 && std::is_integral<TChannelType>::value)
 			{
-				output << static_cast<unsigned>(mPixelData[i]) << " ";
-				if ((i + 1) % (valuesPerRow) == 0)
+				return Formatter::formatByte(output, static_cast<uint8_t>(value));
+			}
+			return Formatter::formatUnsigned(output, static_cast<unsigned>(value));
+		}
+
+		// Returns upper bound of length of an ASCII row with given number of values
+		static size_t getMaxAsciiRowLength(size_t valuesPerRow)
+		{
+			// Each value takes at most getMaxValueLength() characters and one separator
+			return valuesPerRow * (getMaxValueLength() + 1) + 1;
+		}
+
+		// Appends ASCII representation of rows of valuesPerRow values, every row starts on a new line and lines
+		// are wrapped so that none is longer than 70 characters (as recommended by the PNM specification)
+		static void formatAsciiRows(const TChannelType* rowValues, size_t valuesPerRow, size_t rows, std::string& text)
+		{
+			const size_t MaxLineLength = 70;
+			const size_t textStart = text.size();
+
+			text.resize(textStart + rows * getMaxAsciiRowLength(valuesPerRow));
+			char* out = &text[textStart];
+			for (size_t row = 0; row < rows; ++row)
+			{
+				const TChannelType* values = rowValues + row * valuesPerRow;
+				size_t lineLength = 0;
+				for (size_t i = 0; i < valuesPerRow; ++i)
 				{
-					output << std::endl;
+					if (lineLength == 0)
+					{
+						lineLength = formatChannelValue(out, values[i]);
+						out += lineLength;
+						continue;
+					}
+
+					// Value is formatted behind the separator which is chosen once its length is known
+					const size_t length = formatChannelValue(out + 1, values[i]);
+					if (lineLength + 1 + length > MaxLineLength)
+					{
+						*out = '\n';
+						lineLength = length;
+					}
+					else
+					{
+						*out = ' ';
+						lineLength += 1 + length;
+					}
+					out += 1 + length;
 				}
+				*out++ = '\n';
+			}
+			text.resize(static_cast<size_t>(out - text.data()));
+		}
+
+		// Formats bands of rows into large buffers which are written by a single call each,
+		// with a thread pool several bands are formatted in parallel
+		void saveAscii(std::ofstream& output, ThreadPool* pool)
+		{
+			const size_t BandBytes = 1024 * 1024;
+
+			const size_t valuesPerRow = mWidth * getNumberOfChannels();
+			const size_t bandRows = std::max<size_t>(1, BandBytes / getMaxAsciiRowLength(valuesPerRow));
+			if (pool == nullptr || pool->getThreadCount() == 0)
+			{
+				std::string text;
+				for (size_t y = 0; y < mHeight; y += bandRows)
+				{
+					text.clear();
+					formatAsciiRows(mPixelData.data() + y * valuesPerRow, valuesPerRow, std::min(mHeight - y, bandRows), text);
+					output.write(text.data(), text.size());
+				}
+				return;
+			}
+
+			// Bands are formatted in batches so that memory doesn't grow with the image size
+			std::vector<std::string> texts((pool->getThreadCount() + 1) * 2);
+			for (size_t batchStart = 0; batchStart < mHeight; batchStart += texts.size() * bandRows)
+			{
+				const size_t bands = std::min(texts.size(), (mHeight - batchStart + bandRows - 1) / bandRows);
+				pool->parallelFor(bands, [this, &texts, batchStart, bandRows, valuesPerRow](size_t band) {
+					const size_t yStart = batchStart + band * bandRows;
+					texts[band].clear();
+					formatAsciiRows(mPixelData.data() + yStart * valuesPerRow, valuesPerRow,
+						std::min(mHeight - yStart, bandRows), texts[band]);
+				});
+				for (size_t band = 0; band < bands; ++band)
+				{
+					output.write(texts[band].data(), texts[band].size());
+				}
+			}
+		}
+
+		// Returns number of bytes of a row in a binary format, PBM stores a pixel per bit and other
+		// formats store samples as one byte if the maximum value is below 256 and as two bytes otherwise
+		static size_t getBinaryRowBytes(PnmImageType type, unsigned maxValue, size_t width)
+		{
+			if (type == PnmImageType::PBM_BIN)
+			{
+				return PbmBits::getRowBytes(width);
+			}
+			return width * (type == PnmImageType::PPM_BIN ? 3 : 1) * (maxValue > 255 ? 2 : 1);
+		}
+
+		// Encodes rows in a binary format (output must have space for rows * getBinaryRowBytes() bytes),
+		// two-byte samples are stored in big-endian order regardless of the machine
+		static void encodeBinaryRows(PnmImageType type, unsigned maxValue, const TChannelType* rowValues,
+			size_t width, size_t rows, uint8_t* output)
+		{
+			if (type == PnmImageType::PBM_BIN)
+			{
+				const size_t rowBytes = PbmBits::getRowBytes(width);
+				for (size_t row = 0; row < rows; ++row)
+				{
+					PbmBits::packRow(rowValues + row * width, width, output + row * rowBytes);
+				}
+				return;
+			}
+
+			const size_t count = rows * width * (type == PnmImageType::PPM_BIN ? 3 : 1);
+			if (maxValue > 255)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					const unsigned value = static_cast<unsigned>(rowValues[i]);
+					output[2 * i] = static_cast<uint8_t>(value >> 8);
+					output[2 * i + 1] = static_cast<uint8_t>(value);
+				}
+			}
+			else
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					output[i] = static_cast<uint8_t>(rowValues[i]);
+				}
+			}
+		}
+
+		// Appends header of a file
+		static void appendHeader(FormatBuffer<64>& header, PnmImageType type, size_t width, size_t height,
+			unsigned maxValue)
+		{
+			header.append('P').appendUnsigned(static_cast<unsigned>(type)).append('\n');
+			header.appendUnsigned(width).append(' ').appendUnsigned(height).append('\n');
+			if (type != PnmImageType::PBM_ASCII && type != PnmImageType::PBM_BIN)
+			{
+				header.appendUnsigned(maxValue).append('\n');
 			}
 		}
 
 		void saveBinary(std::ofstream& output)
 		{
-			// PBM stores data in a "pixel per bit" format so I have
-			// to transform pixel data before saving them to file
-			if (mImageType == PnmImageType::PBM_BIN)
+			if (mImageType != PnmImageType::PBM_BIN && sizeof(TChannelType) == 1 && mMaxValue <= 255)
+			{
+				output.write(reinterpret_cast<const char*>(mPixelData.data()), mPixelData.size());
+				return;
+			}
+
+			// PBM stores data in a "pixel per bit" format and wider samples are stored in big-endian
+			// order so pixel data are transformed in bands of about 1MB written by a single call each
+			const size_t BandBytes = 1024 * 1024;
+			const size_t rowBytes = getBinaryRowBytes(mImageType, mMaxValue, mWidth);
+			const size_t bandRows = std::max<size_t>(1, BandBytes / std::max<size_t>(1, rowBytes));
+			const size_t valuesPerRow = mWidth * getNumberOfChannels();
+			std::vector<uint8_t> binData(std::min(mHeight, bandRows) * rowBytes);
+
+			for (size_t y = 0; y < mHeight; y += bandRows)
+			{
+				const size_t rows = std::min(mHeight - y, bandRows);
+				encodeBinaryRows(mImageType, mMaxValue, mPixelData.data() + y * valuesPerRow, mWidth, rows,
+					binData.data());
+				output.write(reinterpret_cast<const char*>(binData.data()), rows * rowBytes);
+			}
+		}
+
+		TChannelType getGrayValue(const PixelColor& color) const
+		{
+			return ((mImageType == PnmImageType::PBM_ASCII || mImageType == PnmImageType::PBM_BIN) &&
+				color.y > 1) ? 1 : color.y;
+		}
+
+		// Sets pixels xStart..xEnd (inclusive, inside the image) of row y to given color
+		void fillSpan(size_t y, size_t xStart, size_t xEnd, const PixelColor& color)
+		{
+			if (getNumberOfChannels() == 3)
 			{
-				std::vector<uint8_t> binData((mWidth / 8 + (mWidth % 8 == 0 ? 0 : 1)) * mHeight);
+				TChannelType* pixel = mPixelData.data() + 3 * (y * mWidth + xStart);
+				if (color.r == color.g && color.g == color.b)
+				{
+					std::fill(pixel, pixel + 3 * (xEnd - xStart + 1), color.r);
+					return;
+				}
+				for (size_t x = xStart; x <= xEnd; ++x, pixel += 3)
+				{
+					pixel[0] = color.r;
+					pixel[1] = color.g;
+					pixel[2] = color.b;
+				}
+			}
+			else
+			{
+				TChannelType* row = mPixelData.data() + y * mWidth;
+				std::fill(row + xStart, row + xEnd + 1, getGrayValue(color));
+			}
+		}
+
+		// Same as fillSpan but the span is clipped to the image first
+		void fillClippedSpan(int64_t y, int64_t xStart, int64_t xEnd, const PixelColor& color)
+		{
+			if (y < 0 || y >= static_cast<int64_t>(mHeight) || xEnd < 0 ||
+				xStart >= static_cast<int64_t>(mWidth) || xStart > xEnd)
+			{
+				return;
+			}
+			fillSpan(static_cast<size_t>(y), static_cast<size_t>(std::max<int64_t>(xStart, 0)),
+				static_cast<size_t>(std::min<int64_t>(xEnd, static_cast<int64_t>(mWidth) - 1)), color);
+		}
+
+		// Returns offset along the minor axis of the k-th pixel of a line drawn by the Bresenham's algorithm,
+		// i.e. floor((2 * minorLength * k + majorLength) / (2 * majorLength)) without overflowing
+		static uint64_t getLineMinorOffset(uint64_t majorLength, uint64_t minorLength, uint64_t k)
+		{
+			const uint64_t product = minorLength * k;
+			return product / majorLength + (2 * (product % majorLength) >= majorLength ? 1 : 0);
+		}
 
-				for (size_t y = 0, bdPos = 0; y < mHeight; ++y)
+		// Computes range of offsets (from start in the direction of step) which lie inside 0..limit - 1
+		static void getOffsetsInside(int64_t start, int64_t step, size_t limit, int64_t& first, int64_t& last)
+		{
+			const int64_t maxCoordinate = static_cast<int64_t>(limit) - 1;
+			first = step > 0 ? -start : start - maxCoordinate;
+			last = step > 0 ? maxCoordinate - start : start;
+		}
+
+		// Returns the largest integer whose square is not greater than value
+		static int64_t integerSqrt(int64_t value)
+		{
+			int64_t result = static_cast<int64_t>(std::sqrt(static_cast<double>(value)));
+			while (result > 0 && result * result > value) { --result; }
+			while ((result + 1) * (result + 1) <= value) { ++result; }
+			return result;
+		}
+
+		// Sets rows yStart..yEnd - 1 of pixels fulfilling pred to given color
+		template<typename Pred>
+		void setPixelsInRows(Pred& pred, const PixelColor& color, size_t yStart, size_t yEnd)
+		{
+			const size_t channels = getNumberOfChannels();
+			const TChannelType gray = getGrayValue(color);
+			for (size_t y = yStart; y < yEnd; ++y)
+			{
+				TChannelType* pixel = mPixelData.data() + y * mWidth * channels;
+				for (size_t x = 0; x < mWidth; ++x, pixel += channels)
 				{
-					for (size_t x = 0; x < mWidth; x += 8, ++bdPos)
+					if (!pred(x, y)) { continue; }
+
+					if (channels == 3)
 					{
-						size_t upperBound = mWidth - x > 8 ? 8 : mWidth - x;
-						for (size_t k = 0; k < upperBound; ++k)
-						{
-							// mPixelData equals only to 1 or 0 in case of PBM
-							binData[bdPos] |= mPixelData[y * mWidth + x + k] << (upperBound - 1 - k);
-						}
+						pixel[0] = color.r;
+						pixel[1] = color.g;
+						pixel[2] = color.b;
+					}
+					else
+					{
+						*pixel = gray;
 					}
 				}
-
-				output.write(reinterpret_cast<const char*>(binData.data()),
-					binData.size() * sizeof(uint8_t));
 			}
-			else
+		}
+
+		// Sets rows yStart..yEnd - 1 of pixels to colors returned by generator
+		template<typename Generator>
+		void generatePixelsInRows(Generator& generator, size_t yStart, size_t yEnd)
+		{
+			const size_t channels = getNumberOfChannels();
+			for (size_t y = yStart; y < yEnd; ++y)
 			{
-				output.write(reinterpret_cast<const char*>(mPixelData.data()),
-					mPixelData.size() * sizeof(TChannelType));
+				TChannelType* pixel = mPixelData.data() + y * mWidth * channels;
+				for (size_t x = 0; x < mWidth; ++x, pixel += channels)
+				{
+					const PixelColor color = generator(x, y);
+					if (channels == 3)
+					{
+						pixel[0] = color.r;
+						pixel[1] = color.g;
+						pixel[2] = color.b;
+					}
+					else
+					{
+						*pixel = getGrayValue(color);
+					}
+				}
 			}
 		}
+
+		// Splits the image into bands of rows and calls rowsFunc(yStart, yEnd) for each band on the pool,
+		// bands have roughly BandBytes of pixel data and there are several bands per thread for balancing
+		void forEachBand(ThreadPool& pool, const std::function<void(size_t, size_t)>& rowsFunc)
+		{
+			const size_t BandBytes = 64 * 1024;
+			const size_t BandsPerThread = 4;
+
+			const size_t rowBytes = std::max<size_t>(1, mWidth * getNumberOfChannels() * sizeof(TChannelType));
+			const size_t balancedRows = (mHeight + (pool.getThreadCount() + 1) * BandsPerThread - 1) /
+				((pool.getThreadCount() + 1) * BandsPerThread);
+			const size_t bandRows = std::max<size_t>(1, std::min(BandBytes / rowBytes, balancedRows));
+			const size_t bands = (mHeight + bandRows - 1) / bandRows;
+
+			pool.parallelFor(bands, [this, bandRows, &rowsFunc](size_t band) {
+				rowsFunc(band * bandRows, std::min(mHeight, (band + 1) * bandRows));
+			});
+		}
 	public:
 		/**
 		Main constructor to initialize the whole class
@@ -117,11 +412,28 @@ namespace protolib
 		@param type image type
 		*/
 		PnmExporter(size_t width, size_t height, PnmImageType type = PnmImageType::PPM_BIN)
-			:mWidth(width), mHeight(height), mImageType(type)
+			:mWidth(width), mHeight(height), mImageType(type),
+			mMaxValue(static_cast<unsigned>(std::numeric_limits<TChannelType>::max()))
 		{ 
 			resizePixelData();
 		}
 
+		/**
+		Constructor which takes over existing pixel data (e.g. decoded by PnmReader),
+		the data are resized according to the image dimensions
+
+		@param width width of an image
+		@param height height of an image
+		@param type image type
+		@param pixelData pixel data (row by row, RGB triples for PPM)
+		*/
+		PnmExporter(size_t width, size_t height, PnmImageType type, std::vector<TChannelType>&& pixelData)
+			:mImageType(type), mWidth(width), mHeight(height), mPixelData(std::move(pixelData)),
+			mMaxValue(static_cast<unsigned>(std::numeric_limits<TChannelType>::max()))
+		{
+			resizePixelData();
+		}
+
 		/**
 		Returns width of an image (in pixels)
 
@@ -198,6 +510,40 @@ namespace protolib
 			resizePixelData();
 		}
 
+		/**
+		Replaces current pixel data with new one without copying it
+		(resized according to the image dimensions like above)
+
+		@param pixelData new pixel data
+		*/
+		void setPixelData(std::vector<TChannelType>&& pixelData)
+		{
+			mPixelData = std::move(pixelData);
+			resizePixelData();
+		}
+
+		/**
+		Returns maximum value of a channel written to the header of PGM and PPM files
+
+		@return maximum value
+		*/
+		unsigned getMaxValue() const
+		{
+			return mMaxValue;
+		}
+
+		/**
+		Sets maximum value of a channel written to the header of PGM and PPM files,
+		pixel values are not rescaled (default is the maximum of TChannelType, binary
+		files store samples in one byte if it is below 256 and in two bytes otherwise)
+
+		@param maxValue new maximum value (1-65535 for files readable by other programs)
+		*/
+		void setMaxValue(unsigned maxValue)
+		{
+			mMaxValue = maxValue;
+		}
+
 		/**
 		Returns number of image channels
 
@@ -319,20 +665,43 @@ namespace protolib
 		template<typename Pred>
 		void setPixels(Pred pred, const PixelColor& color)
 		{
-			for (size_t y = 0; y < mHeight; ++y)
-			{
-				for (size_t x = 0; x < mWidth; ++x)
-				{
-					if (pred(x, y))
-					{
-						setPixel(x, y, color);
-					}
-				}
-			}
+			setPixelsInRows(pred, color, 0, mHeight);
+		}
+
+		/**
+		Same as setPixels(pred, color) but bands of image rows are processed
+		in parallel, so pred is called concurrently and must be thread-safe
+
+		@param pred binary predicate
+		@param color new color for pixels fulfilling predicate
+		@param pool thread pool which processes the bands
+		*/
+		template<typename Pred>
+		void setPixelsParallel(Pred pred, const PixelColor& color, ThreadPool& pool = ThreadPool::getShared())
+		{
+			forEachBand(pool, [this, &pred, &color](size_t yStart, size_t yEnd) {
+				setPixelsInRows(pred, color, yStart, yEnd);
+			});
+		}
+
+		/**
+		Sets color of each pixel (x,y) to generator(x,y), bands of image rows are
+		processed in parallel, so generator is called concurrently and must be thread-safe
+
+		@param generator function returning PixelColor of pixel (x,y)
+		@param pool thread pool which processes the bands
+		*/
+		template<typename Generator>
+		void generatePixels(Generator generator, ThreadPool& pool = ThreadPool::getShared())
+		{
+			forEachBand(pool, [this, &generator](size_t yStart, size_t yEnd) {
+				generatePixelsInRows(generator, yStart, yEnd);
+			});
 		}
 
 		/**
-		Draws a circle with given parameters
+		Draws a filled circle with given parameters, i.e. pixels closer
+		to the center than the radius (only covered rows are visited)
 
 		@param cx x-coordinate of center
 		@param cy y-coordinate of center
@@ -341,13 +710,39 @@ namespace protolib
 		*/
 		void addCircle(int cx, int cy, int radius, const PixelColor& color)
 		{
-			setPixels([=](int x, int y) { 
-				return (x - cx)*(x - cx) + (y - cy) * (y - cy) < radius * radius; 
-			}, color);
+			addEllipse(cx, cy, radius, radius, color);
+		}
+
+		/**
+		Draws a filled axis-aligned ellipse, i.e. pixels (x,y) for which
+		(x-cx)^2/rx^2 + (y-cy)^2/ry^2 < 1
+
+		@param cx x-coordinate of center
+		@param cy y-coordinate of center
+		@param rx horizontal radius
+		@param ry vertical radius
+		@param color ellipse color
+		*/
+		void addEllipse(int cx, int cy, int rx, int ry, const PixelColor& color)
+		{
+			const int64_t rx2 = static_cast<int64_t>(rx) * rx;
+			const int64_t ry2 = static_cast<int64_t>(ry) * ry;
+			if (rx2 == 0 || ry2 == 0) { return; }
+
+			const int64_t dyLimit = std::abs(static_cast<int64_t>(ry)) - 1;
+			const int64_t dyStart = std::max<int64_t>(-dyLimit, -static_cast<int64_t>(cy));
+			const int64_t dyEnd = std::min<int64_t>(dyLimit, static_cast<int64_t>(mHeight) - 1 - cy);
+			for (int64_t dy = dyStart; dy <= dyEnd; ++dy)
+			{
+				// Half-width of the row is the largest dx with dx^2 * ry^2 < rx^2 * (ry^2 - dy^2)
+				const int64_t halfWidth = integerSqrt((rx2 * (ry2 - dy * dy) - 1) / ry2);
+				fillClippedSpan(cy + dy, cx - halfWidth, cx + halfWidth, color);
+			}
 		}
 
 		/**
-		Draws a rectangle with given parameters
+		Draws a filled rectangle with given parameters
+		(right and bottom edges at xLeft + width and yTop + height are included)
 
 		@param xLeft x-coordinate of top left point
 		@param yTop y-coordinate of top left point
@@ -357,36 +752,207 @@ namespace protolib
 		*/
 		void addRectangle(int xLeft, int yTop, int width, int height, const PixelColor& color)
 		{
-			int xRight = xLeft + width;
-			int yBottom = yTop + height;
+			const int64_t xRight = static_cast<int64_t>(xLeft) + width;
+			const int64_t yBottom = static_cast<int64_t>(yTop) + height;
+
+			const int64_t yEnd = std::min<int64_t>(yBottom, static_cast<int64_t>(mHeight) - 1);
+			for (int64_t y = std::max<int64_t>(yTop, 0); y <= yEnd; ++y)
+			{
+				fillClippedSpan(y, xLeft, xRight, color);
+			}
+		}
+
+		/**
+		Draws a line by the Bresenham's algorithm (both end points are included)
+
+		@param xStart x-coordinate of the start point
+		@param yStart y-coordinate of the start point
+		@param xEnd x-coordinate of the end point
+		@param yEnd y-coordinate of the end point
+		@param color line color
+		*/
+		void addLine(int xStart, int yStart, int xEnd, int yEnd, const PixelColor& color)
+		{
+			if (yStart == yEnd)
+			{
+				fillClippedSpan(yStart, std::min(xStart, xEnd), std::max(xStart, xEnd), color);
+				return;
+			}
+
+			// Pixel k (0..majorLength) lies k steps along the major axis and getLineMinorOffset steps along
+			// the minor one, so the line is clipped to the image before it is rasterized and the error term
+			// starts with the value the unclipped line would have there (pixels are the same in both cases)
+			const int64_t start[2] = { xStart, yStart };
+			const int64_t step[2] = { xStart < xEnd ? 1 : -1, yStart < yEnd ? 1 : -1 };
+			const int64_t length[2] = { std::abs(static_cast<int64_t>(xEnd) - xStart),
+				std::abs(static_cast<int64_t>(yEnd) - yStart) };
+			const size_t limit[2] = { mWidth, mHeight };
+			const int major = length[0] >= length[1] ? 0 : 1;
+			const int minor = 1 - major;
+			const uint64_t majorLength = static_cast<uint64_t>(length[major]);
+			const uint64_t minorLength = static_cast<uint64_t>(length[minor]);
+
+			int64_t first, last, minorFirst, minorLast;
+			getOffsetsInside(start[major], step[major], limit[major], first, last);
+			getOffsetsInside(start[minor], step[minor], limit[minor], minorFirst, minorLast);
+			first = std::max<int64_t>(first, 0);
+			last = std::min<int64_t>(last, length[major]);
+			if (first > last || minorLast < 0 || minorFirst > length[minor]) { return; }
+
+			// Minor offset never decreases, so the pixels inside form a range found by binary searches
+			int64_t low = first;
+			int64_t high = last + 1;
+			while (low < high)
+			{
+				const int64_t middle = low + (high - low) / 2;
+				if (static_cast<int64_t>(getLineMinorOffset(majorLength, minorLength, middle)) < minorFirst)
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+			first = low;
+			high = last + 1;
+			while (low < high)
+			{
+				const int64_t middle = low + (high - low) / 2;
+				if (static_cast<int64_t>(getLineMinorOffset(majorLength, minorLength, middle)) <= minorLast)
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+			last = low - 1;
+
+			// Error is the numerator 2 * minorLength * k + majorLength modulo 2 * majorLength
+			const uint64_t product = minorLength * static_cast<uint64_t>(first);
+			uint64_t minorOffset = product / majorLength;
+			uint64_t error = 2 * (product % majorLength) + majorLength;
+			if (error >= 2 * majorLength)
+			{
+				error -= 2 * majorLength;
+				++minorOffset;
+			}
+
+			int64_t position[2];
+			for (int64_t k = first; k <= last; ++k)
+			{
+				position[major] = start[major] + step[major] * k;
+				position[minor] = start[minor] + step[minor] * static_cast<int64_t>(minorOffset);
+				fillClippedSpan(position[1], position[0], position[0], color);
+
+				error += 2 * minorLength;
+				if (error >= 2 * majorLength)
+				{
+					error -= 2 * majorLength;
+					++minorOffset;
+				}
+			}
+		}
+
+		/**
+		Draws a filled polygon (even-odd rule), pixel is filled if its center
+		lies inside the polygon, rows are filled by spans between edge crossings
+
+		@param points vertices of the polygon
+		@param color polygon color
+		*/
+		void addPolygon(const std::vector<std::pair<int, int>>& points, const PixelColor& color)
+		{
+			struct Edge
+			{
+				int64_t yFirst;		// First row whose center is crossed by the edge
+				int64_t yLast;		// Last row whose center is crossed by the edge
+				int64_t xTop;
+				int64_t dx;
+				int64_t dy;			// Always positive
+			};
+
+			// Edge table sorted by the first row
+			std::vector<Edge> edges;
+			edges.reserve(points.size());
+			for (size_t i = 0; i < points.size(); ++i)
+			{
+				std::pair<int, int> top = points[i];
+				std::pair<int, int> bottom = points[(i + 1) % points.size()];
+				if (top.second == bottom.second) { continue; }
+				if (top.second > bottom.second) { std::swap(top, bottom); }
+
+				edges.push_back(Edge{ top.second, static_cast<int64_t>(bottom.second) - 1, top.first,
+					static_cast<int64_t>(bottom.first) - top.first, static_cast<int64_t>(bottom.second) - top.second });
+			}
+			if (edges.empty()) { return; }
+			std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.yFirst < b.yFirst; });
+
+			std::vector<Edge> activeEdges;
+			std::vector<int64_t> crossings;
+			activeEdges.reserve(edges.size());
+			crossings.reserve(edges.size());
+			size_t nextEdge = 0;
+			for (int64_t y = std::max<int64_t>(edges.front().yFirst, 0); y < static_cast<int64_t>(mHeight); ++y)
+			{
+				activeEdges.erase(std::remove_if(activeEdges.begin(), activeEdges.end(),
+					[y](const Edge& edge) { return edge.yLast < y; }), activeEdges.end());
+				for (; nextEdge < edges.size() && edges[nextEdge].yFirst <= y; ++nextEdge)
+				{
+					if (edges[nextEdge].yLast >= y)
+					{
+						activeEdges.push_back(edges[nextEdge]);
+					}
+				}
+				if (activeEdges.empty())
+				{
+					if (nextEdge == edges.size()) { break; }
+					continue;
+				}
 
-			setPixels([=](int x, int y) {
-				return x >= xLeft && x <= xRight && y >= yTop && y <= yBottom;
-			}, color);
+				// Edge crosses center of the row at x = xTop + (y + 0.5 - yTop) * dx / dy and pixels
+				// whose centers x + 0.5 lie in [left, right) are inside, so the first pixel right of
+				// the crossing is ceil(x - 0.5), computed exactly in integers
+				crossings.clear();
+				for (const auto& edge : activeEdges)
+				{
+					const int64_t numerator = 2 * edge.xTop * edge.dy + (2 * (y - edge.yFirst) + 1) * edge.dx - edge.dy;
+					const int64_t denominator = 2 * edge.dy;
+					crossings.push_back(numerator >= 0 ? (numerator + denominator - 1) / denominator :
+						-(-numerator / denominator));
+				}
+				std::sort(crossings.begin(), crossings.end());
+
+				for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+				{
+					fillClippedSpan(y, crossings[i], crossings[i + 1] - 1, color);
+				}
+			}
 		}
 
 		/**
 		Saves an image to file
 
 		@param fileName name of the file (including extension, i.e. *.ppm/pgm/pbm)
+		@param pool thread pool which formats data of ASCII formats in parallel
+		(nullptr = formatted by the calling thread)
 		*/
-		void save(const std::string& fileName)
+		void save(const std::string& fileName, ThreadPool* pool = nullptr)
 		{
+			PROTOLIB_TRACE_SCOPE("PnmExporter", "save");
 			std::ofstream output(fileName, isBinFormat() ? std::ios::binary : std::ios::out);
 
 			// Print header
-			output << getMagicNumber() << std::endl;
-			output << mWidth << " " << mHeight << std::endl;
-			if (mImageType != PnmImageType::PBM_ASCII &&
-				mImageType != PnmImageType::PBM_BIN)
-			{
-				output << static_cast<unsigned>(std::numeric_limits<TChannelType>::max()) << std::endl;
-			}
+			FormatBuffer<64> header;
+			appendHeader(header, mImageType, mWidth, mHeight, mMaxValue);
+			output.write(header.data(), header.size());
 			
 			// Print data
 			if (!isBinFormat())
 			{
-				saveAscii(output);
+				saveAscii(output, pool);
 			}
 			else
 			{
@@ -0,0 +1,152 @@
+#include "PnmReader.h"
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace protolib
+{
+	PnmReader::PnmReader(const std::string& fileName)
+		:mFileName(fileName), mImageType(PnmImageType::PBM_ASCII), mWidth(0), mHeight(0), mMaxValue(1),
+		mData(nullptr), mSize(0), mPayloadOffset(0), mMapped(false)
+	{
+		mapFile();
+		try
+		{
+			parseHeader();
+		}
+		catch (...)
+		{
+#if defined(__unix__) || defined(__APPLE__)
+			if (mMapped)
+			{
+				munmap(const_cast<char*>(mData), mSize);
+			}
+#endif
+			throw;
+		}
+	}
+
+	PnmReader::~PnmReader()
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		if (mMapped)
+		{
+			munmap(const_cast<char*>(mData), mSize);
+		}
+#endif
+	}
+
+	void PnmReader::mapFile()
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		const int fd = open(mFileName.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			throw std::runtime_error("Unable to open " + mFileName);
+		}
+
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0)
+		{
+			void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED)
+			{
+				// Pixels are decoded front to back
+				madvise(data, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+				mData = static_cast<const char*>(data);
+				mSize = static_cast<size_t>(fileStat.st_size);
+				mMapped = true;
+			}
+		}
+		close(fd);
+		if (mMapped) { return; }
+#endif
+
+		// Files which can't be mapped (or systems without mmap) are read into memory
+		std::ifstream input(mFileName, std::ios::binary);
+		if (!input.is_open())
+		{
+			throw std::runtime_error("Unable to open " + mFileName);
+		}
+		mBuffer.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+		mData = mBuffer.data();
+		mSize = mBuffer.size();
+	}
+
+	size_t PnmReader::readHeaderValue(const char*& pos, const char* what) const
+	{
+		const size_t MaxValue = size_t(1) << 40;
+
+		const char* end = mData + mSize;
+		pos = skipSeparators(pos, end);
+		if (pos == end || *pos < '0' || *pos > '9')
+		{
+			throw std::runtime_error(mFileName + " has invalid " + what);
+		}
+
+		size_t value = 0;
+		while (pos != end && *pos >= '0' && *pos <= '9')
+		{
+			value = value * 10 + static_cast<size_t>(*pos++ - '0');
+			if (value > MaxValue)
+			{
+				throw std::runtime_error(mFileName + " has too large " + what);
+			}
+		}
+		return value;
+	}
+
+	void PnmReader::parseHeader()
+	{
+		if (mSize < 2 || mData[0] != 'P' || mData[1] < '1' || mData[1] > '6')
+		{
+			throw std::runtime_error(mFileName + " is not a PNM image");
+		}
+		mImageType = static_cast<PnmImageType>(mData[1] - '0');
+
+		const char* pos = mData + 2;
+		mWidth = readHeaderValue(pos, "width");
+		mHeight = readHeaderValue(pos, "height");
+		if (mImageType != PnmImageType::PBM_ASCII && mImageType != PnmImageType::PBM_BIN)
+		{
+			const size_t maxValue = readHeaderValue(pos, "maximum value");
+			if (maxValue == 0 || maxValue > 65535)
+			{
+				throw std::runtime_error(mFileName + " has invalid maximum value");
+			}
+			mMaxValue = static_cast<unsigned>(maxValue);
+		}
+		if (mWidth != 0 && mHeight > std::numeric_limits<size_t>::max() / 8 / mWidth)
+		{
+			throw std::runtime_error(mFileName + " is too large");
+		}
+
+		const char* end = mData + mSize;
+		if (static_cast<int>(mImageType) <= 3)
+		{
+			// ASCII values are validated while they are parsed
+			mPayloadOffset = static_cast<size_t>(pos - mData);
+			return;
+		}
+
+		// Binary data start behind a single whitespace character
+		if (pos == end || !(*pos == ' ' || (*pos >= '\t' && *pos <= '\r')))
+		{
+			throw std::runtime_error(mFileName + " has invalid header");
+		}
+		mPayloadOffset = static_cast<size_t>(++pos - mData);
+
+		const size_t payloadSize = mImageType == PnmImageType::PBM_BIN ? PbmBits::getRowBytes(mWidth) * mHeight :
+			getValueCount() * (mMaxValue > 255 ? 2 : 1);
+		if (getPayloadSize() < payloadSize)
+		{
+			throw std::runtime_error(mFileName + " is truncated");
+		}
+	}
+}
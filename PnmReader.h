@@ -0,0 +1,316 @@
+/*
+   PnmReader loads PBM, PGM and PPM images in both ASCII (P1-P3) and
+   binary (P4-P6) formats, including comments and arbitrary whitespace
+   in the header, any maximum value up to 65535 and 16-bit big-endian
+   samples. The file is memory-mapped (or read into memory on systems
+   without mmap) and pixels are decoded straight from the mapping, binary
+   payloads can be accessed as a zero-copy view when their layout matches
+   the requested channel type (8-bit samples, or 16-bit samples on
+   big-endian machines). ASCII values are parsed by a hand-written loop
+   instead of iostreams. Values are never rescaled, so an image saved
+   by PnmExporter is read back bit-exactly (see toImage).
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "PbmBits.h"
+#include "PnmExporter.h"
+
+namespace protolib
+{
+	class PnmReader
+	{
+	private:
+		std::string mFileName;
+		PnmImageType mImageType;
+		size_t mWidth;
+		size_t mHeight;
+		unsigned mMaxValue;
+		const char* mData;			// Contents of the whole file
+		size_t mSize;
+		size_t mPayloadOffset;		// Position of the first pixel value
+		bool mMapped;
+		std::vector<char> mBuffer;	// Contents of the file if it isn't mapped
+
+		void mapFile();
+
+		void parseHeader();
+
+		size_t readHeaderValue(const char*& pos, const char* what) const;
+
+		// Skips whitespace and comments (from '#' to the end of the line)
+		static const char* skipSeparators(const char* pos, const char* end)
+		{
+			while (pos != end)
+			{
+				if (*pos == '#')
+				{
+					while (pos != end && *pos != '\n' && *pos != '\r') { ++pos; }
+				}
+				else if (*pos == ' ' || (*pos >= '\t' && *pos <= '\r'))
+				{
+					++pos;
+				}
+				else
+				{
+					break;
+				}
+			}
+			return pos;
+		}
+
+		template<typename TChannelType>
+		void readAsciiPixels(TChannelType* pixels, size_t count) const
+		{
+			const char* pos = mData + mPayloadOffset;
+			const char* end = mData + mSize;
+			for (size_t i = 0; i < count; ++i)
+			{
+				pos = skipSeparators(pos, end);
+				if (pos == end || *pos < '0' || *pos > '9')
+				{
+					throw std::runtime_error(mFileName + " contains less pixel values than expected");
+				}
+
+				// PBM digits don't have to be separated
+				if (mImageType == PnmImageType::PBM_ASCII)
+				{
+					if (*pos > '1')
+					{
+						throw std::runtime_error(mFileName + " contains invalid PBM value");
+					}
+					pixels[i] = static_cast<TChannelType>(*pos++ - '0');
+					continue;
+				}
+
+				unsigned value = 0;
+				do
+				{
+					value = value * 10 + static_cast<unsigned>(*pos++ - '0');
+					if (value > mMaxValue)
+					{
+						throw std::runtime_error(mFileName + " contains value greater than its maximum value");
+					}
+				} while (pos != end && *pos >= '0' && *pos <= '9');
+				pixels[i] = static_cast<TChannelType>(value);
+			}
+		}
+
+		template<typename TChannelType>
+		void readBinaryPixels(TChannelType* pixels, size_t count) const
+		{
+			const uint8_t* payload = getPayload();
+			if (mImageType == PnmImageType::PBM_BIN)
+			{
+				const size_t rowBytes = PbmBits::getRowBytes(mWidth);
+				for (size_t y = 0; y < mHeight; ++y)
+				{
+					PbmBits::unpackRow(payload + y * rowBytes, mWidth, pixels + y * mWidth);
+				}
+			}
+			else if (mMaxValue > 255)
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					pixels[i] = static_cast<TChannelType>((payload[2 * i] << 8) | payload[2 * i + 1]);
+				}
+			}
+			else if (std::is_same<TChannelType, uint8_t>::value)
+			{
+				std::memcpy(pixels, payload, count);
+			}
+			else
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					pixels[i] = static_cast<TChannelType>(payload[i]);
+				}
+			}
+		}
+	public:
+		/**
+		Main constructor, maps the file and parses its header
+		(throws std::runtime_error if the file can't be read, it is not a PNM image
+		or its payload is shorter than the header declares)
+
+		@param fileName name of the image file
+		*/
+		explicit PnmReader(const std::string& fileName);
+
+		/**
+		Unmaps the file, views returned by getPayload and getPixelView become invalid
+		*/
+		~PnmReader();
+
+		PnmReader(const PnmReader&) = delete;
+		PnmReader& operator=(const PnmReader&) = delete;
+
+		/**
+		Returns image type
+
+		@return image type
+		*/
+		PnmImageType getImageType() const
+		{
+			return mImageType;
+		}
+
+		/**
+		Returns width of an image (in pixels)
+
+		@return width of an image
+		*/
+		size_t getWidth() const
+		{
+			return mWidth;
+		}
+
+		/**
+		Returns height of an image (in pixels)
+
+		@return height of an image
+		*/
+		size_t getHeight() const
+		{
+			return mHeight;
+		}
+
+		/**
+		Returns maximum value of a channel declared by the header (1 for PBM)
+
+		@return maximum value
+		*/
+		unsigned getMaxValue() const
+		{
+			return mMaxValue;
+		}
+
+		/**
+		Returns number of image channels
+
+		@return number of channels
+		*/
+		size_t getNumberOfChannels() const
+		{
+			return (mImageType == PnmImageType::PPM_ASCII || mImageType == PnmImageType::PPM_BIN) ? 3 : 1;
+		}
+
+		/**
+		Returns number of channel values (width * height * number of channels)
+
+		@return number of values
+		*/
+		size_t getValueCount() const
+		{
+			return mWidth * mHeight * getNumberOfChannels();
+		}
+
+		/**
+		Checks whether the file is memory-mapped (otherwise it was read into memory)
+
+		@return true if the file is mapped, false otherwise
+		*/
+		bool isMapped() const
+		{
+			return mMapped;
+		}
+
+		/**
+		Returns pixel data as stored in the file (packed bits for P4, big-endian samples
+		for 16-bit P5/P6, text for ASCII formats), valid while the reader exists
+
+		@return pointer to the first byte behind the header
+		*/
+		const uint8_t* getPayload() const
+		{
+			return reinterpret_cast<const uint8_t*>(mData + mPayloadOffset);
+		}
+
+		/**
+		Returns size of the payload (might include data behind the image)
+
+		@return size in bytes
+		*/
+		size_t getPayloadSize() const
+		{
+			return mSize - mPayloadOffset;
+		}
+
+		/**
+		Returns binary PGM/PPM samples as an array of getValueCount() values without copying,
+		that is possible when a sample has sizeof(TChannelType) bytes and the machine's
+		byte order and alignment match the file (always for 8-bit samples and uint8_t)
+
+		@return pointer to the samples valid while the reader exists, nullptr if the layout doesn't match
+		*/
+		template<typename TChannelType>
+		const TChannelType* getPixelView() const
+		{
+			if ((mImageType != PnmImageType::PGM_BIN && mImageType != PnmImageType::PPM_BIN) ||
+				!std::is_integral<TChannelType>::value || !std::is_unsigned<TChannelType>::value ||
+				sizeof(TChannelType) != (mMaxValue > 255 ? 2 : 1))
+			{
+				return nullptr;
+			}
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+			if (sizeof(TChannelType) > 1) { return nullptr; }
+#endif
+			if (reinterpret_cast<uintptr_t>(getPayload()) % alignof(TChannelType) != 0) { return nullptr; }
+			return reinterpret_cast<const TChannelType*>(getPayload());
+		}
+
+		/**
+		Decodes all channel values (row by row, RGB triples for PPM, 0/1 for PBM where 1 is black),
+		throws std::runtime_error if ASCII data are malformed
+
+		@param pixels output array of getValueCount() values
+		*/
+		template<typename TChannelType>
+		void readPixels(TChannelType* pixels) const
+		{
+			if (static_cast<int>(mImageType) > 3)
+			{
+				readBinaryPixels(pixels, getValueCount());
+			}
+			else
+			{
+				readAsciiPixels(pixels, getValueCount());
+			}
+		}
+
+		/**
+		Creates PnmExporter with the same type, dimensions, maximum value and pixel data,
+		throws std::runtime_error if the maximum value doesn't fit TChannelType
+
+		@return image which might be edited and saved again
+		*/
+		template<typename TChannelType = uint8_t>
+		PnmExporter<TChannelType> toImage() const
+		{
+			if (static_cast<double>(mMaxValue) > static_cast<double>(std::numeric_limits<TChannelType>::max()))
+			{
+				throw std::runtime_error(mFileName + " has values which don't fit the channel type");
+			}
+
+			std::vector<TChannelType> pixels(getValueCount());
+			readPixels(pixels.data());
+
+			PnmExporter<TChannelType> image(mWidth, mHeight, mImageType, std::move(pixels));
+			if (mImageType != PnmImageType::PBM_ASCII && mImageType != PnmImageType::PBM_BIN)
+			{
+				image.setMaxValue(mMaxValue);
+			}
+			return image;
+		}
+	};
+}
@@ -0,0 +1,114 @@
+#include "PnmStreamWriter.h"
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace protolib
+{
+#if defined(__unix__) || defined(__APPLE__)
+	PnmStreamFile::PnmStreamFile(const std::string& fileName)
+		:mFileName(fileName)
+	{
+		mFd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (mFd < 0)
+		{
+			throw std::runtime_error("Unable to create " + fileName);
+		}
+	}
+
+	PnmStreamFile::~PnmStreamFile()
+	{
+		if (mFd >= 0)
+		{
+			::close(mFd);
+		}
+	}
+
+	void PnmStreamFile::resize(uint64_t size)
+	{
+		if (ftruncate(mFd, static_cast<off_t>(size)) != 0)
+		{
+			throw std::runtime_error("Unable to resize " + mFileName);
+		}
+	}
+
+	void PnmStreamFile::writeAt(uint64_t offset, const void* data, size_t length)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		while (length > 0)
+		{
+			const ssize_t written = pwrite(mFd, bytes, length, static_cast<off_t>(offset));
+			if (written < 0 && errno == EINTR) { continue; }
+			if (written <= 0)
+			{
+				throw std::runtime_error("Unable to write to " + mFileName);
+			}
+			bytes += written;
+			length -= static_cast<size_t>(written);
+			offset += static_cast<uint64_t>(written);
+		}
+	}
+
+	void PnmStreamFile::close()
+	{
+		if (mFd < 0) { return; }
+
+		const int result = ::close(mFd);
+		mFd = -1;
+		if (result != 0)
+		{
+			throw std::runtime_error("Unable to write to " + mFileName);
+		}
+	}
+#else
+	PnmStreamFile::PnmStreamFile(const std::string& fileName)
+		:mFileName(fileName), mFile(fileName, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc)
+	{
+		if (!mFile.is_open())
+		{
+			throw std::runtime_error("Unable to create " + fileName);
+		}
+	}
+
+	PnmStreamFile::~PnmStreamFile()
+	{
+	}
+
+	void PnmStreamFile::resize(uint64_t size)
+	{
+		// Writing the last byte extends the file, the rest is filled with zeros
+		if (size > 0)
+		{
+			const char zero = 0;
+			writeAt(size - 1, &zero, 1);
+		}
+	}
+
+	void PnmStreamFile::writeAt(uint64_t offset, const void* data, size_t length)
+	{
+		// Without pwrite the file position is shared, so writers are serialized
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFile.seekp(static_cast<std::streamoff>(offset));
+		mFile.write(static_cast<const char*>(data), static_cast<std::streamsize>(length));
+		if (!mFile)
+		{
+			throw std::runtime_error("Unable to write to " + mFileName);
+		}
+	}
+
+	void PnmStreamFile::close()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (!mFile.is_open()) { return; }
+
+		mFile.close();
+		if (mFile.fail())
+		{
+			throw std::runtime_error("Unable to write to " + mFileName);
+		}
+	}
+#endif
+}
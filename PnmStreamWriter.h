@@ -0,0 +1,331 @@
+/*
+   PnmStreamWriter writes PNM images which don't have to fit into memory.
+   The header is written when the writer is created and rows are then
+   passed in bands, either by writeRows or by a producer callback
+   (writeBands) which fills a bounded window of bands, optionally on a
+   ThreadPool. Rows of binary formats have a fixed size, so every band is
+   written straight to its offset (pwrite on POSIX systems) in any order
+   and from any thread. ASCII rows vary in length, so a band which arrives
+   before the rows preceding it is kept in memory until they are written.
+   Rows are encoded exactly like PnmExporter::save does.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Formatter.h"
+#include "PnmExporter.h"
+#include "ThreadPool.h"
+
+#if !(defined(__unix__) || defined(__APPLE__))
+#include <fstream>
+#endif
+
+namespace protolib
+{
+	// File written at explicit offsets, concurrent writes to distinct ranges are allowed
+	class PnmStreamFile
+	{
+	private:
+		std::string mFileName;
+#if defined(__unix__) || defined(__APPLE__)
+		int mFd;
+#else
+		std::mutex mMutex;
+		std::fstream mFile;
+#endif
+	public:
+		/**
+		Creates (or truncates) the file, throws std::runtime_error if it can't be created
+
+		@param fileName name of the file
+		*/
+		explicit PnmStreamFile(const std::string& fileName);
+
+		/**
+		Closes the file if close wasn't called
+		*/
+		~PnmStreamFile();
+
+		PnmStreamFile(const PnmStreamFile&) = delete;
+		PnmStreamFile& operator=(const PnmStreamFile&) = delete;
+
+		/**
+		Sets size of the file (unwritten parts read as zeros), throws std::runtime_error on failure
+
+		@param size new size in bytes
+		*/
+		void resize(uint64_t size);
+
+		/**
+		Writes data at given offset, thread-safe, throws std::runtime_error on failure
+
+		@param offset position in the file
+		@param data data to write
+		@param length length of data
+		*/
+		void writeAt(uint64_t offset, const void* data, size_t length);
+
+		/**
+		Closes the file, throws std::runtime_error if buffered data couldn't be written
+		*/
+		void close();
+	};
+
+	template<typename TChannelType = uint8_t>
+	class PnmStreamWriter
+	{
+	private:
+		typedef PnmExporter<TChannelType> Encoder;
+
+		struct PendingBand
+		{
+			size_t rows;
+			std::string text;
+		};
+
+		PnmStreamFile mFile;
+		PnmImageType mImageType;
+		size_t mWidth;
+		size_t mHeight;
+		unsigned mMaxValue;
+		uint64_t mDataOffset;
+
+		// Following members are guarded by mMutex
+		std::vector<bool> mWrittenRows;
+		size_t mWrittenRowCount;
+		std::map<size_t, PendingBand> mPendingBands;	// ASCII bands waiting for preceding rows
+		size_t mNextAsciiRow;
+		uint64_t mAsciiOffset;
+		bool mFinished;
+		std::mutex mMutex;
+
+		bool isBinFormat() const
+		{
+			return static_cast<int>(mImageType) > 3;
+		}
+
+		void checkRows(size_t yStart, size_t rows)
+		{
+			if (yStart > mHeight || rows > mHeight - yStart)
+			{
+				throw std::out_of_range("PnmStreamWriter rows are outside of the image");
+			}
+			if (mFinished)
+			{
+				throw std::runtime_error("PnmStreamWriter is already finished");
+			}
+		}
+
+		void markWritten(size_t yStart, size_t rows)
+		{
+			for (size_t y = yStart; y < yStart + rows; ++y)
+			{
+				if (!mWrittenRows[y])
+				{
+					mWrittenRows[y] = true;
+					++mWrittenRowCount;
+				}
+			}
+		}
+
+		void writeBinaryRows(size_t yStart, size_t rows, const TChannelType* values)
+		{
+			const size_t rowBytes = Encoder::getBinaryRowBytes(mImageType, mMaxValue, mWidth);
+			const uint64_t offset = mDataOffset + static_cast<uint64_t>(yStart) * rowBytes;
+			// 8-bit values are written as they are only if the file stores samples in one byte too
+			if (mImageType != PnmImageType::PBM_BIN && sizeof(TChannelType) == 1 && mMaxValue <= 255)
+			{
+				mFile.writeAt(offset, values, rows * rowBytes);
+			}
+			else
+			{
+				std::vector<uint8_t> bytes(rows * rowBytes);
+				Encoder::encodeBinaryRows(mImageType, mMaxValue, values, mWidth, rows, bytes.data());
+				mFile.writeAt(offset, bytes.data(), bytes.size());
+			}
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			markWritten(yStart, rows);
+		}
+
+		void writeAsciiRows(size_t yStart, size_t rows, const TChannelType* values)
+		{
+			PendingBand band{ rows, std::string() };
+			Encoder::formatAsciiRows(values, getValuesPerRow(), rows, band.text);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (size_t y = yStart; y < yStart + rows; ++y)
+			{
+				if (mWrittenRows[y])
+				{
+					throw std::runtime_error("PnmStreamWriter rows of ASCII formats can be written only once");
+				}
+			}
+			markWritten(yStart, rows);
+			mPendingBands.emplace(yStart, std::move(band));
+
+			// Bands are appended once all rows before them are in the file
+			auto next = mPendingBands.begin();
+			while (next != mPendingBands.end() && next->first == mNextAsciiRow)
+			{
+				mFile.writeAt(mAsciiOffset, next->second.text.data(), next->second.text.size());
+				mAsciiOffset += next->second.text.size();
+				mNextAsciiRow += next->second.rows;
+				next = mPendingBands.erase(next);
+			}
+		}
+	public:
+		/**
+		Main constructor, creates the file and writes its header
+		(throws std::runtime_error if the file can't be created)
+
+		@param fileName name of the file (including extension, i.e. *.ppm/pgm/pbm)
+		@param width width of an image
+		@param height height of an image
+		@param type image type
+		@param maxValue maximum value of a channel written to PGM and PPM headers
+		(binary files store samples in one byte if it is below 256 and in two bytes otherwise)
+		*/
+		PnmStreamWriter(const std::string& fileName, size_t width, size_t height,
+			PnmImageType type = PnmImageType::PPM_BIN,
+			unsigned maxValue = static_cast<unsigned>(std::numeric_limits<TChannelType>::max()))
+			:mFile(fileName), mImageType(type), mWidth(width), mHeight(height), mMaxValue(maxValue),
+			mWrittenRows(height, false), mWrittenRowCount(0), mNextAsciiRow(0), mFinished(false)
+		{
+			FormatBuffer<64> header;
+			Encoder::appendHeader(header, mImageType, mWidth, mHeight, mMaxValue);
+			mFile.writeAt(0, header.data(), header.size());
+			mDataOffset = header.size();
+			mAsciiOffset = mDataOffset;
+
+			// Binary file has its final size right away so bands might be written in any order
+			if (isBinFormat())
+			{
+				mFile.resize(mDataOffset + static_cast<uint64_t>(mHeight) *
+					Encoder::getBinaryRowBytes(mImageType, mMaxValue, mWidth));
+			}
+		}
+
+		/**
+		Returns number of channel values in a row (width * number of channels)
+
+		@return number of values
+		*/
+		size_t getValuesPerRow() const
+		{
+			return mWidth * ((mImageType == PnmImageType::PPM_ASCII || mImageType == PnmImageType::PPM_BIN) ? 3 : 1);
+		}
+
+		/**
+		Returns number of distinct rows passed so far
+
+		@return number of rows
+		*/
+		size_t getWrittenRows()
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			return mWrittenRowCount;
+		}
+
+		/**
+		Writes rows yStart..yStart + rows - 1, thread-safe, rows might come in any order
+		(binary rows might be written repeatedly, ASCII rows only once),
+		throws std::out_of_range for rows outside of the image and std::runtime_error on failure
+
+		@param yStart first row
+		@param rows number of rows
+		@param values rows * getValuesPerRow() values (RGB triples for PPM, 0/1 for PBM)
+		*/
+		void writeRows(size_t yStart, size_t rows, const TChannelType* values)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				checkRows(yStart, rows);
+			}
+			if (rows == 0) { return; }
+
+			if (isBinFormat())
+			{
+				writeBinaryRows(yStart, rows, values);
+			}
+			else
+			{
+				writeAsciiRows(yStart, rows, values);
+			}
+		}
+
+		/**
+		Writes the whole image band by band, producer fills values of each band
+		(which are zero before the call), at most a few bands per thread are kept in memory
+
+		@param producer function called with the first row of a band, its number of rows
+		and rows * getValuesPerRow() values to fill (concurrently from several threads with a pool)
+		@param pool thread pool which runs the producer and encodes bands (nullptr = calling thread only)
+		@param bandRows number of rows in a band (0 = rows of about 1MB of values)
+		*/
+		void writeBands(const std::function<void(size_t, size_t, TChannelType*)>& producer,
+			ThreadPool* pool = nullptr, size_t bandRows = 0)
+		{
+			const size_t BandBytes = 1024 * 1024;
+
+			const size_t valuesPerRow = getValuesPerRow();
+			if (bandRows == 0)
+			{
+				bandRows = std::max<size_t>(1, BandBytes / std::max<size_t>(1, valuesPerRow * sizeof(TChannelType)));
+			}
+			const size_t windowBands = (pool == nullptr) ? 1 : (pool->getThreadCount() + 1) * 2;
+			std::vector<std::vector<TChannelType>> window(windowBands);
+
+			auto writeBand = [&](size_t slot, size_t yStart) {
+				const size_t rows = std::min(bandRows, mHeight - yStart);
+				std::vector<TChannelType>& values = window[slot];
+				values.assign(rows * valuesPerRow, TChannelType());
+				producer(yStart, rows, values.data());
+				writeRows(yStart, rows, values.data());
+			};
+
+			for (size_t batchStart = 0; batchStart < mHeight; batchStart += windowBands * bandRows)
+			{
+				const size_t bands = std::min(windowBands, (mHeight - batchStart + bandRows - 1) / bandRows);
+				if (pool == nullptr)
+				{
+					writeBand(0, batchStart);
+					continue;
+				}
+				pool->parallelFor(bands, [&writeBand, batchStart, bandRows](size_t band) {
+					writeBand(band, batchStart + band * bandRows);
+				});
+			}
+		}
+
+		/**
+		Closes the file, throws std::runtime_error if some rows were not written
+		or if data couldn't be written (the file is incomplete then)
+		*/
+		void finish()
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mFinished) { return; }
+			mFinished = true;
+
+			mFile.close();
+			if (mWrittenRowCount != mHeight)
+			{
+				throw std::runtime_error("PnmStreamWriter finished with " + std::to_string(mHeight - mWrittenRowCount) +
+					" rows missing");
+			}
+		}
+	};
+}
@@ -0,0 +1,135 @@
+/*
+SpscQueue is an unbounded lock-free queue intended for
+exactly one producer thread and one consumer thread.
+Elements are stored in linked fixed-size chunks, the producer
+publishes every element by a release store of the chunk's
+commit counter and the consumer frees chunks it has fully read.
+
+(c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace protolib
+{
+	template<typename T, size_t ChunkSize = 256>
+	class SpscQueue
+	{
+	private:
+		static const size_t CacheLineSize = 64;
+
+		struct Chunk
+		{
+			T items[ChunkSize];
+			std::atomic<size_t> committed;
+			std::atomic<Chunk*> next;
+
+			Chunk()
+				:committed(0), next(nullptr)
+			{ }
+		};
+
+		// Producer's and consumer's positions are kept in separate cache lines
+		Chunk* mHead;
+		size_t mHeadIndex;
+		std::atomic<size_t> mPopped;
+		char mPadding1[CacheLineSize];
+		Chunk* mTail;
+		size_t mTailIndex;
+		std::atomic<size_t> mPushed;
+		char mPadding2[CacheLineSize];
+	public:
+		/**
+		Main constructor to initialize the whole class
+		*/
+		SpscQueue()
+			:mHead(new Chunk), mHeadIndex(0), mPopped(0), mTail(mHead), mTailIndex(0), mPushed(0)
+		{ }
+
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		~SpscQueue()
+		{
+			while (mHead != nullptr)
+			{
+				Chunk* next = mHead->next.load(std::memory_order_relaxed);
+				delete mHead;
+				mHead = next;
+			}
+		}
+
+		/**
+		Returns approximate number of elements in the queue
+
+		@return number of elements
+		*/
+		size_t size() const
+		{
+			size_t popped = mPopped.load(std::memory_order_acquire);
+			size_t pushed = mPushed.load(std::memory_order_acquire);
+			return pushed > popped ? pushed - popped : 0;
+		}
+
+		/**
+		Returns number of elements pushed since the construction
+
+		@return number of pushed elements
+		*/
+		size_t pushedCount() const
+		{
+			return mPushed.load(std::memory_order_acquire);
+		}
+
+		/**
+		Appends an element, may be called only by the producer thread
+
+		@param value element to be moved into the queue
+		*/
+		void push(T&& value)
+		{
+			if (mTailIndex == ChunkSize)
+			{
+				Chunk* chunk = new Chunk;
+				mTail->next.store(chunk, std::memory_order_release);
+				mTail = chunk;
+				mTailIndex = 0;
+			}
+
+			mTail->items[mTailIndex] = std::move(value);
+			++mTailIndex;
+			mTail->committed.store(mTailIndex, std::memory_order_release);
+			mPushed.store(mPushed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/**
+		Removes the oldest element, may be called only by the consumer thread
+
+		@param value where the element is moved
+		@return true if an element was removed, false if the queue was empty
+		*/
+		bool tryPop(T& value)
+		{
+			if (mHeadIndex == ChunkSize)
+			{
+				// Producer never touches a chunk again once it has linked the next one
+				Chunk* next = mHead->next.load(std::memory_order_acquire);
+				if (next == nullptr) { return false; }
+
+				delete mHead;
+				mHead = next;
+				mHeadIndex = 0;
+			}
+
+			if (mHeadIndex >= mHead->committed.load(std::memory_order_acquire)) { return false; }
+
+			value = std::move(mHead->items[mHeadIndex]);
+			++mHeadIndex;
+			mPopped.store(mPopped.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			return true;
+		}
+	};
+}
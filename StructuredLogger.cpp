@@ -0,0 +1,196 @@
+#include "StructuredLogger.h"
+#include <cmath>
+
+namespace protolib
+{
+	std::atomic<int> StructuredLogger::mFormat(static_cast<int>(StructuredLogger::Format::JSON_LINES));
+	std::atomic<size_t> StructuredLogger::mMaxElements(64);
+
+	namespace
+	{
+		const char* const hexDigits = "0123456789abcdef";
+
+		bool needsLogfmtQuotes(const char* str, size_t length)
+		{
+			if (length == 0) { return true; }
+
+			for (size_t i = 0; i < length; ++i)
+			{
+				unsigned char c = static_cast<unsigned char>(str[i]);
+				if (c <= ' ' || c == '=' || c == '"' || c == '\\' || c == 0x7f)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Escaping is the same for JSON strings and quoted logfmt values
+		void appendEscaped(std::string& output, const char* str, size_t length)
+		{
+			size_t plainStart = 0;
+			for (size_t i = 0; i < length; ++i)
+			{
+				unsigned char c = static_cast<unsigned char>(str[i]);
+				if (c >= 0x20 && c != '"' && c != '\\')
+				{
+					continue;
+				}
+
+				output.append(str + plainStart, i - plainStart);
+				plainStart = i + 1;
+				output += '\\';
+				switch (c)
+				{
+				case '"': output += '"'; break;
+				case '\\': output += '\\'; break;
+				case '\n': output += 'n'; break;
+				case '\r': output += 'r'; break;
+				case '\t': output += 't'; break;
+				case '\b': output += 'b'; break;
+				case '\f': output += 'f'; break;
+				default:
+					output += "u00";
+					output += hexDigits[c >> 4];
+					output += hexDigits[c & 0xf];
+				}
+			}
+			output.append(str + plainStart, length - plainStart);
+		}
+	}
+
+	std::string& StructuredLogger::getThreadBuffer()
+	{
+		// Capacity is kept between logs so the buffer stops growing after a few logs
+		thread_local std::string buffer;
+		return buffer;
+	}
+
+	std::string& StructuredLogger::getThreadScratchBuffer()
+	{
+		thread_local std::string buffer;
+		return buffer;
+	}
+
+	void StructuredLogger::appendHeader(std::string& output, Format format, Logger::LogType logType,
+		const char* message, const char* file, size_t line, uint64_t timestamp)
+	{
+		Encoding encoding = format == Format::JSON_LINES ? Encoding::JSON : Encoding::LOGFMT;
+		if (format == Format::JSON_LINES)
+		{
+			output += '{';
+		}
+
+		if (Logger::mTimestampOutput.load(std::memory_order_relaxed))
+		{
+			// Time is always quoted since it contains space
+			appendKey(output, "time", "", format);
+			output += '"';
+			LogClock::appendWallClock(output, LogClock::toWallClockNs(timestamp));
+			output += '"';
+		}
+
+		if (Logger::mThreadIndexOutput.load(std::memory_order_relaxed))
+		{
+			appendKey(output, "thread", "", format);
+			Formatter::appendUnsigned(output, LogClock::threadIndex());
+		}
+
+		appendKey(output, "level", "", format);
+		appendString(output, Logger::getTypeString(logType), 3, encoding);
+
+		if (file != nullptr && file[0] != '\0')
+		{
+			appendKey(output, "file", "", format);
+			appendString(output, file, strlen(file), encoding);
+			if (line > 0)
+			{
+				appendKey(output, "line", "", format);
+				Formatter::appendUnsigned(output, line);
+			}
+		}
+
+		appendKey(output, "msg", "", format);
+		appendString(output, message != nullptr ? message : "", message != nullptr ? strlen(message) : 0, encoding);
+	}
+
+	void StructuredLogger::finishLog(std::string& output, Format format, Logger::LogType logType, uint64_t timestamp)
+	{
+		if (format == Format::JSON_LINES)
+		{
+			output += '}';
+		}
+		output += '\n';
+
+		Logger::dispatchRawLog(output, logType, timestamp, LogClock::threadIndex());
+	}
+
+	void StructuredLogger::appendKey(std::string& output, const char* key, const char* suffix, Format format)
+	{
+		if (format == Format::JSON_LINES)
+		{
+			if (output.size() > 1)
+			{
+				output += ',';
+			}
+			output += '"';
+			appendEscaped(output, key, strlen(key));
+			output += suffix;
+			output += "\":";
+		}
+		else
+		{
+			if (!output.empty())
+			{
+				output += ' ';
+			}
+			output += key;
+			output += suffix;
+			output += '=';
+		}
+	}
+
+	void StructuredLogger::appendString(std::string& output, const char* str, size_t length, Encoding encoding)
+	{
+		if (encoding == Encoding::LOGFMT_ELEMENT ||
+			(encoding == Encoding::LOGFMT && !needsLogfmtQuotes(str, length)))
+		{
+			output.append(str, length);
+			return;
+		}
+
+		output += '"';
+		appendEscaped(output, str, length);
+		output += '"';
+	}
+
+	void StructuredLogger::appendFloating(std::string& output, double value, Encoding encoding)
+	{
+		if (!std::isfinite(value))
+		{
+			// JSON has no representation of NaN and infinities
+			if (encoding == Encoding::JSON)
+			{
+				output += "null";
+			}
+			else
+			{
+				output += std::isnan(value) ? "NaN" : (value > 0 ? "+Inf" : "-Inf");
+			}
+			return;
+		}
+
+		Formatter::appendDouble(output, value);
+	}
+
+	void StructuredLogger::appendFloating(std::string& output, float value, Encoding encoding)
+	{
+		if (!std::isfinite(value))
+		{
+			appendFloating(output, static_cast<double>(value), encoding);
+			return;
+		}
+
+		Formatter::appendFloat(output, value);
+	}
+}
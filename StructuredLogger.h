@@ -0,0 +1,318 @@
+/*
+   StructuredLogger is a static class writing machine-readable key/value logs
+   as JSON Lines or logfmt, so that downstream tools don't have to parse
+   free text of Logger. Fields are taken by reference (see field(...))
+   and serialized directly into a reusable per-thread buffer, i.e. no heap
+   allocation happens in the steady state when logs are processed instantly
+   or asynchronously (in synced mode the finished line is copied).
+   The line is then handed over to Logger and follows its current mode,
+   sinks and log level.
+
+   Supported values are bools, chars, integers, floating point numbers,
+   strings, std::pair and containers supporting std::begin/std::end which are
+   serialized as arrays (pairs as arrays of two values, i.e. maps as arrays of
+   [key, value] arrays). Only first getMaxElements() elements of each array
+   are outputted, number of omitted elements of a field is reported by an
+   extra "<key>_omitted" field. Values of other types are outputted as strings
+   via operator<< (which allocates).
+
+   JSON Lines: {"level":"INF","file":"main.cpp","line":12,"msg":"done","id":42,"tags":["a","b"]}
+   logfmt:     level=INF file=main.cpp line=12 msg=done id=42 tags=[a,b]
+
+   Wall-clock time ("time") and thread index ("thread") are outputted as
+   the first fields when enabled in Logger (enableTimestamps, enableThreadIndices).
+   Keys are expected to be plain identifiers, they are escaped only in JSON.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "Formatter.h"
+#include "Logger.h"
+
+namespace protolib
+{
+	// Named value of a structured log, holds only a reference to the value
+	template<typename T>
+	struct LogField
+	{
+		const char* key;
+		const T& value;
+	};
+
+	/**
+	Creates field of a structured log, the value must outlive the write call
+	(temporaries created in the arguments of the call are fine)
+
+	@param key name of the field
+	@param value value of the field
+	@return field referencing the value
+	*/
+	template<typename T>
+	LogField<T> field(const char* key, const T& value)
+	{
+		return LogField<T>{ key, value };
+	}
+
+	// Detects types which are serialized as arrays
+	template<typename T, typename = void>
+	struct IsLogContainer : std::false_type
+	{ };
+
+	template<typename T>
+	struct IsLogContainer<T, decltype(std::begin(std::declval<const T&>()), std::end(std::declval<const T&>()), void())>
+		: std::true_type
+	{ };
+
+	class StructuredLogger
+	{
+	public:
+		enum class Format
+		{
+			JSON_LINES = 1,		// One JSON object per line
+			LOGFMT,				// key=value pairs separated by spaces
+		};
+	private:
+		// How a value is serialized, LOGFMT_ELEMENT is used inside of arrays in logfmt
+		// where the whole array is quoted at once if needed
+		enum class Encoding
+		{
+			JSON = 1,
+			LOGFMT,
+			LOGFMT_ELEMENT,
+		};
+
+		static std::atomic<int> mFormat;
+		static std::atomic<size_t> mMaxElements;
+
+		static std::string& getThreadBuffer();
+
+		static std::string& getThreadScratchBuffer();
+
+		static void appendHeader(std::string& output, Format format, Logger::LogType logType,
+			const char* message, const char* file, size_t line, uint64_t timestamp);
+
+		static void finishLog(std::string& output, Format format, Logger::LogType logType, uint64_t timestamp);
+
+		static void appendKey(std::string& output, const char* key, const char* suffix, Format format);
+
+		static void appendString(std::string& output, const char* str, size_t length, Encoding encoding);
+
+		static void appendFloating(std::string& output, double value, Encoding encoding);
+
+		static void appendFloating(std::string& output, float value, Encoding encoding);
+
+		static void appendValue(std::string& output, bool value, Encoding, size_t&)
+		{
+			output += value ? "true" : "false";
+		}
+
+		static void appendValue(std::string& output, char value, Encoding encoding, size_t&)
+		{
+			appendString(output, &value, 1, encoding);
+		}
+
+		static void appendValue(std::string& output, const char* value, Encoding encoding, size_t&)
+		{
+			if (value == nullptr)
+			{
+				output += encoding == Encoding::JSON ? "null" : "";
+				return;
+			}
+			appendString(output, value, strlen(value), encoding);
+		}
+
+		static void appendValue(std::string& output, char* value, Encoding encoding, size_t& omitted)
+		{
+			appendValue(output, static_cast<const char*>(value), encoding, omitted);
+		}
+
+		static void appendValue(std::string& output, const std::string& value, Encoding encoding, size_t&)
+		{
+			appendString(output, value.data(), value.size(), encoding);
+		}
+
+		template<typename T>
+		static void appendValue(std::string& output, const T& value, Encoding encoding, size_t& omitted)
+		{
+			appendValue(output, value, encoding, omitted, std::is_integral<T>(), std::is_floating_point<T>());
+		}
+
+		template<typename T>
+		static void appendValue(std::string& output, const T& value, Encoding, size_t&,
+			std::true_type /*isIntegral*/, std::false_type)
+		{
+			if (std::is_signed<T>::value)
+			{
+				Formatter::appendSigned(output, static_cast<int64_t>(value));
+			}
+			else
+			{
+				Formatter::appendUnsigned(output, static_cast<uint64_t>(value));
+			}
+		}
+
+		template<typename T>
+		static void appendValue(std::string& output, const T& value, Encoding encoding, size_t&,
+			std::false_type, std::true_type /*isFloatingPoint*/)
+		{
+			typedef typename std::conditional<std::is_same<T, float>::value, float, double>::type Floating;
+			appendFloating(output, static_cast<Floating>(value), encoding);
+		}
+
+		template<typename T>
+		static void appendValue(std::string& output, const T& value, Encoding encoding, size_t& omitted,
+			std::false_type, std::false_type)
+		{
+			appendOther(output, value, encoding, omitted, IsLogContainer<T>());
+		}
+
+		template<typename A, typename B>
+		static void appendOther(std::string& output, const std::pair<A, B>& value, Encoding encoding, size_t&,
+			std::false_type)
+		{
+			size_t ignored = 0;
+			output += '[';
+			appendValue(output, value.first, encoding, ignored);
+			output += ',';
+			appendValue(output, value.second, encoding, ignored);
+			output += ']';
+		}
+
+		template<typename T>
+		static void appendOther(std::string& output, const T& value, Encoding encoding, size_t& omitted,
+			std::true_type /*isContainer*/)
+		{
+			if (encoding == Encoding::LOGFMT)
+			{
+				// Array is rendered without quoting first and then quoted as a whole if needed
+				std::string& scratch = getThreadScratchBuffer();
+				scratch.clear();
+				appendOther(scratch, value, Encoding::LOGFMT_ELEMENT, omitted, std::true_type());
+				appendString(output, scratch.data(), scratch.size(), Encoding::LOGFMT);
+				return;
+			}
+
+			const size_t maxElements = getMaxElements();
+			size_t count = 0;
+			size_t ignored = 0;
+			auto it = std::begin(value);
+			auto end = std::end(value);
+			output += '[';
+			for (; it != end && count < maxElements; ++it, ++count)
+			{
+				if (count > 0)
+				{
+					output += ',';
+				}
+				appendValue(output, *it, encoding, ignored);
+			}
+			output += ']';
+			omitted = static_cast<size_t>(std::distance(it, end));
+		}
+
+		template<typename T>
+		static void appendOther(std::string& output, const T& value, Encoding encoding, size_t&, std::false_type)
+		{
+			std::stringstream ss;
+			ss << value;
+			const std::string str = ss.str();
+			appendString(output, str.data(), str.size(), encoding);
+		}
+
+		template<typename T>
+		static void appendField(std::string& output, Format format, const LogField<T>& logField)
+		{
+			appendKey(output, logField.key, "", format);
+
+			size_t omitted = 0;
+			appendValue(output, logField.value, format == Format::JSON_LINES ? Encoding::JSON : Encoding::LOGFMT, omitted);
+			if (omitted > 0)
+			{
+				appendKey(output, logField.key, "_omitted", format);
+				Formatter::appendUnsigned(output, omitted);
+			}
+		}
+	public:
+		/**
+		Sets output format of structured logs (JSON_LINES by default)
+
+		@param format new output format
+		*/
+		static void setFormat(Format format)
+		{
+			mFormat.store(static_cast<int>(format), std::memory_order_relaxed);
+		}
+
+		/**
+		Returns output format of structured logs
+
+		@return output format
+		*/
+		static Format getFormat()
+		{
+			return static_cast<Format>(mFormat.load(std::memory_order_relaxed));
+		}
+
+		/**
+		Sets maximal number of outputted elements of each array (64 by default)
+
+		@param maxElements maximal number of elements
+		*/
+		static void setMaxElements(size_t maxElements)
+		{
+			mMaxElements.store(maxElements, std::memory_order_relaxed);
+		}
+
+		/**
+		Returns maximal number of outputted elements of each array
+
+		@return maximal number of elements
+		*/
+		static size_t getMaxElements()
+		{
+			return mMaxElements.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Writes a structured log
+
+		@param logType type of log
+		@param message short description of the event
+		@param file file which contains this write call (e.g. main.cpp)
+		@param line line in the file (0 if unknown)
+		@param fields fields created by field(...)
+		*/
+		template<typename... Fields>
+		static void write(Logger::LogType logType, const char* message, const char* file, size_t line,
+			const Fields&... fields)
+		{
+			if (!Logger::isLogEnabled(logType)) { return; }
+
+			uint64_t timestamp = LogClock::now();
+			Format format = getFormat();
+			std::string& output = getThreadBuffer();
+			output.clear();
+			appendHeader(output, format, logType, message, file, line, timestamp);
+			int expand[] = { 0, (appendField(output, format, fields), 0)... };
+			(void)expand;
+			finishLog(output, format, logType, timestamp);
+		}
+	};
+}
+
+// Writes a structured log of given type (DBG, INF, WAR or ERR) with the current file and line
+// ------
+// Example usage:
+// PROTOLIB_LOG_FIELDS(INF, "request done", protolib::field("id", id), protolib::field("latency_ms", latency));
+// ------
+#define PROTOLIB_LOG_FIELDS(type, message, ...) PROTOLIB_LOG_IF_ENABLED(type, \
+	::protolib::StructuredLogger::write(::protolib::Logger::LogType::type, (message), __FILE__, __LINE__, ##__VA_ARGS__))
@@ -1,27 +1,67 @@
 #include "SvgExporter.h"
 #include <fstream>
 #include <string>
+#include "Formatter.h"
+#include "Tracer.h"
 
 namespace protolib
 {
+	namespace
+	{
+		typedef FormatBuffer<512> SvgElement;
+
+		// Appends stroke, fill (unless nullptr) and stroke-width attributes followed by additional
+		// attributes and end of the tag, value of the previous attribute is not terminated yet
+		void appendStyle(SvgElement& element, size_t strokeWidth, const std::string& stroke, const std::string* fill,
+			const std::string& additionalAttributes, const char* tagEnd)
+		{
+			if (strokeWidth > 0)
+			{
+				element.append("\" stroke=\"").append(stroke);
+			}
+			if (fill != nullptr)
+			{
+				element.append("\" fill=\"").append(*fill);
+			}
+			if (strokeWidth > 0)
+			{
+				element.append("\" stroke-width=\"").appendUnsigned(strokeWidth);
+			}
+			element.append("\" ").append(additionalAttributes).append(tagEnd, strlen(tagEnd));
+		}
+
+		void appendPoints(SvgElement& element, const std::vector<std::pair<int, int>>& points)
+		{
+			for (const auto& coord : points)
+			{
+				element.appendSigned(coord.first).append(',').appendSigned(coord.second).append(' ');
+			}
+		}
+	}
+
 	void SvgExporter::save(const std::string& filepath) const
 	{
+		PROTOLIB_TRACE_SCOPE("SvgExporter", "save");
 		std::ofstream svgImage(filepath);
 
-		svgImage << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>" << std::endl;
-		svgImage << "<svg ";
+		SvgElement header;
+		header.append("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n<svg ");
 		if (mWidth > 0 && mHeight > 0)
 		{
-			svgImage << "width=\"" << mWidth << "\" height=\"" << mHeight << "\" ";
+			header.append("width=\"").appendUnsigned(mWidth).append("\" height=\"").appendUnsigned(mHeight).append("\" ");
 		}
-		svgImage << "xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">" << std::endl;
+		header.append("xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n");
+		svgImage.write(header.data(), header.size());
 
+		// Lines are not flushed one by one, the stream is flushed when the file is closed
 		for (const auto& object : mSvgObjects)
 		{
-			svgImage << "\t" << object << std::endl;
+			svgImage.put('\t');
+			svgImage.write(object.data(), object.size());
+			svgImage.put('\n');
 		}
 
-		svgImage << "</svg>" << std::endl;
+		svgImage << "</svg>\n";
 	}
 
 	void SvgExporter::removeAll()
@@ -37,92 +77,78 @@ namespace protolib
 	void SvgExporter::addRectangle(int x, int y, int width, int height, 
 		const std::string& fill, const std::string& stroke, const std::string& additionalAttributes)
 	{
-		mSvgObjects.push_back("<rect x=\"" + std::to_string(x) + "\" y=\"" + std::to_string(y) + 
-			"\" width=\"" + std::to_string(width) + "\" height=\"" + std::to_string(height) + 
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			"\" fill=\"" + (fill.empty() ? mDefaultFill : fill) +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") + 
-			"\" " + additionalAttributes + " />"
-		);
+		SvgElement element;
+		element.append("<rect x=\"").appendSigned(x).append("\" y=\"").appendSigned(y)
+			.append("\" width=\"").appendSigned(width).append("\" height=\"").appendSigned(height);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			fill.empty() ? &mDefaultFill : &fill, additionalAttributes, " />");
+		mSvgObjects.push_back(element.toString());
 	}
 
 	void SvgExporter::addCircle(int x, int y, int radius, 
 		const std::string& fill, const std::string& stroke, const std::string& additionalAttributes)
 	{
-		mSvgObjects.push_back("<circle cx=\"" + std::to_string(x) + "\" cy=\"" + std::to_string(y) +
-			"\" r=\"" + std::to_string(radius) +
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			"\" fill=\"" + (fill.empty() ? mDefaultFill : fill) +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") +
-			"\" " + additionalAttributes + " />"
-		);
+		SvgElement element;
+		element.append("<circle cx=\"").appendSigned(x).append("\" cy=\"").appendSigned(y)
+			.append("\" r=\"").appendSigned(radius);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			fill.empty() ? &mDefaultFill : &fill, additionalAttributes, " />");
+		mSvgObjects.push_back(element.toString());
 	}
 
 	void SvgExporter::addEllipse(int x, int y, int width, int height, 
 		const std::string& fill, const std::string& stroke, const std::string& additionalAttributes)
 	{
-		mSvgObjects.push_back("<ellipse cx=\"" + std::to_string(x) + "\" cy=\"" + std::to_string(y) +
-			"\" rx=\"" + std::to_string(width) + "\" ry=\"" + std::to_string(height) +
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			"\" fill=\"" + (fill.empty() ? mDefaultFill : fill) +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") +
-			"\" " + additionalAttributes + " />"
-		);
+		SvgElement element;
+		element.append("<ellipse cx=\"").appendSigned(x).append("\" cy=\"").appendSigned(y)
+			.append("\" rx=\"").appendSigned(width).append("\" ry=\"").appendSigned(height);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			fill.empty() ? &mDefaultFill : &fill, additionalAttributes, " />");
+		mSvgObjects.push_back(element.toString());
 	}
 
 	void SvgExporter::addLine(int xStart, int yStart, int xEnd, int yEnd, 
 		const std::string& stroke, const std::string& additionalAttributes)
 	{
-		mSvgObjects.push_back("<line x1=\"" + std::to_string(xStart) + "\" y1=\"" + std::to_string(yStart) +
-			"\" x2=\"" + std::to_string(xEnd) + "\" y2=\"" + std::to_string(yEnd) +
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") +
-			"\" " + additionalAttributes + " />"
-		);
+		SvgElement element;
+		element.append("<line x1=\"").appendSigned(xStart).append("\" y1=\"").appendSigned(yStart)
+			.append("\" x2=\"").appendSigned(xEnd).append("\" y2=\"").appendSigned(yEnd);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			nullptr, additionalAttributes, " />");
+		mSvgObjects.push_back(element.toString());
 	}
 
 	void SvgExporter::addPolygon(const std::vector<std::pair<int, int>>& points, 
 		const std::string& fill, const std::string& stroke, const std::string& additionalAttributes)
 	{
-		std::string pointsStr;
-		for (const auto& coord : points)
-		{
-			pointsStr += std::to_string(coord.first) + "," + std::to_string(coord.second) + " ";
-		}
-
-		mSvgObjects.push_back("<polygon points=\"" + pointsStr +
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			"\" fill=\"" + (fill.empty() ? mDefaultFill : fill) +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") +
-			"\" " + additionalAttributes + " />"
-		);
+		SvgElement element;
+		element.append("<polygon points=\"");
+		appendPoints(element, points);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			fill.empty() ? &mDefaultFill : &fill, additionalAttributes, " />");
+		mSvgObjects.push_back(element.toString());
 	}
 
 	void SvgExporter::addPolyline(const std::vector<std::pair<int, int>>& points,
 		const std::string& stroke, const std::string& additionalAttributes)
 	{
-		std::string pointsStr;
-		for (const auto& coord : points)
-		{
-			pointsStr += std::to_string(coord.first) + "," + std::to_string(coord.second) + " ";
-		}
-
-		mSvgObjects.push_back("<polyline points=\"" + pointsStr +
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") +
-			"\" " + additionalAttributes + " />"
-		);
+		SvgElement element;
+		element.append("<polyline points=\"");
+		appendPoints(element, points);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			nullptr, additionalAttributes, " />");
+		mSvgObjects.push_back(element.toString());
 	}
 
 	void SvgExporter::addText(int x, int y, int fontSize, const std::string& text,
 		const std::string& fill, const std::string& stroke, const std::string& additionalAttributes)
 	{
-		mSvgObjects.push_back("<text x=\"" + std::to_string(x) + "\" y=\"" + std::to_string(y) +
-			"\" font-size=\"" + std::to_string(fontSize) + 
-			(mDefaultStrokeWidth > 0 ? "\" stroke=\"" + (stroke.empty() ? mDefaultStroke : stroke) : "") +
-			"\" fill=\"" + (fill.empty() ? mDefaultFill : fill) +
-			(mDefaultStrokeWidth > 0 ? ("\" stroke-width=\"" + std::to_string(mDefaultStrokeWidth)) : "") +
-			"\" " + additionalAttributes + ">" + text + "</text>"
-		);
+		SvgElement element;
+		element.append("<text x=\"").appendSigned(x).append("\" y=\"").appendSigned(y)
+			.append("\" font-size=\"").appendSigned(fontSize);
+		appendStyle(element, mDefaultStrokeWidth, stroke.empty() ? mDefaultStroke : stroke,
+			fill.empty() ? &mDefaultFill : &fill, additionalAttributes, ">");
+		element.append(text).append("</text>");
+		mSvgObjects.push_back(element.toString());
 	}
 }
@@ -0,0 +1,104 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace protolib
+{
+	ThreadPool::ThreadPool(size_t threads)
+		:mStop(false)
+	{
+		mWorkers.reserve(threads);
+		for (size_t i = 0; i < threads; ++i)
+		{
+			mWorkers.emplace_back(&ThreadPool::worker, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+		mJobsCv.notify_all();
+		for (auto& worker : mWorkers)
+		{
+			worker.join();
+		}
+	}
+
+	bool ThreadPool::runNextTask(std::unique_lock<std::mutex>& lock)
+	{
+		if (mJobs.empty()) { return false; }
+
+		Job* job = mJobs.front();
+		size_t index = job->next++;
+		if (job->next == job->count)
+		{
+			mJobs.pop_front();
+		}
+
+		lock.unlock();
+		std::exception_ptr error;
+		try
+		{
+			(*job->task)(index);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		lock.lock();
+
+		if (error && !job->error)
+		{
+			job->error = error;
+		}
+		if (++job->done == job->count)
+		{
+			mDoneCv.notify_all();
+		}
+		return true;
+	}
+
+	void ThreadPool::worker()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (true)
+		{
+			mJobsCv.wait(lock, [this]() { return mStop || !mJobs.empty(); });
+			if (mJobs.empty()) { return; }
+
+			runNextTask(lock);
+		}
+	}
+
+	void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task)
+	{
+		if (count == 0) { return; }
+
+		Job job{ &task, count, 0, 0, nullptr };
+		std::unique_lock<std::mutex> lock(mMutex);
+		mJobs.push_back(&job);
+		if (count > 1)
+		{
+			mJobsCv.notify_all();
+		}
+
+		// Caller works on its own job (or on jobs queued before it) until all tasks are claimed
+		while (job.next < job.count && runNextTask(lock)) { }
+		mDoneCv.wait(lock, [&job]() { return job.done == job.count; });
+		lock.unlock();
+
+		if (job.error)
+		{
+			std::rethrow_exception(job.error);
+		}
+	}
+
+	ThreadPool& ThreadPool::getShared()
+	{
+		// Pool is never destroyed so that it can be used during static destruction
+		static ThreadPool* pool = new ThreadPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		return *pool;
+	}
+}
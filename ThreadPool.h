@@ -0,0 +1,92 @@
+/*
+   ThreadPool runs indexed tasks on a fixed set of worker threads.
+   parallelFor blocks until all tasks are done and the calling thread
+   processes tasks too, so the pool makes progress even when parallelFor
+   is called from a task or when the pool has no workers. Tasks should
+   be coarse (e.g. bands of image rows) since each one is claimed under a lock.
+   The shared pool has one worker less than there are hardware threads
+   and it lives until the end of the program.
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace protolib
+{
+	class ThreadPool
+	{
+	private:
+		struct Job
+		{
+			const std::function<void(size_t)>* task;
+			size_t count;
+			size_t next;
+			size_t done;
+			std::exception_ptr error;
+		};
+
+		std::vector<std::thread> mWorkers;
+		// Following members are guarded by mMutex
+		std::deque<Job*> mJobs;
+		bool mStop;
+		std::mutex mMutex;
+		std::condition_variable mJobsCv;
+		std::condition_variable mDoneCv;
+
+		void worker();
+
+		// Claims and runs one task of the first job, lock is released while the task runs
+		// and the job is removed from the queue once all its tasks are claimed
+		bool runNextTask(std::unique_lock<std::mutex>& lock);
+	public:
+		/**
+		Main constructor to initialize the whole class
+
+		@param threads number of worker threads (might be 0, then tasks run in the calling thread)
+		*/
+		explicit ThreadPool(size_t threads);
+
+		/**
+		Waits for running tasks and stops worker threads
+		*/
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/**
+		Returns number of worker threads
+
+		@return number of worker threads
+		*/
+		size_t getThreadCount() const
+		{
+			return mWorkers.size();
+		}
+
+		/**
+		Calls task(i) for each i from 0 to count - 1 in parallel and waits until all calls finish,
+		if some calls throw, the first caught exception is rethrown once all calls finished
+
+		@param count number of tasks
+		@param task function called with index of each task (concurrently from several threads)
+		*/
+		void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+		/**
+		Returns pool shared by the library (hardware threads - 1 workers)
+
+		@return shared pool
+		*/
+		static ThreadPool& getShared();
+	};
+}
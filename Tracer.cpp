@@ -0,0 +1,325 @@
+#include "Tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace protolib
+{
+	const size_t Tracer::MaxEventsPerThread;
+
+	std::atomic<bool> Tracer::mEnabled(false);
+
+	namespace
+	{
+		enum class EventType : char
+		{
+			SPAN = 'X',
+			INSTANT = 'i',
+			COUNTER = 'C'
+		};
+
+		struct TraceEvent
+		{
+			const char* category;
+			const char* name;
+			uint64_t start;
+			uint64_t end;
+			double value;
+			EventType type;
+		};
+
+		const size_t eventsPerChunk = 4096;
+		const size_t maxChunks = Tracer::MaxEventsPerThread / eventsPerChunk;
+
+		// Events of a single thread, appended only by the owner thread, chunks are
+		// allocated lazily and never moved so that readers can access published events.
+		// clear() only bumps clearGeneration, the owner notices it on the next append
+		// and starts again from the first event, reusing its chunks.
+		struct ThreadBuffer
+		{
+			std::atomic<TraceEvent*> chunks[maxChunks];
+			std::atomic<size_t> size;
+			std::atomic<uint64_t> dropped;
+			std::atomic<uint32_t> clearGeneration;	// Number of clear() calls (changed under registry mutex)
+			std::atomic<uint32_t> resetGeneration;	// Generation the owner has reset the buffer for
+			uint32_t threadIndex;
+			bool finished;			// Owner thread has finished (guarded by registry mutex)
+
+			ThreadBuffer()
+				:size(0), dropped(0), clearGeneration(0), resetGeneration(0), threadIndex(LogClock::threadIndex()),
+				finished(false)
+			{
+				for (auto& chunk : chunks)
+				{
+					chunk.store(nullptr, std::memory_order_relaxed);
+				}
+			}
+
+			~ThreadBuffer()
+			{
+				for (auto& chunk : chunks)
+				{
+					delete[] chunk.load(std::memory_order_relaxed);
+				}
+			}
+
+			void append(const TraceEvent& event)
+			{
+				const uint32_t generation = clearGeneration.load(std::memory_order_acquire);
+				if (generation != resetGeneration.load(std::memory_order_relaxed))
+				{
+					// Empty buffer is published before any event of the new generation
+					size.store(0, std::memory_order_relaxed);
+					resetGeneration.store(generation, std::memory_order_release);
+				}
+
+				size_t index = size.load(std::memory_order_relaxed);
+				size_t chunkIndex = index / eventsPerChunk;
+				if (chunkIndex >= maxChunks)
+				{
+					dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+
+				TraceEvent* chunk = chunks[chunkIndex].load(std::memory_order_relaxed);
+				if (chunk == nullptr)
+				{
+					chunk = new TraceEvent[eventsPerChunk];
+					chunks[chunkIndex].store(chunk, std::memory_order_release);
+				}
+				chunk[index % eventsPerChunk] = event;
+				size.store(index + 1, std::memory_order_release);
+			}
+
+			const TraceEvent& get(size_t index) const
+			{
+				return chunks[index / eventsPerChunk].load(std::memory_order_acquire)[index % eventsPerChunk];
+			}
+
+			// Returns number of events recorded since the last clear(), the caller must hold registry mutex
+			size_t getPublishedSize() const
+			{
+				// Until the owner resets the buffer, its events belong to the cleared generation
+				if (resetGeneration.load(std::memory_order_acquire) != clearGeneration.load(std::memory_order_relaxed))
+				{
+					return 0;
+				}
+				return size.load(std::memory_order_acquire);
+			}
+		};
+
+		// Buffers outlive their threads so that their events can be exported,
+		// never destroyed since threads might finish during static destruction
+		struct TraceRegistry
+		{
+			std::mutex mutex;
+			std::vector<ThreadBuffer*> buffers;
+			uint64_t startTicks = 0;
+			bool startSet = false;
+		};
+
+		TraceRegistry& getRegistry()
+		{
+			static TraceRegistry* registry = new TraceRegistry();
+			return *registry;
+		}
+
+		ThreadBuffer& getThreadBuffer()
+		{
+			struct Holder
+			{
+				ThreadBuffer* buffer;
+
+				Holder()
+					:buffer(new ThreadBuffer())
+				{
+					TraceRegistry& registry = getRegistry();
+					std::lock_guard<std::mutex> lock(registry.mutex);
+					registry.buffers.push_back(buffer);
+				}
+
+				~Holder()
+				{
+					TraceRegistry& registry = getRegistry();
+					std::lock_guard<std::mutex> lock(registry.mutex);
+					buffer->finished = true;
+				}
+			};
+			thread_local Holder holder;
+			return *holder.buffer;
+		}
+
+		void writeJsonString(std::ostream& output, const char* text)
+		{
+			output << '"';
+			for (const char* c = text; *c != '\0'; ++c)
+			{
+				if (*c == '"' || *c == '\\')
+				{
+					output << '\\' << *c;
+				}
+				else if (static_cast<unsigned char>(*c) < 0x20)
+				{
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*c));
+					output << escaped;
+				}
+				else
+				{
+					output << *c;
+				}
+			}
+			output << '"';
+		}
+	}
+
+	void Tracer::start()
+	{
+		TraceRegistry& registry = getRegistry();
+		{
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			if (!registry.startSet)
+			{
+				registry.startTicks = LogClock::now();
+				registry.startSet = true;
+			}
+		}
+		mEnabled.store(true, std::memory_order_relaxed);
+	}
+
+	void Tracer::stop()
+	{
+		mEnabled.store(false, std::memory_order_relaxed);
+	}
+
+	void Tracer::clear()
+	{
+		TraceRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		auto finishedEnd = std::remove_if(registry.buffers.begin(), registry.buffers.end(), [](ThreadBuffer* buffer) {
+			if (buffer->finished)
+			{
+				delete buffer;
+				return true;
+			}
+			buffer->clearGeneration.fetch_add(1, std::memory_order_release);
+			buffer->dropped.store(0, std::memory_order_relaxed);
+			return false;
+		});
+		registry.buffers.erase(finishedEnd, registry.buffers.end());
+		registry.startSet = false;
+		if (isEnabled())
+		{
+			registry.startTicks = LogClock::now();
+			registry.startSet = true;
+		}
+	}
+
+	void Tracer::recordSpan(const char* category, const char* name, uint64_t startTicks, uint64_t endTicks)
+	{
+		getThreadBuffer().append({ category, name, startTicks, endTicks, 0.0, EventType::SPAN });
+	}
+
+	void Tracer::recordInstant(const char* category, const char* name)
+	{
+		uint64_t now = LogClock::now();
+		getThreadBuffer().append({ category, name, now, now, 0.0, EventType::INSTANT });
+	}
+
+	void Tracer::recordCounter(const char* name, double value)
+	{
+		uint64_t now = LogClock::now();
+		getThreadBuffer().append({ "counter", name, now, now, value, EventType::COUNTER });
+	}
+
+	uint64_t Tracer::getDroppedEventsCount()
+	{
+		TraceRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		uint64_t dropped = 0;
+		for (const ThreadBuffer* buffer : registry.buffers)
+		{
+			dropped += buffer->dropped.load(std::memory_order_relaxed);
+		}
+		return dropped;
+	}
+
+	void Tracer::exportChromeJson(std::ostream& output)
+	{
+		TraceRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		const double usPerTick = 1e6 / LogClock::ticksPerSecond();
+		const uint64_t startTicks = registry.startTicks;
+		auto toUs = [usPerTick, startTicks](uint64_t ticks) {
+			return ticks >= startTicks ? static_cast<double>(ticks - startTicks) * usPerTick :
+				-static_cast<double>(startTicks - ticks) * usPerTick;
+		};
+
+		char number[32];
+		bool first = true;
+		output << "{\"traceEvents\":[";
+		for (const ThreadBuffer* buffer : registry.buffers)
+		{
+			size_t size = buffer->getPublishedSize();
+			if (size == 0) { continue; }
+
+			output << (first ? "\n" : ",\n");
+			first = false;
+			output << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadIndex <<
+				",\"args\":{\"name\":\"Thread " << buffer->threadIndex << "\"}}";
+
+			for (size_t i = 0; i < size; ++i)
+			{
+				const TraceEvent& event = buffer->get(i);
+				output << ",\n{\"name\":";
+				writeJsonString(output, event.name);
+				output << ",\"cat\":";
+				writeJsonString(output, event.category);
+				output << ",\"ph\":\"" << static_cast<char>(event.type) << "\",\"pid\":1,\"tid\":" << buffer->threadIndex;
+				snprintf(number, sizeof(number), "%.3f", toUs(event.start));
+				output << ",\"ts\":" << number;
+
+				switch (event.type)
+				{
+				case EventType::SPAN:
+					snprintf(number, sizeof(number), "%.3f", static_cast<double>(event.end - event.start) * usPerTick);
+					output << ",\"dur\":" << number;
+					break;
+				case EventType::INSTANT:
+					output << ",\"s\":\"t\"";
+					break;
+				case EventType::COUNTER:
+					output << ",\"args\":{\"value\":";
+					// JSON has no representation of NaN and infinities
+					if (std::isfinite(event.value))
+					{
+						snprintf(number, sizeof(number), "%.17g", event.value);
+						output << number;
+					}
+					else
+					{
+						output << "null";
+					}
+					output << '}';
+					break;
+				}
+				output << '}';
+			}
+		}
+		output << "\n],\"displayTimeUnit\":\"ns\"}\n";
+	}
+
+	bool Tracer::saveChromeJson(const std::string& fileName)
+	{
+		std::ofstream output(fileName, std::ios::trunc);
+		if (!output.is_open()) { return false; }
+
+		exportChromeJson(output);
+		return static_cast<bool>(output);
+	}
+}
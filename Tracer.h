@@ -0,0 +1,172 @@
+/*
+   Tracer records scoped spans, instant events and counters of the program
+   and exports them in the Chrome Trace Event JSON format, which is opened
+   by chrome://tracing, Perfetto UI and similar viewers.
+   Every thread appends events to its own buffer (single writer, readers
+   see only events published by a release store), so recording takes no lock.
+   Timestamps are LogClock ticks converted to microseconds only when
+   the trace is exported, thread ids are LogClock thread indices
+   (the same as "[Thread N]" of log records).
+   Names and categories of events aren't copied, they have to outlive
+   the export (string literals are expected).
+
+   Tracing macros are compiled in only when PROTOLIB_TRACING is defined
+   as 1, otherwise they expand to nothing (including spans of ContainerWrapper
+   pipelines and exporters), so the tracing costs nothing unless it is wanted.
+   In compiled-in tracing, recording is enabled by Tracer::start().
+
+   (c) 2018 David Kutak
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "LogClock.h"
+
+#ifndef PROTOLIB_TRACING
+#define PROTOLIB_TRACING 0
+#endif
+
+namespace protolib
+{
+	class Tracer
+	{
+	private:
+		static std::atomic<bool> mEnabled;
+	public:
+		/**
+		Enables recording of events (the first start after clear() also sets zero time of the trace)
+		*/
+		static void start();
+
+		/**
+		Disables recording of events, already recorded events are kept
+		*/
+		static void stop();
+
+		/**
+		Checks whether events are recorded
+
+		@return true if events are recorded, false otherwise
+		*/
+		static bool isEnabled()
+		{
+			return mEnabled.load(std::memory_order_relaxed);
+		}
+
+		/**
+		Discards all recorded events and resets the dropped events count.
+		Memory of buffers of running threads is kept, each thread reuses it
+		for its next events, so a thread can record MaxEventsPerThread events
+		between two calls of clear() (further events are dropped).
+		*/
+		static void clear();
+
+		/**
+		Records a span which started and ended at given ticks (usually used through TraceScope)
+
+		@param category category of the span
+		@param name name of the span
+		@param startTicks LogClock ticks of the start of the span
+		@param endTicks LogClock ticks of the end of the span
+		*/
+		static void recordSpan(const char* category, const char* name, uint64_t startTicks, uint64_t endTicks);
+
+		/**
+		Records an instant event of the calling thread
+
+		@param category category of the event
+		@param name name of the event
+		*/
+		static void recordInstant(const char* category, const char* name);
+
+		/**
+		Records current value of a counter (viewers plot counters as graphs)
+
+		@param name name of the counter
+		@param value current value
+		*/
+		static void recordCounter(const char* name, double value);
+
+		/**
+		Returns number of events which didn't fit into thread buffers
+
+		@return number of dropped events
+		*/
+		static uint64_t getDroppedEventsCount();
+
+		/**
+		Writes recorded events as a Chrome Trace Event JSON object
+
+		@param output output stream
+		*/
+		static void exportChromeJson(std::ostream& output);
+
+		/**
+		Writes recorded events as a Chrome Trace Event JSON file
+
+		@param fileName name of the file
+		@return true if the file was written, false otherwise
+		*/
+		static bool saveChromeJson(const std::string& fileName);
+
+		static const size_t MaxEventsPerThread = 256 * 1024;
+	};
+
+	// Records a span from its construction to its destruction
+	class TraceScope
+	{
+	private:
+		const char* mCategory;
+		const char* mName;
+		uint64_t mStart;
+		bool mEnabled;
+	public:
+		/**
+		Starts the span if tracing is enabled
+
+		@param category category of the span
+		@param name name of the span
+		*/
+		TraceScope(const char* category, const char* name)
+			:mCategory(category), mName(name), mStart(0), mEnabled(Tracer::isEnabled())
+		{
+			if (mEnabled)
+			{
+				mStart = LogClock::now();
+			}
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+
+		~TraceScope()
+		{
+			if (mEnabled)
+			{
+				Tracer::recordSpan(mCategory, mName, mStart, LogClock::now());
+			}
+		}
+	};
+}
+
+#define PROTOLIB_TRACE_CONCAT_INNER(a, b) a##b
+#define PROTOLIB_TRACE_CONCAT(a, b) PROTOLIB_TRACE_CONCAT_INNER(a, b)
+
+#if PROTOLIB_TRACING
+// Records a span lasting until the end of the enclosing scope
+#define PROTOLIB_TRACE_SCOPE(category, name) \
+	protolib::TraceScope PROTOLIB_TRACE_CONCAT(protolibTraceScope, __LINE__)(category, name)
+
+#define PROTOLIB_TRACE_INSTANT(category, name) do { if (protolib::Tracer::isEnabled()) { \
+	protolib::Tracer::recordInstant(category, name); } } while (0)
+
+#define PROTOLIB_TRACE_COUNTER(name, value) do { if (protolib::Tracer::isEnabled()) { \
+	protolib::Tracer::recordCounter(name, static_cast<double>(value)); } } while (0)
+#else
+#define PROTOLIB_TRACE_SCOPE(category, name) static_cast<void>(0)
+#define PROTOLIB_TRACE_INSTANT(category, name) do { } while (0)
+#define PROTOLIB_TRACE_COUNTER(name, value) do { } while (0)
+#endif
@@ -0,0 +1,405 @@
+/*
+Benchmarks comparing ContainerWrapper operations with
+equivalent hand-written loops over raw STL containers.
+
+Usage: benchContainerWrapper [-maxSize N] [-minTime SECONDS] [-csv FILE] [-ops OP1;OP2;...]
+(sizes go from 1K up to maxSize by powers of 10, default maxSize is 1M, upper limit is 100M)
+
+(c) 2018 David Kutak
+*/
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <set>
+#include <map>
+#include "BenchmarkFramework.h"
+#include "ArgsParser.h"
+#include "ContainerWrapper.h"
+
+using protolib::ContainerWrapper;
+using benchmarks::BenchmarkResult;
+using benchmarks::BenchmarkReporter;
+using benchmarks::doNotOptimize;
+using benchmarks::measure;
+
+struct Struct64
+{
+	int64_t key;
+	int64_t payload[7];
+
+	bool operator<(const Struct64& other) const { return key < other.key; }
+	bool operator==(const Struct64& other) const { return key == other.key; }
+};
+
+static_assert(sizeof(Struct64) == 64, "Struct64 is expected to be 64 bytes large.");
+
+// Element values are generated so that roughly half of them are duplicates
+// (to give unique/erase/groupBy something to do)
+
+template<typename T> T makeValue(size_t i, size_t n);
+
+template<> int makeValue<int>(size_t i, size_t n) { return static_cast<int>((i * 7919) % (n / 2 + 1)); }
+template<> double makeValue<double>(size_t i, size_t n) { return makeValue<int>(i, n) * 0.5; }
+template<> char makeValue<char>(size_t i, size_t) { return static_cast<char>('a' + (i * 7) % 26); }
+template<> std::string makeValue<std::string>(size_t i, size_t n) { return "value_" + std::to_string(makeValue<int>(i, n)); }
+template<> Struct64 makeValue<Struct64>(size_t i, size_t n)
+{
+	Struct64 res = Struct64();
+	res.key = makeValue<int>(i, n);
+	return res;
+}
+
+// Cheap integer key used by predicates and grouping functions
+
+int keyOf(int val) { return val; }
+int keyOf(double val) { return static_cast<int>(val); }
+int keyOf(char val) { return val; }
+int keyOf(const std::string& val) { return static_cast<int>(val.size() + val.back()); }
+int keyOf(const Struct64& val) { return static_cast<int>(val.key); }
+
+template<typename T> struct TypeName;
+template<> struct TypeName<int> { static const char* get() { return "int"; } };
+template<> struct TypeName<double> { static const char* get() { return "double"; } };
+template<> struct TypeName<char> { static const char* get() { return "char"; } };
+template<> struct TypeName<std::string> { static const char* get() { return "string"; } };
+template<> struct TypeName<Struct64> { static const char* get() { return "struct64"; } };
+template<typename T> struct TypeName<std::vector<T>> { static const char* get() { return "vector"; } };
+template<typename T> struct TypeName<std::deque<T>> { static const char* get() { return "deque"; } };
+template<typename T> struct TypeName<std::list<T>> { static const char* get() { return "list"; } };
+
+template<typename TContainer>
+TContainer makeContainer(size_t n)
+{
+	TContainer res;
+	for (size_t i = 0; i < n; ++i)
+	{
+		res.insert(res.end(), makeValue<typename TContainer::value_type>(i, n));
+	}
+	return res;
+}
+
+template<typename TContainer>
+void reserveIfPossible(TContainer&, size_t, std::false_type) { }
+
+template<typename TContainer>
+void reserveIfPossible(TContainer& cont, size_t n, std::true_type) { cont.reserve(n); }
+
+template<typename TContainer>
+void reserveIfPossible(TContainer& cont, size_t n)
+{
+	reserveIfPossible(cont, n, std::integral_constant<bool,
+		std::is_same<TContainer, std::vector<typename TContainer::value_type>>::value ||
+		std::is_same<TContainer, std::string>::value>());
+}
+
+class Suite
+{
+private:
+	BenchmarkReporter& mReporter;
+	double mMinTime;
+	std::set<std::string> mOps;
+
+	template<typename TContainer, typename Setup, typename Func>
+	void run(const std::string& name, const std::string& variant, const std::string& container,
+		size_t n, Setup setup, Func func)
+	{
+		BenchmarkResult res = measure(n, mMinTime, setup, func);
+		res.name = name;
+		res.variant = variant;
+		res.container = container;
+		res.element = TypeName<typename TContainer::value_type>::get();
+		mReporter.report(res);
+	}
+
+	template<typename TContainer>
+	void runSorting(const ContainerWrapper<TContainer>&, const std::string&, size_t, std::false_type)
+	{
+		// std::sort requires random access iterators so there is nothing to compare
+	}
+
+	template<typename TContainer>
+	void runSorting(const ContainerWrapper<TContainer>& wrapped, const std::string& cont, size_t n, std::true_type)
+	{
+		if (!enabled("getSorted")) { return; }
+
+		auto noSetup = [] { return 0; };
+		run<TContainer>("getSorted", "wrapper", cont, n, noSetup, [&](int) {
+			auto res = wrapped.getSorted();
+			doNotOptimize(res);
+		});
+		run<TContainer>("getSorted", "stl", cont, n, noSetup, [&](int) {
+			TContainer res = wrapped.getContainer();
+			std::sort(res.begin(), res.end());
+			doNotOptimize(res);
+		});
+	}
+
+	template<typename TContainer>
+	void runArithmetic(const ContainerWrapper<TContainer>&, const std::string&, size_t, std::false_type)
+	{
+		// sum & average are defined only for arithmetic element types
+	}
+
+	template<typename TContainer>
+	void runArithmetic(const ContainerWrapper<TContainer>& wrapped, const std::string& cont, size_t n, std::true_type)
+	{
+		using value_type = typename TContainer::value_type;
+		const TContainer& raw = wrapped.getContainer();
+		auto noSetup = [] { return 0; };
+
+		if (enabled("sum"))
+		{
+			run<TContainer>("sum", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.sum();
+				doNotOptimize(res);
+			});
+			run<TContainer>("sum", "stl", cont, n, noSetup, [&](int) {
+				value_type res = value_type();
+				for (const auto& el : raw) { res += el; }
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("average"))
+		{
+			run<TContainer>("average", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.template average<double>();
+				doNotOptimize(res);
+			});
+			run<TContainer>("average", "stl", cont, n, noSetup, [&](int) {
+				double res = 0.0;
+				for (const auto& el : raw) { res += el; }
+				res /= raw.size();
+				doNotOptimize(res);
+			});
+		}
+	}
+public:
+	Suite(BenchmarkReporter& reporter, double minTime, const std::vector<std::string>& ops)
+		:mReporter(reporter), mMinTime(minTime), mOps(ops.begin(), ops.end())
+	{ }
+
+	bool enabled(const std::string& op) const
+	{
+		return mOps.empty() || mOps.find(op) != mOps.end();
+	}
+
+	template<typename TContainer, typename TMapContainer>
+	void runAll(const std::string& cont, size_t n)
+	{
+		using value_type = typename TContainer::value_type;
+		using map_type = typename TMapContainer::value_type;
+
+		const ContainerWrapper<TContainer> wrapped(makeContainer<TContainer>(n));
+		const TContainer& raw = wrapped.getContainer();
+		const value_type needle = makeValue<value_type>(n / 3, n);
+		auto noSetup = [] { return 0; };
+		auto copySetup = [&] { return raw; };
+
+		if (enabled("where"))
+		{
+			run<TContainer>("where", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.where([](const value_type& val) { return keyOf(val) % 2 == 0; });
+				doNotOptimize(res);
+			});
+			run<TContainer>("where", "stl", cont, n, noSetup, [&](int) {
+				TContainer res;
+				std::copy_if(raw.begin(), raw.end(), std::inserter(res, res.end()),
+					[](const value_type& val) { return keyOf(val) % 2 == 0; });
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("map"))
+		{
+			run<TContainer>("map", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.template map<map_type, TMapContainer>(
+					[](value_type val) { return static_cast<map_type>(keyOf(val)); });
+				doNotOptimize(res);
+			});
+			run<TContainer>("map", "stl", cont, n, noSetup, [&](int) {
+				TMapContainer res;
+				reserveIfPossible(res, raw.size());
+				for (const auto& el : raw) { res.push_back(static_cast<map_type>(keyOf(el))); }
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("groupBy"))
+		{
+			run<TContainer>("groupBy", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.groupBy([](const value_type& val) { return keyOf(val) % 16; });
+				doNotOptimize(res);
+			});
+			run<TContainer>("groupBy", "stl", cont, n, noSetup, [&](int) {
+				std::map<int, std::vector<value_type>> res;
+				for (const auto& el : raw) { res[keyOf(el) % 16].push_back(el); }
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("unique"))
+		{
+			run<TContainer>("unique", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.unique();
+				doNotOptimize(res);
+			});
+			run<TContainer>("unique", "stl", cont, n, noSetup, [&](int) {
+				std::set<value_type> found;
+				TContainer res;
+				for (const auto& el : raw)
+				{
+					if (found.insert(el).second) { res.insert(res.end(), el); }
+				}
+				doNotOptimize(res);
+			});
+		}
+
+		runSorting(wrapped, cont, n, std::integral_constant<bool, std::is_same<
+			typename std::iterator_traits<typename TContainer::iterator>::iterator_category,
+			std::random_access_iterator_tag>::value>());
+
+		if (enabled("skip"))
+		{
+			run<TContainer>("skip", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.skip(n / 2);
+				doNotOptimize(res);
+			});
+			run<TContainer>("skip", "stl", cont, n, noSetup, [&](int) {
+				TContainer res(std::next(raw.begin(), n / 2), raw.end());
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("take"))
+		{
+			run<TContainer>("take", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.take(n / 2);
+				doNotOptimize(res);
+			});
+			run<TContainer>("take", "stl", cont, n, noSetup, [&](int) {
+				TContainer res(raw.begin(), std::next(raw.begin(), n / 2));
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("erase"))
+		{
+			run<TContainer>("erase", "wrapper", cont, n, [&] { return wrapped; },
+				[&](ContainerWrapper<TContainer>& input) {
+				input.erase(needle);
+				doNotOptimize(input);
+			});
+			run<TContainer>("erase", "stl", cont, n, copySetup, [&](TContainer& input) {
+				input.erase(std::remove(input.begin(), input.end(), needle), input.end());
+				doNotOptimize(input);
+			});
+		}
+
+		if (enabled("count"))
+		{
+			run<TContainer>("count", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.count([](const value_type& val) { return keyOf(val) % 2 == 0; });
+				doNotOptimize(res);
+			});
+			run<TContainer>("count", "stl", cont, n, noSetup, [&](int) {
+				size_t res = 0;
+				for (const auto& el : raw) { res += keyOf(el) % 2 == 0; }
+				doNotOptimize(res);
+			});
+		}
+
+		if (enabled("min"))
+		{
+			run<TContainer>("min", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.min();
+				doNotOptimize(res);
+			});
+			run<TContainer>("min", "stl", cont, n, noSetup, [&](int) {
+				auto it = raw.begin();
+				for (auto curr = raw.begin(); curr != raw.end(); ++curr)
+				{
+					if (*curr < *it) { it = curr; }
+				}
+				doNotOptimize(*it);
+			});
+		}
+
+		if (enabled("max"))
+		{
+			run<TContainer>("max", "wrapper", cont, n, noSetup, [&](int) {
+				auto res = wrapped.max();
+				doNotOptimize(res);
+			});
+			run<TContainer>("max", "stl", cont, n, noSetup, [&](int) {
+				auto it = raw.begin();
+				for (auto curr = raw.begin(); curr != raw.end(); ++curr)
+				{
+					if (*it < *curr) { it = curr; }
+				}
+				doNotOptimize(*it);
+			});
+		}
+
+		runArithmetic(wrapped, cont, n, std::is_arithmetic<value_type>());
+	}
+
+	template<typename TElement>
+	void runAllContainers(size_t n)
+	{
+		runAll<std::vector<TElement>, std::vector<int>>("vector", n);
+		runAll<std::deque<TElement>, std::vector<int>>("deque", n);
+		runAll<std::list<TElement>, std::vector<int>>("list", n);
+	}
+};
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	if (!argsParser.containsOnlyValidOptions({ "", "-maxSize", "-minTime", "-csv", "-ops" }))
+	{
+		std::cout << "Usage: " << argsParser.getProgramName()
+			<< " [-maxSize N] [-minTime SECONDS] [-csv FILE] [-ops OP1;OP2;...]" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> args;
+	size_t maxSize = 1000000;
+	double minTime = 0.1;
+	std::string csvFile;
+	std::vector<std::string> ops;
+
+	if (argsParser.getOption("-maxSize", args) && !args.empty())
+	{
+		maxSize = std::min<size_t>(std::stoull(args[0]), 100000000);
+	}
+	if (argsParser.getOption("-minTime", args) && !args.empty())
+	{
+		minTime = std::stod(args[0]);
+	}
+	if (argsParser.getOption("-csv", args) && !args.empty())
+	{
+		csvFile = args[0];
+	}
+	argsParser.getOption("-ops", ops, ';');
+
+	BenchmarkReporter reporter(csvFile);
+	Suite suite(reporter, minTime, ops);
+
+	for (size_t n = 1000; n <= maxSize; n *= 10)
+	{
+		suite.runAllContainers<int>(n);
+		suite.runAllContainers<double>(n);
+		suite.runAllContainers<std::string>(n);
+		suite.runAllContainers<Struct64>(n);
+		suite.runAll<std::string, std::string>("string", n);
+	}
+
+	return 0;
+}
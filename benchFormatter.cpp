@@ -0,0 +1,196 @@
+/*
+Benchmarks comparing formatting by Formatter and FormatBuffer with the
+previously used std::stringstream, std::to_string and operator<<:
+values of log records, SVG elements and ASCII PNM pixel data
+(images are saved to /dev/null, also with formatting in parallel).
+
+Usage: benchFormatter [-minTime SECONDS] [-csv FILE]
+
+(c) 2018 David Kutak
+*/
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BenchmarkFramework.h"
+#include "ArgsParser.h"
+#include "Formatter.h"
+#include "PnmExporter.h"
+#include "ThreadPool.h"
+
+using protolib::Formatter;
+using protolib::FormatBuffer;
+using protolib::PnmExporter;
+using protolib::PnmImageType;
+using protolib::ThreadPool;
+using benchmarks::BenchmarkResult;
+using benchmarks::BenchmarkReporter;
+using benchmarks::doNotOptimize;
+using benchmarks::measure;
+
+const size_t CallsPerIteration = 10000;
+
+template<typename Func>
+void runBenchmark(BenchmarkReporter& reporter, double minTime, const std::string& name,
+	const std::string& variant, const std::string& element, size_t calls, Func func)
+{
+	BenchmarkResult result = measure(calls, minTime, []() { return 0; }, [&func, calls](int) {
+		for (size_t i = 0; i < calls; ++i)
+		{
+			func(i);
+		}
+	});
+
+	result.name = name;
+	result.variant = variant;
+	result.container = "-";
+	result.element = element;
+	reporter.report(result);
+}
+
+// Formatting of log values as Logger did it before Formatter
+template<typename T>
+std::string formatByStream(const T& value)
+{
+	std::stringstream ss;
+	ss << value;
+	return ss.str();
+}
+
+template<typename T>
+std::string formatByStream(const std::vector<T>& values)
+{
+	std::stringstream ss;
+	for (const auto& val : values)
+	{
+		ss << val << ',' << " ";
+	}
+	return ss.str();
+}
+
+template<typename T>
+std::string formatByFormatter(const T& value)
+{
+	std::string formatted;
+	Formatter::appendValue(formatted, value);
+	return formatted;
+}
+
+template<typename T>
+std::string formatByFormatter(const std::vector<T>& values)
+{
+	std::string formatted;
+	for (const auto& val : values)
+	{
+		Formatter::appendValue(formatted, val);
+		formatted += ',';
+		formatted += ' ';
+	}
+	return formatted;
+}
+
+// ASCII pixel data written as PnmExporter did it before FormatBuffer
+void saveAsciiByStream(const std::vector<uint8_t>& pixelData, size_t valuesPerRow)
+{
+	std::ofstream output("/dev/null");
+	for (size_t i = 0; i < pixelData.size(); ++i)
+	{
+		output << static_cast<unsigned>(pixelData[i]) << " ";
+		if ((i + 1) % (valuesPerRow) == 0)
+		{
+			output << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	if (!argsParser.containsOnlyValidOptions({ "", "-minTime", "-csv" }))
+	{
+		std::cout << "Usage: " << argsParser.getProgramName() << " [-minTime SECONDS] [-csv FILE]" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> args;
+	double minTime = 0.1;
+	std::string csvFile;
+
+	if (argsParser.getOption("-minTime", args) && !args.empty())
+	{
+		minTime = std::stod(args[0]);
+	}
+	if (argsParser.getOption("-csv", args) && !args.empty())
+	{
+		csvFile = args[0];
+	}
+
+	BenchmarkReporter reporter(csvFile);
+
+	runBenchmark(reporter, minTime, "logValue", "stream", "int", CallsPerIteration, [](size_t i) {
+		doNotOptimize(formatByStream(static_cast<int>(i * 7919)));
+	});
+	runBenchmark(reporter, minTime, "logValue", "format", "int", CallsPerIteration, [](size_t i) {
+		doNotOptimize(formatByFormatter(static_cast<int>(i * 7919)));
+	});
+
+	runBenchmark(reporter, minTime, "logValue", "stream", "double", CallsPerIteration, [](size_t i) {
+		doNotOptimize(formatByStream(static_cast<double>(i) * 0.25));
+	});
+	runBenchmark(reporter, minTime, "logValue", "format", "double", CallsPerIteration, [](size_t i) {
+		doNotOptimize(formatByFormatter(static_cast<double>(i) * 0.25));
+	});
+
+	const std::vector<int> vector100(100, 42);
+	runBenchmark(reporter, minTime, "logValue", "stream", "vector100", CallsPerIteration / 100, [&vector100](size_t) {
+		doNotOptimize(formatByStream(vector100));
+	});
+	runBenchmark(reporter, minTime, "logValue", "format", "vector100", CallsPerIteration / 100, [&vector100](size_t) {
+		doNotOptimize(formatByFormatter(vector100));
+	});
+
+	// Rectangle element as SvgExporter::addRectangle builds it
+	const std::string fill = "red";
+	const std::string stroke = "black";
+	const size_t strokeWidth = 2;
+	runBenchmark(reporter, minTime, "svgElement", "toString", "rect", CallsPerIteration, [&](size_t i) {
+		const int x = static_cast<int>(i);
+		doNotOptimize("<rect x=\"" + std::to_string(x) + "\" y=\"" + std::to_string(x + 1) +
+			"\" width=\"" + std::to_string(x + 2) + "\" height=\"" + std::to_string(x + 3) +
+			"\" stroke=\"" + stroke + "\" fill=\"" + fill + "\" stroke-width=\"" + std::to_string(strokeWidth) +
+			"\" " + " />");
+	});
+	runBenchmark(reporter, minTime, "svgElement", "buffer", "rect", CallsPerIteration, [&](size_t i) {
+		const int x = static_cast<int>(i);
+		FormatBuffer<512> element;
+		element.append("<rect x=\"").appendSigned(x).append("\" y=\"").appendSigned(x + 1)
+			.append("\" width=\"").appendSigned(x + 2).append("\" height=\"").appendSigned(x + 3)
+			.append("\" stroke=\"").append(stroke).append("\" fill=\"").append(fill)
+			.append("\" stroke-width=\"").appendUnsigned(strokeWidth).append("\" ").append(" />");
+		doNotOptimize(element.toString());
+	});
+
+	for (const auto& size : std::vector<std::pair<size_t, size_t>>{ { 640, 480 }, { 3840, 2160 } })
+	{
+		const std::string element = std::to_string(size.first) + "x" + std::to_string(size.second);
+		PnmExporter<> image(size.first, size.second, PnmImageType::PPM_ASCII);
+		image.setPixels([](size_t x, size_t y) { return (x / 8 + y / 8) % 2 == 0; },
+			PnmExporter<>::PixelColor(255, 128, 7));
+		const std::vector<uint8_t>& pixelData = image.getPixelData();
+		const size_t valuesPerRow = size.first * 3;
+		runBenchmark(reporter, minTime, "pnmAscii", "stream", element, 1, [&pixelData, valuesPerRow](size_t) {
+			saveAsciiByStream(pixelData, valuesPerRow);
+		});
+		runBenchmark(reporter, minTime, "pnmAscii", "buffer", element, 1, [&image](size_t) {
+			image.save("/dev/null");
+		});
+		runBenchmark(reporter, minTime, "pnmAscii", "parallel", element, 1, [&image](size_t) {
+			image.save("/dev/null", &ThreadPool::getShared());
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+Benchmarks measuring how much it costs to timestamp a log record
+by LogClock compared with reading and formatting the wall clock.
+
+Usage: benchLogClock [-minTime SECONDS] [-csv FILE]
+
+(c) 2018 David Kutak
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "BenchmarkFramework.h"
+#include "ArgsParser.h"
+#include "LogClock.h"
+
+using protolib::LogClock;
+using benchmarks::BenchmarkResult;
+using benchmarks::BenchmarkReporter;
+using benchmarks::doNotOptimize;
+using benchmarks::measure;
+
+const size_t CallsPerIteration = 100000;
+
+template<typename Func>
+void runBenchmark(BenchmarkReporter& reporter, double minTime, const std::string& name,
+	const std::string& variant, Func func)
+{
+	BenchmarkResult result = measure(CallsPerIteration, minTime, []() { return 0; }, [&func](int) {
+		for (size_t i = 0; i < CallsPerIteration; ++i)
+		{
+			func();
+		}
+	});
+
+	result.name = name;
+	result.variant = variant;
+	result.container = "-";
+	result.element = "-";
+	reporter.report(result);
+}
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	if (!argsParser.containsOnlyValidOptions({ "", "-minTime", "-csv" }))
+	{
+		std::cout << "Usage: " << argsParser.getProgramName() << " [-minTime SECONDS] [-csv FILE]" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> args;
+	double minTime = 0.1;
+	std::string csvFile;
+
+	if (argsParser.getOption("-minTime", args) && !args.empty())
+	{
+		minTime = std::stod(args[0]);
+	}
+	if (argsParser.getOption("-csv", args) && !args.empty())
+	{
+		csvFile = args[0];
+	}
+
+	std::cout << "Ticks source: " << (LogClock::usesTsc() ? "invariant TSC" : "monotonic clock") << std::endl;
+	BenchmarkReporter reporter(csvFile);
+
+	runBenchmark(reporter, minTime, "capture", "logClock", []() {
+		doNotOptimize(LogClock::now());
+	});
+
+	runBenchmark(reporter, minTime, "capture", "threadIdx", []() {
+		doNotOptimize(LogClock::threadIndex());
+	});
+
+	runBenchmark(reporter, minTime, "capture", "steady", []() {
+		doNotOptimize(std::chrono::steady_clock::now());
+	});
+
+	runBenchmark(reporter, minTime, "capture", "system", []() {
+		doNotOptimize(std::chrono::system_clock::now());
+	});
+
+	// What records would pay without deferred conversion
+	runBenchmark(reporter, minTime, "format", "system", []() {
+		std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+		char buffer[32];
+		std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+		doNotOptimize(buffer[0]);
+	});
+
+	// Cost paid at output time
+	std::string output;
+	runBenchmark(reporter, minTime, "format", "logClock", [&output]() {
+		output.clear();
+		LogClock::appendWallClock(output, LogClock::toWallClockNs(LogClock::now()));
+		doNotOptimize(output.data());
+	});
+
+	return 0;
+}
@@ -0,0 +1,266 @@
+/*
+Benchmarks measuring throughput and producer latency of Logger
+with 1 to N producer threads in different modes:
+disabled (logging disabled), immediate (log file and std::cout),
+fileOnly (log file only) and synced (log file only, buffered by
+enableSyncedLogging and written by syncedOutput after producers finish).
+Log file is /dev/null (cost of formatting) or a file in tmpfs
+(cost of formatting and writing), std::cout is redirected to /dev/null
+during measurement. Throughput includes flushing (and syncedOutput),
+latency is measured around each write call.
+
+Usage: benchLogger [-maxThreads N] [-messages N] [-tmpfs DIR] [-csv FILE]
+(threads go from 1 up to maxThreads by powers of 2, default maxThreads is the number
+of hardware threads, messages is the number of messages per thread, default 100000,
+vector messages use 1/100 of it, default tmpfs directory is /dev/shm)
+
+(c) 2018 David Kutak
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchmarkFramework.h"
+#include "ArgsParser.h"
+#include "LogClock.h"
+#include "LogMetrics.h"
+#include "Logger.h"
+
+using protolib::LogClock;
+using protolib::LogMetrics;
+using protolib::Logger;
+
+struct LoggerBenchmarkResult
+{
+	std::string mode;
+	std::string target;
+	std::string shape;
+	size_t threads;
+	size_t messages;
+	double messagesPerSecond;
+	double p50Ns;
+	double p99Ns;
+	double p999Ns;
+	double bytesPerMessage;
+	double allocsPerMessage;
+};
+
+// Writes one message of given shape (i = index of the message)
+using MessageWriter = std::function<void(size_t i)>;
+
+double getPercentile(std::vector<uint64_t>& latencies, double percentile)
+{
+	if (latencies.empty()) { return 0.0; }
+
+	size_t index = std::min(latencies.size() - 1, static_cast<size_t>(percentile * latencies.size()));
+	std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+	return static_cast<double>(latencies[index]) * 1e9 / LogClock::ticksPerSecond();
+}
+
+void setUpMode(const std::string& mode, const std::string& logFile)
+{
+	if (mode == "disabled")
+	{
+		Logger::disableLogging();
+		return;
+	}
+
+	Logger::setLogFile(logFile, mode != "immediate");
+	if (mode == "synced")
+	{
+		Logger::enableSyncedLogging();
+	}
+}
+
+void tearDownMode(const std::string& mode)
+{
+	if (mode == "synced")
+	{
+		Logger::syncedOutput();
+		Logger::disableSyncedLogging();
+	}
+	Logger::flush();
+	Logger::closeLogFile();
+	Logger::enableLogging();
+}
+
+LoggerBenchmarkResult runBenchmark(const std::string& mode, const std::string& target, const std::string& logFile,
+	const std::string& shape, size_t threads, size_t messages, const MessageWriter& writer)
+{
+	setUpMode(mode, logFile);
+
+	std::vector<std::vector<uint64_t>> latencies(threads, std::vector<uint64_t>(messages));
+	std::vector<std::thread> producers;
+	std::atomic<size_t> readyProducers(0);
+	std::atomic<bool> start(false);
+	for (size_t t = 0; t < threads; ++t)
+	{
+		producers.emplace_back([&, t]() {
+			std::vector<uint64_t>& threadLatencies = latencies[t];
+			readyProducers.fetch_add(1);
+			while (!start.load(std::memory_order_acquire)) { }
+
+			for (size_t i = 0; i < messages; ++i)
+			{
+				uint64_t before = LogClock::now();
+				writer(i);
+				threadLatencies[i] = LogClock::now() - before;
+			}
+		});
+	}
+	while (readyProducers.load() < threads) { }
+
+	uint64_t bytesBefore = LogMetrics::getSnapshot().bytesWritten;
+	size_t allocsBefore = benchCounters::allocCount.load(std::memory_order_relaxed);
+	auto startTime = std::chrono::steady_clock::now();
+	start.store(true, std::memory_order_release);
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+	tearDownMode(mode);
+	auto stopTime = std::chrono::steady_clock::now();
+	size_t allocs = benchCounters::allocCount.load(std::memory_order_relaxed) - allocsBefore;
+	uint64_t bytes = LogMetrics::getSnapshot().bytesWritten - bytesBefore;
+
+	std::vector<uint64_t> allLatencies;
+	allLatencies.reserve(threads * messages);
+	for (const auto& threadLatencies : latencies)
+	{
+		allLatencies.insert(allLatencies.end(), threadLatencies.begin(), threadLatencies.end());
+	}
+
+	const double totalMessages = static_cast<double>(threads * messages);
+	const double seconds = std::chrono::duration<double>(stopTime - startTime).count();
+	LoggerBenchmarkResult result;
+	result.mode = mode;
+	result.target = target;
+	result.shape = shape;
+	result.threads = threads;
+	result.messages = threads * messages;
+	result.messagesPerSecond = seconds > 0.0 ? totalMessages / seconds : 0.0;
+	result.p50Ns = getPercentile(allLatencies, 0.5);
+	result.p99Ns = getPercentile(allLatencies, 0.99);
+	result.p999Ns = getPercentile(allLatencies, 0.999);
+	result.bytesPerMessage = static_cast<double>(bytes) / totalMessages;
+	result.allocsPerMessage = static_cast<double>(allocs) / totalMessages;
+	return result;
+}
+
+void printHeader(std::ofstream& csvFile)
+{
+	if (csvFile.is_open())
+	{
+		csvFile << "mode,target,shape,threads,messages,messages_per_second,p50_ns,p99_ns,p999_ns,"
+			"bytes_per_message,allocs_per_message\n";
+	}
+
+	std::cout << std::left << std::setw(10) << "mode" << std::setw(8) << "target" << std::setw(10) << "shape"
+		<< std::right << std::setw(8) << "threads" << std::setw(14) << "msgs/s" << std::setw(10) << "p50 ns"
+		<< std::setw(10) << "p99 ns" << std::setw(11) << "p99.9 ns" << std::setw(11) << "bytes/msg"
+		<< std::setw(11) << "allocs/msg" << std::endl;
+}
+
+void report(std::ofstream& csvFile, const LoggerBenchmarkResult& result)
+{
+	std::cout << std::left << std::setw(10) << result.mode << std::setw(8) << result.target << std::setw(10)
+		<< result.shape << std::right << std::setw(8) << result.threads << std::setw(14) << std::fixed
+		<< std::setprecision(0) << result.messagesPerSecond << std::setw(10) << result.p50Ns << std::setw(10)
+		<< result.p99Ns << std::setw(11) << result.p999Ns << std::setw(11) << std::setprecision(1)
+		<< result.bytesPerMessage << std::setw(11) << result.allocsPerMessage << std::endl;
+
+	if (csvFile.is_open())
+	{
+		csvFile << result.mode << ',' << result.target << ',' << result.shape << ',' << result.threads << ','
+			<< result.messages << ',' << result.messagesPerSecond << ',' << result.p50Ns << ',' << result.p99Ns
+			<< ',' << result.p999Ns << ',' << result.bytesPerMessage << ',' << result.allocsPerMessage << '\n';
+	}
+}
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	if (!argsParser.containsOnlyValidOptions({ "", "-maxThreads", "-messages", "-tmpfs", "-csv" }))
+	{
+		std::cout << "Usage: " << argsParser.getProgramName() <<
+			" [-maxThreads N] [-messages N] [-tmpfs DIR] [-csv FILE]" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> args;
+	size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	size_t messages = 100000;
+	std::string tmpfsDir = "/dev/shm";
+	std::ofstream csvFile;
+
+	if (argsParser.getOption("-maxThreads", args) && !args.empty())
+	{
+		maxThreads = std::max<size_t>(1, std::stoul(args[0]));
+	}
+	if (argsParser.getOption("-messages", args) && !args.empty())
+	{
+		messages = std::max<size_t>(100, std::stoul(args[0]));
+	}
+	if (argsParser.getOption("-tmpfs", args) && !args.empty())
+	{
+		tmpfsDir = args[0];
+	}
+	if (argsParser.getOption("-csv", args) && !args.empty())
+	{
+		csvFile.open(args[0]);
+	}
+
+	const std::string tmpfsFile = tmpfsDir + "/benchLogger.log";
+	const std::string text = "message of a typical length written by a service";
+	const std::vector<int> vector1k(1000, 42);
+	const std::vector<std::pair<std::string, MessageWriter>> shapes = {
+		{ "int", [](size_t i) { Logger::writeSimpleLog(i, "value", "benchLogger.cpp", Logger::LogType::INF); } },
+		{ "string", [&text](size_t) { Logger::writeSimpleLog(text, "text", "benchLogger.cpp", Logger::LogType::INF); } },
+		{ "vector1k", [&vector1k](size_t) {
+			Logger::writeStructuredLog(vector1k, "vector", "benchLogger.cpp", Logger::LogType::INF); } }
+	};
+	const std::vector<std::pair<std::string, std::string>> targets = {
+		{ "devnull", "/dev/null" },
+		{ "tmpfs", tmpfsFile }
+	};
+
+	// Console output (immediate mode) must not be mixed with results
+	std::ofstream nullOutput("/dev/null");
+	std::streambuf* coutBuffer = std::cout.rdbuf();
+	printHeader(csvFile);
+
+	const std::vector<std::string> modes = { "disabled", "immediate", "fileOnly", "synced" };
+	for (const std::string& mode : modes)
+	{
+		for (const auto& target : targets)
+		{
+			// Target doesn't matter when logging is disabled
+			if (mode == "disabled" && target.first != "devnull") { continue; }
+
+			for (const auto& shape : shapes)
+			{
+				size_t shapeMessages = shape.first == "vector1k" ? std::max<size_t>(1, messages / 100) : messages;
+				for (size_t threads = 1; threads <= maxThreads; threads = threads < maxThreads ?
+					std::min(threads * 2, maxThreads) : threads + 1)
+				{
+					std::cout.rdbuf(nullOutput.rdbuf());
+					LoggerBenchmarkResult result = runBenchmark(mode, mode == "disabled" ? "-" : target.first,
+						target.second, shape.first, threads, shapeMessages, shape.second);
+					std::cout.rdbuf(coutBuffer);
+					report(csvFile, result);
+				}
+			}
+		}
+	}
+
+	std::remove(tmpfsFile.c_str());
+	return 0;
+}
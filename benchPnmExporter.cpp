@@ -0,0 +1,282 @@
+/*
+Benchmarks of PnmExporter drawing: small shapes drawn by rasterizers
+(only covered rows and spans are touched) compared with the previous
+approach of evaluating a predicate for every pixel of the image, and
+per-pixel masks and shaders computed by one thread and by the shared
+thread pool, and packing of PBM rows into bits pixel by pixel
+compared with the PbmBits kernels. PnmReader loads a PGM image through
+a zero-copy view, a decoded copy and ASCII parsing, compared with
+reading by std::ifstream. PnmStreamWriter writes the same frame band by
+band (serially and on the shared pool) compared with PnmExporter::save
+of the whole image.
+
+Usage: benchPnmExporter [-minTime SECONDS] [-csv FILE] [-size PIXELS]
+(size is the width and height of the canvas, default 4096)
+
+(c) 2018 David Kutak
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BenchmarkFramework.h"
+#include "ArgsParser.h"
+#include "PbmBits.h"
+#include "PnmExporter.h"
+#include "PnmReader.h"
+#include "PnmStreamWriter.h"
+#include "ThreadPool.h"
+
+using protolib::PbmBits;
+using protolib::PnmExporter;
+using protolib::PnmImageType;
+using protolib::PnmReader;
+using protolib::PnmStreamWriter;
+using protolib::ThreadPool;
+using benchmarks::BenchmarkResult;
+using benchmarks::BenchmarkReporter;
+using benchmarks::doNotOptimize;
+using benchmarks::measure;
+
+typedef PnmExporter<>::PixelColor Color;
+
+// Calls func(i) for i from 0 to calls - 1, each call processes elementsPerCall elements (shapes or pixels)
+template<typename Func>
+void runBenchmark(BenchmarkReporter& reporter, double minTime, const std::string& name,
+	const std::string& variant, const std::string& element, size_t calls, Func func, size_t elementsPerCall = 1)
+{
+	BenchmarkResult result = measure(calls * elementsPerCall, minTime, []() { return 0; }, [&func, calls](int) {
+		for (size_t i = 0; i < calls; ++i)
+		{
+			func(i);
+		}
+	});
+
+	result.name = name;
+	result.variant = variant;
+	result.container = "-";
+	result.element = element;
+	reporter.report(result);
+}
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	if (!argsParser.containsOnlyValidOptions({ "", "-minTime", "-csv", "-size" }))
+	{
+		std::cout << "Usage: " << argsParser.getProgramName() << " [-minTime SECONDS] [-csv FILE] [-size PIXELS]"
+			<< std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> args;
+	double minTime = 0.1;
+	std::string csvFile;
+	size_t size = 4096;
+
+	if (argsParser.getOption("-minTime", args) && !args.empty())
+	{
+		minTime = std::stod(args[0]);
+	}
+	if (argsParser.getOption("-csv", args) && !args.empty())
+	{
+		csvFile = args[0];
+	}
+	if (argsParser.getOption("-size", args) && !args.empty())
+	{
+		size = std::max<size_t>(64, std::stoul(args[0]));
+	}
+
+	BenchmarkReporter reporter(csvFile);
+	PnmExporter<> image(size, size, PnmImageType::PPM_BIN);
+	const Color color(255, 128, 7);
+	const int extent = static_cast<int>(size) - 10;
+
+	// Markers are spread over the image, the full-image scan visits all pixels regardless
+	runBenchmark(reporter, minTime, "rect5x5", "scan", "ppm", 1, [&](size_t i) {
+		const int xLeft = static_cast<int>(i * 7919) % extent, yTop = static_cast<int>(i * 104729) % extent;
+		image.setPixels([=](int x, int y) {
+			return x >= xLeft && x <= xLeft + 4 && y >= yTop && y <= yTop + 4;
+		}, color);
+	});
+	runBenchmark(reporter, minTime, "rect5x5", "raster", "ppm", 100000, [&](size_t i) {
+		image.addRectangle(static_cast<int>(i * 7919) % extent, static_cast<int>(i * 104729) % extent, 4, 4, color);
+	});
+
+	runBenchmark(reporter, minTime, "circle5", "scan", "ppm", 1, [&](size_t i) {
+		const int cx = static_cast<int>(i * 7919) % extent, cy = static_cast<int>(i * 104729) % extent;
+		image.setPixels([=](int x, int y) { return (x - cx) * (x - cx) + (y - cy) * (y - cy) < 25; }, color);
+	});
+	runBenchmark(reporter, minTime, "circle5", "raster", "ppm", 100000, [&](size_t i) {
+		image.addCircle(static_cast<int>(i * 7919) % extent, static_cast<int>(i * 104729) % extent, 5, color);
+	});
+
+	runBenchmark(reporter, minTime, "ellipse", "raster", "ppm", 100000, [&](size_t i) {
+		image.addEllipse(static_cast<int>(i * 7919) % extent, static_cast<int>(i * 104729) % extent, 8, 3, color);
+	});
+
+	runBenchmark(reporter, minTime, "line", "raster", "ppm", 100000, [&](size_t i) {
+		const int x = static_cast<int>(i * 7919) % extent, y = static_cast<int>(i * 104729) % extent;
+		image.addLine(x, y, x + 9, y + 4, color);
+	});
+
+	runBenchmark(reporter, minTime, "triangle", "raster", "ppm", 100000, [&](size_t i) {
+		const int x = static_cast<int>(i * 7919) % extent, y = static_cast<int>(i * 104729) % extent;
+		image.addPolygon({ { x, y }, { x + 8, y + 2 }, { x + 3, y + 9 } }, color);
+	});
+
+	// Masks and shaders doing real math per pixel
+	const size_t pixels = size * size;
+	auto mask = [](size_t x, size_t y) { return std::sin(x * 0.01) * std::cos(y * 0.013) > 0.25; };
+	auto shader = [](size_t x, size_t y) {
+		const double value = 127.5 * (1.0 + std::sin(std::sqrt(static_cast<double>(x * x + y * y)) * 0.05));
+		return Color(static_cast<uint8_t>(value), static_cast<uint8_t>(x), static_cast<uint8_t>(y));
+	};
+	ThreadPool singleThread(0);
+	ThreadPool& sharedPool = ThreadPool::getShared();
+	const std::string threads = std::to_string(sharedPool.getThreadCount() + 1) + "thr";
+	runBenchmark(reporter, minTime, "mask", "serial", "1thr", 1, [&](size_t) {
+		image.setPixels(mask, color);
+	}, pixels);
+	runBenchmark(reporter, minTime, "mask", "parallel", threads, 1, [&](size_t) {
+		image.setPixelsParallel(mask, color, sharedPool);
+	}, pixels);
+	runBenchmark(reporter, minTime, "shader", "serial", "1thr", 1, [&](size_t) {
+		image.generatePixels(shader, singleThread);
+	}, pixels);
+	runBenchmark(reporter, minTime, "shader", "parallel", threads, 1, [&](size_t) {
+		image.generatePixels(shader, sharedPool);
+	}, pixels);
+
+	// Binary mask packed into PBM rows and unpacked back
+	PnmExporter<> binaryMask(size, size, PnmImageType::PBM_BIN);
+	binaryMask.setPixels(mask, Color(1));
+	const std::vector<uint8_t>& maskData = binaryMask.getPixelData();
+	const size_t rowBytes = PbmBits::getRowBytes(size);
+	std::vector<uint8_t> packed(rowBytes * size);
+	std::vector<uint8_t> unpacked(size * size);
+	runBenchmark(reporter, minTime, "pbmPack", "bitwise", "pbm", 1, [&](size_t) {
+		std::fill(packed.begin(), packed.end(), 0);
+		for (size_t y = 0, bdPos = 0; y < size; ++y)
+		{
+			for (size_t x = 0; x < size; x += 8, ++bdPos)
+			{
+				const size_t upperBound = size - x > 8 ? 8 : size - x;
+				for (size_t k = 0; k < upperBound; ++k)
+				{
+					packed[bdPos] |= maskData[y * size + x + k] << (7 - k);
+				}
+			}
+		}
+		doNotOptimize(packed.data());
+	}, pixels);
+	runBenchmark(reporter, minTime, "pbmPack", "kernel", "pbm", 1, [&](size_t) {
+		for (size_t y = 0; y < size; ++y)
+		{
+			PbmBits::packRow(maskData.data() + y * size, size, packed.data() + y * rowBytes);
+		}
+		doNotOptimize(packed.data());
+	}, pixels);
+	runBenchmark(reporter, minTime, "pbmUnpack", "bitwise", "pbm", 1, [&](size_t) {
+		for (size_t i = 0, y = 0; y < size; ++y)
+		{
+			for (size_t x = 0; x < size; ++x, ++i)
+			{
+				unpacked[i] = (packed[y * rowBytes + x / 8] >> (7 - x % 8)) & 1;
+			}
+		}
+		doNotOptimize(unpacked.data());
+	}, pixels);
+	runBenchmark(reporter, minTime, "pbmUnpack", "kernel", "pbm", 1, [&](size_t) {
+		for (size_t y = 0; y < size; ++y)
+		{
+			PbmBits::unpackRow(packed.data() + y * rowBytes, size, unpacked.data() + y * size);
+		}
+		doNotOptimize(unpacked.data());
+	}, pixels);
+
+	// Grayscale frame loaded back, the stream variants are what loading would cost without PnmReader
+	PnmExporter<> frame(size, size, PnmImageType::PGM_BIN);
+	frame.generatePixels([](size_t x, size_t y) { return Color(static_cast<uint8_t>(x * 3 + y)); }, sharedPool);
+	frame.save("benchRead.pgm");
+	frame.swapBtwnASCIIandBIN();
+	frame.save("benchReadAscii.pgm");
+	uint64_t checksum = 0;
+	runBenchmark(reporter, minTime, "pgmLoad", "stream", "bin", 1, [&](size_t) {
+		std::ifstream input("benchRead.pgm", std::ios::binary);
+		std::string magic;
+		unsigned width, height, maxValue;
+		input >> magic >> width >> height >> maxValue;
+		input.get();
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height);
+		input.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+		checksum += pixels[pixels.size() / 2];
+	}, pixels);
+	runBenchmark(reporter, minTime, "pgmLoad", "copy", "bin", 1, [&](size_t) {
+		checksum += PnmReader("benchRead.pgm").toImage().getPixelData()[pixels / 2];
+	}, pixels);
+	runBenchmark(reporter, minTime, "pgmLoad", "view", "bin", 1, [&](size_t) {
+		// Touches every page like the other variants do
+		PnmReader reader("benchRead.pgm");
+		const uint8_t* view = reader.getPixelView<uint8_t>();
+		for (size_t i = 0; i < pixels; i += 4096)
+		{
+			checksum += view[i];
+		}
+	}, pixels);
+	runBenchmark(reporter, minTime, "pgmLoad", "stream", "ascii", 1, [&](size_t) {
+		std::ifstream input("benchReadAscii.pgm");
+		std::string magic;
+		unsigned width, height, maxValue;
+		input >> magic >> width >> height >> maxValue;
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height);
+		for (uint8_t& pixel : pixels)
+		{
+			unsigned value;
+			input >> value;
+			pixel = static_cast<uint8_t>(value);
+		}
+		checksum += pixels[pixels.size() / 2];
+	}, pixels);
+	runBenchmark(reporter, minTime, "pgmLoad", "parser", "ascii", 1, [&](size_t) {
+		checksum += PnmReader("benchReadAscii.pgm").toImage().getPixelData()[pixels / 2];
+	}, pixels);
+	doNotOptimize(checksum);
+	std::remove("benchRead.pgm");
+	std::remove("benchReadAscii.pgm");
+
+	// Same frame produced band by band, bytes/iter shows the memory held by each variant
+	auto frameRows = [size](size_t yStart, size_t rows, uint8_t* values) {
+		for (size_t y = yStart; y < yStart + rows; ++y)
+		{
+			for (size_t x = 0; x < size; ++x)
+			{
+				*values++ = static_cast<uint8_t>(x * 3 + y);
+			}
+		}
+	};
+	runBenchmark(reporter, minTime, "pgmWrite", "save", "bin", 1, [&](size_t) {
+		PnmExporter<> whole(size, size, PnmImageType::PGM_BIN);
+		whole.generatePixels([](size_t x, size_t y) { return Color(static_cast<uint8_t>(x * 3 + y)); }, singleThread);
+		whole.save("benchWrite.pgm");
+	}, pixels);
+	runBenchmark(reporter, minTime, "pgmWrite", "stream", "bin", 1, [&](size_t) {
+		PnmStreamWriter<> writer("benchWrite.pgm", size, size, PnmImageType::PGM_BIN);
+		writer.writeBands(frameRows);
+		writer.finish();
+	}, pixels);
+	runBenchmark(reporter, minTime, "pgmWrite", "pool", "bin", 1, [&](size_t) {
+		PnmStreamWriter<> writer("benchWrite.pgm", size, size, PnmImageType::PGM_BIN);
+		writer.writeBands(frameRows, &sharedPool);
+		writer.finish();
+	}, pixels);
+	std::remove("benchWrite.pgm");
+
+	doNotOptimize(image.getPixelData().data());
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+Converts binary log file produced by BinaryLogger to text.
+
+Usage: decodeBinaryLog -in BINARY_LOG [-out TEXT_FILE]
+(if no output file is given, text is written to std::cout)
+
+(c) 2018 David Kutak
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ArgsParser.h"
+#include "BinaryLogger.h"
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	std::vector<std::string> inFile;
+	std::vector<std::string> outFile;
+
+	if (!argsParser.containsOnlyValidOptions({ "-in", "-out" }) ||
+		!argsParser.getOption("-in", inFile) || inFile.size() != 1)
+	{
+		std::cout << "Usage: " << argsParser.getProgramName() << " -in BINARY_LOG [-out TEXT_FILE]" << std::endl;
+		return 1;
+	}
+
+	bool success;
+	if (argsParser.getOption("-out", outFile) && outFile.size() == 1)
+	{
+		std::ofstream output(outFile[0]);
+		success = protolib::BinaryLogger::decodeFile(inFile[0], output);
+	}
+	else
+	{
+		success = protolib::BinaryLogger::decodeFile(inFile[0], std::cout);
+	}
+
+	if (!success)
+	{
+		std::cout << "[ERROR] " << inFile[0] << " is not a valid binary log (or it is truncated)." << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+Decompresses log file written by CompressedFileSink.
+
+Usage: decompressLog -in COMPRESSED_LOG [-out TEXT_FILE] [-offset BYTES] [-follow]
+(if no output file is given, text is written to std::cout, -offset starts
+at the frame containing given position of the decompressed text and -follow
+keeps waiting for new frames like tail -f)
+
+(c) 2018 David Kutak
+*/
+
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ArgsParser.h"
+#include "CompressedLogFile.h"
+
+int main(int argc, char** argv)
+{
+	protolib::ArgsParser argsParser(argc, argv);
+	std::vector<std::string> inFile;
+	std::vector<std::string> args;
+
+	if (!argsParser.containsOnlyValidOptions({ "-in", "-out", "-offset", "-follow" }) ||
+		!argsParser.getOption("-in", inFile) || inFile.size() != 1)
+	{
+		std::cout << "Usage: " << argsParser.getProgramName() <<
+			" -in COMPRESSED_LOG [-out TEXT_FILE] [-offset BYTES] [-follow]" << std::endl;
+		return 1;
+	}
+
+	std::ofstream outFile;
+	if (argsParser.getOption("-out", args) && args.size() == 1)
+	{
+		outFile.open(args[0]);
+	}
+	std::ostream& output = outFile.is_open() ? outFile : std::cout;
+
+	try
+	{
+		protolib::CompressedLogReader reader(inFile[0]);
+		if (argsParser.getOption("-offset", args) && args.size() == 1 && !reader.seek(std::stoull(args[0])))
+		{
+			std::cout << "[ERROR] " << inFile[0] << " doesn't contain offset " << args[0] << "." << std::endl;
+			return 1;
+		}
+
+		const bool follow = argsParser.getOption("-follow");
+		std::string text;
+		while (true)
+		{
+			while (reader.readFrame(text))
+			{
+				output.write(text.data(), text.size());
+				text.clear();
+			}
+			output.flush();
+
+			if (!follow || reader.isCorrupted()) { break; }
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		}
+
+		if (reader.isCorrupted())
+		{
+			std::cout << "[ERROR] " << inFile[0] << " is corrupted at offset " << reader.getPosition() << "." << std::endl;
+			return 1;
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "[ERROR] " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
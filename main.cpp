@@ -1,16 +1,46 @@
+// Tracing spans of the library are compiled in so that they can be tested
+#define PROTOLIB_TRACING 1
+
 #include <iostream>
 #include <vector>
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <sstream>
 #include "UnitTestsFramework.h"
 #include "ArgsParser.h"
 #include "Logger.h"
+#include "BinaryLogger.h"
+#include "CompressedLogFile.h"
+#include "LogMetrics.h"
+#include "LogSiteLimiter.h"
+#include "NamedLogger.h"
+#include "StructuredLogger.h"
+#include "ThreadPool.h"
+#include "Tracer.h"
 #include "ContainerWrapper.h"
 #include "SvgExporter.h"
+#include "PbmBits.h"
 #include "PnmExporter.h"
+#include "PnmReader.h"
+#include "PnmStreamWriter.h"
 #include "Utils.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <exception>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #define TESTS_ARGS_PARSER 1
 #define TESTS_LOGGER 1
 #define TESTS_CONT_WRAP 1
@@ -74,6 +104,8 @@ void testsArgsParser()
 void testsLogger()
 {
 	using protolib::Logger;
+	using protolib::BinaryLogger;
+	using protolib::FlushPolicy;
 	std::vector<int> testVector = { 2, 4, 6, 8 };
 	size_t lineNum = 0;
 	std::string tmp;
@@ -148,10 +180,870 @@ void testsLogger()
 
 	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 2);
 
+	std::vector<std::thread> syncedProducers;
+	std::vector<std::thread::id> syncedProducerIds;
+	std::atomic<int> syncedProducersDone(0);
+	std::atomic<bool> syncedStatsChecked(false);
+	for (int t = 0; t < 4; ++t)
+	{
+		syncedProducers.emplace_back([t, &syncedProducersDone, &syncedStatsChecked]() {
+			for (int i = 0; i < 100; ++i)
+			{
+				Logger::writeSimpleLog(i, "t" + std::to_string(t), "synced.cpp");
+			}
+			++syncedProducersDone;
+			while (!syncedStatsChecked) { std::this_thread::yield(); }
+		});
+		syncedProducerIds.push_back(syncedProducers.back().get_id());
+	}
+	while (syncedProducersDone != 4) { std::this_thread::yield(); }
+
+	size_t syncedThreads = 0;
+	for (const auto& stats : Logger::getThreadStats())
+	{
+		if (std::find(syncedProducerIds.begin(), syncedProducerIds.end(), stats.threadId) != syncedProducerIds.end())
+		{
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, stats.writtenLogs == 100);
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, stats.pendingLogs == 100);
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, stats.maxPendingLogs == 100);
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !stats.finished);
+			++syncedThreads;
+		}
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, syncedThreads == 4);
+	syncedStatsChecked = true;
+	for (auto& producer : syncedProducers) { producer.join(); }
+
+	Logger::setLogFile("testsLogger_8.txt", true);
+	Logger::syncedOutput();
+	Logger::closeLogFile();
+
+	syncedThreads = 0;
+	for (const auto& stats : Logger::getThreadStats())
+	{
+		if (std::find(syncedProducerIds.begin(), syncedProducerIds.end(), stats.threadId) != syncedProducerIds.end())
+		{
+			++syncedThreads;
+		}
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, syncedThreads == 0);
+
+	std::ifstream tl8("testsLogger_8.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tl8.good());
+	std::vector<int> lastSyncedValues(4, -1);
+	lineNum = 0;
+	while (std::getline(tl8, tmp))
+	{
+		const std::string prefix = "[File synced.cpp] [Type INF] t";
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.compare(0, prefix.size(), prefix) == 0);
+		int thread = tmp[prefix.size()] - '0';
+		int value = std::stoi(tmp.substr(prefix.size() + 4));
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, thread >= 0 && thread < 4 && value == lastSyncedValues[thread] + 1);
+		lastSyncedValues[thread] = value;
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 400);
+
+	Logger::disableSyncedLogging();
+	Logger::setMappedLogFile("testsLogger_9.log", true, 4096);
+	std::vector<std::thread> mappedProducers;
+	for (int t = 0; t < 4; ++t)
+	{
+		mappedProducers.emplace_back([t]() {
+			for (int i = 0; i < 100; ++i)
+			{
+				Logger::writeSimpleLog(i, "t" + std::to_string(t), "mapped.cpp");
+			}
+		});
+	}
+	for (auto& producer : mappedProducers) { producer.join(); }
+	Logger::closeMappedLogFile();
+
+	size_t mappedSegments = 0;
+	lineNum = 0;
+	while (true)
+	{
+		std::ifstream segment("testsLogger_9.log." + std::to_string(mappedSegments));
+		if (!segment.good()) { break; }
+		while (std::getline(segment, tmp))
+		{
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("[File mapped.cpp] [Type INF] t") == 0);
+			++lineNum;
+		}
+		++mappedSegments;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 400);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, mappedSegments > 1);
+	for (size_t i = 0; i < mappedSegments; ++i)
+	{
+		remove(("testsLogger_9.log." + std::to_string(i)).c_str());
+	}
+
+	// Log file might be switched while the asynchronous worker flushes it
+	Logger::enableAsyncLogging(64, Logger::OverflowPolicy::BLOCK);
+	for (int i = 0; i < 50; ++i)
+	{
+		Logger::setLogFile("testsLogger_25.txt", true);
+		Logger::writeSimpleLog(i, "i", "switch.cpp");
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+		Logger::closeLogFile();
+	}
+	Logger::disableAsyncLogging();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, remove("testsLogger_25.txt") == 0);
+
+	Logger::setLogFile("testsLogger_3.txt", true);
+	Logger::enableAsyncLogging(64, Logger::OverflowPolicy::BLOCK);
+	std::vector<std::thread> producers;
+	for (int t = 0; t < 4; ++t)
+	{
+		producers.emplace_back([]() {
+			for (int i = 0; i < 250; ++i)
+			{
+				Logger::writeSimpleLog(i, "i", "async.cpp");
+			}
+		});
+	}
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+	Logger::flush();
+	Logger::disableAsyncLogging();
+	Logger::closeLogFile();
+
+	std::ifstream tl3("testsLogger_3.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tl3.good());
+	lineNum = 0;
+	size_t validLines = 0;
+	const std::string asyncPrefix = "[File async.cpp] [Type INF] i = ";
+	while (std::getline(tl3, tmp))
+	{
+		validLines += tmp.compare(0, asyncPrefix.size(), asyncPrefix) == 0;
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 1000);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, validLines == 1000);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::getDroppedLogsCount() == 0);
+
+	Logger::setLogFile("testsLogger_4.txt", true);
+	int evaluations = 0;
+	auto countedValue = [&evaluations]() { ++evaluations; return 42; };
+	Logger::setLogLevel(Logger::LogType::WAR);
+	PROTOLIB_LOG_VAR(INF, countedValue());
+	PROTOLIB_LOG_BOOL(DBG, countedValue() == 42);
+	PROTOLIB_LOG_VAR(ERR, countedValue());
+	Logger::setLogLevel(Logger::LogType::DBG);
+	Logger::closeLogFile();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, evaluations == 1);
+
+	std::ifstream tl4("testsLogger_4.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tl4.good());
+	lineNum = 0;
+	while (std::getline(tl4, tmp))
+	{
+		const std::string expectedEnd = "] [Type ERR] countedValue() = 42";
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("main.cpp:") != std::string::npos);
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.size() > expectedEnd.size() &&
+			tmp.compare(tmp.size() - expectedEnd.size(), expectedEnd.size(), expectedEnd) == 0);
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 1);
+
+	BinaryLogger::start("testsLogger_5.bin");
+	PROTOLIB_LOG_DEFERRED(WAR, "x = {}, name = {}, ok = {}", 42, "abc", true);
+	for (int i = 0; i < 3; ++i)
+	{
+		PROTOLIB_LOG_DEFERRED(INF, "iteration {} of {}", i, 2.5);
+	}
+	BinaryLogger::stop();
+
+	std::stringstream decoded;
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, BinaryLogger::decodeFile("testsLogger_5.bin", decoded));
+	lineNum = 0;
+	while (std::getline(decoded, tmp))
+	{
+		// Records carry time and thread of the call, not of the background thread
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("[Time ") == 0 && tmp.find("] [Thread " +
+			std::to_string(protolib::LogClock::threadIndex()) + "] [File ") != std::string::npos &&
+			tmp.find("main.cpp:") != std::string::npos);
+		if (lineNum == 0)
+		{
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("] [Type WAR] x = 42, name = abc, ok = 1") != std::string::npos);
+		}
+		else
+		{
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, 
+				tmp.find("] [Type INF] iteration " + std::to_string(lineNum - 1) + " of 2.5") != std::string::npos);
+		}
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 4);
+
+	// Decoded numbers are formatted exactly like text logs format them
+	BinaryLogger::start("testsLogger_26.bin");
+	PROTOLIB_LOG_DEFERRED(INF, "{} {} {} {} {} {}", 1234567.891, 0.1, static_cast<int64_t>(-9007199254740993LL),
+		static_cast<uint64_t>(18446744073709551615ULL), 0.1f, 3.14159f);
+	BinaryLogger::stop();
+	decoded.str("");
+	decoded.clear();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, BinaryLogger::decodeFile("testsLogger_26.bin", decoded));
+	std::string expectedNumbers;
+	protolib::Formatter::appendValue(expectedNumbers, 1234567.891);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, expectedNumbers == "1234567.891" && decoded.str().find(
+		"] [Type INF] 1234567.891 0.1 -9007199254740993 18446744073709551615 0.1 3.14159\n") != std::string::npos);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, remove("testsLogger_26.bin") == 0);
+
+	Logger::setLogFile("testsLogger_6.txt", true);
+	Logger::enableThreadIndices();
+	BinaryLogger::start();
+	PROTOLIB_LOG_DEFERRED(ERR, "formatted in {}", std::string("background"));
+	BinaryLogger::flush();
+	BinaryLogger::stop();
+	Logger::disableThreadIndices();
+	Logger::closeLogFile();
+
+	std::ifstream tl6("testsLogger_6.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tl6.good());
+	lineNum = 0;
+	while (std::getline(tl6, tmp))
+	{
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("[Thread " + std::to_string(protolib::LogClock::threadIndex()) +
+			"] [File ") == 0 && tmp.find("] [Type ERR] formatted in background") != std::string::npos);
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 1);
+
+	auto fileSize = [](const std::string& fileName) {
+		std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+		return static_cast<long long>(file.tellg());
+	};
+
+	Logger::setFileFlushPolicy(FlushPolicy::explicitOnly());
+	Logger::setLogFile("testsLogger_7.txt", true);
+	for (int i = 0; i < 3; ++i)
+	{
+		Logger::writeSimpleLog(i, "i", "batched.cpp");
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, fileSize("testsLogger_7.txt") == 0);
+	Logger::flush();
+	long long flushedSize = fileSize("testsLogger_7.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, flushedSize > 0);
+
+	Logger::setFileFlushPolicy(FlushPolicy(1 << 20, 0, std::chrono::milliseconds(0), true));
+	Logger::writeSimpleInfoLog("buffered", "batched.cpp");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, fileSize("testsLogger_7.txt") == flushedSize);
+	Logger::writeSimpleInfoLog("failure", "batched.cpp", Logger::LogType::ERR);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, fileSize("testsLogger_7.txt") > flushedSize);
+
+	Logger::setFileFlushPolicy(FlushPolicy(1 << 20, 2, std::chrono::milliseconds(0), false));
+	Logger::writeSimpleInfoLog("first", "batched.cpp");
+	flushedSize = fileSize("testsLogger_7.txt");
+	Logger::writeSimpleInfoLog("second", "batched.cpp");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, fileSize("testsLogger_7.txt") > flushedSize);
+	Logger::setFileFlushPolicy(FlushPolicy());
+	Logger::closeLogFile();
+
+	std::ifstream tl7("testsLogger_7.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tl7.good());
+	lineNum = 0;
+	while (std::getline(tl7, tmp))
+	{
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("[File batched.cpp] [Type ") == 0);
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 7);
+
+	// Idle asynchronous worker sleeps until the time limit of buffered records and flushes them
+	Logger::setFileFlushPolicy(FlushPolicy(1 << 20, 0, std::chrono::milliseconds(20), false));
+	Logger::setLogFile("testsLogger_27.txt", true);
+	Logger::enableAsyncLogging(64);
+	Logger::writeSimpleInfoLog("delayed", "batched.cpp");
+	long long delayedSize = 0;
+	for (int i = 0; i < 200 && delayedSize <= 0; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		delayedSize = fileSize("testsLogger_27.txt");
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, delayedSize > 0);
+	Logger::disableAsyncLogging();
+	Logger::closeLogFile();
+	Logger::setFileFlushPolicy(FlushPolicy());
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, remove("testsLogger_27.txt") == 0);
+
+	std::atomic<size_t> rotatedFiles(0);
+	protolib::RotationPolicy rotation(200, std::chrono::seconds(0), 2, "%n.%i");
+	rotation.onRotated = [&rotatedFiles](const std::string&) { ++rotatedFiles; };
+	Logger::setFileFlushPolicy(FlushPolicy::everyRecord());
+	Logger::setRotatingLogFile("testsLogger_10.txt", rotation, true);
+	for (int i = 0; i < 20; ++i)
+	{
+		Logger::writeSimpleLog(i, "rotated", "rotation.cpp");
+	}
+	Logger::closeLogFile();
+	Logger::setFileFlushPolicy(FlushPolicy());
+
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, rotatedFiles >= 4);
+	std::vector<std::string> rotationFiles = { "testsLogger_10.txt",
+		"testsLogger_10.txt." + std::to_string(rotatedFiles - 1), "testsLogger_10.txt." + std::to_string(rotatedFiles) };
+	for (const auto& fileName : rotationFiles)
+	{
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, fileSize(fileName) > 0 && fileSize(fileName) <= 200);
+		std::ifstream rotatedFile(fileName);
+		while (std::getline(rotatedFile, tmp))
+		{
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("[File rotation.cpp] [Type INF] rotated = ") == 0);
+		}
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !std::ifstream("testsLogger_10.txt." + std::to_string(rotatedFiles - 2)).good());
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !std::ifstream("testsLogger_10.txt.next0").good());
+	for (const auto& fileName : rotationFiles)
+	{
+		remove(fileName.c_str());
+	}
+
+	uint64_t ticksBefore = protolib::LogClock::now();
+	int64_t wallNow = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, protolib::LogClock::now() >= ticksBefore);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::llabs(protolib::LogClock::toWallClockNs(ticksBefore) - wallNow) < 50000000);
+
+	Logger::enableTimestamps();
+	Logger::enableThreadIndices();
+	Logger::setLogFile("testsLogger_11.txt", true);
+	Logger::writeSimpleInfoLog("timed", "clock.cpp");
+	Logger::closeLogFile();
+	Logger::disableTimestamps();
+	Logger::disableThreadIndices();
+
+	std::ifstream tl11("testsLogger_11.txt");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::getline(tl11, tmp));
+	// [Time YYYY-MM-DD HH:MM:SS.uuuuuu] [Thread N] [File clock.cpp] [Type INF] timed
+	const std::string timedSuffix = "] [Thread " + std::to_string(protolib::LogClock::threadIndex()) +
+		"] [File clock.cpp] [Type INF] timed";
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.compare(0, 6, "[Time ") == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.size() == 6 + 26 + timedSuffix.size());
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.compare(6 + 26, std::string::npos, timedSuffix) == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp[6 + 4] == '-' && tmp[6 + 10] == ' ' && tmp[6 + 19] == '.');
+
+	Logger::setLogFile("testsLogger_12.txt", true);
+	int limitedEvaluations = 0;
+	auto countEvaluation = [&limitedEvaluations](int value) { ++limitedEvaluations; return value; };
+	for (int i = 0; i < 100; ++i)
+	{
+		PROTOLIB_LOG_EVERY_N(INF, 10, PROTOLIB_LOG_VAR(INF, countEvaluation(i)));
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, limitedEvaluations == 10);
+	for (int i = 0; i < 50; ++i)
+	{
+		PROTOLIB_LOG_FIRST_N(ERR, 3, 0, PROTOLIB_LOG_MSG(ERR, "storm"));
+	}
+	for (int i = 0; i < 100; ++i)
+	{
+		PROTOLIB_LOG_RATE_LIMITED(WAR, 0.01, 5, PROTOLIB_LOG_MSG(WAR, "limited"));
+	}
+	protolib::LogSiteLimiter::reportAllSuppressed();
+	Logger::closeLogFile();
+
+	std::ifstream tl12("testsLogger_12.txt");
+	size_t everyNthLogs = 0, firstNLogs = 0, rateLimitedLogs = 0;
+	bool stormSummary = false, rateLimitedSummary = false;
+	while (std::getline(tl12, tmp))
+	{
+		everyNthLogs += tmp.find("] [Type INF] countEvaluation(i) = ") != std::string::npos ? 1 : 0;
+		firstNLogs += tmp.find("] [Type ERR] storm") != std::string::npos ? 1 : 0;
+		rateLimitedLogs += tmp.find("] [Type WAR] limited") != std::string::npos ? 1 : 0;
+		stormSummary = stormSummary || tmp.find("] [Type ERR] suppressed 47 similar messages") != std::string::npos;
+		rateLimitedSummary = rateLimitedSummary || tmp.find("] [Type WAR] suppressed 95 similar messages") != std::string::npos;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, everyNthLogs == 10);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, firstNLogs == 3);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, rateLimitedLogs == 5);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, stormSummary);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, rateLimitedSummary);
+
+	using protolib::StructuredLogger;
+	using protolib::field;
+	Logger::setLogFile("testsLogger_13.txt", true);
+	std::vector<int> structuredIds = { 1, 2, 3, 4, 5 };
+	std::map<std::string, int> structuredMap = { { "a", 1 }, { "b", 2 } };
+	std::vector<std::vector<int>> structuredNested = { { 1 }, { 2, 3 } };
+	std::string structuredName = "quote\" and\nline";
+	StructuredLogger::write(Logger::LogType::INF, "request done", "main.cpp", 7, field("id", 42), field("neg", -5),
+		field("ratio", 0.1), field("ok", true), field("name", structuredName), field("c", 'x'), field("ids", structuredIds),
+		field("map", structuredMap), field("nested", structuredNested), field("nan", std::nan("")));
+	StructuredLogger::setMaxElements(2);
+	StructuredLogger::write(Logger::LogType::WAR, "capped", "main.cpp", 8, field("ids", structuredIds));
+	StructuredLogger::setFormat(StructuredLogger::Format::LOGFMT);
+	StructuredLogger::write(Logger::LogType::ERR, "two words", "main.cpp", 9, field("id", 42), field("path", "/a b"),
+		field("empty", ""), field("ids", structuredIds), field("tags", std::vector<std::string>{ "x", "y z" }));
+	StructuredLogger::setMaxElements(64);
+	StructuredLogger::setFormat(StructuredLogger::Format::JSON_LINES);
+	Logger::enableAsyncLogging(64);
+	PROTOLIB_LOG_FIELDS(INF, "async", field("big", std::string(600, 'b')));
+	PROTOLIB_LOG_FIELDS(DBG, "no fields");
+	Logger::disableAsyncLogging();
+	Logger::enableSyncedLogging();
+	PROTOLIB_LOG_FIELDS(INF, "synced", field("value", 1.5f), field("tenth", 0.1f));
+	Logger::syncedOutput();
+	Logger::disableSyncedLogging();
+	Logger::closeLogFile();
+
+	std::ifstream tl13("testsLogger_13.txt");
+	std::vector<std::string> structuredLines;
+	while (std::getline(tl13, tmp))
+	{
+		structuredLines.push_back(tmp);
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() == 6);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() > 0 && structuredLines[0] ==
+		"{\"level\":\"INF\",\"file\":\"main.cpp\",\"line\":7,\"msg\":\"request done\",\"id\":42,\"neg\":-5,"
+		"\"ratio\":0.1,\"ok\":true,\"name\":\"quote\\\" and\\nline\",\"c\":\"x\",\"ids\":[1,2,3,4,5],"
+		"\"map\":[[\"a\",1],[\"b\",2]],\"nested\":[[1],[2,3]],\"nan\":null}");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() > 1 && structuredLines[1] ==
+		"{\"level\":\"WAR\",\"file\":\"main.cpp\",\"line\":8,\"msg\":\"capped\",\"ids\":[1,2],\"ids_omitted\":3}");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() > 2 && structuredLines[2] ==
+		"level=ERR file=main.cpp line=9 msg=\"two words\" id=42 path=\"/a b\" empty=\"\" ids=[1,2] ids_omitted=3 "
+		"tags=\"[x,y z]\"");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() > 3 && structuredLines[3].size() > 600 &&
+		structuredLines[3].find("\"msg\":\"async\",\"big\":\"bbb") != std::string::npos && structuredLines[3].back() == '}');
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() > 4 &&
+		structuredLines[4].find("\"level\":\"DBG\",\"file\":\"") == 1 &&
+		structuredLines[4].find("\"msg\":\"no fields\"}") != std::string::npos);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, structuredLines.size() > 5 &&
+		structuredLines[5].find("\"msg\":\"synced\",\"value\":1.5,\"tenth\":0.1}") != std::string::npos);
+
+	// Added sinks with their own threads, levels and overflow policies
+	std::unique_ptr<protolib::RingSink> ringSinkOwner(new protolib::RingSink(4096));
+	protolib::RingSink* ringSink = ringSinkOwner.get();
+	size_t ringSinkId = Logger::addSink(std::move(ringSinkOwner), Logger::LogType::WAR);
+	std::mutex callbackMutex;
+	std::vector<std::string> callbackRecords;
+	std::atomic<bool> callbackReleased(false);
+	size_t callbackSinkId = Logger::addSink(std::unique_ptr<protolib::LogSink>(new protolib::CallbackSink(
+		[&](const char* data, size_t length) {
+			// Simulates stalled consumer
+			while (!callbackReleased.load())
+			{
+				std::this_thread::yield();
+			}
+			std::lock_guard<std::mutex> lock(callbackMutex);
+			callbackRecords.push_back(std::string(data, length));
+		})), Logger::LogType::DBG, Logger::OverflowPolicy::DROP_OLDEST, 512);
+	Logger::setLogFile("testsLogger_14.txt", true);
+	for (int i = 0; i < 100; ++i)
+	{
+		Logger::writeSimpleLog(i, "sinkValue", "sinks.cpp", i % 2 == 0 ? Logger::LogType::INF : Logger::LogType::WAR);
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::getSinkDroppedLogsCount(callbackSinkId) > 0);
+	callbackReleased.store(true);
+	Logger::flush();
+	std::string ringContent = ringSink->getContent();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::count(ringContent.begin(), ringContent.end(), '\n') == 50);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, ringContent.find("[Type INF]") == std::string::npos);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, ringContent.find("[File sinks.cpp] [Type WAR] sinkValue = 99\n") != std::string::npos);
+	{
+		std::lock_guard<std::mutex> lock(callbackMutex);
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !callbackRecords.empty() && callbackRecords.size() < 100);
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !callbackRecords.empty() &&
+			callbackRecords.back() == "[File sinks.cpp] [Type WAR] sinkValue = 99\n");
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::setSinkLogLevel(ringSinkId, Logger::LogType::ERR));
+	Logger::writeSimpleInfoLog("not in ring", "sinks.cpp", Logger::LogType::WAR);
+	Logger::flush();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, ringSink->getContent() == ringContent);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::removeSink(ringSinkId));
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !Logger::removeSink(ringSinkId));
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::removeSink(callbackSinkId));
+	Logger::closeLogFile();
+	std::ifstream tl14("testsLogger_14.txt");
+	lineNum = 0;
+	while (std::getline(tl14, tmp))
+	{
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 101);
+
+	protolib::RingSink smallRing(48);
+	const char smallRecords[] = "first record\nsecond record\nthird record which is long\n";
+	smallRing.write(smallRecords, sizeof(smallRecords) - 1);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, smallRing.getContent() == "second record\nthird record which is long\n");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, smallRing.getWrittenBytes() == sizeof(smallRecords) - 1);
+
+#if defined(__unix__) || defined(__APPLE__)
+	const std::string socketPath = "testsLogger_15.sock";
+	remove(socketPath.c_str());
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un socketAddress;
+	memset(&socketAddress, 0, sizeof(socketAddress));
+	socketAddress.sun_family = AF_UNIX;
+	memcpy(socketAddress.sun_path, socketPath.c_str(), socketPath.size());
+	bool listening = listener >= 0 &&
+		bind(listener, reinterpret_cast<struct sockaddr*>(&socketAddress), sizeof(socketAddress)) == 0 &&
+		listen(listener, 1) == 0;
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, listening);
+	if (listening)
+	{
+		size_t socketSinkId = Logger::addSink(std::unique_ptr<protolib::LogSink>(
+			new protolib::UnixSocketSink(socketPath)), Logger::LogType::ERR);
+		int connection = accept(listener, nullptr, nullptr);
+		Logger::disableConsoleOutput();
+		Logger::writeSimpleInfoLog("ignored by socket", "socket.cpp", Logger::LogType::WAR);
+		Logger::writeSimpleInfoLog("sent over socket", "socket.cpp", Logger::LogType::ERR);
+		Logger::enableConsoleOutput();
+		Logger::removeSink(socketSinkId);
+
+		std::string received;
+		char socketBuffer[256];
+		ssize_t receivedBytes;
+		while (connection >= 0 && (receivedBytes = read(connection, socketBuffer, sizeof(socketBuffer))) > 0)
+		{
+			received.append(socketBuffer, static_cast<size_t>(receivedBytes));
+		}
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, received == "[File socket.cpp] [Type ERR] sent over socket\n");
+		if (connection >= 0)
+		{
+			close(connection);
+		}
+	}
+	if (listener >= 0)
+	{
+		close(listener);
+	}
+	remove(socketPath.c_str());
+#endif
+
+	// Flight recorder keeps more verbose logs than those which are outputted
+	Logger::setLogFile("testsLogger_16.txt", true);
+	Logger::setLogLevel(Logger::LogType::WAR);
+	Logger::enableFlightRecorder("testsLogger_16.dump", 4096, Logger::LogType::DBG, false);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::isLogEnabled(Logger::LogType::DBG));
+	PROTOLIB_LOG_MSG(DBG, "recorded only");
+	PROTOLIB_LOG_MSG(WAR, "persisted");
+	Logger::closeLogFile();
+	std::string recorderContent = Logger::getFlightRecorderContent();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, recorderContent.find("[Type DBG] recorded only\n") != std::string::npos);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, recorderContent.find("[Type WAR] persisted\n") != std::string::npos);
+	std::ifstream tl16("testsLogger_16.txt");
+	lineNum = 0;
+	while (std::getline(tl16, tmp))
+	{
+		++lineNum;
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp.find("[Type WAR] persisted") != std::string::npos);
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 1);
+	for (int i = 0; i < 500; ++i)
+	{
+		Logger::writeSimpleLog(i, "recorded", "recorder.cpp", Logger::LogType::DBG);
+	}
+	recorderContent = Logger::getFlightRecorderContent();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, recorderContent.size() <= 4096 && recorderContent.size() > 4000);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, recorderContent.compare(0, 23, "[File recorder.cpp] [Ty") == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, recorderContent.size() > 30 &&
+		recorderContent.compare(recorderContent.size() - 15, 15, "recorded = 499\n") == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::dumpFlightRecorder("test"));
+	std::ifstream tl16Dump("testsLogger_16.dump");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::getline(tl16Dump, tmp) && tmp == "=== Flight recorder dump (test) ===");
+	lineNum = 0;
+	while (std::getline(tl16Dump, tmp))
+	{
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == static_cast<size_t>(
+		std::count(recorderContent.begin(), recorderContent.end(), '\n')));
+	Logger::disableFlightRecorder();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !Logger::isLogEnabled(Logger::LogType::DBG));
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !Logger::dumpFlightRecorder());
+	Logger::setLogLevel(Logger::LogType::DBG);
+
+#if defined(__unix__) || defined(__APPLE__)
+	// Crashing children dump their flight recorders
+	auto runCrashingChild = [](const char* dumpFile, bool terminate) {
+		pid_t child = fork();
+		if (child == 0)
+		{
+			struct rlimit noCore = { 0, 0 };
+			setrlimit(RLIMIT_CORE, &noCore);
+			freopen("/dev/null", "w", stderr);
+			Logger::setLogLevel(Logger::LogType::ERR);
+			Logger::enableFlightRecorder(dumpFile, 4096);
+			PROTOLIB_LOG_MSG(DBG, "before crash");
+			if (terminate)
+			{
+				std::terminate();
+			}
+			raise(SIGSEGV);
+			_exit(0);
+		}
+
+		int status = 0;
+		waitpid(child, &status, 0);
+		return WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+	};
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, runCrashingChild("testsLogger_17.dump", false) == SIGSEGV);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, runCrashingChild("testsLogger_18.dump", true) == SIGABRT);
+	std::ifstream tl17("testsLogger_17.dump");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::getline(tl17, tmp) && tmp == "=== Flight recorder dump (SIGSEGV) ===");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::getline(tl17, tmp) && tmp.find("[Type DBG] before crash") != std::string::npos);
+	std::ifstream tl18("testsLogger_18.dump");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::getline(tl18, tmp) && tmp == "=== Flight recorder dump (std::terminate) ===");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, std::getline(tl18, tmp) && tmp.find("[Type DBG] before crash") != std::string::npos);
+	tl17.close();
+	tl18.close();
+	remove("testsLogger_17.dump");
+	remove("testsLogger_18.dump");
+#endif
+
+	// Metrics are cumulative, so only differences of snapshots are tested
+	Logger::setLogFile("testsLogger_19.txt", true);
+	protolib::LogMetricsSnapshot metricsBefore = protolib::LogMetrics::getSnapshot();
+	PROTOLIB_LOG_MSG(DBG, "metrics debug");
+	PROTOLIB_LOG_MSG(INF, "metrics info");
+	PROTOLIB_LOG_MSG(INF, "metrics info");
+	PROTOLIB_LOG_MSG(ERR, "metrics error");
+	for (int i = 0; i < 5; ++i)
+	{
+		PROTOLIB_LOG_FIRST_N(WAR, 2, 0, PROTOLIB_LOG_MSG(WAR, "metrics limited"));
+	}
+	Logger::flush();
+	protolib::LogMetricsSnapshot metricsAfter = protolib::LogMetrics::getSnapshot();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.records[0] - metricsBefore.records[0] == 1);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.records[1] - metricsBefore.records[1] == 2);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.records[2] - metricsBefore.records[2] == 2);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.records[3] - metricsBefore.records[3] == 1);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.suppressedLogs - metricsBefore.suppressedLogs == 3);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.bytesWritten > metricsBefore.bytesWritten);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.lockHold.count >= metricsBefore.lockHold.count + 6);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.flush.count > metricsBefore.flush.count);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.lockHold.p50Ns <= metricsAfter.lockHold.p99Ns &&
+		metricsAfter.lockHold.p99Ns <= metricsAfter.lockHold.maxNs);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsAfter.toString().find(" records_inf=") != std::string::npos);
+	protolib::LogMetrics::startPeriodicLog(std::chrono::milliseconds(10));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	protolib::LogMetrics::stopPeriodicLog();
+	Logger::closeLogFile();
+	std::ifstream tl19("testsLogger_19.txt");
+	size_t metricsLogs = 0;
+	while (std::getline(tl19, tmp))
+	{
+		if (tmp.find("[File LogMetrics] [Type INF] metrics = records_dbg=") != std::string::npos)
+		{
+			++metricsLogs;
+		}
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, metricsLogs >= 1);
+
+	// Named loggers have their own outputs and propagate to the default Logger
+	Logger::setLogFile("testsLogger_21.txt", true);
+	protolib::NamedLogger& network = protolib::LoggerRegistry::get("network");
+	protolib::NamedLogger& storage = protolib::LoggerRegistry::get("storage");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, &network == &protolib::LoggerRegistry::get("network"));
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, network.getName() == "network");
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, protolib::LoggerRegistry::getNames() ==
+		std::vector<std::string>({ "network", "storage" }));
+	network.setLogFile("testsLogger_20.txt", true);
+	network.setLogLevel(Logger::LogType::WAR);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !network.isLogEnabled(Logger::LogType::INF));
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, storage.isLogEnabled(Logger::LogType::INF));
+	std::thread networkThread([&network]() {
+		for (int i = 0; i < 100; ++i)
+		{
+			network.writeSimpleLog(i, "packet", "network.cpp", Logger::LogType::WAR);
+			PROTOLIB_LOGGER_MSG(network, INF, "below level");
+		}
+	});
+	for (int i = 0; i < 50; ++i)
+	{
+		storage.writeSimpleLog(i, "block", "storage.cpp", Logger::LogType::INF);
+	}
+	networkThread.join();
+	PROTOLIB_LOGGER_MSG(storage, ERR, "disk full");
+	storage.writeStructuredLog(testVector, "testVector", "storage.cpp");
+	storage.disablePropagation();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !storage.isLogEnabled(Logger::LogType::ERR));
+	PROTOLIB_LOGGER_MSG(storage, ERR, "not written anywhere");
+	storage.enablePropagation();
+	protolib::LoggerRegistry::flushAll();
+	network.closeLogFile();
+	Logger::closeLogFile();
+	std::ifstream tl20("testsLogger_20.txt");
+	lineNum = 0;
+	while (std::getline(tl20, tmp))
+	{
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, tmp == "[Logger network] [File network.cpp] [Type WAR] packet = " +
+			std::to_string(lineNum));
+		++lineNum;
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, lineNum == 100);
+	std::ifstream tl21("testsLogger_21.txt");
+	std::vector<std::string> defaultLines;
+	while (std::getline(tl21, tmp))
+	{
+		defaultLines.push_back(tmp);
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, defaultLines.size() == 52);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, defaultLines.size() == 52 &&
+		defaultLines[0] == "[Logger storage] [File storage.cpp] [Type INF] block = 0" &&
+		defaultLines[50].find("[Logger storage] [File main.cpp:") == 0 &&
+		defaultLines[50].find("[Type ERR] disk full") != std::string::npos &&
+		defaultLines[51] == "[Logger storage] [File storage.cpp] [Type INF] testVector = 2, 4, 6, 8, ");
+
+	// Compressed log files
+	protolib::LogCompressor compressor;
+	std::string randomText;
+	uint32_t randomState = 12345;
+	for (size_t i = 0; i < 5000; ++i)
+	{
+		randomState = randomState * 1103515245u + 12345u;
+		randomText += static_cast<char>(randomState >> 24);
+	}
+	std::string repetitiveText;
+	for (size_t i = 0; repetitiveText.size() < protolib::LogCompressor::MaxBlockSize - 100; ++i)
+	{
+		repetitiveText += "[File main.cpp] [Type INF] value = " + std::to_string(i % 1000) + "\n";
+	}
+	for (const std::string& text : { std::string(), std::string("abc"), std::string(1000, 'a'),
+		std::string("abcdabcdabcdabcdabcd"), randomText, repetitiveText })
+	{
+		std::string compressed;
+		compressor.compress(text.data(), text.size(), compressed);
+		std::string decompressed(text.size(), '\0');
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, protolib::LogCompressor::decompress(compressed.data(), compressed.size(),
+			&decompressed[0], decompressed.size()) && decompressed == text);
+		if (!text.empty())
+		{
+			UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !protolib::LogCompressor::decompress(compressed.data(),
+				compressed.size(), &decompressed[0], decompressed.size() - 1));
+		}
+	}
+	std::string compressedText;
+	compressor.compress(repetitiveText.data(), repetitiveText.size(), compressedText);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedText.size() * 5 < repetitiveText.size());
+	std::string decompressedText(repetitiveText.size(), '\0');
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !protolib::LogCompressor::decompress(compressedText.data(),
+		compressedText.size() / 2, &decompressedText[0], decompressedText.size()));
+
+	size_t compressedSinkId = Logger::addSink(std::unique_ptr<protolib::LogSink>(
+		new protolib::CompressedFileSink("testsLogger_22.lz")), Logger::LogType::DBG, Logger::OverflowPolicy::BLOCK);
+	Logger::setLogFile("testsLogger_23.txt", true);
+	for (int i = 0; i < 20000; ++i)
+	{
+		Logger::writeSimpleLog(i, "counter", "compressed.cpp");
+	}
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, Logger::removeSink(compressedSinkId));
+	Logger::closeLogFile();
+	std::ifstream tl23("testsLogger_23.txt", std::ios::binary);
+	std::string expectedText((std::istreambuf_iterator<char>(tl23)), std::istreambuf_iterator<char>());
+	std::ostringstream decompressedLog;
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, protolib::CompressedLogReader::decompressFile("testsLogger_22.lz",
+		decompressedLog));
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !expectedText.empty() && decompressedLog.str() == expectedText);
+	std::ifstream tl22("testsLogger_22.lz", std::ios::binary);
+	std::string compressedLog((std::istreambuf_iterator<char>(tl22)), std::istreambuf_iterator<char>());
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedLog.size() * 5 < expectedText.size());
+
+	protolib::CompressedLogReader compressedReader("testsLogger_22.lz");
+	std::string frameText;
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedReader.readFrame(frameText) &&
+		frameText.size() <= protolib::CompressedFileSink::FrameSize && frameText.back() == '\n' &&
+		expectedText.compare(0, frameText.size(), frameText) == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedReader.getPosition() == frameText.size());
+	const uint64_t seekOffset = expectedText.size() * 2 / 3;
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedReader.seek(seekOffset) &&
+		compressedReader.getPosition() <= seekOffset && compressedReader.getPosition() > frameText.size());
+	const uint64_t frameStart = compressedReader.getPosition();
+	frameText.clear();
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedReader.readFrame(frameText) &&
+		frameStart + frameText.size() > seekOffset && expectedText.compare(frameStart, frameText.size(), frameText) == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, compressedReader.seek(10) && compressedReader.getPosition() == 0);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !compressedReader.seek(expectedText.size()) &&
+		compressedReader.getPosition() == 0 && !compressedReader.isCorrupted());
+
+	// Reader of a file being written returns only complete frames
+	std::ofstream tl24("testsLogger_24.lz", std::ios::binary);
+	tl24.write(compressedLog.data(), compressedLog.size() / 2);
+	tl24.flush();
+	protolib::CompressedLogReader tailReader("testsLogger_24.lz");
+	std::string tailText;
+	while (tailReader.readFrame(tailText)) { }
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !tailReader.isCorrupted() && !tailText.empty() &&
+		tailText.size() < expectedText.size() && expectedText.compare(0, tailText.size(), tailText) == 0);
+	tl24.write(compressedLog.data() + compressedLog.size() / 2, compressedLog.size() - compressedLog.size() / 2);
+	tl24.flush();
+	while (tailReader.readFrame(tailText)) { }
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !tailReader.isCorrupted() && tailText == expectedText);
+	tl24.close();
+
+	// Half of the second frame written before a failed write is skipped, the retried frame follows
+	auto frameEnd = [&compressedLog](size_t frameStart) {
+		return frameStart + 28 + static_cast<size_t>(static_cast<unsigned char>(compressedLog[frameStart + 20])) +
+			(static_cast<size_t>(static_cast<unsigned char>(compressedLog[frameStart + 21])) << 8) +
+			(static_cast<size_t>(static_cast<unsigned char>(compressedLog[frameStart + 22])) << 16);
+	};
+	const size_t secondFrame = frameEnd(8);
+	const size_t secondFrameLength = frameEnd(secondFrame) - secondFrame;
+	std::string interruptedLog = compressedLog.substr(0, secondFrame) +
+		compressedLog.substr(secondFrame, secondFrameLength / 2) + compressedLog.substr(secondFrame);
+	std::ofstream("testsLogger_24.lz", std::ios::binary).write(interruptedLog.data(), interruptedLog.size());
+	std::ostringstream resynchronizedLog;
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !protolib::CompressedLogReader::decompressFile("testsLogger_24.lz",
+		resynchronizedLog) && resynchronizedLog.str() == expectedText);
+	protolib::CompressedLogReader interruptedReader("testsLogger_24.lz");
+	frameText.clear();
+	while (interruptedReader.readFrame(frameText)) { }
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, interruptedReader.isCorrupted() && frameText == expectedText);
+
+#if defined(__linux__)
+	// Frames which can't be written are counted as dropped records and don't move the text offset
+	{
+		protolib::CompressedFileSink fullSink("/dev/full");
+		const std::string records = "first\nsecond\nthird\n";
+		fullSink.write(records.data(), records.size(), false, 3);
+		fullSink.flush();
+		UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, fullSink.getDroppedRecordsCount() == 3 &&
+			fullSink.getWrittenBytes() == 0 && fullSink.getRawBytes() == 0);
+	}
+#endif
+
+	std::ostringstream truncatedLog;
+	std::ofstream("testsLogger_24.lz", std::ios::binary).write(compressedLog.data(), compressedLog.size() - 1);
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, !protolib::CompressedLogReader::decompressFile("testsLogger_24.lz",
+		truncatedLog));
+	compressedLog[compressedLog.size() - 10] ^= 0x55;
+	std::ofstream("testsLogger_24.lz", std::ios::binary).write(compressedLog.data(), compressedLog.size());
+	protolib::CompressedLogReader corruptedReader("testsLogger_24.lz");
+	frameText.clear();
+	while (corruptedReader.readFrame(frameText)) { }
+	UNIT_TEST(TESTS_LOGGER, REQUIRE_TRUE, corruptedReader.isCorrupted() && frameText.size() < expectedText.size());
+
 	// Cleanup
 	tl1.close();
 	tl2.close();
-	if (remove("testsLogger_1.txt") != 0 || remove("testsLogger_2.txt") != 0)
+	tl3.close();
+	tl4.close();
+	tl6.close();
+	tl7.close();
+	tl8.close();
+	tl11.close();
+	tl12.close();
+	tl13.close();
+	tl14.close();
+	tl16.close();
+	tl16Dump.close();
+	tl19.close();
+	tl20.close();
+	tl21.close();
+	tl22.close();
+	tl23.close();
+	if (remove("testsLogger_1.txt") != 0 || remove("testsLogger_2.txt") != 0 ||
+		remove("testsLogger_3.txt") != 0 || remove("testsLogger_4.txt") != 0 ||
+		remove("testsLogger_5.bin") != 0 || remove("testsLogger_6.txt") != 0 ||
+		remove("testsLogger_7.txt") != 0 || remove("testsLogger_8.txt") != 0 ||
+		remove("testsLogger_11.txt") != 0 || remove("testsLogger_12.txt") != 0 ||
+		remove("testsLogger_13.txt") != 0 || remove("testsLogger_14.txt") != 0 ||
+		remove("testsLogger_16.txt") != 0 || remove("testsLogger_16.dump") != 0 ||
+		remove("testsLogger_19.txt") != 0 || remove("testsLogger_20.txt") != 0 ||
+		remove("testsLogger_21.txt") != 0 || remove("testsLogger_22.lz") != 0 ||
+		remove("testsLogger_23.txt") != 0 || remove("testsLogger_24.lz") != 0)
 	{
 		std::cout << "UNIT TESTS WARNING! Removing of files in testsLogger method failed." << std::endl;
 	}
@@ -250,6 +1142,73 @@ void testsContainerWrapper()
 	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_FALSE, res);
 	res = cont4.map<int, std::vector<int>>([](auto val) { return static_cast<int>(val); }).getContainer() == std::vector<int>({ 97, 98, 99, 100 });
 	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, res);
+
+	// Pipelines are traced as spans once tracing is started
+	using protolib::Tracer;
+	cont3.where([](auto val) { return val > 3; });
+	Tracer::start();
+	{
+		PROTOLIB_TRACE_SCOPE("tests", "pipeline \"quoted\"");
+		cont3.where([](auto val) { return val > 3; }).reverse();
+		PROTOLIB_TRACE_INSTANT("tests", "checkpoint");
+	}
+	std::thread tracedThread([]() {
+		for (int i = 0; i < 3; ++i)
+		{
+			PROTOLIB_TRACE_COUNTER("tracedCounter", i * 1.5);
+		}
+		PROTOLIB_TRACE_COUNTER("nonFiniteCounter", std::nan(""));
+		PROTOLIB_TRACE_COUNTER("nonFiniteCounter", -HUGE_VAL);
+	});
+	tracedThread.join();
+	Tracer::stop();
+	cont3.skip(1);
+	std::ostringstream trace;
+	Tracer::exportChromeJson(trace);
+	std::string traceJson = trace.str();
+	auto countOccurrences = [&traceJson](const std::string& pattern) {
+		size_t count = 0;
+		for (size_t pos = traceJson.find(pattern); pos != std::string::npos; pos = traceJson.find(pattern, pos + 1))
+		{
+			++count;
+		}
+		return count;
+	};
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, traceJson.compare(0, 16, "{\"traceEvents\":[") == 0);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"where\",\"cat\":\"ContainerWrapper\",\"ph\":\"X\"") == 1);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"reverse\"") == 1);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"skip\"") == 0);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"pipeline \\\"quoted\\\"\",\"cat\":\"tests\"") == 1);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"checkpoint\",\"cat\":\"tests\",\"ph\":\"i\"") == 1);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"tracedCounter\"") == 3);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"args\":{\"value\":3}") == 1);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"args\":{\"value\":null}") == 2 &&
+		countOccurrences("nan") == 0 && countOccurrences("inf") == 0);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"ph\":\"M\"") == 2);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, traceJson.find("\n],\"displayTimeUnit\":\"ns\"}\n") != std::string::npos);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, Tracer::getDroppedEventsCount() == 0);
+	Tracer::clear();
+	trace.str("");
+	Tracer::exportChromeJson(trace);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, trace.str() == "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ns\"}\n");
+
+	// Buffer of a long-lived thread is reused after clear instead of staying full
+	Tracer::start();
+	for (size_t i = 0; i < Tracer::MaxEventsPerThread + 10; ++i)
+	{
+		Tracer::recordInstant("tests", "filler");
+	}
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, Tracer::getDroppedEventsCount() == 10);
+	Tracer::clear();
+	Tracer::recordInstant("tests", "afterClear");
+	Tracer::stop();
+	trace.str("");
+	Tracer::exportChromeJson(trace);
+	traceJson = trace.str();
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, countOccurrences("\"name\":\"afterClear\"") == 1 &&
+		countOccurrences("filler") == 0);
+	UNIT_TEST(TESTS_CONT_WRAP, REQUIRE_TRUE, Tracer::getDroppedEventsCount() == 0);
+	Tracer::clear();
 }
 
 void testsSvgExporter()
@@ -374,6 +1333,534 @@ void testsPnmExporter()
 	pnmExport2.save("test.pbm");
 	pnmExport3.save("test.pgm");
 
+	// Rasterized shapes cover the same pixels as the corresponding predicates
+	typedef PnmExporter<>::PixelColor Color;
+	PnmExporter<> rasterized(97, 61, PnmImageType::PGM_BIN);
+	PnmExporter<> expected(97, 61, PnmImageType::PGM_BIN);
+	auto sameImages = [&rasterized, &expected]() {
+		bool same = rasterized.getPixelData() == expected.getPixelData();
+		rasterized.clear();
+		expected.clear();
+		return same;
+	};
+	for (const auto& circle : std::vector<std::vector<int>>{ { 48, 30, 15 }, { 0, 0, 20 }, { 90, 55, 30 },
+		{ 10, 10, 1 }, { 20, 20, 0 }, { -5, 30, 7 }, { 48, 30, 200 } })
+	{
+		const int cx = circle[0], cy = circle[1], radius = circle[2];
+		rasterized.addCircle(cx, cy, radius, Color(200));
+		expected.setPixels([=](int x, int y) {
+			return (x - cx) * (x - cx) + (y - cy) * (y - cy) < radius * radius;
+		}, Color(200));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	}
+	for (const auto& ellipse : std::vector<std::vector<int>>{ { 48, 30, 40, 10 }, { 48, 30, 3, 25 },
+		{ 95, 2, 17, 9 }, { 30, 30, 1, 1 }, { 30, 30, 0, 5 } })
+	{
+		const long long cx = ellipse[0], cy = ellipse[1], rx = ellipse[2], ry = ellipse[3];
+		rasterized.addEllipse(ellipse[0], ellipse[1], ellipse[2], ellipse[3], Color(7));
+		expected.setPixels([=](long long x, long long y) {
+			return (x - cx) * (x - cx) * ry * ry + (y - cy) * (y - cy) * rx * rx < rx * rx * ry * ry;
+		}, Color(7));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	}
+	for (const auto& rect : std::vector<std::vector<int>>{ { 10, 5, 20, 30 }, { -10, -10, 15, 12 },
+		{ 90, 50, 40, 40 }, { 3, 3, 0, 0 }, { 50, 20, -5, 10 }, { 200, 10, 5, 5 } })
+	{
+		const int xLeft = rect[0], yTop = rect[1], xRight = rect[0] + rect[2], yBottom = rect[1] + rect[3];
+		rasterized.addRectangle(rect[0], rect[1], rect[2], rect[3], Color(255));
+		expected.setPixels([=](int x, int y) {
+			return x >= xLeft && x <= xRight && y >= yTop && y <= yBottom;
+		}, Color(255));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	}
+
+	const std::vector<std::vector<std::pair<int, int>>> polygons = {
+		{ { 0, 0 }, { 10, 0 }, { 10, 5 }, { 0, 5 } },
+		{ { 5, 2 }, { 90, 20 }, { 40, 58 } },
+		{ { 10, 10 }, { 80, 10 }, { 45, 30 }, { 80, 50 }, { 10, 50 }, { 30, 30 } },
+		{ { 48, -20 }, { 120, 30 }, { 48, 80 }, { -20, 30 } },
+		{ { 20, 5 }, { 35, 55 }, { 50, 5 }, { 5, 40 }, { 65, 40 } },
+		{ { 1, 1 }, { 2, 1 } }
+	};
+	for (const auto& polygon : polygons)
+	{
+		rasterized.addPolygon(polygon, Color(99));
+		expected.setPixels([&polygon](size_t x, size_t y) {
+			// Even-odd test of the pixel center by a horizontal ray
+			const double px = x + 0.5, py = y + 0.5;
+			bool inside = false;
+			for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+			{
+				const double xi = polygon[i].first, yi = polygon[i].second;
+				const double xj = polygon[j].first, yj = polygon[j].second;
+				if ((yi > py) != (yj > py) && px < (xj - xi) * (py - yi) / (yj - yi) + xi)
+				{
+					inside = !inside;
+				}
+			}
+			return inside;
+		}, Color(99));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	}
+
+	rasterized.addLine(2, 3, 2, 3, Color(1));
+	rasterized.addLine(-5, 10, 200, 10, Color(1));
+	rasterized.addLine(0, 20, 10, 25, Color(1));
+	rasterized.addLine(50, 60, 47, 40, Color(1));
+	expected.setPixel(2, 3, Color(1));
+	expected.setPixels([](size_t, size_t y) { return y == 10; }, Color(1));
+	for (const auto& pixel : std::vector<std::pair<int, int>>{ { 0, 20 }, { 1, 21 }, { 2, 21 }, { 3, 22 },
+		{ 4, 22 }, { 5, 23 }, { 6, 23 }, { 7, 24 }, { 8, 24 }, { 9, 25 }, { 10, 25 } })
+	{
+		expected.setPixel(pixel.first, pixel.second, Color(1));
+	}
+	for (int y = 40; y <= 60; ++y)
+	{
+		expected.setPixel(y < 44 ? 47 : (y < 51 ? 48 : (y < 57 ? 49 : 50)), y, Color(1));
+	}
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	// Lines with end points far outside are clipped, pixels inside are the same as of the whole line
+	const int intMax = std::numeric_limits<int>::max();
+	const int intMin = std::numeric_limits<int>::min();
+	rasterized.addLine(0, 0, intMax, 1, Color(1));
+	rasterized.addLine(intMin, intMin, intMax, intMax, Color(2));
+	expected.setPixels([](size_t, size_t y) { return y == 0; }, Color(1));
+	expected.setPixels([](size_t x, size_t y) { return x == y; }, Color(2));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	for (const auto& line : std::vector<std::vector<int>>{ { -300, -100, 400, 170 }, { 500, -40, -250, 90 },
+		{ 20, -700, 70, 900 }, { 150, 300, -60, -350 }, { -1000, 30, 1000, 31 } })
+	{
+		PnmExporter<> whole(2200, 1700, PnmImageType::PGM_BIN);
+		whole.addLine(line[0] + 1100, line[1] + 800, line[2] + 1100, line[3] + 800, Color(1));
+		expected.setPixels([&whole](size_t x, size_t y) { return whole.getPixel(x + 1100, y + 800).y == 1; }, Color(1));
+		rasterized.addLine(line[0], line[1], line[2], line[3], Color(1));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, sameImages());
+	}
+
+	PnmExporter<> rgb(16, 8, PnmImageType::PPM_BIN);
+	rgb.addRectangle(2, 2, 3, 1, Color(10, 20, 30));
+	rgb.addCircle(12, 4, 2, Color(40, 40, 40));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, rgb.getPixel(2, 2).r == 10 && rgb.getPixel(5, 3).g == 20 &&
+		rgb.getPixel(5, 3).b == 30 && rgb.getPixel(6, 3).r == 0 && rgb.getPixel(1, 2).b == 0);
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, rgb.getPixel(12, 4).r == 40 && rgb.getPixel(13, 5).b == 40 &&
+		rgb.getPixel(14, 4).g == 0 && rgb.getPixel(12, 2).r == 0);
+	// Parallel rendering gives the same result as the serial one
+	ThreadPool pool(3);
+	ThreadPool noWorkers(0);
+	auto mask = [](size_t x, size_t y) { return std::sin(x * 0.05) * std::cos(y * 0.07) > 0.2; };
+	for (PnmImageType type : { PnmImageType::PPM_BIN, PnmImageType::PGM_BIN, PnmImageType::PBM_BIN })
+	{
+		PnmExporter<> serial(301, 203, type);
+		PnmExporter<> parallel(301, 203, type);
+		PnmExporter<> inCaller(301, 203, type);
+		serial.setPixels(mask, Color(200, 100, 50));
+		parallel.setPixelsParallel(mask, Color(200, 100, 50), pool);
+		inCaller.setPixelsParallel(mask, Color(200, 100, 50), noWorkers);
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, serial.getPixelData() == parallel.getPixelData() &&
+			serial.getPixelData() == inCaller.getPixelData());
+		parallel.setPixelsParallel(mask, Color(1, 2, 3));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, type != PnmImageType::PPM_BIN ||
+			(parallel.getPixel(31, 0).b == 3 && parallel.getPixel(0, 0).r == 0));
+
+		auto shader = [](size_t x, size_t y) {
+			return PnmExporter<>::PixelColor(static_cast<uint8_t>(x ^ y), static_cast<uint8_t>(x), static_cast<uint8_t>(y));
+		};
+		serial.generatePixels(shader, noWorkers);
+		parallel.generatePixels(shader, pool);
+		bool generated = serial.getPixelData() == parallel.getPixelData();
+		for (size_t y = 0; y < 203; y += 50)
+		{
+			for (size_t x = 0; x < 301; x += 30)
+			{
+				const PnmExporter<>::PixelColor expectedColor = shader(x, y);
+				const PnmExporter<>::PixelColor color = parallel.getPixel(x, y);
+				generated = generated && (type == PnmImageType::PPM_BIN ?
+					color.r == expectedColor.r && color.g == expectedColor.g && color.b == expectedColor.b :
+					color.y == (type == PnmImageType::PBM_BIN && expectedColor.y > 1 ? 1 : expectedColor.y));
+			}
+		}
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, generated);
+	}
+	// ASCII data are wrapped to lines of at most 70 characters, every image row starts on a new line
+	PnmExporter<uint16_t> ascii16(97, 13, PnmImageType::PPM_ASCII);
+	ascii16.generatePixels([](size_t x, size_t y) {
+		return PnmExporter<uint16_t>::PixelColor(static_cast<uint16_t>(x * 677 + y), static_cast<uint16_t>(y * 7),
+			static_cast<uint16_t>(x % 2 == 0 ? 65535 : 0));
+	}, pool);
+	ascii16.save("testAscii.ppm");
+	ascii16.save("testAsciiParallel.ppm", &pool);
+	std::ifstream asciiFile("testAscii.ppm");
+	std::ifstream asciiParallelFile("testAsciiParallel.ppm");
+	std::string asciiText((std::istreambuf_iterator<char>(asciiFile)), std::istreambuf_iterator<char>());
+	std::string asciiParallelText((std::istreambuf_iterator<char>(asciiParallelFile)),
+		std::istreambuf_iterator<char>());
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, asciiText == asciiParallelText && asciiText.find("P3\n97 13\n65535\n") == 0);
+	std::istringstream asciiLines(asciiText);
+	std::string asciiLine;
+	size_t longestLine = 0;
+	size_t asciiLineCount = 0;
+	while (std::getline(asciiLines, asciiLine))
+	{
+		longestLine = std::max(longestLine, asciiLine.size());
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, !asciiLine.empty() && asciiLine.back() != ' ');
+		++asciiLineCount;
+	}
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, longestLine <= 70 && longestLine > 60 && asciiLineCount > 3 + 13);
+	std::istringstream asciiValues(asciiText.substr(asciiText.find("65535\n") + 6));
+	std::vector<uint16_t> parsedValues;
+	unsigned parsedValue;
+	while (asciiValues >> parsedValue)
+	{
+		parsedValues.push_back(static_cast<uint16_t>(parsedValue));
+	}
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, parsedValues == ascii16.getPixelData());
+	PnmExporter<> asciiRows(3, 4, PnmImageType::PGM_ASCII);
+	asciiRows.setPixel(2, 3, Color(255));
+	asciiRows.save("testAscii.pgm", &pool);
+	std::ifstream asciiRowsFile("testAscii.pgm");
+	std::string asciiRowsText((std::istreambuf_iterator<char>(asciiRowsFile)), std::istreambuf_iterator<char>());
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, asciiRowsText == "P2\n3 4\n255\n0 0 0\n0 0 0\n0 0 0\n0 0 255\n");
+	asciiFile.close();
+	asciiParallelFile.close();
+	asciiRowsFile.close();
+	if (remove("testAscii.ppm") != 0 || remove("testAsciiParallel.ppm") != 0 || remove("testAscii.pgm") != 0)
+	{
+		std::cout << "UNIT TESTS WARNING! Removing of files in testsPnmExporter method failed." << std::endl;
+	}
+
+	PnmExporter<> tiny(1, 1, PnmImageType::PGM_BIN);
+	tiny.setPixelsParallel([](size_t, size_t) { return true; }, Color(9), pool);
+	PnmExporter<> empty(0, 0, PnmImageType::PGM_BIN);
+	empty.setPixelsParallel([](size_t, size_t) { return true; }, Color(9), pool);
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, tiny.getPixel(0, 0).y == 9 && empty.getPixelData().empty());
+
+	PnmExporter<> binary(8, 8, PnmImageType::PBM_BIN);
+	binary.addPolygon({ { 0, 0 }, { 8, 0 }, { 0, 8 } }, Color(255));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, binary.getPixel(0, 0).y == 1 && binary.getPixel(6, 0).y == 1 &&
+		binary.getPixel(7, 0).y == 0 && binary.getPixel(7, 7).y == 0);
+
+	// Packed rows match bit-by-bit packing for widths covering the SIMD, 8-pixel and tail paths
+	bool packedCorrectly = true;
+	bool unpackedCorrectly = true;
+	for (size_t width : { 0, 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 45, 100 })
+	{
+		std::vector<uint8_t> pixels(width);
+		std::vector<uint16_t> widePixels(width);
+		for (size_t x = 0; x < width; ++x)
+		{
+			pixels[x] = static_cast<uint8_t>((x * 7 + width) % 5 < 2 ? 0 : (x % 3 == 0 ? 255 : 1 + x % 2));
+			widePixels[x] = pixels[x] * 257;
+		}
+		// Last byte guards against writes behind the packed row
+		std::vector<uint8_t> expectedBits(PbmBits::getRowBytes(width) + 1, 0);
+		expectedBits.back() = 0xAB;
+		for (size_t x = 0; x < width; ++x)
+		{
+			expectedBits[x / 8] |= static_cast<uint8_t>((pixels[x] != 0) << (7 - x % 8));
+		}
+
+		std::vector<uint8_t> bits(expectedBits.size(), 0xAB);
+		std::vector<uint8_t> wideBits(expectedBits.size(), 0xAB);
+		PbmBits::packRow(pixels.data(), width, bits.data());
+		PbmBits::packRow(widePixels.data(), width, wideBits.data());
+		packedCorrectly = packedCorrectly && bits == expectedBits && wideBits == expectedBits;
+
+		std::vector<uint8_t> unpacked(width + 1, 7);
+		std::vector<uint16_t> wideUnpacked(width, 7);
+		// Padding bits are ignored when unpacking
+		if (width % 8 != 0)
+		{
+			bits[width / 8] |= static_cast<uint8_t>(0xFF >> (width % 8));
+		}
+		PbmBits::unpackRow(bits.data(), width, unpacked.data());
+		PbmBits::unpackRow(bits.data(), width, wideUnpacked.data());
+		for (size_t x = 0; x < width; ++x)
+		{
+			unpackedCorrectly = unpackedCorrectly && unpacked[x] == (pixels[x] != 0) && wideUnpacked[x] == (pixels[x] != 0);
+		}
+		unpackedCorrectly = unpackedCorrectly && unpacked[width] == 7;
+	}
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, packedCorrectly);
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, unpackedCorrectly);
+
+	// Binary PBM rows start on a new byte and the last byte of a row is padded by zero bits
+	PnmExporter<> padded(11, 2, PnmImageType::PBM_BIN);
+	padded.setPixel(0, 0, Color(1));
+	padded.setPixel(10, 0, Color(1));
+	padded.setPixel(8, 1, Color(1));
+	padded.save("testPadded.pbm");
+	{
+		std::ifstream paddedFile("testPadded.pbm", std::ios::binary);
+		std::ostringstream content;
+		content << paddedFile.rdbuf();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, content.str() == std::string("P4\n11 2\n\x80\x20\x00\x80", 12));
+	}
+	if (std::remove("testPadded.pbm") != 0)
+	{
+		std::cout << "UNIT TESTS WARNING! Removing of files in testsPnmExporter method failed." << std::endl;
+	}
+
+	// Saved images of all types are read back unchanged
+	for (int type = 1; type <= 6; ++type)
+	{
+		PnmExporter<> original(37, 23, static_cast<PnmImageType>(type));
+		original.generatePixels([](size_t x, size_t y) {
+			return Color(static_cast<uint8_t>(x * 7 + y), static_cast<uint8_t>(y * 11), static_cast<uint8_t>(x ^ y));
+		}, pool);
+		original.save("testRead.pnm");
+
+		PnmReader reader("testRead.pnm");
+		PnmExporter<> loaded = reader.toImage();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.getImageType() == original.getImageType() &&
+			reader.getWidth() == 37 && reader.getHeight() == 23 && reader.getMaxValue() == (type % 3 == 1 ? 1 : 255));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, loaded.getImageType() == original.getImageType() &&
+			loaded.getPixelData() == original.getPixelData());
+#if defined(__unix__) || defined(__APPLE__)
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.isMapped());
+#endif
+
+		// 8-bit binary samples are viewed directly in the mapped file
+		const uint8_t* view = reader.getPixelView<uint8_t>();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, (type == 5 || type == 6) == (view != nullptr));
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, view == nullptr ||
+			std::equal(original.getPixelData().begin(), original.getPixelData().end(), view));
+	}
+
+	// 16-bit samples are stored in big-endian order, smaller maximum values are kept
+	PnmExporter<uint16_t> deep(5, 3, PnmImageType::PGM_BIN);
+	deep.setPixel(0, 0, PnmExporter<uint16_t>::PixelColor(0x1234));
+	deep.setPixel(4, 2, PnmExporter<uint16_t>::PixelColor(65535));
+	deep.save("testRead.pnm");
+	{
+		PnmReader reader("testRead.pnm");
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.getMaxValue() == 65535 &&
+			reader.getPayload()[0] == 0x12 && reader.getPayload()[1] == 0x34);
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.toImage<uint16_t>().getPixelData() == deep.getPixelData());
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.getPixelView<uint8_t>() == nullptr);
+
+		bool tooNarrow = false;
+		try
+		{
+			reader.toImage<uint8_t>();
+		}
+		catch (std::runtime_error&)
+		{
+			tooNarrow = true;
+		}
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, tooNarrow);
+	}
+	deep.setPixel(0, 0, PnmExporter<uint16_t>::PixelColor(77));
+	deep.setPixel(4, 2, PnmExporter<uint16_t>::PixelColor(1000));
+	deep.setMaxValue(1023);
+	deep.swapBtwnASCIIandBIN();
+	deep.save("testRead.pnm");
+	{
+		PnmExporter<uint16_t> loaded = PnmReader("testRead.pnm").toImage<uint16_t>();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, loaded.getMaxValue() == 1023 &&
+			loaded.getPixelData() == deep.getPixelData());
+	}
+	deep.setPixel(0, 0, PnmExporter<uint16_t>::PixelColor(200));
+	deep.setPixel(4, 2, PnmExporter<uint16_t>::PixelColor(150));
+	deep.setMaxValue(200);
+	deep.swapBtwnASCIIandBIN();
+	deep.save("testRead.pnm");
+	{
+		PnmReader reader("testRead.pnm");
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.getPayloadSize() == 15 && reader.getPayload()[0] == 200);
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.toImage<uint16_t>().getPixelData() == deep.getPixelData());
+	}
+
+	// 8-bit channel with a maximum value above 255 is saved with two-byte samples
+	PnmExporter<> wide(4, 3, PnmImageType::PPM_BIN);
+	wide.generatePixels([](size_t x, size_t y) {
+		return Color(static_cast<uint8_t>(x * 60 + y), static_cast<uint8_t>(y), 255);
+	}, pool);
+	wide.setMaxValue(1000);
+	wide.save("testRead.pnm");
+	{
+		PnmReader reader("testRead.pnm");
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, reader.getMaxValue() == 1000 && reader.getPayloadSize() == 72 &&
+			reader.getPayload()[0] == 0 && reader.getPayload()[5] == 255);
+		PnmExporter<uint16_t> loaded = reader.toImage<uint16_t>();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, loaded.getMaxValue() == 1000 &&
+			std::equal(wide.getPixelData().begin(), wide.getPixelData().end(), loaded.getPixelData().begin()));
+	}
+
+	// Files written by other programs: comments, unusual whitespace, PBM digits without separators
+	auto readWritten = [](const std::string& content, std::vector<unsigned>& values) {
+		{
+			std::ofstream file("testRead.pnm", std::ios::binary);
+			file << content;
+		}
+		PnmReader reader("testRead.pnm");
+		values.resize(reader.getValueCount());
+		reader.readPixels(values.data());
+		return reader.getWidth() * 100 + reader.getHeight();
+	};
+	std::vector<unsigned> values;
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE,
+		readWritten("P2\n# created by hand\n 3\t 2 # size\r\n\f15\n0 1 2\n  3 4\n#last\n15", values) == 302 &&
+		values == std::vector<unsigned>({ 0, 1, 2, 3, 4, 15 }));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readWritten("P1 4 2 0101\n1 0 0\n1", values) == 402 &&
+		values == std::vector<unsigned>({ 0, 1, 0, 1, 1, 0, 0, 1 }));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readWritten("P3\n1 1 65535\n65535 0 1023\n", values) == 101 &&
+		values == std::vector<unsigned>({ 65535, 0, 1023 }));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readWritten(std::string("P5#c\n2 1#c\n300\n\x01\x2C\x00\xFF", 20), values) ==
+		201 && values == std::vector<unsigned>({ 300, 255 }));
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readWritten("P4\n10 2\n\xC0\x7F\x01\x80", values) == 1002 &&
+		values == std::vector<unsigned>({ 1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0 }));
+
+	// Malformed files are rejected
+	for (const std::string& content : { std::string(""), std::string("P7\n1 1\n"), std::string("P2\n2 1\n0\n0 0"),
+		std::string("P2\n2 1\n9\n5 10"), std::string("P2\n2 1\n9\n5"), std::string("P1\n2 1\n0 2"),
+		std::string("P5\n2 2\n255\nabc"), std::string("P6 1 1 255"), std::string("P2\nx 1\n9\n1") })
+	{
+		bool rejected = false;
+		try
+		{
+			readWritten(content, values);
+		}
+		catch (std::runtime_error&)
+		{
+			rejected = true;
+		}
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, rejected);
+	}
+
+	bool missing = false;
+	try
+	{
+		PnmReader reader("testReadMissing.pnm");
+	}
+	catch (std::runtime_error&)
+	{
+		missing = true;
+	}
+	UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, missing);
+	if (std::remove("testRead.pnm") != 0)
+	{
+		std::cout << "UNIT TESTS WARNING! Removing of files in testsPnmExporter method failed." << std::endl;
+	}
+
+	// Streamed images are identical to saved ones regardless of band order and threads
+	auto readFile = [](const std::string& fileName) {
+		std::ifstream file(fileName, std::ios::binary);
+		std::ostringstream content;
+		content << file.rdbuf();
+		return content.str();
+	};
+	auto pattern = [](size_t x, size_t y) {
+		return Color(static_cast<uint8_t>(x * 5 + y), static_cast<uint8_t>(y * 3), static_cast<uint8_t>(x % 7 == 0 ? 1 : 0));
+	};
+	for (int type = 1; type <= 6; ++type)
+	{
+		PnmExporter<> original(37, 23, static_cast<PnmImageType>(type));
+		original.generatePixels(pattern, pool);
+		original.save("testStream.pnm");
+		const std::string expectedFile = readFile("testStream.pnm");
+		const std::vector<uint8_t>& data = original.getPixelData();
+		const size_t valuesPerRow = data.size() / 23;
+
+		for (ThreadPool* bandPool : { static_cast<ThreadPool*>(nullptr), &pool })
+		{
+			PnmStreamWriter<> writer("testStream.pnm", 37, 23, static_cast<PnmImageType>(type));
+			writer.writeBands([&data, valuesPerRow](size_t yStart, size_t rows, uint8_t* values) {
+				std::copy(data.begin() + yStart * valuesPerRow, data.begin() + (yStart + rows) * valuesPerRow, values);
+			}, bandPool, 4);
+			UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, writer.getWrittenRows() == 23 && writer.getValuesPerRow() == valuesPerRow);
+			writer.finish();
+			UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readFile("testStream.pnm") == expectedFile);
+		}
+
+		// Bands written from the last one to the first one
+		{
+			PnmStreamWriter<> writer("testStream.pnm", 37, 23, static_cast<PnmImageType>(type));
+			for (size_t yEnd = 23; yEnd > 0; yEnd -= std::min<size_t>(yEnd, 5))
+			{
+				const size_t yStart = yEnd - std::min<size_t>(yEnd, 5);
+				writer.writeRows(yStart, yEnd - yStart, data.data() + yStart * valuesPerRow);
+				UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, writer.getWrittenRows() == 23 - yStart);
+			}
+			writer.finish();
+			UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readFile("testStream.pnm") == expectedFile);
+		}
+	}
+
+	PnmExporter<uint16_t> deepOriginal(9, 7, PnmImageType::PPM_BIN);
+	deepOriginal.generatePixels([](size_t x, size_t y) {
+		return PnmExporter<uint16_t>::PixelColor(static_cast<uint16_t>(x * 7000 + y), static_cast<uint16_t>(y * 300), 1000);
+	}, pool);
+	for (PnmImageType type : { PnmImageType::PPM_BIN, PnmImageType::PPM_ASCII })
+	{
+		if (deepOriginal.getImageType() != type)
+		{
+			deepOriginal.swapBtwnASCIIandBIN();
+		}
+		deepOriginal.save("testStream.pnm");
+		const std::string expectedFile = readFile("testStream.pnm");
+		const std::vector<uint16_t>& data = deepOriginal.getPixelData();
+
+		PnmStreamWriter<uint16_t> writer("testStream.pnm", 9, 7, type);
+		writer.writeBands([&data](size_t yStart, size_t rows, uint16_t* values) {
+			std::copy(data.begin() + yStart * 27, data.begin() + (yStart + rows) * 27, values);
+		}, &pool, 2);
+		writer.finish();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readFile("testStream.pnm") == expectedFile);
+	}
+
+	// 8-bit channel values written as two-byte samples when the maximum value needs them
+	{
+		std::vector<uint8_t> rows = { 1, 2, 3, 250, 251, 252 };
+		PnmStreamWriter<> writer("testStream.pnm", 3, 2, PnmImageType::PGM_BIN, 1000);
+		writer.writeRows(1, 1, rows.data() + 3);
+		writer.writeRows(0, 1, rows.data());
+		writer.finish();
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readFile("testStream.pnm") ==
+			std::string("P5\n3 2\n1000\n\0\1\0\2\0\3\0\xFA\0\xFB\0\xFC", 24));
+	}
+
+	// Missing rows, rows outside of the image and repeated ASCII rows are reported
+	{
+		std::vector<uint8_t> row(10, 1);
+		PnmStreamWriter<> writer("testStream.pnm", 10, 3, PnmImageType::PGM_ASCII, 1);
+		writer.writeRows(2, 1, row.data());
+		writer.writeRows(0, 1, row.data());
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, readFile("testStream.pnm") == "P2\n10 3\n1\n1 1 1 1 1 1 1 1 1 1\n");
+
+		bool outside = false;
+		bool repeated = false;
+		bool incomplete = false;
+		try
+		{
+			writer.writeRows(2, 2, row.data());
+		}
+		catch (std::out_of_range&)
+		{
+			outside = true;
+		}
+		try
+		{
+			writer.writeRows(0, 1, row.data());
+		}
+		catch (std::runtime_error&)
+		{
+			repeated = true;
+		}
+		try
+		{
+			writer.finish();
+		}
+		catch (std::runtime_error&)
+		{
+			incomplete = true;
+		}
+		UNIT_TEST(TESTS_PNM_EXP, REQUIRE_TRUE, outside && repeated && incomplete);
+	}
+	if (std::remove("testStream.pnm") != 0)
+	{
+		std::cout << "UNIT TESTS WARNING! Removing of files in testsPnmExporter method failed." << std::endl;
+	}
+
 
 }
 
@@ -503,6 +1990,134 @@ void testsUtils()
 	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, res.size() == 2);
 	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, res[0] == "First line!");
 	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, res[1] == "Line nr. 2");
+
+	// Formatter
+	auto formatDouble = [](double value) {
+		std::string formatted;
+		Formatter::appendDouble(formatted, value);
+		return formatted;
+	};
+
+	std::string formatted;
+	Formatter::appendUnsigned(formatted, 0);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == "0");
+	formatted.clear();
+	Formatter::appendUnsigned(formatted, 18446744073709551615ull);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == "18446744073709551615");
+	formatted.clear();
+	Formatter::appendSigned(formatted, -9);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == "-9");
+	formatted.clear();
+	Formatter::appendSigned(formatted, INT64_MIN);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == "-9223372036854775808");
+	for (int64_t value : { 1, 9, 10, 99, 100, 101, 12345, 1000000, -7654321 })
+	{
+		formatted.clear();
+		Formatter::appendSigned(formatted, value);
+		UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == std::to_string(value));
+	}
+
+	bool bytesFormatted = true;
+	for (unsigned value = 0; value < 256; ++value)
+	{
+		char byteText[4];
+		bytesFormatted = bytesFormatted &&
+			std::string(byteText, Formatter::formatByte(byteText, static_cast<uint8_t>(value))) == std::to_string(value);
+	}
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, bytesFormatted);
+
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(0.1) == "0.1");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(1.5) == "1.5");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(100.0) == "100");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(-2.25) == "-2.25");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(0.0001) == "0.0001");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(1e-05) == "1e-05");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(1e20) == "1e+20");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(0.0) == "0");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(-0.0) == "-0");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(0.1 + 0.2) == "0.30000000000000004");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(1.0 / 3.0) == "0.3333333333333333");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(std::nan("")) == "nan");
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatDouble(-HUGE_VAL) == "-inf");
+	for (double value : { 3.14159, 123456.789, 2.5e-7, 6.02214076e23, 1.7976931348623157e308, 4.9e-324 })
+	{
+		UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, std::strtod(formatDouble(value).c_str(), nullptr) == value);
+	}
+
+	formatted.clear();
+	Formatter::appendValue(formatted, true);
+	Formatter::appendValue(formatted, 'x');
+	Formatter::appendValue(formatted, 2.5f);
+	Formatter::appendValue(formatted, std::string("text"));
+	Formatter::appendValue(formatted, static_cast<unsigned short>(7));
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == "1x2.5text7");
+
+	// Floats are printed with their own precision, not as the digits of the widened double
+	formatted.clear();
+	Formatter::appendValue(formatted, 0.1f);
+	formatted += ' ';
+	Formatter::appendValue(formatted, 3.14159f);
+	formatted += ' ';
+	Formatter::appendValue(formatted, -1e-5f);
+	formatted += ' ';
+	Formatter::appendValue(formatted, 1.0f / 3.0f);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, formatted == "0.1 3.14159 -1e-05 0.33333334");
+	for (float value : { 0.3f, 123456.79f, 16777216.0f, 2.5e-7f, 3.4028235e38f, 1.4e-45f })
+	{
+		formatted.clear();
+		Formatter::appendFloat(formatted, value);
+		UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, std::strtof(formatted.c_str(), nullptr) == value);
+	}
+
+	FormatBuffer<8> buffer;
+	buffer.append("x=").appendSigned(-42).append(',').appendDouble(0.5);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, buffer.toString() == "x=-42,0.5");
+	buffer.clear();
+	buffer.appendFloat(0.1f).append(',').appendFloat(3.14159f);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, buffer.toString() == "0.1,3.14159");
+	buffer.clear();
+	buffer.append("x=").appendSigned(-42).append(',').appendDouble(0.5);
+	for (size_t i = 0; i < 100; ++i)
+	{
+		buffer.appendUnsigned(i % 10);
+	}
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, buffer.size() == 109);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, buffer.toString().substr(0, 12) == "x=-42,0.5012");
+	buffer.clear();
+	buffer.append(std::string("abc"));
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, buffer.toString() == "abc");
+
+	// ThreadPool
+	ThreadPool pool(4);
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, pool.getThreadCount() == 4);
+	std::vector<std::atomic<int>> calls(1000);
+	pool.parallelFor(calls.size(), [&calls](size_t i) { calls[i].fetch_add(1); });
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, std::all_of(calls.begin(), calls.end(),
+		[](const std::atomic<int>& count) { return count.load() == 1; }));
+	std::atomic<size_t> nestedCalls(0);
+	pool.parallelFor(8, [&pool, &nestedCalls](size_t) {
+		pool.parallelFor(8, [&nestedCalls](size_t) { nestedCalls.fetch_add(1); });
+	});
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, nestedCalls.load() == 64);
+	std::atomic<size_t> finishedCalls(0);
+	bool rethrown = false;
+	try
+	{
+		pool.parallelFor(100, [&finishedCalls](size_t i) {
+			if (i % 10 == 3) { throw std::runtime_error("task failed"); }
+			finishedCalls.fetch_add(1);
+		});
+	}
+	catch (std::runtime_error& e)
+	{
+		rethrown = std::string(e.what()) == "task failed";
+	}
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, rethrown && finishedCalls.load() == 90);
+	pool.parallelFor(0, [](size_t) { throw std::runtime_error("not called"); });
+	size_t sharedCalls = 0;
+	ThreadPool::getShared().parallelFor(1, [&sharedCalls](size_t) { ++sharedCalls; });
+	UNIT_TEST(TESTS_UTILS, REQUIRE_TRUE, sharedCalls == 1 &&
+		ThreadPool::getShared().getThreadCount() + 1 >= std::thread::hardware_concurrency());
 } 
 
 int main()